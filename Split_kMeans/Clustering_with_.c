@@ -1,3 +1,6 @@
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // strtok_r, mmap and clock_gettime under -std=c11
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,8 +10,62 @@
 #include <float.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <direct.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <assert.h>
+#include <threads.h>
+#include <stdatomic.h>
+#include <signal.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+// POSIX versions of the MSVC functions used for the file handling
+#define strtok_s strtok_r
+#define strcpy_s(destination, size, source) snprintf(destination, size, "%s", source)
+#define _mkdir(path) mkdir(path, 0755)
+#endif
+#ifndef _MSC_VER
+#define _Analysis_assume_(expression)
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2_KERNELS
+#endif
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#define NORETURN __declspec(noreturn)
+#else
+#define THREAD_LOCAL _Thread_local
+#define NORETURN _Noreturn
+#endif
+#ifdef _WIN32
+#define DUMP_SIGNAL SIGBREAK // Ctrl+Break, Windows has no SIGUSR1
+#else
+#define DUMP_SIGNAL SIGUSR1
+#endif
 
 // Change logs
 // 20-01-2025: Initial release by Niko Ruohonen
@@ -37,6 +94,7 @@
  * Usage:
  * The project can be run by executing the main function, which initializes datasets, ground truth files, and clustering parameters.
  * It then runs different clustering algorithms on each dataset and writes the results to output files.
+ * The algorithms can also be used from Python through the extension module in the python directory (see python/setup.py).
  *
  * Notes:
  * - Ensure that the data files and ground truth files are placed in the appropriate directories before running the project.
@@ -54,6 +112,98 @@
 // Currently most of the LOGGING lines are commented out
 const size_t LOGGING = 1;
 
+// Deterministic execution mode
+// true = the generator is seeded from RANDOM_SEED and reseeded for every trial, so runs are repeatable
+// false = the generator is seeded from the current time
+// SSE and centroid sums are always reduced in fixed chunks combined in a fixed order,
+// so the results never depend on the number of threads
+const bool DETERMINISTIC = false;
+const unsigned int RANDOM_SEED = 20250120;
+
+// Fixed-order reductions: points per chunk, maximum number of chunks
+// and the memory limit for the per-chunk partial sums (in bytes)
+const size_t REDUCTION_CHUNK_SIZE = 4096;
+const size_t MAX_REDUCTION_CHUNKS = 64;
+const size_t REDUCTION_MEMORY_LIMIT = 64 * 1024 * 1024;
+
+// K-means stops when the relative SSE improvement of an iteration is at most this value,
+// so differences at the level of rounding noise do not keep the iterations going
+const double KMEANS_STOP_TOLERANCE = 1e-12;
+
+// Text loading: size of the chunks read or decompressed at a time (in bytes)
+// and the number of chunk buffers between the decompression thread and the parser (together they bound its memory)
+// Compressed files (gzip or zstd, detected from the content) need HAVE_ZLIB or HAVE_ZSTD at compile time
+// (python/setup.py detects the libraries, the Visual Studio project enables them with /p:WithZlib=true /p:WithZstd=true)
+const size_t STREAM_CHUNK_SIZE = 1024 * 1024;
+const size_t STREAM_QUEUE_LENGTH = 8;
+
+// Text files are read with this many STREAM_CHUNK_SIZE reads in flight,
+// using io_uring when compiled with HAVE_LIBURING (python/setup.py detects liburing on Linux), otherwise (or if io_uring is unavailable) a pool of reader threads
+const size_t READ_QUEUE_DEPTH = 4;
+const size_t READ_THREADS = 4;
+
+// Hierarchical k-means: number of nearest groups (including its own) whose centroids
+// a data point may move to during the flat refinement
+const size_t HIERARCHICAL_NEIGHBOUR_GROUPS = 3;
+
+// Approximate assignment: neighbours per centroid in the small-world graph (the graph allows twice as many),
+// beam width of the assignment searches (the graph is built with twice the degree), k-means iterations between graph rebuilds, and data points sampled for the recall report
+const size_t GRAPH_DEGREE = 12;
+const size_t GRAPH_SEARCH_WIDTH = 8;
+const size_t GRAPH_REBUILD_INTERVAL = 3;
+const size_t RECALL_SAMPLE_SIZE = 2000;
+
+// Batched k-means: bytes of data points in one block, every model processes the block while it is in the cache
+const size_t BATCH_BLOCK_BYTES = 256 * 1024;
+
+// Clustering snapshots: partitions per shared chunk, snapshots share the chunks that did not change
+const size_t SNAPSHOT_CHUNK_SIZE = 4096;
+
+// Anytime runs: the largest number of (time, SSE) points kept in the quality versus time trace
+const size_t ANYTIME_TRACE_CAPACITY = 4096;
+
+// Adaptive random swap: the acceptance and improvement rates are averaged over a window of
+// max(ADAPTIVE_SWAP_WINDOW, ADAPTIVE_WINDOW_PER_CLUSTER * K) swaps, a swap improves when it lowers the SSE by
+// at least ADAPTIVE_MIN_GAIN (relative), the swaps stop when the estimated probability of an improvement within
+// the next window falls below ADAPTIVE_STOP_PROBABILITY, and this share of the new centroid locations is sampled
+// in proportion to the error of the data points (the rest uniformly)
+const size_t ADAPTIVE_SWAP_WINDOW = 50;
+const size_t ADAPTIVE_WINDOW_PER_CLUSTER = 5;
+const double ADAPTIVE_MIN_GAIN = 1e-4;
+const double ADAPTIVE_STOP_PROBABILITY = 0.05;
+const double ADAPTIVE_BIASED_PROPOSALS = 0.5;
+
+// Phase tracing: events kept per thread, older events are overwritten when a thread records more
+const size_t TRACE_BUFFER_EVENTS = 65536;
+
+// Memory accounting: every allocation is counted in one subsystem, 0 = clustering state (centroids, partitions, caches),
+// 1 = data points, 2 = tentative splits (local data and centroids of a trial split), 3 = reduction buffers (per-chunk partial sums)
+// The cap on the total is set at run time with setMemoryCap. Only the reduction chunks and the swap candidate cache have
+// a smaller mode to fall back to, there is no streaming mode: any other allocation over the cap ends the run with an error
+#define MEMORY_SUBSYSTEMS 4
+const size_t MEMORY_CLUSTERING = 0;
+const size_t MEMORY_DATA = 1;
+const size_t MEMORY_TENTATIVE = 2;
+const size_t MEMORY_REDUCTIONS = 3;
+
+// Bytes in front of every counted allocation for its size and subsystem (keeps the alignment of malloc)
+#define ALLOCATION_HEADER_SIZE 16
+
+// Assignment autotuning: data points in the calibration sample, the fastest configurations of the sample that are timed again
+// on all data points of a larger data set, the least time each configuration is measured for (in seconds),
+// and the profile file in the output directory that keeps the chosen configuration of each machine and data shape
+const size_t AUTOTUNE_SAMPLE_SIZE = 20000;
+#define AUTOTUNE_FINALISTS 3
+const double AUTOTUNE_MIN_SECONDS = 0.02;
+const char* AUTOTUNE_PROFILE_FILE = "autotune_profile.txt";
+
+// Blocked assignment engine: bytes of centroid attributes compared with a block of data points before moving to the next centroids
+const size_t ASSIGNMENT_TILE_BYTES = 16 * 1024;
+
+// Conformance check: largest relative difference of a centroid coordinate, a distance or the SSE from the reference
+// implementation, which sums in another order, so the engines agree with it only up to rounding
+const double CONFORMANCE_TOLERANCE = 1e-9;
+
 //////////////
 // Structs //
 ////////////
@@ -70,6 +220,7 @@ typedef struct
     double* attributes;  /**< Array of attributes representing the coordinates of the data point. */
     size_t dimensions;   /**< Number of dimensions (length of the attributes array). */
 	size_t partition;    /**< Partition index indicating the cluster to which the data point belongs. */
+    double weight;       /**< Number of original data points the point stands for (1.0 for ordinary data points). */
 } DataPoint;
 
 /**
@@ -81,6 +232,9 @@ typedef struct
 {
     DataPoint* points;   /**< Array of DataPoint structures. */
     size_t size;         /**< Number of data points in the array. */
+    double* matrix;      /**< Contiguous row-major attribute storage owned by the structure, or NULL if each point owns its attributes. */
+    void* mappedView;    /**< Memory-mapped file containing the matrix, or NULL if the matrix is allocated. */
+    size_t mappedSize;   /**< Size of the mapped file in bytes. */
 } DataPoints;
 
 /**
@@ -125,2038 +279,10855 @@ typedef struct
     double successRate;  /**< Success rate of the clustering algorithm. */
 } Statistics;
 
+/**
+ * @brief Caches the nearest and second-nearest centroid of every data point.
+ *
+ * This struct contains, for each data point, the indices of its nearest and second-nearest centroids
+ * and the distances to them with the active metric, the distances calculateSSE sums. While the cache matches
+ * the current centroids, the cost of removing a centroid or the gain of adding a new one can be computed
+ * without a partition step. The data points of each cluster are listed in members, so a single cluster
+ * is evaluated in O(cluster size).
+ */
+typedef struct
+{
+    size_t* nearest;          /**< Index of the nearest centroid for each data point. */
+    size_t* secondNearest;    /**< Index of the second-nearest centroid for each data point (SIZE_MAX if there is only one centroid). */
+    double* nearestDistance;  /**< Distance from each data point to its nearest centroid. */
+    double* secondDistance;   /**< Distance from each data point to its second-nearest centroid (DBL_MAX if there is only one centroid). */
+    size_t* members;          /**< Indices of the data points grouped by their nearest centroid. */
+    size_t* memberOffsets;    /**< Start of each cluster in members, numClusters + 1 entries. */
+    double* radii;            /**< Largest distance from each centroid to a member of its cluster, numClusters entries. */
+    size_t numClusters;       /**< Number of clusters in memberOffsets and radii. */
+    size_t size;              /**< Number of data points in the cache. */
+} NearestCentroidCache;
 
-///////////////
-// Memories //
-/////////////
+/**
+ * @brief Describes the layout of a binary matrix file.
+ *
+ * This struct contains the shape and the element type of a .npy or raw binary matrix,
+ * and the offset of the first element in the file.
+ */
+typedef struct
+{
+    size_t rows;          /**< Number of data points. */
+    size_t columns;       /**< Number of dimensions. */
+    size_t elementSize;   /**< Size of an element in bytes (4 = float32, 8 = float64). */
+    bool bigEndian;       /**< True if the elements are stored in big-endian byte order. */
+    bool fortranOrder;    /**< True if the matrix is stored column by column. */
+    size_t dataOffset;    /**< Offset of the first element from the start of the file. */
+} MatrixFileLayout;
 
 /**
- * @brief Handles memory allocation errors.
+ * @brief Represents the state of an incremental text parser.
  *
- * Function checks if the given pointer is NULL, indicating a memory allocation failure.
- * If the pointer is NULL, it prints an error message to stderr and exits the program with a failure status.
+ * The parser turns chunks of whitespace-separated text into data points. A line that
+ * continues in the next chunk is kept in the pending buffer until its end arrives.
+ */
+typedef struct
+{
+    DataPoints dataPoints;    /**< Data points parsed so far. */
+    size_t allocatedSize;     /**< Allocated length of the dataPoints.points array. */
+    char* pending;            /**< Incomplete last line of the previous chunks. */
+    size_t pendingLength;     /**< Length of the incomplete line. */
+    size_t pendingCapacity;   /**< Allocated size of the pending buffer. */
+} TextParser;
+
+/**
+ * @brief Represents an asynchronous sequential reader of a file in fixed-size chunks.
  *
- * @param ptr A pointer to the allocated memory. If this pointer is NULL, the function will handle the error.
+ * Each of the READ_QUEUE_DEPTH slots has its own buffer and holds one chunk. Up to READ_QUEUE_DEPTH reads
+ * are in flight, and the chunks are delivered in file order. The slot of a delivered chunk is reused for
+ * a new read when the next chunk is requested, so the caller can work on the buffer in place until then.
  */
-void handleMemoryError(void* ptr)
+typedef struct
 {
-    if (ptr == NULL)
-    {
-        fprintf(stderr, "Error: Unable to allocate memory\n");
-        exit(EXIT_FAILURE);
-    }
-}
+#ifdef _WIN32
+    HANDLE file;              /**< Handle of the file. */
+#else
+    int file;                 /**< Descriptor of the file. */
+#endif
+    const char* filename;     /**< Name of the file, for error messages. */
+    size_t fileSize;          /**< Size of the file in bytes. */
+    size_t chunkSize;         /**< Size of a chunk in bytes. */
+    size_t depth;             /**< Number of slots. */
+    char* bufferMemory;       /**< Aligned memory of all slot buffers. */
+    size_t* offsets;          /**< File offset of the chunk in each slot. */
+    size_t* lengths;          /**< Length of the chunk in each slot. */
+    size_t* filled;           /**< Bytes read so far into each slot. */
+    bool* ready;              /**< True when the read of the slot has completed. */
+    size_t nextOffset;        /**< File offset of the next chunk to submit. */
+    size_t nextChunk;         /**< Index of the next chunk to deliver. */
+    size_t submittedChunks;   /**< Number of chunks submitted so far. */
+    bool failed;              /**< True if a read failed. */
+#ifdef HAVE_LIBURING
+    bool useUring;            /**< True if the reads go through io_uring. */
+    bool buffersRegistered;   /**< True if the slot buffers are registered with the ring. */
+    struct io_uring ring;     /**< The io_uring instance. */
+#endif
+    thrd_t* threads;          /**< Reader threads of the fallback pool. */
+    size_t numThreads;        /**< Number of reader threads. */
+    size_t* requests;         /**< Ring of slots waiting for a reader thread. */
+    size_t requestHead;       /**< Index of the oldest waiting slot. */
+    size_t requestCount;      /**< Number of waiting slots. */
+    bool closing;             /**< Tells the reader threads to exit. */
+    mtx_t lock;               /**< Protects the slot states and the request ring of the thread pool. */
+    cnd_t requestAvailable;   /**< Signaled when a slot is submitted or the reader closes. */
+    cnd_t readCompleted;      /**< Signaled when a read completes. */
+} ChunkReader;
 
 /**
- * @brief Frees the memory allocated for a single DataPoint structure.
+ * @brief Represents a navigable small-world graph over the centroids.
  *
- * This function frees the memory allocated for the attributes of the DataPoint
- * and then sets the pointer to the attributes to NULL.
+ * Every centroid is linked to nearby centroids, and the centroids inserted early also keep
+ * long-range links, so a greedy beam search reaches the nearest centroid in few steps.
+ */
+typedef struct
+{
+    size_t* neighbours;   /**< Neighbour lists, maxDegree entries per centroid. */
+    size_t* degrees;      /**< Number of neighbours of each centroid. */
+    size_t maxDegree;     /**< Maximum number of neighbours of a centroid. */
+    size_t size;          /**< Number of centroids in the graph. */
+} CentroidGraph;
+
+/**
+ * @brief Represents the working memory of one graph search.
  *
- * @param point A pointer to the DataPoint structure to be freed.
+ * The visited marks use a running stamp, so they do not have to be cleared between searches.
  */
-void freeDataPoint(DataPoint* point)
+typedef struct
 {
-    //if (point == NULL) return;
+    unsigned int* visited;      /**< Stamp of the last search that visited each centroid. */
+    unsigned int stamp;         /**< Stamp of the current search. */
+    size_t* beam;               /**< Centroids of the beam, ordered by distance. */
+    double* beamDistances;      /**< Squared distances of the beam centroids. */
+    bool* expanded;             /**< True if the neighbours of the beam entry have been visited. */
+    size_t beamSize;            /**< Number of entries in the beam. */
+    size_t evaluations;         /**< Number of distance evaluations made. */
+} GraphSearch;
 
-    if (point->attributes != NULL)
-    {
-        free(point->attributes);
-        point->attributes = NULL;
-    }
-}
+/**
+ * @brief Reports the accuracy of the approximate assignment.
+ */
+typedef struct
+{
+    double recall;                /**< Fraction of sampled data points assigned to their exact nearest centroid. */
+    double sseRatio;              /**< Sampled error with the approximate assignment divided by the error with the exact one. */
+    double evaluationsPerPoint;   /**< Average number of distance evaluations per data point in the last assignment. */
+} ApproximateSearchReport;
 
 /**
- * @brief Frees the memory allocated for an array of DataPoint structures.
- *
- * This function iterates through an array of DataPoint structures, freeing the memory
- * allocated for the attributes of each DataPoint. It then frees the memory allocated for
- * the array of DataPoint structures itself.
+ * @brief Reports the progress of the adaptive random swap when it stopped.
+ */
+typedef struct
+{
+    size_t swaps;                    /**< Number of attempted swaps. */
+    size_t acceptedSwaps;            /**< Number of swaps that lowered the SSE. */
+    double acceptanceRate;           /**< Share of accepted swaps over the last window. */
+    double improvementRate;          /**< Average relative SSE drop per swap over the last window. */
+    double improvementProbability;   /**< Estimated probability of an improvement within the next window. */
+} AdaptiveSwapReport;
+
+/**
+ * @brief Represents data points aggregated into the occupied cells of a grid.
  *
- * @param points A pointer to the array of DataPoint structures to be freed.
- * @param size The number of DataPoint structures in the array.
+ * Every occupied cell is represented by the weighted mean of its data points, and the weight of
+ * the representative is the total weight of the data points in the cell.
  */
-void freeDataPointArray(DataPoint* points, size_t size)
+typedef struct
 {
-    //if (points == NULL) return;
+    DataPoints cells;     /**< Representatives of the occupied cells, with weights. */
+    size_t* pointCells;   /**< Index of the cell of each original data point. */
+    double cellWidth;     /**< Width of the cells at the selected resolution. */
+    size_t levels;        /**< Number of times the grid was coarsened from the initial cell width. */
+} GridAggregation;
 
-    for (size_t i = 0; i < size; ++i)
-    {
-        if (points[i].attributes != NULL) //TODO: if pois lopullisesta versiosta?
-        {
-            free(points[i].attributes);
-            points[i].attributes = NULL;
-        }
-    }
-    free(points);
-}
+/**
+ * @brief Represents a chunk of partitions shared by clustering snapshots.
+ */
+typedef struct
+{
+    size_t* partitions;       /**< Partitions of the data points of the chunk. */
+    size_t referenceCount;    /**< Number of snapshots using the chunk. */
+} PartitionChunk;
 
 /**
- * @brief Frees the memory allocated for a DataPoints structure.
+ * @brief Represents a snapshot of a clustering state: the centroids, the partitions and the cached cluster statistics.
  *
- * This function frees the memory allocated for the array of DataPoint structures
- * within the DataPoints structure and then sets the pointer to the array to NULL.
+ * The partitions are stored in reference-counted chunks. A snapshot taken with a parent snapshot shares
+ * every chunk that is unchanged since the parent, so snapshots of related states cost memory only for
+ * the chunks in which they differ. Chunks are never modified after they are created.
+ */
+typedef struct
+{
+    Centroids centroids;        /**< Copy of the centroids. */
+    PartitionChunk** chunks;    /**< Chunks of the partitions, SNAPSHOT_CHUNK_SIZE data points each. */
+    size_t numChunks;           /**< Number of chunks. */
+    size_t numPoints;           /**< Number of data points. */
+    double* clusterMSEs;        /**< Cached SSE of each cluster, or NULL. */
+    double* mseDrops;           /**< Cached tentative SSE drop of each cluster, or NULL. */
+    unsigned int randomSeed;    /**< Seed that continues the random sequence of the snapshot. */
+} ClusteringSnapshot;
+
+/**
+ * @brief Represents one model of the batched k-means, which runs several models over the same data passes.
  *
- * @param dataPoints A pointer to the DataPoints structure to be freed.
- */void freeDataPoints(DataPoints* dataPoints)
+ * The partitions of the model are kept in its own array, as the partition field of the data points
+ * can hold only one of the models.
+ */
+typedef struct
 {
-    if (dataPoints == NULL) return;
-    freeDataPointArray(dataPoints->points, dataPoints->size);
-    dataPoints->points = NULL;
-}
+    Centroids centroids;   /**< Centroids of the model. */
+    size_t* partitions;    /**< Partition of each data point under the model. */
+    double bestSse;        /**< Best SSE of the assignment passes. */
+    size_t iterations;     /**< Number of iterations run. */
+    bool converged;        /**< True when the SSE stopped improving or the iteration limit was reached. */
+} BatchedModel;
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+/**
+ * @brief Represents a bounded queue of text chunks between a producer and a consumer thread.
+ *
+ * The queue owns a ring of capacity slots of STREAM_CHUNK_SIZE bytes. The producer writes into the free slots
+ * and commits them in order, the consumer parses the oldest committed slot in place and releases it.
+ * The producer blocks while every slot is in use, so the pipeline never holds more than the ring.
+ * A producer error is handed to the consumer with the end of the chunks.
+ */
+typedef struct
+{
+    char* slots;         /**< Ring of capacity chunks of STREAM_CHUNK_SIZE bytes. */
+    size_t* lengths;     /**< Length of each committed chunk. */
+    size_t capacity;     /**< Number of slots. */
+    size_t head;         /**< Index of the oldest committed chunk. */
+    size_t tail;         /**< Index of the first free slot, only changed by the producer. */
+    size_t count;        /**< Number of committed chunks. */
+    bool finished;       /**< True after the producer has committed its last chunk or failed. */
+    bool cancelled;      /**< True when the consumer stopped reading, the producer then stops too. */
+    bool failed;         /**< True if the producer failed, errorMessage holds the reason. */
+    bool outOfMemory;    /**< True if the producer failed to allocate memory. */
+    char errorMessage[512]; /**< The message of the producer error. */
+    mtx_t lock;          /**< Protects the fields above. */
+    cnd_t notEmpty;      /**< Signaled when a chunk is committed or the producer finishes. */
+    cnd_t notFull;       /**< Signaled when a chunk is released or the consumer cancels. */
+} ChunkQueue;
 
- /**
-  * @brief Frees the memory allocated for a Centroids structure.
-  *
-  * This function frees the memory allocated for the array of DataPoint structures
-  * within the Centroids structure and then sets the pointer to the array to NULL.
-  *
-  * @param centroids A pointer to the Centroids structure to be freed.
-  */
-void freeCentroids(Centroids* centroids)
+/**
+ * @brief Describes the work of the decompression thread.
+ */
+typedef struct
 {
-    if (centroids == NULL) return;
-    freeDataPointArray(centroids->points, centroids->size);
-    centroids->points = NULL;
-}
+    const char* filename;   /**< Name of the compressed file. */
+    size_t compression;     /**< Compression format (1 = gzip, 2 = zstd). */
+    ChunkQueue* queue;      /**< Queue that receives the decompressed chunks. */
+} DecompressionJob;
+#endif
 
 /**
- * @brief Frees the memory allocated for a ClusteringResult structure.
- *
- * This function frees the memory allocated for the partition array and the array of DataPoint structures
- * representing the centroids within the ClusteringResult structure. It then sets the pointers to NULL.
+ * @brief Represents the distance metric used by the clustering engine.
  *
- * @param result A pointer to the ClusteringResult structure to be freed.
- * @param numCentroids The number of centroids in the ClusteringResult structure.
+ * This struct contains the metric type and, for the diagonal Mahalanobis metric, the inverse variance
+ * of each dimension. The metric is selected once per run with setDistanceMetric.
  */
-void freeClusteringResult(ClusteringResult* result, size_t numCentroids)
+typedef struct
 {
-    if (result == NULL) return;
+    size_t type;         /**< Metric type (0 = Euclidean, 1 = cosine, 2 = Manhattan, 3 = diagonal Mahalanobis). */
+    double* weights;     /**< Inverse variance of each dimension for the diagonal Mahalanobis metric, otherwise NULL. */
+    size_t dimensions;   /**< Number of dimensions (length of the weights array). */
+} DistanceMetric;
 
-    if (result->partition != NULL)
-    {
-        free(result->partition);
-        result->partition = NULL;
-    }
+// Distance metric of the current run, used by partitionStep, centroidStep and the SSE calculations
+DistanceMetric activeMetric = { 0, NULL, 0 };
 
-    if (result->centroids != NULL)
-    {
-        freeDataPointArray(result->centroids, numCentroids);
-        result->centroids = NULL;
-    }
-}
+// Empty cluster handling after the centroid step, selected with setEmptyClusterStrategy
+// 0 = keep the centroid where it was, 1 = reseed at the farthest data point,
+// 2 = split the cluster with the largest SSE, 3 = drop the cluster (the number of clusters decreases, K-means only)
+size_t activeEmptyClusterStrategy = 1;
 
 /**
- * @brief Creates a list of strings.
- *
- * This function allocates memory for a list of strings, each with a fixed size of 256 characters.
+ * @brief Represents the configuration of the squared Euclidean assignment step.
  *
- * @param size The number of strings in the list.
- * @return A pointer to the list of strings.
- */char** createStringList(size_t size)
+ * Every configuration assigns the data points to the same centroids, only the speed differs.
+ * The configuration is chosen for the data and the machine by autotuneAssignment.
+ */
+typedef struct
 {
-    char** list = malloc(size * sizeof(char*));
-	handleMemoryError(list);
+    size_t engine;       /**< 0 = direct (each data point against all centroids), 1 = blocked (blocks of data points against tiles of a contiguous copy of the centroids). */
+    int threads;         /**< Number of threads, 0 = the maximum number of threads. */
+    size_t chunkSize;    /**< Data points in a block handed to a thread, 0 = one equal block per thread. */
+} AssignmentConfig;
 
-    const size_t stringSize = 256;
+// Assignment configuration of the current run, used by partitionStep with the Euclidean metric
+AssignmentConfig activeAssignment = { 0, 0, 0 };
 
-    for (size_t i = 0; i < size; ++i)
-    {
-        // Suppress warning about potential NULL dereference
-		// We already check for NULL pointers in handleMemoryError
-        #pragma warning(suppress : 6011)
-        list[i] = malloc(stringSize * sizeof(char));
-		handleMemoryError(list[i]);
-    }
+/**
+ * @brief Represents the amount of work done by the clustering, counted for the benchmark.
+ */
+typedef struct
+{
+    atomic_size_t iterations;            /**< Iterations of all k-means runs, including the local ones of the split algorithms. */
+} WorkCounters;
 
-    return list;
-}
+// Work done since the counters were last cleared
+WorkCounters activeWork;
 
- /**
-  * @brief Frees the memory allocated for a list of strings.
-  *
-  * This function frees the memory allocated for each string in the list and then frees the list itself.
-  *
-  * @param list A pointer to the list of strings to be freed.
-  * @param size The number of strings in the list.
-  */
- void freeStringList(char** list, size_t size)
+/**
+ * @brief Represents the wall-clock budget of an anytime run.
+ *
+ * This struct contains the deadline checked by the iterative algorithms, the quality versus time trace
+ * and a copy of the best solution. Only the SSEs of complete solutions (all numCentroids clusters on the full data)
+ * are traced, so the SSEs of local k-means runs on single clusters or samples are ignored.
+ * The flag and the deadline are atomic, as any thread may check the deadline; the trace and the best solution
+ * are updated under the lock.
+ */
+typedef struct
 {
-    for (size_t i = 0; i < size; ++i)
-    {
-        free(list[i]);
-    }
-    free(list);
-}
+    atomic_bool active;                   /**< True while an anytime run is in progress. */
+    atomic_uint_least64_t deadlineBits;   /**< Bit pattern of the monotonic time at which the algorithms stop (in seconds). */
+    double startTime;                     /**< Monotonic time of the start of the run (in seconds). */
+    const DataPoints* dataPoints;         /**< The full data of the run, SSEs of other data are not traced. */
+    size_t numCentroids;                  /**< Number of clusters of a complete solution. */
+    double bestSse;                       /**< Best traced SSE so far. */
+    Centroids bestCentroids;              /**< Centroids of the solution with bestSse, valid if bestSse < DBL_MAX. */
+    double* traceTimes;                   /**< Elapsed time of each trace point (in seconds). */
+    double* traceSses;                    /**< Best SSE at each trace point. */
+    size_t traceLength;                   /**< Number of trace points. */
+    mtx_t lock;                           /**< Protects the trace and the best solution, initialized with the trace arrays. */
+} AnytimeBudget;
+
+// Wall-clock budget of the current anytime run, checked by runKMeans, randomSwap and the split algorithms
+AnytimeBudget activeBudget;
 
- /**
- * @brief Allocates and initializes a DataPoint structure.
+/**
+ * @brief Represents the requests of the signal handlers and the partial statistics of the current runner.
  *
- * This function allocates memory for the attributes of a DataPoint structure and initializes its dimensions and partition.
+ * The handlers only set the request flags. The dump and the stop are done by the algorithms at safe points
+ * (between k-means iterations on the full data, swaps, repeats, splits and trials), where the centroids are a complete solution.
+ */
+typedef struct
+{
+    volatile sig_atomic_t stopRequested;  /**< Set by the first SIGINT, the runners stop at the next trial boundary. */
+    volatile sig_atomic_t dumpRequested;  /**< Set by DUMP_SIGNAL, served at the next safe point. */
+    const char* algorithmName;            /**< Name of the current runner, NULL if it keeps no statistics. */
+    Statistics stats;                     /**< Statistics of the completed trials of the current runner. */
+    size_t completedTrials;               /**< Number of completed trials of the current runner. */
+    size_t numCentroids;                  /**< Number of clusters of the current runner. */
+    size_t scaling;                       /**< Scaling factor of the MSE values of the current runner. */
+    size_t dumpCount;                     /**< Number of dumps so far, numbers the dump files. */
+    const char* outputDirectory;          /**< Directory of the dump files, set by installSignalHandlers. */
+    const DataPoints* dataPoints;         /**< The full data of the run, runKMeans serves the dumps only for it (not for local k-means). */
+} SignalControl;
+
+// Signal requests and partial statistics, the handlers are installed by installSignalHandlers
+SignalControl activeSignals;
+
+/**
+ * @brief Represents one progress sample published by the progress sampler.
  *
- * @param dimensions The number of dimensions for the DataPoint.
- * @return A DataPoint structure with allocated memory for its attributes.
+ * The values are read from counters that the algorithms update without locks, so a sample may combine
+ * values of consecutive iterations. The SSE, CI and number of clusters are those of the last k-means
+ * iteration on the full data.
  */
- DataPoint allocateDataPoint(size_t dimensions)
- {
-     DataPoint point;
-     point.attributes = malloc(dimensions * sizeof(double));
-     handleMemoryError(point.attributes);
-     point.dimensions = dimensions;
-     point.partition = SIZE_MAX; // Initialize partition to default value, here SIZE_MAX. Cant use -1 as its size_t
+typedef struct
+{
+    size_t iteration;         /**< Number of k-means iterations run so far (on the full data or on parts of it). */
+    double sse;               /**< SSE of the last k-means iteration on the full data, or -1 if there is none yet. */
+    size_t centroidIndex;     /**< CI of the last k-means iteration on the full data, or SIZE_MAX without ground truth. */
+    size_t clusters;          /**< Number of clusters so far (grows during the split algorithms). */
+    double elapsedSeconds;    /**< Wall-clock time since the reporting started. */
+    double pointsPerSecond;   /**< Data points processed per second since the previous sample. */
+    bool finished;            /**< True for the last sample, published when the reporting stops. */
+} ProgressSample;
 
-     return point;
- }
+/**
+ * @brief Receives the progress samples. It is called from the sampler thread, one sample at a time.
+ */
+typedef void (*ProgressCallback)(const ProgressSample* sample, void* userData);
 
- /**
- * @brief Allocates and initializes a DataPoints structure.
- *
- * This function allocates memory for an array of DataPoint structures and initializes each DataPoint.
+/**
+ * @brief Represents the progress counters and the sampler thread that publishes them.
  *
- * @param size The number of DataPoint structures in the array.
- * @param dimensions The number of dimensions for each DataPoint.
- * @return A DataPoints structure with allocated memory for its points.
+ * The algorithms only update the atomic counters (with relaxed ordering), the sampler thread reads them
+ * at a fixed interval and passes a ProgressSample to the callback.
  */
- DataPoints allocateDataPoints(size_t size, size_t dimensions)
- {
-     DataPoints dataPoints;
-     dataPoints.points = malloc(size * sizeof(DataPoint));
-     handleMemoryError(dataPoints.points);
-     dataPoints.size = size;
-     for (size_t i = 0; i < size; ++i)
-     {
-         dataPoints.points[i] = allocateDataPoint(dimensions);
-     }
+typedef struct
+{
+    atomic_bool enabled;                  /**< True while the reporting is running, tested before any other update. */
+    atomic_size_t iterations;             /**< Number of k-means iterations. */
+    atomic_size_t pointsProcessed;        /**< Number of data points assigned by the k-means iterations. */
+    atomic_size_t clusters;               /**< Number of clusters so far. */
+    atomic_size_t centroidIndex;          /**< CI of the last full-data iteration, SIZE_MAX if unknown. */
+    atomic_uint_least64_t sseBits;        /**< Bit pattern of the SSE of the last full-data iteration. */
+    atomic_size_t samplesTaken;           /**< Number of samples passed to the callback so far. */
+    atomic_size_t indexedSample;          /**< samplesTaken when the CI was last counted, the CI is counted once per sample. */
+    atomic_bool acceptedOnly;             /**< True during the k-means of a swap, whose SSE is published only if the swap is kept. */
+    const DataPoints* dataPoints;         /**< The full data, the SSE and CI of other data (local k-means) are not published. */
+    double startTime;                     /**< Monotonic time of the start of the reporting (in seconds). */
+    double interval;                      /**< Seconds between the samples. */
+    ProgressCallback callback;            /**< Receives the samples. */
+    void* userData;                       /**< Passed to the callback. */
+    thrd_t sampler;                       /**< The sampler thread. */
+    mtx_t lock;                           /**< Protects stopRequested. */
+    cnd_t stopSignal;                     /**< Signaled when the reporting stops. */
+    bool stopRequested;                   /**< True when the sampler thread should publish its last sample and exit. */
+} ProgressMonitor;
+
+// Progress counters of the current run, updated by runKMeans and the split algorithms
+ProgressMonitor activeProgress;
 
-     return dataPoints;
- }
+/**
+ * @brief Represents one traced phase: a named time span on one thread.
+ */
+typedef struct
+{
+    const char* name;   /**< Name of the phase, a string literal. */
+    double start;       /**< Monotonic start time (in seconds). */
+    double duration;    /**< Duration (in seconds). */
+} TraceEvent;
 
- /**
- * @brief Allocates and initializes a Centroids structure.
+/**
+ * @brief Represents the ring buffer of trace events of one thread.
  *
- * This function allocates memory for an array of DataPoint structures representing the centroids and initializes each DataPoint.
+ * Only its own thread writes to the buffer, so recording an event needs no lock.
+ */
+typedef struct
+{
+    TraceEvent* events;      /**< Ring of TRACE_BUFFER_EVENTS events. */
+    size_t count;            /**< Number of events recorded, the latest ones are in the ring. */
+    size_t threadIndex;      /**< Index of the thread in the trace (0 = the thread that started the tracing). */
+} TraceBuffer;
+
+/**
+ * @brief Represents the state of the phase tracing.
  *
- * @param size The number of centroids.
- * @param dimensions The number of dimensions for each centroid.
- * @return A Centroids structure with allocated memory for its points.
+ * The buffers of the threads are registered under the lock when a thread records its first event.
+ * The session number changes with every tracing, so a thread notices that its buffer belongs to an earlier one.
  */
- Centroids allocateCentroids(size_t size, size_t dimensions)
- {
-     Centroids centroids;
-     centroids.points = malloc(size * sizeof(DataPoint));
-     handleMemoryError(centroids.points);
-     centroids.size = size;
-     for (size_t i = 0; i < size; ++i)
-     {
-         centroids.points[i] = allocateDataPoint(dimensions);
-     }
+typedef struct
+{
+    bool enabled;              /**< True while tracing, changed only outside parallel regions. */
+    unsigned int session;      /**< Number of the current tracing. */
+    double startTime;          /**< Monotonic time of the start of the tracing (in seconds). */
+    TraceBuffer** buffers;     /**< The buffers of the threads that recorded events. */
+    size_t numBuffers;         /**< Number of buffers. */
+    mtx_t lock;                /**< Protects the buffer list. */
+    bool lockInitialized;      /**< True after the lock has been initialized. */
+} TraceRecorder;
+
+// Phase tracing of the current run
+TraceRecorder activeTrace;
+
+// Trace buffer of the calling thread and the tracing it belongs to
+static THREAD_LOCAL TraceBuffer* threadTraceBuffer = NULL;
+static THREAD_LOCAL unsigned int threadTraceSession = 0;
 
-     return centroids;
- }
+/**
+ * @brief Represents the allocation counters of one memory subsystem.
+ */
+typedef struct
+{
+    atomic_size_t current;   /**< Bytes allocated now. */
+    atomic_size_t peak;      /**< Largest value of current since the last reset. */
+    atomic_size_t count;     /**< Number of allocations since the last reset. */
+} MemoryCounters;
 
- /**
- * @brief Allocates and initializes a ClusteringResult structure.
- *
- * This function allocates memory for the partition array and the array of DataPoint structures representing the centroids.
+/**
+ * @brief Represents the memory accounting of the program.
  *
- * @param numDataPoints The number of data points.
- * @param numCentroids The number of centroids.
- * @param dimensions The number of dimensions for each centroid.
- * @return A ClusteringResult structure with allocated memory for its partition and centroids.
+ * The total has counters of its own, as its peak is usually lower than the sum of the peaks of the subsystems.
  */
- ClusteringResult allocateClusteringResult(size_t numDataPoints, size_t numCentroids, size_t dimensions)
- {
-     ClusteringResult result;
-     result.partition = malloc(numDataPoints * sizeof(size_t));
-     handleMemoryError(result.partition);
-     result.centroids = malloc(numCentroids * sizeof(DataPoint));
-     handleMemoryError(result.centroids);
-     for (size_t i = 0; i < numCentroids; ++i)
-     {
-         result.centroids[i] = allocateDataPoint(dimensions);
-     }
-     result.mse = DBL_MAX;
-     result.centroidIndex = SIZE_MAX;
+typedef struct
+{
+    MemoryCounters subsystems[MEMORY_SUBSYSTEMS];   /**< Counters of each subsystem. */
+    MemoryCounters total;                           /**< Counters of all subsystems together. */
+    size_t cap;                                     /**< Largest total in bytes, 0 = no cap. Changed only between runs. */
+} MemoryAccounting;
 
-     return result;
- }
+/**
+ * @brief Represents the header stored in front of every counted allocation.
+ */
+typedef struct
+{
+    size_t size;          /**< Size of the allocation in bytes, without the header. */
+    uint32_t subsystem;   /**< Subsystem the allocation is counted in. */
+    uint32_t scopeSlot;   /**< Slot of the allocation in the open allocation scope plus one, 0 = not in a scope. */
+} AllocationHeader;
 
- /**
- * @brief Initializes a Statistics structure.
- *
- * This function sets all fields of the Statistics structure to their default values.
+/**
+ * @brief Represents the allocations of one library call, freed together if the call ends in a fatal error.
  *
- * @param stats A pointer to the Statistics structure to be initialized.
+ * Only the allocations of the thread that opened the scope are recorded, the other threads free theirs inside
+ * the parallel regions. Each recorded block has a slot; a freed slot holds the index of the next free slot plus one
+ * (cast to a pointer), so recording and forgetting a block are O(1).
  */
- void initializeStatistics(Statistics* stats)
- {
-     if (stats == NULL)
-     {
-         fprintf(stderr, "Error: Null pointer passed to initializeStatistics\n");
-         exit(EXIT_FAILURE);
-     }
+typedef struct
+{
+    char** blocks;        /**< Block of each slot (the header), or the next free slot plus one for a free slot. */
+    size_t capacity;      /**< Number of slots allocated in blocks. */
+    size_t used;          /**< Number of slots handed out at least once. */
+    size_t freeSlot;      /**< First free slot plus one, 0 = none. */
+    mtx_t lock;           /**< Protects the fields above while the scope is open. */
+} AllocationScope;
 
-     stats->mseSum = 0.0;
-     stats->ciSum = 0;
-     stats->timeSum = 0.0;
-     stats->successRate = 0.0;
- }
+// Memory accounting of the program
+MemoryAccounting activeMemory;
 
+// Allocations of the library call in progress (the Python module opens a scope for each call), and whether the calling thread records into it
+AllocationScope activeScope;
+static THREAD_LOCAL bool threadInAllocationScope = false;
 
-//////////////
-// Helpers //
-////////////
+// Subsystem of the allocations of the calling thread, and the size and subsystem of its last allocation if the cap refused it (size 0 = not refused)
+static THREAD_LOCAL size_t threadMemorySubsystem = 0;
+static THREAD_LOCAL size_t threadRefusedAllocation = 0;
+static THREAD_LOCAL size_t threadRefusedSubsystem = 0;
+
+// Fatal errors jump to fatalErrorHandler when the calling thread has set one (the Python module does), otherwise the program exits.
+// The message and whether an allocation failed are kept for the handler
+static THREAD_LOCAL jmp_buf* fatalErrorHandler = NULL;
+static THREAD_LOCAL char fatalErrorMessage[512];
+static THREAD_LOCAL bool fatalErrorOutOfMemory = false;
+
+
+///////////////
+// Memories //
+/////////////
 
 /**
- * @brief Calculates the squared Euclidean distance between two data points.
- *
- * This function computes the squared Euclidean distance between two data points
- * by summing the squared differences of their corresponding attributes.
+ * @brief Gets the name of a memory subsystem.
  *
- * @param point1 A pointer to the first DataPoint structure.
- * @param point2 A pointer to the second DataPoint structure.
- * @return The squared Euclidean distance between the two data points.
+ * @param subsystem The subsystem (MEMORY_CLUSTERING, MEMORY_DATA, MEMORY_TENTATIVE or MEMORY_REDUCTIONS).
+ * @return The name of the subsystem.
  */
- double calculateSquaredEuclideanDistance(const DataPoint* point1, const DataPoint* point2)
- {
-     if (point1 == NULL || point2 == NULL)
-     {
-         fprintf(stderr, "Error: Null pointer passed to calculateSquaredEuclideanDistance\n");
-         exit(EXIT_FAILURE);
-     }
-
-     if (point1->dimensions != point2->dimensions)
-     {
-         fprintf(stderr, "Error: Data points have different dimensions in calculateSquaredEuclideanDistance\n");
-         exit(EXIT_FAILURE);
-     }
-
-    double sum = 0.0;
-    for (size_t i = 0; i < point1->dimensions; ++i)
+const char* getMemorySubsystemName(size_t subsystem)
+{
+    switch (subsystem)
     {
-        double diff = point1->attributes[i] - point2->attributes[i];
-        sum += diff * diff;
+    case 0: return "clustering";
+    case 1: return "data";
+    case 2: return "tentative splits";
+    case 3: return "reductions";
+    default: return "unknown";
     }
-    return sum;
- }
+}
 
- /**
-  * @brief Calculates the Euclidean distance between two data points.
-  *
-  * This function computes the Euclidean distance between two data points
-  * by first calculating the squared Euclidean distance and then taking the square root.
-  *
-  * @param point1 A pointer to the first DataPoint structure.
-  * @param point2 A pointer to the second DataPoint structure.
-  * @return The Euclidean distance between the two data points.
-  */
- double calculateEuclideanDistance(const DataPoint* point1, const DataPoint* point2)
- {
-	double sqrtDistance = sqrt(calculateSquaredEuclideanDistance(point1, point2));
-    return sqrtDistance;
- }
+/**
+ * @brief Sets the subsystem that the allocations of the calling thread are counted in.
+ *
+ * The previous subsystem is returned, so a function can restore it when its own allocations are done.
+ * The threads start in MEMORY_CLUSTERING.
+ *
+ * @param subsystem The subsystem of the following allocations.
+ * @return The previous subsystem.
+ */
+size_t setMemorySubsystem(size_t subsystem)
+{
+    size_t previous = threadMemorySubsystem;
+    threadMemorySubsystem = subsystem < MEMORY_SUBSYSTEMS ? subsystem : MEMORY_CLUSTERING;
+    return previous;
+}
 
-  /**
-   * @brief Handles file opening errors.
-   *
-   * This function prints an error message to stderr indicating that the specified file
-   * could not be opened and then exits the program with a failure status.
-   *
-   * @param filename The name of the file that could not be opened.
-   */
- void handleFileError(const char* filename)
- {
-    fprintf(stderr, "Error: Unable to open file '%s'\n", filename);
-    exit(EXIT_FAILURE);
- }
+/**
+ * @brief Sets the cap on the total memory of the counted allocations.
+ *
+ * An allocation that would take the total above the cap fails, and handleMemoryError reports the subsystem
+ * that asked for it. Memory allocated before the cap was set still counts towards it.
+ * The cap does not make the algorithms stream the data: only the reduction chunks (fewer chunks) and
+ * random swap (no candidate screening) fall back to a smaller mode near the cap, every other
+ * allocation over it is a fatal error.
+ *
+ * @param bytes The cap in bytes, 0 = no cap.
+ */
+void setMemoryCap(size_t bytes)
+{
+    activeMemory.cap = bytes;
+}
 
- /**
- * @brief Handles file read errors.
+/**
+ * @brief Gets the number of bytes that can still be allocated under the memory cap.
  *
- * This function prints an error message to stderr indicating that an error occurred while reading
- * from the specified file and then exits the program with a failure status.
+ * The algorithms with a faster but larger mode use this to fall back to a smaller one.
  *
- * @param filename The name of the file that could not be read.
+ * @return The bytes left under the cap, SIZE_MAX if there is no cap.
  */
- void handleFileReadError(const char* filename)
- {
-     fprintf(stderr, "Error: Unable to read from file '%s'\n", filename);
-     exit(EXIT_FAILURE);
- }
+size_t getAvailableMemory(void)
+{
+    if (activeMemory.cap == 0) return SIZE_MAX;
+
+    size_t current = atomic_load_explicit(&activeMemory.total.current, memory_order_relaxed);
+    return current < activeMemory.cap ? activeMemory.cap - current : 0;
+}
 
 /**
-* @brief Gets the number of dimensions in the data file.
-*
-* This function reads the first line of the specified file and counts the number of tokens
-* (assumed to be the number of dimensions) separated by spaces (" ", tabs "\t", newlines "\n", carriage return "\r").
-*
-* @param filename The name of the file to read.
-* @return The number of dimensions in the data file.
-*/
-size_t getNumDimensions(const char* filename)
+ * @brief Raises the peak of the counters to the given value if it is higher.
+ *
+ * @param counters A pointer to the counters.
+ * @param value The current value.
+ */
+static void raiseMemoryPeak(MemoryCounters* counters, size_t value)
 {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL)
+    size_t peak = atomic_load_explicit(&counters->peak, memory_order_relaxed);
+    while (value > peak && !atomic_compare_exchange_weak_explicit(&counters->peak, &peak, value, memory_order_relaxed, memory_order_relaxed))
     {
-        handleFileError(filename);
     }
+}
 
-    // For disabling the CS6387 warning,
-    // inform the static analyzer that 'file' is not NULL.
-    // Safe to use as we actually check for NULL earlier
-    _Analysis_assume_(file != NULL);
+/**
+ * @brief Counts the given number of bytes as allocated in a subsystem, unless the total would exceed the cap.
+ *
+ * @param bytes The number of bytes.
+ * @param subsystem The subsystem of the allocation.
+ * @return True if the bytes were counted, false if the cap refused them.
+ */
+static bool reserveMemory(size_t bytes, size_t subsystem)
+{
+    threadRefusedAllocation = 0;
 
-    //TODO: mieti, ett tarvitseeko nit buffereita yhdenmukaistaa, tss 512 muualla 256
-	char firstLine[512]; // Buffer size = 512, increase if needed
-    if (fgets(firstLine, sizeof(firstLine), file) == NULL)
+    size_t total = atomic_fetch_add_explicit(&activeMemory.total.current, bytes, memory_order_relaxed) + bytes;
+    if (activeMemory.cap > 0 && (total > activeMemory.cap || total < bytes))
     {
-        handleFileReadError(filename);
+        atomic_fetch_sub_explicit(&activeMemory.total.current, bytes, memory_order_relaxed);
+        threadRefusedAllocation = bytes;
+        threadRefusedSubsystem = subsystem;
+        return false;
     }
+    raiseMemoryPeak(&activeMemory.total, total);
 
-    size_t dimensions = 0;
-    char* context = NULL;
-	char* token = strtok_s(firstLine, " \t\r\n", &context); //Delimiter = " ", tabs "\t", newlines "\n", carriage return "\r" //TODO: Haluanko muuta kuin " "? TODO: halutaanko CONST?
-    while (token != NULL)
-    {
-        dimensions++;
-        token = strtok_s(NULL, " \t\r\n", &context); //Delimiter = " ", tabs "\t", newlines "\n", carriage return "\r" 
-    }
+    MemoryCounters* counters = &activeMemory.subsystems[subsystem];
+    size_t current = atomic_fetch_add_explicit(&counters->current, bytes, memory_order_relaxed) + bytes;
+    raiseMemoryPeak(counters, current);
 
-    fclose(file);
+    return true;
+}
 
-    return dimensions;
+/**
+ * @brief Removes the given number of bytes from the allocated memory of a subsystem.
+ *
+ * @param bytes The number of bytes.
+ * @param subsystem The subsystem of the allocation.
+ */
+static void releaseMemory(size_t bytes, size_t subsystem)
+{
+    atomic_fetch_sub_explicit(&activeMemory.total.current, bytes, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&activeMemory.subsystems[subsystem].current, bytes, memory_order_relaxed);
 }
 
 /**
- * @brief Reads data points from a file.
+ * @brief Records a block in the open allocation scope.
  *
- * This function reads data points from the specified file, where each line represents a data point
- * with attributes separated by spaces, tabs, newlines, or carriage returns. It allocates memory
- * for the data points and their attributes, and returns a DataPoints structure containing the data points.
+ * A block that cannot be recorded (the slot array cannot grow) is left out, it is then only lost on a fatal error.
  *
- * @param filename The name of the file to read.
- * @return A DataPoints structure containing the data points read from the file.
+ * @param block The block with its header.
  */
-DataPoints readDataPoints(const char* filename)
+static void recordScopedAllocation(char* block)
 {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL)
+    mtx_lock(&activeScope.lock);
+
+    size_t slot;
+    if (activeScope.freeSlot != 0)
     {
-        handleFileError(filename);
+        slot = activeScope.freeSlot - 1;
+        activeScope.freeSlot = (size_t)(uintptr_t)activeScope.blocks[slot];
     }
-
-    DataPoints dataPoints;
-    dataPoints.points = NULL;
-    dataPoints.size = 0;
-    size_t allocatedSize = 0;
-
-    char line[512]; // Buffer size = 512, increase if needed
-    while (fgets(line, sizeof(line), file))
+    else
     {
-        size_t attributeAllocatedSize = 6;
-
-        DataPoint point;
-        point.attributes = malloc(sizeof(double) * attributeAllocatedSize);
-        handleMemoryError(point.attributes);
-        point.dimensions = 0;
-        point.partition = SIZE_MAX;
-
-        char* context = NULL;
-        char* token = strtok_s(line, " \t\r\n", &context); // Delimiter = " ", tabs "\t", newlines "\n", carriage return "\r"
-        while (token != NULL)
+        if (activeScope.used == activeScope.capacity)
         {
-            if (point.dimensions == attributeAllocatedSize)
+            // Plain realloc, the bookkeeping of the scope is not part of the counted memory
+            size_t capacity = activeScope.capacity > 0 ? 2 * activeScope.capacity : 256;
+            char** blocks = realloc(activeScope.blocks, capacity * sizeof(char*));
+            if (blocks == NULL)
             {
-                attributeAllocatedSize = attributeAllocatedSize > 0 ? attributeAllocatedSize * 2 : 1;
-                double* temp = realloc(point.attributes, sizeof(double) * attributeAllocatedSize);
-                handleMemoryError(temp);
-                point.attributes = temp;
+                mtx_unlock(&activeScope.lock);
+                return;
             }
-            
-            // if(LOGGING >= 3) printf("Token: %s\n", token);
-            point.attributes[point.dimensions++] = strtod(token, NULL); // atoi(token) for int or strtod(token, NULL) for double
-            token = strtok_s(NULL, " \t\r\n", &context); // Delimiter = " ", tabs "\t", newlines "\n", carriage return "\r"
-        }
-
-        // if(LOGGING >= 3) printf("\n", token);
-
-        if (dataPoints.size == allocatedSize)
-        {
-            allocatedSize = allocatedSize > 0 ? allocatedSize * 2 : 1;
-            DataPoint* temp = realloc(dataPoints.points, sizeof(DataPoint) * allocatedSize);
-            handleMemoryError(temp);
-            dataPoints.points = temp;
+            activeScope.blocks = blocks;
+            activeScope.capacity = capacity;
         }
-
-        // Remove the suppression, if there are unknown issues while running the code.
-        // The "if(dataPoints.size == allocatedSize)" -check above should be enough
-		// to handle this warning, but the static analyzer is not able to detect it.
-        // 
-        // Suppress warning C6386 for this line
-        #pragma warning(suppress : 6386)
-        dataPoints.points[dataPoints.size++] = point;
+        slot = activeScope.used++;
     }
 
-    fclose(file);
+    activeScope.blocks[slot] = block;
+    ((AllocationHeader*)block)->scopeSlot = (uint32_t)(slot + 1);
 
-    /*if (LOGGING >= 3)
-    {
-        // for (size_t i = 0; i < dataPoints.size; ++i) // Debug helper: print all data points
-        for (size_t i = 0; i < dataPoints.size; ++i) // Debug helper: print the first two data points
-        {
-            printf("Data point %zu attributes: ", i);
-            for (size_t j = 0; j < dataPoints.points[i].dimensions; ++j)
-            {
-                printf("%.0f ", dataPoints.points[i].attributes[j]);
-            }
-            printf("\n");
-        }
-    }*/
-    
-    return dataPoints;
+    mtx_unlock(&activeScope.lock);
 }
 
-
 /**
- * @brief Reads centroids from a file.
- *
- * This function reads centroids from the specified file by first reading the data points
- * and then converting them into centroids. It allocates memory for the centroids and their attributes,
- * and returns a Centroids structure containing the centroids.
+ * @brief Removes a block from the allocation scope, or points its slot to the block's new address.
  *
- * @param filename The name of the file to read.
- * @return A Centroids structure containing the centroids read from the file.
+ * @param block The block with its header, scopeSlot set.
+ * @param moved The new address of the block after realloc, or NULL to free the slot.
  */
-Centroids readCentroids(const char* filename)
+static void updateScopedAllocation(char* block, char* moved)
 {
-    DataPoints points = readDataPoints(filename);
+    mtx_lock(&activeScope.lock);
 
-    Centroids centroids;
-    centroids.size = points.size;
-    centroids.points = points.points;
-    
-    /*if (LOGGING >= 3)
+    size_t slot = ((AllocationHeader*)block)->scopeSlot - 1;
+    if (moved != NULL)
     {
-        for (size_t i = 0; i < centroids.size; ++i)
-        {
-            printf("Centroid %zu (dimensions: %zu) attributes: ", i, points.points[i].dimensions);
-            for (size_t j = 0; j < points.points[i].dimensions; ++j)
-            {
-                printf("%.0f ", points.points[i].attributes[j]);
-            }
-            printf("\n");
-        }
-    }*/
+        activeScope.blocks[slot] = moved;
+    }
+    else
+    {
+        activeScope.blocks[slot] = (char*)(uintptr_t)activeScope.freeSlot;
+        activeScope.freeSlot = slot + 1;
+        ((AllocationHeader*)block)->scopeSlot = 0;
+    }
 
-    return centroids;
+    mtx_unlock(&activeScope.lock);
 }
 
 /**
- * @brief Writes centroids to a file.
- *
- * This function writes the centroids to the specified file. Each centroid's attributes
- * are written on a new line, with attributes separated by spaces.
+ * @brief Counts a new allocation and stores its header.
  *
- * @param filename The name of the file to write the centroids to.
- * @param centroids A pointer to the Centroids structure containing the centroids to be written.
+ * @param block The block returned by malloc or calloc, or NULL.
+ * @param size The size of the allocation without the header.
+ * @param subsystem The subsystem the size was reserved in.
+ * @return A pointer to the memory after the header, or NULL if the block is NULL.
  */
-void writeCentroidsToFile(const char* filename, const Centroids* centroids)
+static void* finishAllocation(char* block, size_t size, size_t subsystem)
 {
-    FILE* centroidFile = fopen(filename, "w");
-    if (centroidFile == NULL)
-    {
-        handleFileError(filename);
-        return;
-    }
-
-    for (size_t i = 0; i < centroids->size; ++i) // Loop through each centroid
+    if (block == NULL)
     {
-        for (size_t j = 0; j < centroids->points[i].dimensions; ++j) // Loop through each dimension of a centroid
-        {
-            fprintf(centroidFile, "%f ", centroids->points[i].attributes[j]);
-        }
-        fprintf(centroidFile, "\n"); // New line after each centroid's attributes
+        releaseMemory(size, subsystem);
+        return NULL;
     }
 
-    fclose(centroidFile);
+    atomic_fetch_add_explicit(&activeMemory.subsystems[subsystem].count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&activeMemory.total.count, 1, memory_order_relaxed);
 
-    //if (LOGGING >= 3) printf("Centroids written to file: %s\n", filename);
+    AllocationHeader* header = (AllocationHeader*)block;
+    header->size = size;
+    header->subsystem = (uint32_t)subsystem;
+    header->scopeSlot = 0;
+    if (threadInAllocationScope) recordScopedAllocation(block);
+    return block + ALLOCATION_HEADER_SIZE;
 }
 
 /**
- * @brief Writes data point partitions to a file.
+ * @brief Allocates memory like malloc and counts it in the subsystem of the calling thread.
  *
- * This function writes the partition indices of data points to the specified file.
- * Each partition index is written on a new line.
+ * Memory from trackedMalloc, trackedCalloc and trackedRealloc must be released with trackedFree.
  *
- * @param filename The name of the file to write the partitions to.
- * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param size The number of bytes to allocate.
+ * @return A pointer to the memory, or NULL if the allocation failed or the memory cap refused it.
  */
-void writeDataPointPartitionsToFile(const char* filename, const DataPoints* dataPoints)
+void* trackedMalloc(size_t size)
 {
-    FILE* file = fopen(filename, "w");
-    if (file == NULL)
-    {
-        handleFileError(filename);
-        return;
-    }
+    size_t subsystem = threadMemorySubsystem;
+    if (size > SIZE_MAX - ALLOCATION_HEADER_SIZE || !reserveMemory(size, subsystem)) return NULL;
 
-    for (size_t i = 0; i < dataPoints->size; ++i)
-    {
-        fprintf(file, "%zu\n", dataPoints->points[i].partition);
-    }
-
-    fclose(file);
-
-    //if (LOGGING >= 3) printf("Data point partitions written to file: %s\n", filename);
+    return finishAllocation(malloc(ALLOCATION_HEADER_SIZE + size), size, subsystem);
 }
 
 /**
- * @brief Creates a deep copy of a data point.
- *
- * This function copies the attributes and dimensions of the source data point
- * to the destination data point. It allocates memory for the attributes of the
- * destination data point and copies the attribute values from the source.
+ * @brief Allocates zeroed memory like calloc and counts it in the subsystem of the calling thread.
  *
- * @param destination A pointer to the destination DataPoint structure.
- * @param source A pointer to the source DataPoint structure.
+ * @param count The number of elements.
+ * @param size The size of an element in bytes.
+ * @return A pointer to the memory, or NULL if the allocation failed or the memory cap refused it.
  */
-void deepCopyDataPoint(DataPoint* destination, const DataPoint* source)
+void* trackedCalloc(size_t count, size_t size)
 {
-    //Debugging
-    /*if (destination == NULL || source == NULL)
-    {
-        fprintf(stderr, "Error: Null pointer passed to deepCopyDataPoint\n");
-        exit(EXIT_FAILURE);
-    }*/
+    if (size > 0 && count > (SIZE_MAX - ALLOCATION_HEADER_SIZE) / size) return NULL;
 
-    destination->dimensions = source->dimensions;
-    destination->partition = source->partition;
-    
-    if (destination->attributes != NULL)
-    {
-        free(destination->attributes);
-    }
+    size_t bytes = count * size;
+    size_t subsystem = threadMemorySubsystem;
+    if (!reserveMemory(bytes, subsystem)) return NULL;
 
-    destination->attributes = malloc(source->dimensions * sizeof(double));
-    handleMemoryError(destination->attributes);
-    
-    // Suppress warning C6387 for this line
-	// The static analyzer is not able to detect that 'destination->attributes' is not NULL
-    #pragma warning(suppress : 6387)
-    memcpy(destination->attributes, source->attributes, source->dimensions * sizeof(double));
+    // One zeroed block, so large allocations still get their zero pages from the system
+    return finishAllocation(calloc(1, ALLOCATION_HEADER_SIZE + bytes), bytes, subsystem);
 }
 
 /**
- * @brief Creates deep copies of an array of data points.
- *
- * This function copies the attributes and dimensions of each source data point
- * to the corresponding destination data point. It allocates memory for the attributes
- * of each destination data point and copies the attribute values from the source.
+ * @brief Resizes memory like realloc. The memory stays in the subsystem it was allocated in.
  *
- * @param destination A pointer to the array of destination DataPoint structures.
- * @param source A pointer to the array of source DataPoint structures.
- * @param size The number of data points in the source and destination arrays.
+ * @param ptr A pointer to memory from the tracked functions, or NULL.
+ * @param size The new size in bytes.
+ * @return A pointer to the resized memory, or NULL if the resizing failed (the old memory is left as it was).
  */
-void deepCopyDataPoints(DataPoint* destination, const DataPoint* source, size_t size)
+void* trackedRealloc(void* ptr, size_t size)
 {
-    if (destination == NULL || source == NULL)
-    {
-        fprintf(stderr, "Error: Null pointer passed to deepCopyDataPoints\n");
-        exit(EXIT_FAILURE);
-    }
+    if (ptr == NULL) return trackedMalloc(size);
+    if (size > SIZE_MAX - ALLOCATION_HEADER_SIZE) return NULL;
 
-    for (size_t i = 0; i < size; ++i)
+    char* block = (char*)ptr - ALLOCATION_HEADER_SIZE;
+    AllocationHeader* header = (AllocationHeader*)block;
+    size_t oldSize = header->size;
+    size_t subsystem = header->subsystem;
+
+    if (size > oldSize && !reserveMemory(size - oldSize, subsystem)) return NULL;
+
+    // The slot is updated under the lock of the scope, so the scope never holds a freed address it could free again
+    bool scoped = header->scopeSlot != 0;
+    if (scoped) mtx_lock(&activeScope.lock);
+    char* resized = realloc(block, ALLOCATION_HEADER_SIZE + size);
+    if (scoped && resized != NULL) activeScope.blocks[((AllocationHeader*)resized)->scopeSlot - 1] = resized;
+    if (scoped) mtx_unlock(&activeScope.lock);
+
+    if (resized == NULL)
     {
-        deepCopyDataPoint(&destination[i], &source[i]);
+        if (size > oldSize) releaseMemory(size - oldSize, subsystem);
+        return NULL;
     }
+    if (size < oldSize) releaseMemory(oldSize - size, subsystem);
+
+    ((AllocationHeader*)resized)->size = size;
+    return resized + ALLOCATION_HEADER_SIZE;
 }
 
 /**
- * @brief Creates a deep copy of a Centroids structure.
- *
- * This function copies the centroids from the source Centroids structure
- * to the destination Centroids structure. It allocates memory for the centroids
- * in the destination structure and copies the attribute values from the source.
+ * @brief Frees memory from trackedMalloc, trackedCalloc or trackedRealloc.
  *
- * @param source A pointer to the source Centroids structure.
- * @param destination A pointer to the destination Centroids structure.
- * @param numCentroids The number of centroids to copy.
+ * @param ptr A pointer to the memory, or NULL.
  */
-void deepCopyCentroids(const Centroids* source, Centroids* destination, size_t numCentroids)
+void trackedFree(void* ptr)
 {
-    destination->size = source->size;
-
-    if (destination->points != NULL)
-    {
-        freeDataPointArray(destination->points, destination->size);
-    }
+    if (ptr == NULL) return;
 
-	destination->points = allocateDataPoints(numCentroids, source->points[0].dimensions).points;
+    char* block = (char*)ptr - ALLOCATION_HEADER_SIZE;
+    AllocationHeader* header = (AllocationHeader*)block;
+    if (header->scopeSlot != 0) updateScopedAllocation(block, NULL);
+    releaseMemory(header->size, header->subsystem);
+    free(block);
+}
 
-    for (size_t i = 0; i < numCentroids; ++i)
-    {
-        deepCopyDataPoint(&destination->points[i], &source->points[i]);
-    }
+/**
+ * @brief Opens an allocation scope: the counted allocations of the calling thread are recorded until endAllocationScope.
+ *
+ * Meant for a library call that catches fatal errors with fatalErrorHandler, so that the allocations of an interrupted
+ * call can be freed. Only one scope is open at a time.
+ */
+void beginAllocationScope(void)
+{
+    mtx_init(&activeScope.lock, mtx_plain);
+    activeScope.blocks = NULL;
+    activeScope.capacity = 0;
+    activeScope.used = 0;
+    activeScope.freeSlot = 0;
+    threadInAllocationScope = true;
 }
 
 /**
- * @brief Prints all information about the centroids.
+ * @brief Closes the allocation scope of the calling thread.
  *
- * This function prints the number of centroids and the attributes of each centroid.
- * Each centroid's attributes are printed on a new line, with attributes separated by spaces.
+ * After a fatal error the recorded allocations that are still in use are freed. Memory that must outlive the call
+ * (the reduction workspace, the weights of the distance metric) must be released or replaced before this call.
+ * Otherwise the allocations are kept and only forgotten by the scope.
  *
- * @param centroids A pointer to the Centroids structure containing the centroids to be printed.
+ * @param freeAllocations True to free the allocations still in use, false to keep them.
+ * @return The number of allocations freed.
  */
-void printCentroidsInfo(const Centroids* centroids)
+size_t endAllocationScope(bool freeAllocations)
 {
-    printf("Number of centroids: %zu\n", centroids->size);
+    size_t freed = 0;
+    threadInAllocationScope = false;
 
-    for (size_t i = 0; i < centroids->size; ++i)
+    // Free slots hold small indices, the blocks are the addresses above them
+    for (size_t slot = 0; slot < activeScope.used; ++slot)
     {
-        DataPoint* centroid = &centroids->points[i];
+        char* block = activeScope.blocks[slot];
+        if ((uintptr_t)block <= activeScope.used) continue;
 
-        printf("Centroid %zu (dimensions: %zu) attributes: ", i, centroid->dimensions);
-
-        for (size_t j = 0; j < centroid->dimensions; ++j)
+        AllocationHeader* header = (AllocationHeader*)block;
+        header->scopeSlot = 0;
+        if (freeAllocations)
         {
-            printf("%f ", centroid->attributes[j]);
+            releaseMemory(header->size, header->subsystem);
+            free(block);
+            freed++;
         }
-        printf("\n");
     }
-    printf("\n");
+
+    free(activeScope.blocks);
+    activeScope.blocks = NULL;
+    activeScope.capacity = 0;
+    activeScope.used = 0;
+    activeScope.freeSlot = 0;
+    mtx_destroy(&activeScope.lock);
+
+    return freed;
 }
 
 /**
- * @brief Prints partition assignments for data points with partition >= cMax.
- *
- * This function prints the partition assignments for data points whose partition index
- * is greater than or equal to the specified cMax value. It prints the data point index
- * and its partition index.
+ * @brief Starts a new measurement of the peak memory and the allocation counts.
  *
- * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param cMax The partition index threshold.
+ * The peaks start from the memory allocated now, so memory kept from earlier runs (the data points) is included.
  */
-void printDataPointsPartitions(const DataPoints* dataPoints, size_t cMax)
+void resetMemoryPeaks(void)
 {
-    printf("Data Points Partition Assignments (Partition <= %zu):\n", cMax);
-    printf("Data Points size: %zu\n", dataPoints->size);
-    for (size_t i = 0; i < dataPoints->size; ++i)
+    for (size_t s = 0; s < MEMORY_SUBSYSTEMS; ++s)
     {
-        if (dataPoints->points[i].partition >= cMax)
-        {
-            printf("Data Point %zu: Partition %zu\n", i, dataPoints->points[i].partition);
-        }
+        MemoryCounters* counters = &activeMemory.subsystems[s];
+        atomic_store(&counters->peak, atomic_load(&counters->current));
+        atomic_store(&counters->count, 0);
     }
-    printf("\n");
+    atomic_store(&activeMemory.total.peak, atomic_load(&activeMemory.total.current));
+    atomic_store(&activeMemory.total.count, 0);
 }
 
 /**
- * @brief Resets all partitions to 0.
+ * @brief Adds the current measurement of one set of counters to a saved one.
  *
- * This function iterates through all data points in the DataPoints structure
- * and sets their partition index to 0.
+ * @param saved A pointer to the saved MemoryCounters structure.
+ * @param counters A pointer to the MemoryCounters structure being measured.
+ */
+static void mergeMemoryCounters(MemoryCounters* saved, const MemoryCounters* counters)
+{
+    size_t peak = atomic_load(&counters->peak);
+    if (peak > atomic_load(&saved->peak)) atomic_store(&saved->peak, peak);
+    atomic_fetch_add(&saved->count, atomic_load(&counters->count));
+}
+
+/**
+ * @brief Adds the current measurement of the peak memory and the allocation counts to a saved measurement.
  *
- * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * The saved peaks become the larger of the two and the counts are summed, so algorithms whose trials alternate
+ * can each keep a measurement of their own, made between resetMemoryPeaks and this call.
+ *
+ * @param saved A pointer to the MemoryAccounting structure of the saved measurement, zeroed before the first call.
  */
-void resetPartitions(DataPoints* dataPoints)
-{    
-    for (size_t i = 0; i < dataPoints->size; ++i)
+void saveMemoryPeaks(MemoryAccounting* saved)
+{
+    for (size_t s = 0; s < MEMORY_SUBSYSTEMS; ++s)
     {
-        dataPoints->points[i].partition = 0;
+        mergeMemoryCounters(&saved->subsystems[s], &activeMemory.subsystems[s]);
     }
+    mergeMemoryCounters(&saved->total, &activeMemory.total);
 }
 
 /**
- * @brief Writes clustering results to a file.
+ * @brief Makes a saved measurement the current one, so that writeMemoryUsage reports it.
  *
- * This function writes the clustering results, including average CI, MSE, relative CI,
- * average time taken, and success rate, to the specified file. The results are appended
- * to the file if it already exists.
- *
- * @param filename The name of the file to write the results to.
- * @param ciSum The sum of Centroid Index (CI) values.
- * @param mseSum The sum of Mean Squared Error (MSE) values.
- * @param timeSum The sum of time taken for each loop.
- * @param successRate The success rate of the clustering algorithm.
- * @param numCentroids The number of centroids used in the clustering algorithm.
- * @param header A header string to be written at the beginning of the results.
- * @param loopCount The number of loops performed.
- * @param scaling A scaling factor for the MSE values.
- * @param outputDirectory The directory where the results file is located.
+ * @param saved A pointer to the MemoryAccounting structure filled by saveMemoryPeaks.
  */
-void writeResultsToFile(const char* filename, Statistics stats, size_t numCentroids, const char* header, size_t loopCount, size_t scaling, const char* outputDirectory)
+void loadMemoryPeaks(const MemoryAccounting* saved)
 {
-    char outputFilePath[256];
-    snprintf(outputFilePath, sizeof(outputFilePath), "%s/%s", outputDirectory, filename);
-
-    FILE* file = fopen(outputFilePath, "a"); // "a" = appends
-    if (file == NULL)
+    for (size_t s = 0; s < MEMORY_SUBSYSTEMS; ++s)
     {
-        fprintf(stderr, "Error: Cannot open file %s for writing\n", filename);
-        return;
+        atomic_store(&activeMemory.subsystems[s].peak, atomic_load(&saved->subsystems[s].peak));
+        atomic_store(&activeMemory.subsystems[s].count, atomic_load(&saved->subsystems[s].count));
     }
+    atomic_store(&activeMemory.total.peak, atomic_load(&saved->total.peak));
+    atomic_store(&activeMemory.total.count, atomic_load(&saved->total.count));
+}
 
-    fprintf(file, "%s\n", header);
-    fprintf(file, "Average CI: %.2f and MSE: %.2f\n", (double)stats.ciSum / loopCount, stats.mseSum / loopCount / scaling);
-    fprintf(file, "Relative CI: %.2f\n", (double)stats.ciSum / loopCount / numCentroids);
-    fprintf(file, "Average time taken: %.2f seconds\n", stats.timeSum / loopCount);
-    fprintf(file, "Success rate: %.2f%%\n\n", stats.successRate / loopCount * 100);
+/**
+ * @brief Continues an unrecoverable error that was caught to clean up, or handed over from another thread.
+ *
+ * The message has already been printed and is in fatalErrorMessage. Like raiseFatalError, the function jumps
+ * to fatalErrorHandler if the calling thread has set one and is not inside a parallel region, otherwise the program exits.
+ */
+NORETURN void resumeFatalError(void)
+{
+    bool inParallel = false;
+#ifdef _OPENMP
+    inParallel = omp_in_parallel() != 0;
+#endif
+    if (fatalErrorHandler != NULL && !inParallel)
+    {
+        longjmp(*fatalErrorHandler, 1);
+    }
 
-    fclose(file);
-    
-    //if(LOGGING >= 3) printf("Metrics written to file: %s\n", filename);
+    exit(EXIT_FAILURE);
 }
 
 /**
- * @brief Creates a unique directory based on the current date and time.
+ * @brief Reports an unrecoverable error.
  *
- * This function generates a unique directory name based on the current date and time
- * and attempts to create the directory. The directory name is stored in the provided
- * outputDirectory buffer.
+ * This function prints the message to stderr and keeps it in fatalErrorMessage. If the calling thread has set
+ * fatalErrorHandler and is not inside a parallel region, the function jumps there; the allocations of the
+ * interrupted run are only freed if the caller opened an allocation scope. Otherwise the program exits with a failure status.
  *
- * @param outputDirectory A buffer to store the generated directory name.
- * @param size The size of the outputDirectory buffer.
+ * @param format The printf format of the message, printed after "Error: ".
  */
-void createUniqueDirectory(char* outputDirectory, size_t size)
+NORETURN void raiseFatalError(const char* format, ...)
 {
-    time_t now = time(NULL);
-    struct tm* t = localtime(&now);
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(fatalErrorMessage, sizeof(fatalErrorMessage), format, arguments);
+    va_end(arguments);
 
-    if (strftime(outputDirectory, size, "outputs/%Y-%m-%d_%H-%M-%S", t) == 0)
-    {
-        fprintf(stderr, "Error: Buffer size is too small in createUniqueDirectory\n");
-        return; //TODO: Exit_failure mieluummin nihin?
-    }
+    fprintf(stderr, "Error: %s\n", fatalErrorMessage);
 
-    if (_mkdir(outputDirectory) != 0)
-    {
-        perror("Error: Unable to create directory");
-    }
+    resumeFatalError();
 }
 
 /**
- * @brief Gets the name of the split type based on the provided split type index.
+ * @brief Handles memory allocation errors.
  *
- * This function returns the name of the split type corresponding to the provided split type index.
- * If the split type index is invalid, it prints an error message to stderr and returns NULL.
+ * Function checks if the given pointer is NULL, indicating a memory allocation failure.
+ * If the pointer is NULL, it reports the error with raiseFatalError, which exits the program unless the caller handles it.
+ * If the memory cap refused the allocation, the message names the subsystem that asked for the memory.
  *
- * @param splitType The index of the split type.
- * @return The name of the split type, or NULL if the split type index is invalid.
+ * @param ptr A pointer to the allocated memory. If this pointer is NULL, the function will handle the error.
  */
-const char* getSplitTypeName(size_t splitType)
+void handleMemoryError(void* ptr)
 {
-    switch (splitType)
+    if (ptr == NULL)
     {
-    case 0:
-        return "Intra-cluster";
-    case 1:
-        return "Global";
-    case 2:
-        return "Local repartition";
-    default:
-        fprintf(stderr, "Error: Invalid split type provided\n");
-        return NULL;
+        fatalErrorOutOfMemory = true;
+        if (threadRefusedAllocation > 0)
+        {
+            raiseFatalError("Allocating %zu bytes for the %s would exceed the memory cap of %zu bytes (%zu bytes in use). "
+                "This allocation has no lower-memory mode, raise the memory cap or remove it",
+                threadRefusedAllocation, getMemorySubsystemName(threadRefusedSubsystem), activeMemory.cap,
+                atomic_load_explicit(&activeMemory.total.current, memory_order_relaxed));
+        }
+        raiseFatalError("Unable to allocate memory");
     }
 }
 
 /**
- * @brief Prints the statistics of a clustering algorithm.
- *
- * This function prints the average Centroid Index (CI), Mean Squared Error (MSE),
- * relative CI, average time taken, and success rate of a clustering algorithm.
+ * @brief Releases a file mapping created by mapFile.
  *
- * @param algorithmName The name of the clustering algorithm.
- * @param stats A Statistics structure containing the results to be printed.
- * @param loopCount The number of loops performed.
- * @param numCentroids The number of centroids used in the clustering algorithm.
- * @param scaling A scaling factor for the MSE values.
+ * @param view A pointer to the start of the mapping.
+ * @param size The size of the mapping in bytes.
  */
-void printStatistics(const char* algorithmName, Statistics stats, size_t loopCount, size_t numCentroids, size_t scaling)
+void unmapFile(void* view, size_t size)
 {
-    printf("(%s) Average CI: %.2f and MSE: %.2f\n", algorithmName, (double)stats.ciSum / loopCount, stats.mseSum / loopCount / scaling);
-    printf("(%s) Relative CI: %.2f\n", algorithmName, (double)stats.ciSum / loopCount / numCentroids);
-    printf("(%s) Average time taken: %.2f seconds\n", algorithmName, stats.timeSum / loopCount);
-    printf("(%s) Success rate: %.2f%%\n\n", algorithmName, stats.successRate / loopCount * 100);
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(view);
+#else
+    munmap(view, size);
+#endif
 }
 
-
-/////////////////
-// Clustering //
-///////////////
-
 /**
- * @brief Generates random centroids from the data points.
+ * @brief Frees the memory allocated for a single DataPoint structure.
  *
- * This function selects random data points to be used as initial centroids for clustering.
+ * This function frees the memory allocated for the attributes of the DataPoint
+ * and then sets the pointer to the attributes to NULL.
  *
- * @param numCentroids The number of centroids to generate.
- * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure to store the generated centroids.
+ * @param point A pointer to the DataPoint structure to be freed.
  */
-void generateRandomCentroids(size_t numCentroids, const DataPoints* dataPoints, Centroids* centroids)
-{    
-    //DEBUGGING
-    /*if (dataPoints->size < numCentroids)
-    {
-        fprintf(stderr, "Error: There are less data points than the required number of clusters\n");
-        exit(EXIT_FAILURE);
-    }*/
-
-    size_t* indices = malloc(sizeof(size_t) * dataPoints->size);
-    handleMemoryError(indices);
+void freeDataPoint(DataPoint* point)
+{
+    //if (point == NULL) return;
 
-    for (size_t i = 0; i < dataPoints->size; ++i)
+    if (point->attributes != NULL)
     {
-        indices[i] = i;
+        trackedFree(point->attributes);
+        point->attributes = NULL;
     }
-
-    for (size_t i = 0; i < numCentroids; ++i)
-    {
-        size_t j = i + rand() % (dataPoints->size - i);
-        size_t temp = indices[i];
-        indices[i] = indices[j];
-        indices[j] = temp;
-    }
-
-    for (size_t i = 0; i < numCentroids; ++i)
-    {
-        size_t selectedIndex = indices[i];
-        deepCopyDataPoint(&centroids->points[i], &dataPoints->points[selectedIndex]);
-    }
-
-    free(indices);
-}
+}
 
 /**
- * @brief Calculates the sum of squared errors (SSE) for the given data points and centroids.
+ * @brief Frees the memory allocated for an array of DataPoint structures.
  *
- * This function computes the SSE by summing the squared Euclidean distances between each data point
- * and its assigned centroid.
+ * This function iterates through an array of DataPoint structures, freeing the memory
+ * allocated for the attributes of each DataPoint. It then frees the memory allocated for
+ * the array of DataPoint structures itself.
  *
- * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure containing the centroids.
- * @return The sum of squared errors (SSE).
+ * @param points A pointer to the array of DataPoint structures to be freed.
+ * @param size The number of DataPoint structures in the array.
  */
-double calculateSSE(const DataPoints* dataPoints, const Centroids* centroids)
+void freeDataPointArray(DataPoint* points, size_t size)
 {
-    double sse = 0.0;
+    //if (points == NULL) return;
 
-    for (size_t i = 0; i < dataPoints->size; ++i)
+    for (size_t i = 0; i < size; ++i)
     {
-        size_t cIndex = dataPoints->points[i].partition;
-
-        //Debugging
-        /*if (cIndex >= centroids->size)
+        if (points[i].attributes != NULL) //TODO: if pois lopullisesta versiosta?
         {
-            fprintf(stderr, "Error: Invalid partition index %zu for data point %zu\n", cIndex, i);
-            exit(EXIT_FAILURE);
-        }*/
-
-        sse += calculateEuclideanDistance(&dataPoints->points[i], &centroids->points[cIndex]);
+            trackedFree(points[i].attributes);
+            points[i].attributes = NULL;
+        }
     }
-
-    return sse;
+    trackedFree(points);
 }
 
 /**
- * @brief Calculates the mean squared error (MSE) for the given data points and centroids.
+ * @brief Frees the memory allocated for a DataPoints structure.
  *
- * This function computes the MSE by dividing the sum of squared errors (SSE) by the total number
- * of data points and dimensions.
+ * This function frees the memory allocated for the array of DataPoint structures
+ * within the DataPoints structure and then sets the pointer to the array to NULL.
  *
- * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure containing the centroids.
- * @return The mean squared error (MSE).
- */
-double calculateMSE(const DataPoints* dataPoints, const Centroids* centroids)
+ * @param dataPoints A pointer to the DataPoints structure to be freed.
+ */void freeDataPoints(DataPoints* dataPoints)
 {
-    double sse = calculateSSE(dataPoints, centroids);
-
-    double mse = sse / (dataPoints->size * dataPoints->points[0].dimensions);
+    if (dataPoints == NULL) return;
 
-    return mse;
+    if (dataPoints->matrix == NULL)
+    {
+        freeDataPointArray(dataPoints->points, dataPoints->size);
+    }
+    else
+    {
+        // The attributes are rows of the shared matrix
+        trackedFree(dataPoints->points);
+        if (dataPoints->mappedView != NULL)
+        {
+            unmapFile(dataPoints->mappedView, dataPoints->mappedSize);
+        }
+        else
+        {
+            trackedFree(dataPoints->matrix);
+        }
+        dataPoints->matrix = NULL;
+        dataPoints->mappedView = NULL;
+    }
+    dataPoints->points = NULL;
 }
 
 /**
- * @brief Calculates the mean squared error (MSE) for the given data points and centroids.
+ * @brief Frees a DataPoints structure created by wrapDataPointMatrix.
  *
- * This function computes the MSE by dividing the sum of squared errors (SSE) by the total number
- * of data points and dimensions.
+ * This function frees only the array of DataPoint structures. The attributes belong
+ * to the caller's matrix and are left untouched.
  *
- * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure containing the centroids.
- * @param size The size of the whole data set.
- * @return The mean squared error (MSE).
+ * @param dataPoints A pointer to the DataPoints structure to be freed.
  */
-double calculateMSEWithSize(const DataPoints* dataPoints, const Centroids* centroids, size_t size)
+void freeDataPointViews(DataPoints* dataPoints)
 {
-    double sse = calculateSSE(dataPoints, centroids);
-
-    double mse = sse / (size * dataPoints->points[0].dimensions);
+    if (dataPoints == NULL) return;
+    trackedFree(dataPoints->points);
+    dataPoints->points = NULL;
+}
 
-    return mse;
+ /**
+  * @brief Frees the memory allocated for a Centroids structure.
+  *
+  * This function frees the memory allocated for the array of DataPoint structures
+  * within the Centroids structure and then sets the pointer to the array to NULL.
+  *
+  * @param centroids A pointer to the Centroids structure to be freed.
+  */
+void freeCentroids(Centroids* centroids)
+{
+    if (centroids == NULL) return;
+    freeDataPointArray(centroids->points, centroids->size);
+    centroids->points = NULL;
 }
 
-//TODO: ky description lpi, ett vastaa sit mit lasketaan (count vai size)
 /**
- * @brief Calculates the mean squared error (MSE) for a specific cluster.
+ * @brief Frees the memory allocated for a ClusteringResult structure.
  *
- * This function computes the MSE for a specific cluster by summing the Euclidean distances
- * between data points and their assigned centroid, and then dividing by the number of data points
- * in the cluster and the number of dimensions.
+ * This function frees the memory allocated for the partition array and the array of DataPoint structures
+ * representing the centroids within the ClusteringResult structure. It then sets the pointers to NULL.
  *
- * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure containing the centroids.
- * @param clusterLabel The label of the cluster for which to calculate the MSE.
- * @return The mean squared error (MSE) for the specified cluster.
+ * @param result A pointer to the ClusteringResult structure to be freed.
+ * @param numCentroids The number of centroids in the ClusteringResult structure.
  */
-double calculateClusterMSE(const DataPoints* dataPoints, const Centroids* centroids, size_t clusterLabel)
+void freeClusteringResult(ClusteringResult* result, size_t numCentroids)
 {
-    double sse = 0.0;
-    size_t count = 0;
-    size_t dimensions = dataPoints->points[0].dimensions;
+    if (result == NULL) return;
 
-    for (size_t i = 0; i < dataPoints->size; ++i)
+    if (result->partition != NULL)
     {
-        if (dataPoints->points[i].partition == clusterLabel)
-        {
-            sse += calculateEuclideanDistance(&dataPoints->points[i], &centroids->points[clusterLabel]);
-            count++;
-        }
+        trackedFree(result->partition);
+        result->partition = NULL;
     }
 
-    //Debugger
-    /*if (count == 0)
+    if (result->centroids != NULL)
     {
-        return 0.0;
-    }*/
-
-	//TODO: count vai dataPoints->size? Eli datapisteiden mr clusterissa vai koko datasetiss?
-    double mse = sse;// (dataPoints->size * dimensions);
-    return mse;
+        freeDataPointArray(result->centroids, numCentroids);
+        result->centroids = NULL;
+    }
 }
 
 /**
- * @brief Finds the nearest centroid to a given data point.
+ * @brief Creates a list of strings.
  *
- * This function calculates the squared Euclidean distance between the query point and each centroid,
- * and returns the index of the nearest centroid.
+ * This function allocates memory for a list of strings, each with a fixed size of 256 characters.
  *
- * @param queryPoint A pointer to the DataPoint structure representing the query point.
- * @param targetCentroids A pointer to the Centroids structure containing the centroids.
- * @return The index of the nearest centroid.
- */
-size_t findNearestCentroid(const DataPoint* queryPoint, const Centroids* targetCentroids)
+ * @param size The number of strings in the list.
+ * @return A pointer to the list of strings.
+ */char** createStringList(size_t size)
 {
-    // Debugging    
-    /*if (targetPoints->size == 0)
-    {
-        fprintf(stderr, "Error: Cannot find nearest centroid in an empty set of data\n");
-        exit(EXIT_FAILURE);
-    }*/
+    char** list = trackedMalloc(size * sizeof(char*));
+	handleMemoryError(list);
 
-    size_t nearestCentroidId = SIZE_MAX;
-    double minDistance = DBL_MAX;
-	double newDistance = DBL_MAX;
+    const size_t stringSize = 256;
 
-    for (size_t i = 0; i < targetCentroids->size; ++i)
+    for (size_t i = 0; i < size; ++i)
     {
-        newDistance = calculateSquaredEuclideanDistance(queryPoint, &targetCentroids->points[i]);
-		
-        if (newDistance < minDistance)
-        {
-            minDistance = newDistance;
-            nearestCentroidId = i;
-        }
+        // Suppress warning about potential NULL dereference
+		// We already check for NULL pointers in handleMemoryError
+        #pragma warning(suppress : 6011)
+        list[i] = trackedMalloc(stringSize * sizeof(char));
+		handleMemoryError(list[i]);
     }
 
-    return nearestCentroidId;
+    return list;
 }
 
-/**
- * @brief Assigns each data point to the nearest centroid.
- *
- * This function iterates through all data points and assigns each one to the nearest centroid
- * based on the squared Euclidean distance.
- *
- * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure containing the centroids.
- */
-void partitionStep(DataPoints* dataPoints, const Centroids* centroids)
+ /**
+  * @brief Frees the memory allocated for a list of strings.
+  *
+  * This function frees the memory allocated for each string in the list and then frees the list itself.
+  *
+  * @param list A pointer to the list of strings to be freed.
+  * @param size The number of strings in the list.
+  */
+ void freeStringList(char** list, size_t size)
 {
-    //DEBUGGING    
-    /*if (dataPoints->size == 0 || centroids->size == 0)
-    {
-        fprintf(stderr, "Error: Cannot perform optimal partition with empty data or centroids\n");
-        exit(EXIT_FAILURE);
-    }*/
-
-	size_t nearestCentroidId = SIZE_MAX;
-
-    for (size_t i = 0; i < dataPoints->size; ++i)
+    for (size_t i = 0; i < size; ++i)
     {
-        nearestCentroidId = findNearestCentroid(&dataPoints->points[i], centroids);
-        dataPoints->points[i].partition = nearestCentroidId;
+        trackedFree(list[i]);
     }
+    trackedFree(list);
 }
 
-/**
- * @brief Performs the centroid step in the k-means algorithm.
+ /**
+ * @brief Allocates and initializes a DataPoint structure.
  *
- * This function updates the centroids by calculating the mean of the data points assigned to each centroid.
+ * This function allocates memory for the attributes of a DataPoint structure and initializes its dimensions and partition.
  *
- * @param centroids A pointer to the Centroids structure containing the centroids to be updated.
- * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param dimensions The number of dimensions for the DataPoint.
+ * @return A DataPoint structure with allocated memory for its attributes.
  */
-void centroidStep(Centroids* centroids, const DataPoints* dataPoints)
-{
-    size_t numClusters = centroids->size;
-    size_t dimensions = dataPoints->points[0].dimensions;
-
-    // Temporary storage for sums and counts
-    double** sums = malloc(sizeof(double*) * numClusters);
-    size_t* counts = calloc(numClusters, sizeof(size_t));
-    handleMemoryError(sums);
-    handleMemoryError(counts);
-
-    // Initialize sums and counts for each centroid
-    for (size_t clusterLabel = 0; clusterLabel < numClusters; ++clusterLabel)
-    {
-        sums[clusterLabel] = calloc(dimensions, sizeof(double));
-        handleMemoryError(sums[clusterLabel]);
-    }
-
-    // Accumulate sums and counts for each cluster
-    for (size_t i = 0; i < dataPoints->size; ++i)
-    {
-        DataPoint* point = &dataPoints->points[i];
-        size_t clusterLabel = point->partition; 
-
-        for (size_t dim = 0; dim < dimensions; ++dim)
-        {
-            sums[clusterLabel][dim] += point->attributes[dim];
-        }
-        counts[clusterLabel]++;
-    }
-
-    // Update the centroids
-    for (size_t clusterLabel = 0; clusterLabel < numClusters; ++clusterLabel)
-    {
-        if (counts[clusterLabel] > 0)
-        {
-            for (size_t dim = 0; dim < dimensions; ++dim)
-            {
-                centroids->points[clusterLabel].attributes[dim] = sums[clusterLabel][dim] / counts[clusterLabel];
-            }
-        }
-        /*else
-        {
-            if(LOGGING >= 3) fprintf(stderr, "Warning: Cluster %zu has no points assigned.\n", clusterLabel);
-        }*/
-
-        free(sums[clusterLabel]);
-    }
+ DataPoint allocateDataPoint(size_t dimensions)
+ {
+     DataPoint point;
+     point.attributes = trackedMalloc(dimensions * sizeof(double));
+     handleMemoryError(point.attributes);
+     point.dimensions = dimensions;
+     point.partition = SIZE_MAX; // Initialize partition to default value, here SIZE_MAX. Cant use -1 as its size_t
+     point.weight = 1.0;
 
-    free(sums);
-    free(counts);
-}
+     return point;
+ }
 
-/**
- * @brief Counts the number of centroids in centroids2 that do not have any centroids in centroids1 assigned to them.
+ /**
+ * @brief Allocates and initializes a DataPoints structure.
  *
- * This function iterates through all centroids in centroids1 and finds the nearest centroid in centroids2.
- * It then counts the number of centroids in centroids2 that do not have any centroids in centroids1 assigned to them.
+ * This function allocates memory for an array of DataPoint structures and initializes each DataPoint.
  *
- * @param centroids1 A pointer to the first Centroids structure.
- * @param centroids2 A pointer to the second Centroids structure.
- * @return The number of centroids in centroids2 that do not have any centroids in centroids1 assigned to them.
+ * @param size The number of DataPoint structures in the array.
+ * @param dimensions The number of dimensions for each DataPoint.
+ * @return A DataPoints structure with allocated memory for its points.
  */
-size_t countOrphans(const Centroids* centroids1, const Centroids* centroids2)
+ DataPoints allocateDataPoints(size_t size, size_t dimensions)
+ {
+     DataPoints dataPoints;
+     dataPoints.points = trackedMalloc(size * sizeof(DataPoint));
+     handleMemoryError(dataPoints.points);
+     dataPoints.size = size;
+     dataPoints.matrix = NULL;
+     dataPoints.mappedView = NULL;
+     dataPoints.mappedSize = 0;
+     for (size_t i = 0; i < size; ++i)
+     {
+         dataPoints.points[i] = allocateDataPoint(dimensions);
+     }
+
+     return dataPoints;
+ }
+
+ /**
+ * @brief Wraps a row-major matrix as a DataPoints structure without copying it.
+ *
+ * This function allocates only the DataPoint structures. The attributes of each data point
+ * point to its row in the matrix, so the matrix must outlive the DataPoints structure,
+ * which is freed with freeDataPointViews. The clustering algorithms only write the partitions,
+ * so the matrix is not modified.
+ *
+ * @param matrix The row-major matrix of size * dimensions values.
+ * @param size The number of data points (rows).
+ * @param dimensions The number of dimensions (columns).
+ * @return A DataPoints structure whose points refer to the rows of the matrix.
+ */
+ DataPoints wrapDataPointMatrix(double* matrix, size_t size, size_t dimensions)
+ {
+     DataPoints dataPoints;
+     dataPoints.points = trackedMalloc(size * sizeof(DataPoint));
+     handleMemoryError(dataPoints.points);
+     dataPoints.size = size;
+     dataPoints.matrix = NULL; // Owned by the caller
+     dataPoints.mappedView = NULL;
+     dataPoints.mappedSize = 0;
+     for (size_t i = 0; i < size; ++i)
+     {
+         dataPoints.points[i].attributes = &matrix[i * dimensions];
+         dataPoints.points[i].dimensions = dimensions;
+         dataPoints.points[i].partition = SIZE_MAX;
+         dataPoints.points[i].weight = 1.0;
+     }
+
+     return dataPoints;
+ }
+
+ /**
+ * @brief Allocates and initializes a Centroids structure.
+ *
+ * This function allocates memory for an array of DataPoint structures representing the centroids and initializes each DataPoint.
+ *
+ * @param size The number of centroids.
+ * @param dimensions The number of dimensions for each centroid.
+ * @return A Centroids structure with allocated memory for its points.
+ */
+ Centroids allocateCentroids(size_t size, size_t dimensions)
+ {
+     Centroids centroids;
+     centroids.points = trackedMalloc(size * sizeof(DataPoint));
+     handleMemoryError(centroids.points);
+     centroids.size = size;
+     for (size_t i = 0; i < size; ++i)
+     {
+         centroids.points[i] = allocateDataPoint(dimensions);
+     }
+
+     return centroids;
+ }
+
+ /**
+ * @brief Allocates and initializes a ClusteringResult structure.
+ *
+ * This function allocates memory for the partition array and the array of DataPoint structures representing the centroids.
+ *
+ * @param numDataPoints The number of data points.
+ * @param numCentroids The number of centroids.
+ * @param dimensions The number of dimensions for each centroid.
+ * @return A ClusteringResult structure with allocated memory for its partition and centroids.
+ */
+ ClusteringResult allocateClusteringResult(size_t numDataPoints, size_t numCentroids, size_t dimensions)
+ {
+     ClusteringResult result;
+     result.partition = trackedMalloc(numDataPoints * sizeof(size_t));
+     handleMemoryError(result.partition);
+     result.centroids = trackedMalloc(numCentroids * sizeof(DataPoint));
+     handleMemoryError(result.centroids);
+     for (size_t i = 0; i < numCentroids; ++i)
+     {
+         result.centroids[i] = allocateDataPoint(dimensions);
+     }
+     result.mse = DBL_MAX;
+     result.centroidIndex = SIZE_MAX;
+
+     return result;
+ }
+
+ /**
+ * @brief Initializes a Statistics structure.
+ *
+ * This function sets all fields of the Statistics structure to their default values.
+ *
+ * @param stats A pointer to the Statistics structure to be initialized.
+ */
+ void initializeStatistics(Statistics* stats)
+ {
+     if (stats == NULL)
+     {
+         raiseFatalError("Null pointer passed to initializeStatistics");
+     }
+
+     stats->mseSum = 0.0;
+     stats->ciSum = 0;
+     stats->timeSum = 0.0;
+     stats->successRate = 0.0;
+
+     // The peak memory reported with the statistics is measured from here
+     resetMemoryPeaks();
+ }
+
+ /**
+ * @brief Allocates a NearestCentroidCache structure.
+ *
+ * This function allocates memory for the nearest and second-nearest centroid indices and distances
+ * of the given number of data points. The contents are filled by partitionStepWithSecondNearest.
+ *
+ * @param numDataPoints The number of data points.
+ * @return A NearestCentroidCache structure with allocated memory for its arrays.
+ */
+ NearestCentroidCache allocateNearestCentroidCache(size_t numDataPoints)
+ {
+     NearestCentroidCache cache;
+     cache.nearest = trackedMalloc(numDataPoints * sizeof(size_t));
+     handleMemoryError(cache.nearest);
+     cache.secondNearest = trackedMalloc(numDataPoints * sizeof(size_t));
+     handleMemoryError(cache.secondNearest);
+     cache.nearestDistance = trackedMalloc(numDataPoints * sizeof(double));
+     handleMemoryError(cache.nearestDistance);
+     cache.secondDistance = trackedMalloc(numDataPoints * sizeof(double));
+     handleMemoryError(cache.secondDistance);
+     cache.members = trackedMalloc(numDataPoints * sizeof(size_t));
+     handleMemoryError(cache.members);
+     cache.memberOffsets = NULL;
+     cache.radii = NULL;
+     cache.numClusters = 0;
+     cache.size = numDataPoints;
+
+     return cache;
+ }
+
+/**
+ * @brief Frees the memory allocated for a NearestCentroidCache structure.
+ *
+ * This function frees the index and distance arrays of the cache and sets the pointers to NULL.
+ *
+ * @param cache A pointer to the NearestCentroidCache structure to be freed.
+ */
+void freeNearestCentroidCache(NearestCentroidCache* cache)
+{
+    if (cache == NULL) return;
+
+    trackedFree(cache->nearest);
+    trackedFree(cache->secondNearest);
+    trackedFree(cache->nearestDistance);
+    trackedFree(cache->secondDistance);
+    trackedFree(cache->members);
+    trackedFree(cache->memberOffsets);
+    trackedFree(cache->radii);
+    cache->nearest = NULL;
+    cache->secondNearest = NULL;
+    cache->nearestDistance = NULL;
+    cache->secondDistance = NULL;
+    cache->members = NULL;
+    cache->memberOffsets = NULL;
+    cache->radii = NULL;
+    cache->numClusters = 0;
+    cache->size = 0;
+}
+
+
+//////////////
+// Helpers //
+////////////
+
+/**
+ * @brief Calculates the squared Euclidean distance between two data points.
+ *
+ * This function computes the squared Euclidean distance between two data points
+ * by summing the squared differences of their corresponding attributes.
+ *
+ * @param point1 A pointer to the first DataPoint structure.
+ * @param point2 A pointer to the second DataPoint structure.
+ * @return The squared Euclidean distance between the two data points.
+ */
+ double calculateSquaredEuclideanDistance(const DataPoint* point1, const DataPoint* point2)
+ {
+     if (point1 == NULL || point2 == NULL)
+     {
+         raiseFatalError("Null pointer passed to calculateSquaredEuclideanDistance");
+     }
+
+     if (point1->dimensions != point2->dimensions)
+     {
+         raiseFatalError("Data points have different dimensions in calculateSquaredEuclideanDistance");
+     }
+
+    double sum = 0.0;
+    for (size_t i = 0; i < point1->dimensions; ++i)
+    {
+        double diff = point1->attributes[i] - point2->attributes[i];
+        sum += diff * diff;
+    }
+    return sum;
+ }
+
+ /**
+  * @brief Calculates the Euclidean distance between two data points.
+  *
+  * This function computes the Euclidean distance between two data points
+  * by first calculating the squared Euclidean distance and then taking the square root.
+  *
+  * @param point1 A pointer to the first DataPoint structure.
+  * @param point2 A pointer to the second DataPoint structure.
+  * @return The Euclidean distance between the two data points.
+  */
+ double calculateEuclideanDistance(const DataPoint* point1, const DataPoint* point2)
+ {
+	double sqrtDistance = sqrt(calculateSquaredEuclideanDistance(point1, point2));
+    return sqrtDistance;
+ }
+
+/**
+ * @brief Calculates the squared Euclidean distance between two attribute arrays.
+ *
+ * This is the unchecked kernel used by the clustering engine. It processes two dimensions
+ * per SSE2 instruction when available, and the remaining dimension with scalar code.
+ *
+ * @param a The attributes of the first point.
+ * @param b The attributes of the second point.
+ * @param dimensions The number of dimensions.
+ * @return The squared Euclidean distance.
+ */
+static inline double squaredEuclideanKernel(const double* a, const double* b, size_t dimensions)
+{
+    size_t dim = 0;
+    double sum = 0.0;
+
+#ifdef USE_SSE2_KERNELS
+    __m128d accumulator = _mm_setzero_pd();
+    for (; dim + 2 <= dimensions; dim += 2)
+    {
+        __m128d diff = _mm_sub_pd(_mm_loadu_pd(&a[dim]), _mm_loadu_pd(&b[dim]));
+        accumulator = _mm_add_pd(accumulator, _mm_mul_pd(diff, diff));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, accumulator);
+    sum = lanes[0] + lanes[1];
+#endif
+
+    for (; dim < dimensions; ++dim)
+    {
+        double diff = a[dim] - b[dim];
+        sum += diff * diff;
+    }
+
+    return sum;
+}
+
+/**
+ * @brief Calculates the Manhattan (L1) distance between two attribute arrays.
+ *
+ * @param a The attributes of the first point.
+ * @param b The attributes of the second point.
+ * @param dimensions The number of dimensions.
+ * @return The Manhattan distance.
+ */
+static inline double manhattanKernel(const double* a, const double* b, size_t dimensions)
+{
+    size_t dim = 0;
+    double sum = 0.0;
+
+#ifdef USE_SSE2_KERNELS
+    const __m128d signMask = _mm_set1_pd(-0.0);
+    __m128d accumulator = _mm_setzero_pd();
+    for (; dim + 2 <= dimensions; dim += 2)
+    {
+        __m128d diff = _mm_sub_pd(_mm_loadu_pd(&a[dim]), _mm_loadu_pd(&b[dim]));
+        accumulator = _mm_add_pd(accumulator, _mm_andnot_pd(signMask, diff));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, accumulator);
+    sum = lanes[0] + lanes[1];
+#endif
+
+    for (; dim < dimensions; ++dim)
+    {
+        sum += fabs(a[dim] - b[dim]);
+    }
+
+    return sum;
+}
+
+/**
+ * @brief Calculates the weighted squared Euclidean distance between two attribute arrays.
+ *
+ * With inverse variances as weights this is the squared diagonal Mahalanobis distance.
+ *
+ * @param a The attributes of the first point.
+ * @param b The attributes of the second point.
+ * @param weights The weight of each dimension.
+ * @param dimensions The number of dimensions.
+ * @return The weighted squared Euclidean distance.
+ */
+static inline double weightedSquaredKernel(const double* a, const double* b, const double* weights, size_t dimensions)
+{
+    size_t dim = 0;
+    double sum = 0.0;
+
+#ifdef USE_SSE2_KERNELS
+    __m128d accumulator = _mm_setzero_pd();
+    for (; dim + 2 <= dimensions; dim += 2)
+    {
+        __m128d diff = _mm_sub_pd(_mm_loadu_pd(&a[dim]), _mm_loadu_pd(&b[dim]));
+        accumulator = _mm_add_pd(accumulator, _mm_mul_pd(_mm_loadu_pd(&weights[dim]), _mm_mul_pd(diff, diff)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, accumulator);
+    sum = lanes[0] + lanes[1];
+#endif
+
+    for (; dim < dimensions; ++dim)
+    {
+        double diff = a[dim] - b[dim];
+        sum += weights[dim] * diff * diff;
+    }
+
+    return sum;
+}
+
+/**
+ * @brief Calculates the dot product of two attribute arrays.
+ *
+ * @param a The attributes of the first point.
+ * @param b The attributes of the second point.
+ * @param dimensions The number of dimensions.
+ * @return The dot product.
+ */
+static inline double dotProductKernel(const double* a, const double* b, size_t dimensions)
+{
+    size_t dim = 0;
+    double sum = 0.0;
+
+#ifdef USE_SSE2_KERNELS
+    __m128d accumulator = _mm_setzero_pd();
+    for (; dim + 2 <= dimensions; dim += 2)
+    {
+        accumulator = _mm_add_pd(accumulator, _mm_mul_pd(_mm_loadu_pd(&a[dim]), _mm_loadu_pd(&b[dim])));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, accumulator);
+    sum = lanes[0] + lanes[1];
+#endif
+
+    for (; dim < dimensions; ++dim)
+    {
+        sum += a[dim] * b[dim];
+    }
+
+    return sum;
+}
+
+/**
+ * @brief Calculates the distance between a data point and a centroid with the active metric.
+ *
+ * This function returns the distance that the SSE calculations sum up: the Euclidean distance,
+ * the cosine distance (1 - cosine similarity, for unit-length vectors), the Manhattan distance,
+ * or the diagonal Mahalanobis distance. The metric is switched on per call, so it is only meant
+ * for loops that evaluate one distance per data point; the assignment loops are specialized per metric.
+ *
+ * @param point1 A pointer to the DataPoint structure of the data point.
+ * @param point2 A pointer to the DataPoint structure of the centroid.
+ * @return The distance between the two points.
+ */
+static inline double calculateMetricDistance(const DataPoint* point1, const DataPoint* point2)
+{
+    switch (activeMetric.type)
+    {
+    case 1:
+        return 1.0 - dotProductKernel(point1->attributes, point2->attributes, point1->dimensions);
+    case 2:
+        return manhattanKernel(point1->attributes, point2->attributes, point1->dimensions);
+    case 3:
+        return sqrt(weightedSquaredKernel(point1->attributes, point2->attributes, activeMetric.weights, point1->dimensions));
+    default:
+        return sqrt(squaredEuclideanKernel(point1->attributes, point2->attributes, point1->dimensions));
+    }
+}
+
+/**
+ * @brief Calculates the distance used to find the nearest centroid under the active metric.
+ *
+ * The value orders the centroids like calculateMetricDistance, but skips the square root where it has one.
+ *
+ * @param a The attributes of the data point.
+ * @param b The attributes of the centroid.
+ * @param dimensions The number of dimensions.
+ * @return The assignment distance.
+ */
+static inline double calculateAssignmentDistance(const double* a, const double* b, size_t dimensions)
+{
+    switch (activeMetric.type)
+    {
+    case 1:
+        return 1.0 - dotProductKernel(a, b, dimensions);
+    case 2:
+        return manhattanKernel(a, b, dimensions);
+    case 3:
+        return weightedSquaredKernel(a, b, activeMetric.weights, dimensions);
+    default:
+        return squaredEuclideanKernel(a, b, dimensions);
+    }
+}
+
+/**
+ * @brief Converts an assignment distance of the active metric to the distance calculateMetricDistance returns.
+ *
+ * Meant for the results of a search, after a loop that compared the cheaper assignment distances.
+ *
+ * @param distance The assignment distance.
+ * @return The distance of the active metric.
+ */
+static inline double assignmentToMetricDistance(double distance)
+{
+    return activeMetric.type == 0 || activeMetric.type == 3 ? sqrt(distance) : distance;
+}
+
+/**
+ * @brief Gets the name of the distance metric based on the provided metric index.
+ *
+ * @param metricType The index of the distance metric.
+ * @return The name of the distance metric, or NULL if the index is invalid.
+ */
+const char* getDistanceMetricName(size_t metricType)
+{
+    switch (metricType)
+    {
+    case 0:
+        return "Euclidean";
+    case 1:
+        return "Cosine";
+    case 2:
+        return "Manhattan";
+    case 3:
+        return "Diagonal Mahalanobis";
+    default:
+        fprintf(stderr, "Error: Invalid distance metric provided\n");
+        return NULL;
+    }
+}
+
+/**
+ * @brief Scales every data point to unit length.
+ *
+ * The cosine metric expects unit-length vectors. Points with zero length are left unchanged.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ */
+void normalizeDataPoints(DataPoints* dataPoints)
+{
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        DataPoint* point = &dataPoints->points[i];
+        double norm = sqrt(dotProductKernel(point->attributes, point->attributes, point->dimensions));
+
+        if (norm > 0.0)
+        {
+            for (size_t dim = 0; dim < point->dimensions; ++dim)
+            {
+                point->attributes[dim] /= norm;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Selects the distance metric for the following clustering runs.
+ *
+ * This function sets the active metric. For the diagonal Mahalanobis metric it calculates
+ * the inverse variance of each dimension from the data points; dimensions with zero variance get weight 1.
+ * The cosine metric expects the data points to be normalized with normalizeDataPoints.
+ *
+ * @param metricType The metric type (0 = Euclidean, 1 = cosine, 2 = Manhattan, 3 = diagonal Mahalanobis).
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ */
+void setDistanceMetric(size_t metricType, const DataPoints* dataPoints)
+{
+    trackedFree(activeMetric.weights);
+    activeMetric.weights = NULL;
+    activeMetric.dimensions = 0;
+    activeMetric.type = metricType;
+
+    if (metricType != 3) return;
+
+    size_t dimensions = dataPoints->points[0].dimensions;
+    double* means = trackedCalloc(dimensions, sizeof(double));
+    activeMetric.weights = trackedCalloc(dimensions, sizeof(double));
+    handleMemoryError(means);
+    handleMemoryError(activeMetric.weights);
+    activeMetric.dimensions = dimensions;
+
+    // Welford's algorithm, weights hold the sums of squared deviations until the end
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        for (size_t dim = 0; dim < dimensions; ++dim)
+        {
+            double value = dataPoints->points[i].attributes[dim];
+            double delta = value - means[dim];
+            means[dim] += delta / (double)(i + 1);
+            activeMetric.weights[dim] += delta * (value - means[dim]);
+        }
+    }
+
+    for (size_t dim = 0; dim < dimensions; ++dim)
+    {
+        double variance = activeMetric.weights[dim] / (double)dataPoints->size;
+        activeMetric.weights[dim] = variance > 0.0 ? 1.0 / variance : 1.0;
+    }
+
+    trackedFree(means);
+}
+
+/**
+ * @brief Gets the number of chunks used in a fixed-order reduction.
+ *
+ * This function splits the given number of items into chunks of at least REDUCTION_CHUNK_SIZE items,
+ * limited by MAX_REDUCTION_CHUNKS and by the memory needed for the partial results of all chunks.
+ * The count depends only on the sizes (and under a memory cap on the memory left), never on the number
+ * of threads, so the order of the floating-point additions is always the same.
+ *
+ * @param numItems The number of items to reduce.
+ * @param stateSize The number of doubles in the partial result of a single chunk.
+ * @return The number of chunks (at least 1).
+ */
+size_t getReductionChunkCount(size_t numItems, size_t stateSize)
+{
+    size_t numChunks = (numItems + REDUCTION_CHUNK_SIZE - 1) / REDUCTION_CHUNK_SIZE;
+
+    if (numChunks > MAX_REDUCTION_CHUNKS)
+    {
+        numChunks = MAX_REDUCTION_CHUNKS;
+    }
+
+    // Under a memory cap the partial sums may take at most half of the memory left, fewer chunks only mean less parallelism
+    size_t memoryLimit = REDUCTION_MEMORY_LIMIT;
+    size_t availableMemory = getAvailableMemory();
+    if (availableMemory / 2 < memoryLimit)
+    {
+        memoryLimit = availableMemory / 2;
+    }
+
+    size_t memoryChunks = memoryLimit / ((stateSize > 0 ? stateSize : 1) * sizeof(double));
+    if (numChunks > memoryChunks)
+    {
+        numChunks = memoryChunks;
+    }
+
+    return numChunks > 0 ? numChunks : 1;
+}
+
+/**
+ * @brief Scratch buffers of the centroid step, kept between calls.
+ *
+ * The buffers only grow, so the iterations of a run reuse a single allocation.
+ * Every thread has its own workspace, released with freeReductionWorkspace.
+ */
+typedef struct
+{
+    double* values;       /**< Chunk sums, chunk weights and the compensation terms. */
+    size_t* counts;       /**< Chunk counts. */
+    size_t valueCapacity; /**< Number of doubles allocated in values. */
+    size_t countCapacity; /**< Number of counts allocated in counts. */
+} ReductionWorkspace;
+
+static THREAD_LOCAL ReductionWorkspace threadReductionWorkspace = { NULL, NULL, 0, 0 };
+
+/**
+ * @brief Gets the reduction workspace of the calling thread, grown to at least the given sizes.
+ *
+ * The contents are not cleared.
+ *
+ * @param numValues The number of doubles needed.
+ * @param numCounts The number of counts needed.
+ * @return A pointer to the workspace of the calling thread.
+ */
+static ReductionWorkspace* reserveReductionWorkspace(size_t numValues, size_t numCounts)
+{
+    ReductionWorkspace* workspace = &threadReductionWorkspace;
+    size_t previousSubsystem = setMemorySubsystem(MEMORY_REDUCTIONS);
+
+    if (workspace->valueCapacity < numValues)
+    {
+        trackedFree(workspace->values);
+        workspace->values = trackedMalloc(numValues * sizeof(double));
+        handleMemoryError(workspace->values);
+        workspace->valueCapacity = numValues;
+    }
+
+    if (workspace->countCapacity < numCounts)
+    {
+        trackedFree(workspace->counts);
+        workspace->counts = trackedMalloc(numCounts * sizeof(size_t));
+        handleMemoryError(workspace->counts);
+        workspace->countCapacity = numCounts;
+    }
+
+    setMemorySubsystem(previousSubsystem);
+    return workspace;
+}
+
+/**
+ * @brief Frees the reduction workspace of the calling thread.
+ */
+void freeReductionWorkspace(void)
+{
+    ReductionWorkspace* workspace = &threadReductionWorkspace;
+
+    trackedFree(workspace->values);
+    trackedFree(workspace->counts);
+    workspace->values = NULL;
+    workspace->counts = NULL;
+    workspace->valueCapacity = 0;
+    workspace->countCapacity = 0;
+}
+
+/**
+ * @brief Adds a value to a sum using Kahan compensated summation.
+ *
+ * This function keeps the rounding error of the additions in a separate compensation term,
+ * so the error of a long sum does not grow with the number of terms. The function is branch-free,
+ * so loops calling it element-wise over arrays can still be vectorized.
+ * Note: the compiler must not reassociate floating-point math (no /fp:fast or -ffast-math).
+ *
+ * @param sum A pointer to the running sum.
+ * @param compensation A pointer to the running compensation term, initialized to 0.
+ * @param value The value to add.
+ */
+static inline void addCompensated(double* sum, double* compensation, double value)
+{
+    double corrected = value - *compensation;
+    double newSum = *sum + corrected;
+    *compensation = (newSum - *sum) - corrected;
+    *sum = newSum;
+}
+
+/**
+ * @brief Seeds the random number generator for a single trial.
+ *
+ * In deterministic mode this function reseeds the generator from RANDOM_SEED and the trial index,
+ * so every trial gets the same random sequence regardless of the trials run before it.
+ * Otherwise it does nothing and the generator keeps its time-based sequence.
+ *
+ * @param trialIndex The index of the trial.
+ */
+void seedTrial(size_t trialIndex)
+{
+    if (DETERMINISTIC)
+    {
+        srand(RANDOM_SEED ^ (unsigned int)(trialIndex * 2654435761u));
+    }
+}
+
+/**
+ * @brief Reseeds the random number generator with a seed drawn from its own sequence.
+ *
+ * The state of rand() cannot be saved, but a seed drawn at a known point can: reseeding with it
+ * continues the sequence in the same way every time the seed is applied again.
+ *
+ * @return The new seed.
+ */
+unsigned int reseedFromRandomState(void)
+{
+    unsigned int seed = (unsigned int)rand();
+    srand(seed);
+
+    return seed;
+}
+
+/**
+ * @brief Draws the next number of a random sequence whose state belongs to the caller (splitmix64).
+ *
+ * Unlike rand(), the generator can be used inside a parallel loop: every task seeds a state of its own
+ * with a seed drawn from rand() beforehand, so its numbers do not depend on the order of the tasks.
+ *
+ * @param state A pointer to the state of the sequence, the seed before the first call.
+ * @return The next number of the sequence.
+ */
+uint64_t nextLocalRandom(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Reads a monotonic wall-clock time.
+ *
+ * Unlike clock(), the time does not depend on the number of threads and never jumps with the system clock.
+ *
+ * @return The time in seconds from an arbitrary starting point.
+ */
+double getMonotonicSeconds(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#endif
+}
+
+/**
+ * @brief Starts an anytime run with the given wall-clock budget.
+ *
+ * The trace and the best solution of the previous run are cleared. The trace arrays and the lock are created
+ * on the first call and released with freeAnytimeTrace.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the full data of the run.
+ * @param numCentroids The number of clusters of a complete solution.
+ * @param budgetSeconds The budget in seconds.
+ */
+void startAnytimeBudget(const DataPoints* dataPoints, size_t numCentroids, double budgetSeconds)
+{
+    if (activeBudget.traceTimes == NULL)
+    {
+        activeBudget.traceTimes = trackedMalloc(ANYTIME_TRACE_CAPACITY * sizeof(double));
+        handleMemoryError(activeBudget.traceTimes);
+        activeBudget.traceSses = trackedMalloc(ANYTIME_TRACE_CAPACITY * sizeof(double));
+        handleMemoryError(activeBudget.traceSses);
+        if (mtx_init(&activeBudget.lock, mtx_plain) != thrd_success)
+        {
+            raiseFatalError("Unable to initialize the anytime budget");
+        }
+    }
+
+    freeCentroids(&activeBudget.bestCentroids);
+    activeBudget.bestCentroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
+
+    activeBudget.dataPoints = dataPoints;
+    activeBudget.numCentroids = numCentroids;
+    activeBudget.bestSse = DBL_MAX;
+    activeBudget.traceLength = 0;
+    activeBudget.startTime = getMonotonicSeconds();
+
+    double deadline = activeBudget.startTime + budgetSeconds;
+    uint64_t bits;
+    memcpy(&bits, &deadline, sizeof(bits));
+    atomic_store(&activeBudget.deadlineBits, bits);
+    atomic_store(&activeBudget.active, true);
+}
+
+/**
+ * @brief Stops the current anytime run. The trace is kept until the next run.
+ *
+ * @return The wall-clock time used by the run (in seconds).
+ */
+double stopAnytimeBudget(void)
+{
+    atomic_store(&activeBudget.active, false);
+
+    return getMonotonicSeconds() - activeBudget.startTime;
+}
+
+/**
+ * @brief Releases the trace arrays, the best solution and the lock of the anytime runs.
+ */
+void freeAnytimeTrace(void)
+{
+    if (activeBudget.traceTimes != NULL) mtx_destroy(&activeBudget.lock);
+    trackedFree(activeBudget.traceTimes);
+    trackedFree(activeBudget.traceSses);
+    freeCentroids(&activeBudget.bestCentroids);
+    activeBudget.bestCentroids.size = 0;
+    activeBudget.traceTimes = NULL;
+    activeBudget.traceSses = NULL;
+    activeBudget.traceLength = 0;
+}
+
+/**
+ * @brief Checks whether the deadline of the current anytime run has passed.
+ *
+ * The check reads the clock once, so it is cheap compared to a pass over the data.
+ * Without an anytime run it only tests a flag.
+ *
+ * @return True if an anytime run is in progress and its deadline has passed, false otherwise.
+ */
+bool deadlineReached(void)
+{
+    if (!atomic_load(&activeBudget.active)) return false;
+
+    uint64_t bits = atomic_load(&activeBudget.deadlineBits);
+    double deadline;
+    memcpy(&deadline, &bits, sizeof(deadline));
+
+    return getMonotonicSeconds() >= deadline;
+}
+
+/**
+ * @brief Adds the SSE of a solution to the quality versus time trace if it improves the best so far.
+ *
+ * The SSE is ignored unless it belongs to a complete solution on the full data of the run.
+ * An improving solution also replaces the copy of the best centroids, which the anytime run returns.
+ * When the trace is full, its last point is replaced so the final quality is always kept.
+ *
+ * @param dataPoints A pointer to the DataPoints structure the SSE was calculated on.
+ * @param centroids A pointer to the Centroids structure of the solution.
+ * @param sse The SSE of the solution.
+ */
+void recordAnytimeProgress(const DataPoints* dataPoints, const Centroids* centroids, double sse)
+{
+    if (!atomic_load(&activeBudget.active) || dataPoints != activeBudget.dataPoints || centroids->size != activeBudget.numCentroids) return;
+
+    mtx_lock(&activeBudget.lock);
+    if (sse < activeBudget.bestSse)
+    {
+        activeBudget.bestSse = sse;
+        for (size_t c = 0; c < centroids->size; ++c)
+        {
+            memcpy(activeBudget.bestCentroids.points[c].attributes, centroids->points[c].attributes, centroids->points[c].dimensions * sizeof(double));
+        }
+
+        size_t index = activeBudget.traceLength < ANYTIME_TRACE_CAPACITY ? activeBudget.traceLength++ : ANYTIME_TRACE_CAPACITY - 1;
+        activeBudget.traceTimes[index] = getMonotonicSeconds() - activeBudget.startTime;
+        activeBudget.traceSses[index] = sse;
+    }
+    mtx_unlock(&activeBudget.lock);
+}
+
+/**
+ * @brief Returns the trace buffer of the calling thread, registering a new one for a new tracing.
+ *
+ * @return A pointer to the TraceBuffer structure of the calling thread.
+ */
+static TraceBuffer* getThreadTraceBuffer(void)
+{
+    if (threadTraceBuffer != NULL && threadTraceSession == activeTrace.session) return threadTraceBuffer;
+
+    TraceBuffer* buffer = trackedMalloc(sizeof(TraceBuffer));
+    handleMemoryError(buffer);
+    buffer->events = trackedMalloc(TRACE_BUFFER_EVENTS * sizeof(TraceEvent));
+    handleMemoryError(buffer->events);
+    buffer->count = 0;
+
+    mtx_lock(&activeTrace.lock);
+    activeTrace.buffers = trackedRealloc(activeTrace.buffers, (activeTrace.numBuffers + 1) * sizeof(TraceBuffer*));
+    handleMemoryError(activeTrace.buffers);
+    buffer->threadIndex = activeTrace.numBuffers;
+    activeTrace.buffers[activeTrace.numBuffers++] = buffer;
+    mtx_unlock(&activeTrace.lock);
+
+    threadTraceBuffer = buffer;
+    threadTraceSession = activeTrace.session;
+
+    return buffer;
+}
+
+/**
+ * @brief Starts recording the phases of the run.
+ *
+ * The calling thread becomes thread 0 of the trace. Must not be called inside a parallel region.
+ */
+void startTracing(void)
+{
+    if (!activeTrace.lockInitialized)
+    {
+        if (mtx_init(&activeTrace.lock, mtx_plain) != thrd_success)
+        {
+            raiseFatalError("Unable to initialize the trace lock");
+        }
+        activeTrace.lockInitialized = true;
+    }
+
+    activeTrace.session++;
+    activeTrace.startTime = getMonotonicSeconds();
+    activeTrace.enabled = true;
+
+    getThreadTraceBuffer();
+}
+
+/**
+ * @brief Returns the start time of a traced phase.
+ *
+ * @return The monotonic time, or 0 when not tracing.
+ */
+double traceBegin(void)
+{
+    return activeTrace.enabled ? getMonotonicSeconds() : 0.0;
+}
+
+/**
+ * @brief Records a traced phase in the buffer of the calling thread.
+ *
+ * @param name The name of the phase, a string literal.
+ * @param start The start time returned by traceBegin.
+ */
+void traceEnd(const char* name, double start)
+{
+    if (!activeTrace.enabled || start == 0.0) return;
+
+    double end = getMonotonicSeconds();
+    TraceBuffer* buffer = getThreadTraceBuffer();
+    TraceEvent* event = &buffer->events[buffer->count % TRACE_BUFFER_EVENTS];
+
+    event->name = name;
+    event->start = start;
+    event->duration = end - start;
+    buffer->count++;
+}
+
+/**
+ * @brief Stops the tracing and writes the recorded phases as a Chrome trace JSON file.
+ *
+ * Every thread is a track of its own, so the file can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing
+ * to see where the threads wait for each other. The buffers are released afterwards.
+ * Must not be called inside a parallel region.
+ *
+ * @param filename The name of the file.
+ */
+void writeChromeTrace(const char* filename)
+{
+    activeTrace.enabled = false;
+
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Cannot open file %s for writing\n", filename);
+    }
+
+    size_t totalEvents = 0;
+    size_t overwrittenEvents = 0;
+
+    if (file != NULL)
+    {
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Clustering\"}}");
+    }
+
+    for (size_t b = 0; b < activeTrace.numBuffers; ++b)
+    {
+        TraceBuffer* buffer = activeTrace.buffers[b];
+        size_t stored = buffer->count < TRACE_BUFFER_EVENTS ? buffer->count : TRACE_BUFFER_EVENTS;
+        totalEvents += stored;
+        overwrittenEvents += buffer->count - stored;
+
+        if (file != NULL)
+        {
+            if (buffer->threadIndex == 0) fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"main\"}}");
+            else fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"worker %zu\"}}", buffer->threadIndex, buffer->threadIndex);
+
+            for (size_t i = buffer->count - stored; i < buffer->count; ++i)
+            {
+                const TraceEvent* event = &buffer->events[i % TRACE_BUFFER_EVENTS];
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+                    event->name, buffer->threadIndex, (event->start - activeTrace.startTime) * 1e6, event->duration * 1e6);
+            }
+        }
+
+        trackedFree(buffer->events);
+        trackedFree(buffer);
+    }
+
+    if (file != NULL)
+    {
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        printf("Trace: %zu events of %zu threads written to %s (%zu older events overwritten)\n", totalEvents, activeTrace.numBuffers, filename, overwrittenEvents);
+    }
+
+    trackedFree(activeTrace.buffers);
+    activeTrace.buffers = NULL;
+    activeTrace.numBuffers = 0;
+}
+
+/**
+ * @brief Gets the maximum number of threads used by the parallel loops.
+ *
+ * @return The maximum number of OpenMP threads, or 1 when compiled without OpenMP.
+ */
+int getMaxThreads(void)
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/**
+ * @brief Gets the number of processors, independent of the thread count set with setThreadCount.
+ *
+ * @return The number of processors available to OpenMP, or 1 when compiled without OpenMP.
+ */
+int getProcessorCount(void)
+{
+#ifdef _OPENMP
+    return omp_get_num_procs();
+#else
+    return 1;
+#endif
+}
+
+/**
+ * @brief Sets the number of threads used by the parallel loops.
+ *
+ * This function does nothing when compiled without OpenMP.
+ *
+ * @param numThreads The number of threads to use.
+ */
+void setThreadCount(int numThreads)
+{
+#ifdef _OPENMP
+    omp_set_num_threads(numThreads);
+#else
+    (void)numThreads;
+#endif
+}
+
+/**
+ * @brief Gets the name of the machine, used to keep the autotuning results of different machines apart.
+ *
+ * Whitespace in the name is replaced with underscores, so the name is a single word in the profile file.
+ *
+ * @param buffer A buffer for the name.
+ * @param size The size of the buffer.
+ */
+void getMachineName(char* buffer, size_t size)
+{
+    bool found = false;
+#ifdef _WIN32
+    DWORD length = (DWORD)size;
+    found = GetComputerNameA(buffer, &length) != 0;
+#else
+    found = gethostname(buffer, size) == 0;
+    if (size > 0) buffer[size - 1] = '\0';
+#endif
+    if (!found || buffer[0] == '\0')
+    {
+        snprintf(buffer, size, "unknown");
+    }
+
+    for (char* c = buffer; *c != '\0'; ++c)
+    {
+        if (*c == ' ' || *c == '\t') *c = '_';
+    }
+}
+
+  /**
+   * @brief Handles file opening errors.
+   *
+   * This function reports with raiseFatalError that the specified file could not be opened,
+   * which exits the program unless the caller handles fatal errors.
+   *
+   * @param filename The name of the file that could not be opened.
+   */
+ void handleFileError(const char* filename)
+ {
+    raiseFatalError("Unable to open file '%s'", filename);
+ }
+
+ /**
+ * @brief Handles file read errors.
+ *
+ * This function reports with raiseFatalError that an error occurred while reading
+ * from the specified file, which exits the program unless the caller handles fatal errors.
+ *
+ * @param filename The name of the file that could not be read.
+ */
+ void handleFileReadError(const char* filename)
+ {
+     raiseFatalError("Unable to read from file '%s'", filename);
+ }
+
+ /**
+ * @brief Handles file format errors.
+ *
+ * This function reports with raiseFatalError that the specified file
+ * is not in the expected format, which exits the program unless the caller handles fatal errors.
+ *
+ * @param filename The name of the file with the invalid format.
+ * @param reason A description of the problem.
+ */
+ void handleFileFormatError(const char* filename, const char* reason)
+ {
+     raiseFatalError("Invalid format in file '%s': %s", filename, reason);
+ }
+
+/**
+ * @brief Maps a file into memory with copy-on-write pages.
+ *
+ * Writes to the mapping (e.g. normalizeDataPoints) stay private to the process and never reach the file.
+ * The function exits the program if the file cannot be opened or mapped.
+ *
+ * @param filename The name of the file to map.
+ * @param size Receives the size of the file in bytes.
+ * @return A pointer to the start of the mapping, released with unmapFile.
+ */
+void* mapFile(const char* filename, size_t* size)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        handleFileError(filename);
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        handleFileReadError(filename);
+    }
+    *size = (size_t)fileSize.QuadPart;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        handleFileReadError(filename);
+    }
+
+    // The view keeps the file mapped after the handles are closed
+    void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    int file = open(filename, O_RDONLY);
+    if (file < 0)
+    {
+        handleFileError(filename);
+    }
+
+    struct stat fileInfo;
+    if (fstat(file, &fileInfo) != 0 || fileInfo.st_size == 0)
+    {
+        handleFileReadError(filename);
+    }
+    *size = (size_t)fileInfo.st_size;
+
+    void* view = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (view == MAP_FAILED)
+    {
+        view = NULL;
+    }
+#ifdef MADV_SEQUENTIAL
+    else
+    {
+        madvise(view, *size, MADV_SEQUENTIAL);
+    }
+#endif
+#endif
+
+    if (view == NULL)
+    {
+        handleFileReadError(filename);
+    }
+
+    return view;
+}
+
+/**
+* @brief Gets the number of dimensions in the data file.
+*
+* This function reads the first line of the specified file and counts the number of tokens
+* (assumed to be the number of dimensions) separated by spaces (" ", tabs "\t", newlines "\n", carriage return "\r").
+*
+* @param filename The name of the file to read.
+* @return The number of dimensions in the data file.
+*/
+size_t getNumDimensions(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        handleFileError(filename);
+    }
+
+    // For disabling the CS6387 warning,
+    // inform the static analyzer that 'file' is not NULL.
+    // Safe to use as we actually check for NULL earlier
+    _Analysis_assume_(file != NULL);
+
+    //TODO: mieti, ett tarvitseeko nit buffereita yhdenmukaistaa, tss 512 muualla 256
+	char firstLine[512]; // Buffer size = 512, increase if needed
+    if (fgets(firstLine, sizeof(firstLine), file) == NULL)
+    {
+        handleFileReadError(filename);
+    }
+
+    size_t dimensions = 0;
+    char* context = NULL;
+	char* token = strtok_s(firstLine, " \t\r\n", &context); //Delimiter = " ", tabs "\t", newlines "\n", carriage return "\r" //TODO: Haluanko muuta kuin " "? TODO: halutaanko CONST?
+    while (token != NULL)
+    {
+        dimensions++;
+        token = strtok_s(NULL, " \t\r\n", &context); //Delimiter = " ", tabs "\t", newlines "\n", carriage return "\r" 
+    }
+
+    fclose(file);
+
+    return dimensions;
+}
+
+/**
+ * @brief Reads from a file at the given offset.
+ *
+ * @param reader A pointer to the ChunkReader structure of the file.
+ * @param buffer The buffer to read into.
+ * @param length The number of bytes to read.
+ * @param offset The file offset.
+ * @return The number of bytes read, 0 at the end of the file, or -1 on error.
+ */
+static long long readFileAt(const ChunkReader* reader, char* buffer, size_t length, size_t offset)
+{
+#ifdef _WIN32
+    OVERLAPPED overlapped = { 0 };
+    overlapped.Offset = (DWORD)(offset & 0xFFFFFFFFu);
+    overlapped.OffsetHigh = (DWORD)((unsigned long long)offset >> 32);
+
+    DWORD bytesRead = 0;
+    if (!ReadFile(reader->file, buffer, (DWORD)length, &bytesRead, &overlapped))
+    {
+        return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+    }
+    return (long long)bytesRead;
+#else
+    ssize_t bytesRead;
+    do
+    {
+        bytesRead = pread(reader->file, buffer, length, (off_t)offset);
+    } while (bytesRead < 0 && errno == EINTR);
+    return (long long)bytesRead;
+#endif
+}
+
+/**
+ * @brief Runs a reader thread of the fallback pool.
+ *
+ * The thread takes submitted slots in order and reads their chunks completely with positioned reads.
+ *
+ * @param argument A pointer to the ChunkReader structure.
+ * @return Always 0.
+ */
+static int runChunkReaderThread(void* argument)
+{
+    ChunkReader* reader = argument;
+
+    mtx_lock(&reader->lock);
+    while (true)
+    {
+        while (reader->requestCount == 0 && !reader->closing)
+        {
+            cnd_wait(&reader->requestAvailable, &reader->lock);
+        }
+        if (reader->requestCount == 0) break;
+
+        size_t slot = reader->requests[reader->requestHead];
+        reader->requestHead = (reader->requestHead + 1) % reader->depth;
+        reader->requestCount--;
+        mtx_unlock(&reader->lock);
+
+        char* buffer = &reader->bufferMemory[slot * reader->chunkSize];
+        size_t filled = 0;
+        bool failed = false;
+        while (filled < reader->lengths[slot])
+        {
+            long long result = readFileAt(reader, &buffer[filled], reader->lengths[slot] - filled, reader->offsets[slot] + filled);
+            if (result <= 0)
+            {
+                failed = true;
+                break;
+            }
+            filled += (size_t)result;
+        }
+
+        mtx_lock(&reader->lock);
+        reader->filled[slot] = filled;
+        reader->ready[slot] = true;
+        if (failed) reader->failed = true;
+        cnd_broadcast(&reader->readCompleted);
+    }
+    mtx_unlock(&reader->lock);
+
+    return 0;
+}
+
+#ifdef HAVE_LIBURING
+/**
+ * @brief Queues a read of the unread part of a slot on the io_uring instance.
+ *
+ * @param reader A pointer to the ChunkReader structure.
+ * @param slot The slot to read into.
+ */
+static void queueUringRead(ChunkReader* reader, size_t slot)
+{
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&reader->ring);
+    if (sqe == NULL)
+    {
+        io_uring_submit(&reader->ring);
+        sqe = io_uring_get_sqe(&reader->ring);
+    }
+    if (sqe == NULL)
+    {
+        handleFileReadError(reader->filename);
+    }
+
+    char* buffer = &reader->bufferMemory[slot * reader->chunkSize + reader->filled[slot]];
+    unsigned int length = (unsigned int)(reader->lengths[slot] - reader->filled[slot]);
+    unsigned long long offset = (unsigned long long)(reader->offsets[slot] + reader->filled[slot]);
+
+    if (reader->buffersRegistered)
+    {
+        io_uring_prep_read_fixed(sqe, reader->file, buffer, length, offset, (int)slot);
+    }
+    else
+    {
+        io_uring_prep_read(sqe, reader->file, buffer, length, offset);
+    }
+    io_uring_sqe_set_data(sqe, (void*)(uintptr_t)slot);
+}
+
+/**
+ * @brief Waits for one io_uring completion and updates the state of its slot.
+ *
+ * A short read is continued with a new read of the remaining part.
+ *
+ * @param reader A pointer to the ChunkReader structure.
+ */
+static void completeUringRead(ChunkReader* reader)
+{
+    struct io_uring_cqe* cqe;
+    int result = io_uring_wait_cqe(&reader->ring, &cqe);
+    if (result < 0)
+    {
+        handleFileReadError(reader->filename);
+    }
+
+    size_t slot = (size_t)(uintptr_t)io_uring_cqe_get_data(cqe);
+    int bytesRead = cqe->res;
+    io_uring_cqe_seen(&reader->ring, cqe);
+
+    if (bytesRead <= 0)
+    {
+        reader->failed = true;
+        reader->ready[slot] = true;
+        return;
+    }
+
+    reader->filled[slot] += (size_t)bytesRead;
+    if (reader->filled[slot] < reader->lengths[slot])
+    {
+        queueUringRead(reader, slot);
+        io_uring_submit(&reader->ring);
+    }
+    else
+    {
+        reader->ready[slot] = true;
+    }
+}
+#endif
+
+/**
+ * @brief Submits the read of the next chunk of the file into a slot.
+ *
+ * @param reader A pointer to the ChunkReader structure.
+ * @param slot The free slot to read into.
+ * @return True if a read was submitted, false if the whole file has been submitted.
+ */
+static bool submitChunkRead(ChunkReader* reader, size_t slot)
+{
+    if (reader->nextOffset >= reader->fileSize) return false;
+
+    size_t remaining = reader->fileSize - reader->nextOffset;
+    reader->offsets[slot] = reader->nextOffset;
+    reader->lengths[slot] = remaining < reader->chunkSize ? remaining : reader->chunkSize;
+    reader->filled[slot] = 0;
+    reader->ready[slot] = false;
+    reader->nextOffset += reader->lengths[slot];
+    reader->submittedChunks++;
+
+#ifdef HAVE_LIBURING
+    if (reader->useUring)
+    {
+        queueUringRead(reader, slot);
+        return true;
+    }
+#endif
+
+    mtx_lock(&reader->lock);
+    reader->requests[(reader->requestHead + reader->requestCount) % reader->depth] = slot;
+    reader->requestCount++;
+    cnd_signal(&reader->requestAvailable);
+    mtx_unlock(&reader->lock);
+
+    return true;
+}
+
+/**
+ * @brief Opens a file for asynchronous chunked reading and starts the first reads.
+ *
+ * The reads go through io_uring with registered buffers when the program is compiled with HAVE_LIBURING
+ * and the kernel allows it, otherwise through a pool of READ_THREADS threads doing positioned reads.
+ *
+ * @param reader A pointer to the ChunkReader structure to be initialized.
+ * @param filename The name of the file to read.
+ * @param chunkSize The size of a chunk in bytes.
+ * @param depth The number of chunks read ahead.
+ */
+void openChunkReader(ChunkReader* reader, const char* filename, size_t chunkSize, size_t depth)
+{
+    reader->filename = filename;
+    reader->chunkSize = chunkSize;
+    reader->depth = depth;
+    reader->nextOffset = 0;
+    reader->nextChunk = 0;
+    reader->submittedChunks = 0;
+    reader->failed = false;
+
+#ifdef _WIN32
+    reader->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (reader->file == INVALID_HANDLE_VALUE)
+    {
+        handleFileError(filename);
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(reader->file, &fileSize))
+    {
+        handleFileReadError(filename);
+    }
+    reader->fileSize = (size_t)fileSize.QuadPart;
+
+    reader->bufferMemory = _aligned_malloc(chunkSize * depth, 4096);
+#else
+    reader->file = open(filename, O_RDONLY);
+    if (reader->file < 0)
+    {
+        handleFileError(filename);
+    }
+    struct stat fileInfo;
+    if (fstat(reader->file, &fileInfo) != 0)
+    {
+        handleFileReadError(filename);
+    }
+    reader->fileSize = (size_t)fileInfo.st_size;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(reader->file, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    void* bufferMemory = NULL;
+    reader->bufferMemory = posix_memalign(&bufferMemory, 4096, chunkSize * depth) == 0 ? bufferMemory : NULL;
+#endif
+    handleMemoryError(reader->bufferMemory);
+
+    reader->offsets = trackedMalloc(depth * sizeof(size_t));
+    reader->lengths = trackedMalloc(depth * sizeof(size_t));
+    reader->filled = trackedMalloc(depth * sizeof(size_t));
+    reader->ready = trackedMalloc(depth * sizeof(bool));
+    reader->requests = trackedMalloc(depth * sizeof(size_t));
+    handleMemoryError(reader->offsets);
+    handleMemoryError(reader->lengths);
+    handleMemoryError(reader->filled);
+    handleMemoryError(reader->ready);
+    handleMemoryError(reader->requests);
+    reader->requestHead = 0;
+    reader->requestCount = 0;
+    reader->closing = false;
+    reader->threads = NULL;
+    reader->numThreads = 0;
+
+    if (mtx_init(&reader->lock, mtx_plain) != thrd_success || cnd_init(&reader->requestAvailable) != thrd_success || cnd_init(&reader->readCompleted) != thrd_success)
+    {
+        raiseFatalError("Unable to initialize the chunk reader");
+    }
+
+#ifdef HAVE_LIBURING
+    reader->useUring = io_uring_queue_init((unsigned int)depth, &reader->ring, 0) == 0;
+    reader->buffersRegistered = false;
+    if (reader->useUring)
+    {
+        // Registered buffers are pinned once, so the kernel does not map them for every read
+        struct iovec* buffers = trackedMalloc(depth * sizeof(struct iovec));
+        handleMemoryError(buffers);
+        for (size_t slot = 0; slot < depth; ++slot)
+        {
+            buffers[slot].iov_base = &reader->bufferMemory[slot * chunkSize];
+            buffers[slot].iov_len = chunkSize;
+        }
+        reader->buffersRegistered = io_uring_register_buffers(&reader->ring, buffers, (unsigned int)depth) == 0;
+        trackedFree(buffers);
+    }
+    else
+#endif
+    {
+        size_t numThreads = READ_THREADS < depth ? READ_THREADS : depth;
+        reader->threads = trackedMalloc(numThreads * sizeof(thrd_t));
+        handleMemoryError(reader->threads);
+        for (size_t i = 0; i < numThreads; ++i)
+        {
+            if (thrd_create(&reader->threads[i], runChunkReaderThread, reader) != thrd_success)
+            {
+                raiseFatalError("Unable to start a reader thread");
+            }
+            reader->numThreads++;
+        }
+    }
+
+    for (size_t slot = 0; slot < depth; ++slot)
+    {
+        if (!submitChunkRead(reader, slot)) break;
+    }
+#ifdef HAVE_LIBURING
+    if (reader->useUring) io_uring_submit(&reader->ring);
+#endif
+}
+
+/**
+ * @brief Returns the next chunk of the file.
+ *
+ * The slot of the previously returned chunk is reused for a new read, so the previous chunk
+ * must not be used after this call. The returned buffer may be modified by the caller.
+ *
+ * @param reader A pointer to the ChunkReader structure.
+ * @param length Receives the length of the chunk.
+ * @return The chunk, or NULL at the end of the file.
+ */
+char* readNextChunk(ChunkReader* reader, size_t* length)
+{
+    // Refill the slot of the previous chunk
+    if (reader->nextChunk > 0)
+    {
+        submitChunkRead(reader, (reader->nextChunk - 1) % reader->depth);
+#ifdef HAVE_LIBURING
+        if (reader->useUring) io_uring_submit(&reader->ring);
+#endif
+    }
+
+    if (reader->nextChunk >= reader->submittedChunks) return NULL;
+
+    size_t slot = reader->nextChunk % reader->depth;
+
+#ifdef HAVE_LIBURING
+    if (reader->useUring)
+    {
+        while (!reader->ready[slot])
+        {
+            completeUringRead(reader);
+        }
+    }
+    else
+#endif
+    {
+        mtx_lock(&reader->lock);
+        while (!reader->ready[slot])
+        {
+            cnd_wait(&reader->readCompleted, &reader->lock);
+        }
+        mtx_unlock(&reader->lock);
+    }
+
+    if (reader->failed || reader->filled[slot] != reader->lengths[slot])
+    {
+        handleFileReadError(reader->filename);
+    }
+
+    reader->nextChunk++;
+    *length = reader->lengths[slot];
+    return &reader->bufferMemory[slot * reader->chunkSize];
+}
+
+/**
+ * @brief Stops the reads and frees the memory allocated for a ChunkReader structure.
+ *
+ * @param reader A pointer to the ChunkReader structure to be freed.
+ */
+void closeChunkReader(ChunkReader* reader)
+{
+#ifdef HAVE_LIBURING
+    if (reader->useUring)
+    {
+        // Reads may still be in flight if the caller stopped early
+        for (size_t chunk = reader->nextChunk; chunk < reader->submittedChunks; ++chunk)
+        {
+            while (!reader->ready[chunk % reader->depth])
+            {
+                completeUringRead(reader);
+            }
+        }
+        if (reader->buffersRegistered) io_uring_unregister_buffers(&reader->ring);
+        io_uring_queue_exit(&reader->ring);
+    }
+#endif
+
+    mtx_lock(&reader->lock);
+    reader->closing = true;
+    cnd_broadcast(&reader->requestAvailable);
+    mtx_unlock(&reader->lock);
+    for (size_t i = 0; i < reader->numThreads; ++i)
+    {
+        thrd_join(reader->threads[i], NULL);
+    }
+
+    mtx_destroy(&reader->lock);
+    cnd_destroy(&reader->requestAvailable);
+    cnd_destroy(&reader->readCompleted);
+
+#ifdef _WIN32
+    CloseHandle(reader->file);
+    _aligned_free(reader->bufferMemory);
+#else
+    close(reader->file);
+    free(reader->bufferMemory);
+#endif
+
+    trackedFree(reader->threads);
+    trackedFree(reader->offsets);
+    trackedFree(reader->lengths);
+    trackedFree(reader->filled);
+    trackedFree(reader->ready);
+    trackedFree(reader->requests);
+    reader->threads = NULL;
+    reader->bufferMemory = NULL;
+}
+
+/**
+ * @brief Initializes a TextParser structure.
+ *
+ * @param parser A pointer to the TextParser structure to be initialized.
+ */
+void initializeTextParser(TextParser* parser)
+{
+    parser->dataPoints.points = NULL;
+    parser->dataPoints.size = 0;
+    parser->dataPoints.matrix = NULL;
+    parser->dataPoints.mappedView = NULL;
+    parser->dataPoints.mappedSize = 0;
+    parser->allocatedSize = 0;
+    parser->pending = NULL;
+    parser->pendingLength = 0;
+    parser->pendingCapacity = 0;
+}
+
+/**
+ * @brief Parses one line of text into a data point.
+ *
+ * The attributes are separated by spaces, tabs, newlines, or carriage returns. Lines without attributes are skipped.
+ *
+ * @param parser A pointer to the TextParser structure.
+ * @param line The NUL-terminated line, modified by the tokenizer.
+ */
+void parseTextLine(TextParser* parser, char* line)
+{
+    size_t attributeAllocatedSize = 6;
+
+    DataPoint point;
+    point.attributes = trackedMalloc(sizeof(double) * attributeAllocatedSize);
+    handleMemoryError(point.attributes);
+    point.dimensions = 0;
+    point.partition = SIZE_MAX;
+    point.weight = 1.0;
+
+    char* context = NULL;
+    char* token = strtok_s(line, " \t\r\n", &context); // Delimiter = " ", tabs "\t", newlines "\n", carriage return "\r"
+    while (token != NULL)
+    {
+        if (point.dimensions == attributeAllocatedSize)
+        {
+            attributeAllocatedSize = attributeAllocatedSize > 0 ? attributeAllocatedSize * 2 : 1;
+            double* temp = trackedRealloc(point.attributes, sizeof(double) * attributeAllocatedSize);
+            handleMemoryError(temp);
+            point.attributes = temp;
+        }
+        
+        // if(LOGGING >= 3) printf("Token: %s\n", token);
+        point.attributes[point.dimensions++] = strtod(token, NULL); // atoi(token) for int or strtod(token, NULL) for double
+        token = strtok_s(NULL, " \t\r\n", &context); // Delimiter = " ", tabs "\t", newlines "\n", carriage return "\r"
+    }
+
+    // if(LOGGING >= 3) printf("\n", token);
+
+    if (point.dimensions == 0)
+    {
+        trackedFree(point.attributes);
+        return;
+    }
+
+    DataPoints* dataPoints = &parser->dataPoints;
+    if (dataPoints->size == parser->allocatedSize)
+    {
+        parser->allocatedSize = parser->allocatedSize > 0 ? parser->allocatedSize * 2 : 1;
+        DataPoint* temp = trackedRealloc(dataPoints->points, sizeof(DataPoint) * parser->allocatedSize);
+        handleMemoryError(temp);
+        dataPoints->points = temp;
+    }
+
+    // Remove the suppression, if there are unknown issues while running the code.
+    // The "if(dataPoints->size == parser->allocatedSize)" -check above should be enough
+	// to handle this warning, but the static analyzer is not able to detect it.
+    // 
+    // Suppress warning C6386 for this line
+    #pragma warning(suppress : 6386)
+    dataPoints->points[dataPoints->size++] = point;
+}
+
+/**
+ * @brief Appends text to the pending line of the parser.
+ *
+ * @param parser A pointer to the TextParser structure.
+ * @param text The text to append.
+ * @param length The length of the text.
+ */
+static void appendPendingText(TextParser* parser, const char* text, size_t length)
+{
+    if (parser->pendingLength + length + 1 > parser->pendingCapacity)
+    {
+        size_t capacity = parser->pendingCapacity > 0 ? parser->pendingCapacity : 512;
+        while (parser->pendingLength + length + 1 > capacity) capacity *= 2;
+
+        char* temp = trackedRealloc(parser->pending, capacity);
+        handleMemoryError(temp);
+        parser->pending = temp;
+        parser->pendingCapacity = capacity;
+    }
+
+    memcpy(&parser->pending[parser->pendingLength], text, length);
+    parser->pendingLength += length;
+    parser->pending[parser->pendingLength] = '\0';
+}
+
+/**
+ * @brief Parses a chunk of text.
+ *
+ * The chunk may start and end in the middle of a line. Complete lines are parsed in place,
+ * so the chunk is modified, and the incomplete last line is kept until the next chunk.
+ *
+ * @param parser A pointer to the TextParser structure.
+ * @param chunk The chunk of text (not NUL-terminated).
+ * @param length The length of the chunk.
+ */
+void parseTextChunk(TextParser* parser, char* chunk, size_t length)
+{
+    char* lineStart = chunk;
+    char* end = chunk + length;
+
+    while (lineStart < end)
+    {
+        char* newline = memchr(lineStart, '\n', (size_t)(end - lineStart));
+        if (newline == NULL)
+        {
+            appendPendingText(parser, lineStart, (size_t)(end - lineStart));
+            return;
+        }
+
+        *newline = '\0';
+        if (parser->pendingLength > 0)
+        {
+            // The line started in an earlier chunk
+            appendPendingText(parser, lineStart, (size_t)(newline - lineStart));
+            parseTextLine(parser, parser->pending);
+            parser->pendingLength = 0;
+        }
+        else
+        {
+            parseTextLine(parser, lineStart);
+        }
+        lineStart = newline + 1;
+    }
+}
+
+/**
+ * @brief Parses the last line and returns the data points of the parser.
+ *
+ * @param parser A pointer to the TextParser structure.
+ * @return A DataPoints structure containing the parsed data points.
+ */
+DataPoints finishTextParser(TextParser* parser)
+{
+    if (parser->pendingLength > 0)
+    {
+        parseTextLine(parser, parser->pending);
+    }
+
+    trackedFree(parser->pending);
+    parser->pending = NULL;
+    parser->pendingLength = 0;
+    parser->pendingCapacity = 0;
+
+    return parser->dataPoints;
+}
+
+/**
+ * @brief Reads data points from a file.
+ *
+ * This function reads data points from the specified file, where each line represents a data point
+ * with attributes separated by spaces, tabs, newlines, or carriage returns. The file is read in chunks
+ * of STREAM_CHUNK_SIZE bytes by a ChunkReader, which keeps READ_QUEUE_DEPTH reads in flight while the chunks
+ * are parsed in place with a TextParser, so there is no limit on the line length.
+ * It allocates memory for the data points and their attributes, and returns a DataPoints structure containing the data points.
+ *
+ * @param filename The name of the file to read.
+ * @return A DataPoints structure containing the data points read from the file.
+ */
+DataPoints readDataPoints(const char* filename)
+{
+    ChunkReader reader;
+    openChunkReader(&reader, filename, STREAM_CHUNK_SIZE, READ_QUEUE_DEPTH);
+
+    TextParser parser;
+    initializeTextParser(&parser);
+
+    char* chunk;
+    size_t length;
+    while ((chunk = readNextChunk(&reader, &length)) != NULL)
+    {
+        parseTextChunk(&parser, chunk, length);
+    }
+
+    closeChunkReader(&reader);
+
+    DataPoints dataPoints = finishTextParser(&parser);
+
+    /*if (LOGGING >= 3)
+    {
+        // for (size_t i = 0; i < dataPoints.size; ++i) // Debug helper: print all data points
+        for (size_t i = 0; i < dataPoints.size; ++i) // Debug helper: print the first two data points
+        {
+            printf("Data point %zu attributes: ", i);
+            for (size_t j = 0; j < dataPoints.points[i].dimensions; ++j)
+            {
+                printf("%.0f ", dataPoints.points[i].attributes[j]);
+            }
+            printf("\n");
+        }
+    }*/
+    
+    return dataPoints;
+}
+
+
+/**
+ * @brief Reads centroids from a file.
+ *
+ * This function reads centroids from the specified file by first reading the data points
+ * and then converting them into centroids. It allocates memory for the centroids and their attributes,
+ * and returns a Centroids structure containing the centroids.
+ *
+ * @param filename The name of the file to read.
+ * @return A Centroids structure containing the centroids read from the file.
+ */
+Centroids readCentroids(const char* filename)
+{
+    DataPoints points = readDataPoints(filename);
+
+    Centroids centroids;
+    centroids.size = points.size;
+    centroids.points = points.points;
+    
+    /*if (LOGGING >= 3)
+    {
+        for (size_t i = 0; i < centroids.size; ++i)
+        {
+            printf("Centroid %zu (dimensions: %zu) attributes: ", i, points.points[i].dimensions);
+            for (size_t j = 0; j < points.points[i].dimensions; ++j)
+            {
+                printf("%.0f ", points.points[i].attributes[j]);
+            }
+            printf("\n");
+        }
+    }*/
+
+    return centroids;
+}
+
+/**
+ * @brief Checks whether the host stores numbers in little-endian byte order.
+ *
+ * @return True on little-endian hosts.
+ */
+static bool isLittleEndianHost(void)
+{
+    const uint16_t probe = 1;
+    return *(const unsigned char*)&probe == 1;
+}
+
+/**
+ * @brief Reads one element of a binary matrix as a double.
+ *
+ * @param bytes A pointer to the first byte of the element.
+ * @param elementSize The size of the element in bytes (4 = float32, 8 = float64).
+ * @param swapBytes True if the byte order of the element differs from the host.
+ * @return The value of the element.
+ */
+static inline double readMatrixElement(const unsigned char* bytes, size_t elementSize, bool swapBytes)
+{
+    unsigned char buffer[8];
+    for (size_t i = 0; i < elementSize; ++i)
+    {
+        buffer[i] = swapBytes ? bytes[elementSize - 1 - i] : bytes[i];
+    }
+
+    if (elementSize == 4)
+    {
+        float value;
+        memcpy(&value, buffer, sizeof(float));
+        return (double)value;
+    }
+
+    double value;
+    memcpy(&value, buffer, sizeof(double));
+    return value;
+}
+
+/**
+ * @brief Parses the header of a .npy file.
+ *
+ * This function supports format versions 1.0 to 3.0 with float32 or float64 elements in either
+ * byte order, C or Fortran order, and one- or two-dimensional shapes. A one-dimensional array
+ * is read as one-dimensional data points. The program exits if the header is not supported.
+ *
+ * @param bytes A pointer to the start of the file.
+ * @param fileSize The size of the file in bytes.
+ * @param filename The name of the file, for error messages.
+ * @return The layout of the matrix in the file.
+ */
+MatrixFileLayout parseNpyHeader(const unsigned char* bytes, size_t fileSize, const char* filename)
+{
+    MatrixFileLayout layout = { 0, 1, 0, false, false, 0 };
+
+    if (fileSize < 10 || memcmp(bytes, "\x93NUMPY", 6) != 0)
+    {
+        handleFileFormatError(filename, "missing .npy magic string");
+    }
+
+    size_t headerLength;
+    size_t headerStart;
+    if (bytes[6] == 1)
+    {
+        headerLength = (size_t)bytes[8] | ((size_t)bytes[9] << 8);
+        headerStart = 10;
+    }
+    else if ((bytes[6] == 2 || bytes[6] == 3) && fileSize >= 12)
+    {
+        headerLength = (size_t)bytes[8] | ((size_t)bytes[9] << 8) | ((size_t)bytes[10] << 16) | ((size_t)bytes[11] << 24);
+        headerStart = 12;
+    }
+    else
+    {
+        handleFileFormatError(filename, "unsupported .npy version");
+        return layout;
+    }
+
+    if (headerLength > fileSize - headerStart)
+    {
+        handleFileFormatError(filename, "truncated .npy header");
+    }
+    layout.dataOffset = headerStart + headerLength;
+
+    // The header is a Python dictionary literal, copy it to get a terminated string
+    char* header = trackedMalloc(headerLength + 1);
+    handleMemoryError(header);
+    memcpy(header, &bytes[headerStart], headerLength);
+    header[headerLength] = '\0';
+
+    const char* descr = strstr(header, "'descr'");
+    const char* fortranOrder = strstr(header, "'fortran_order'");
+    const char* shape = strstr(header, "'shape'");
+    if (descr == NULL || fortranOrder == NULL || shape == NULL)
+    {
+        handleFileFormatError(filename, "incomplete .npy header");
+    }
+
+    // Element type, e.g. '<f8'
+    descr = strchr(descr + 7, '\'');
+    if (descr == NULL || (strncmp(descr + 2, "f8'", 3) != 0 && strncmp(descr + 2, "f4'", 3) != 0))
+    {
+        handleFileFormatError(filename, "only float32 and float64 arrays are supported");
+    }
+    char byteOrder = descr[1];
+    layout.elementSize = descr[3] == '8' ? 8 : 4;
+    if (byteOrder == '>') layout.bigEndian = true;
+    else if (byteOrder == '<') layout.bigEndian = false;
+    else if (byteOrder == '=') layout.bigEndian = !isLittleEndianHost();
+    else handleFileFormatError(filename, "unknown byte order");
+
+    // Storage order
+    fortranOrder = strchr(fortranOrder + 15, ':');
+    while (fortranOrder != NULL && (*fortranOrder == ':' || *fortranOrder == ' ')) fortranOrder++;
+    layout.fortranOrder = fortranOrder != NULL && strncmp(fortranOrder, "True", 4) == 0;
+
+    // Shape, e.g. (1000, 2) or (1000,)
+    shape = strchr(shape + 7, '(');
+    if (shape == NULL)
+    {
+        handleFileFormatError(filename, "invalid shape");
+    }
+    size_t shapeDimensions = 0;
+    size_t extents[2] = { 0, 1 };
+    const char* cursor = shape + 1;
+    while (true)
+    {
+        while (*cursor == ' ' || *cursor == ',') cursor++;
+        if (*cursor == ')') break;
+
+        char* end;
+        unsigned long long extent = strtoull(cursor, &end, 10);
+        if (end == cursor || shapeDimensions == 2)
+        {
+            handleFileFormatError(filename, "only one- and two-dimensional arrays are supported");
+        }
+        extents[shapeDimensions++] = (size_t)extent;
+        cursor = end;
+    }
+    if (shapeDimensions == 0 || extents[0] == 0 || extents[1] == 0)
+    {
+        handleFileFormatError(filename, "the array is empty");
+    }
+    layout.rows = extents[0];
+    layout.columns = extents[1];
+
+    trackedFree(header);
+
+    return layout;
+}
+
+/**
+ * @brief Creates a DataPoints structure over a mapped binary matrix.
+ *
+ * If the file holds a float64 matrix in host byte order and C order at an aligned offset,
+ * the data points refer to the mapped rows directly and the file is read by the page cache on demand.
+ * Otherwise the elements are converted once into an allocated matrix and the mapping is released.
+ * Either way the DataPoints structure owns the storage and is freed with freeDataPoints.
+ *
+ * @param view A pointer to the start of the mapped file.
+ * @param fileSize The size of the file in bytes.
+ * @param layout A pointer to the layout of the matrix in the file.
+ * @param filename The name of the file, for error messages.
+ * @return A DataPoints structure containing the data points of the matrix.
+ */
+DataPoints createMatrixDataPoints(void* view, size_t fileSize, const MatrixFileLayout* layout, const char* filename)
+{
+    size_t numElements = layout->rows * layout->columns;
+    if (numElements / layout->columns != layout->rows || numElements > (fileSize - layout->dataOffset) / layout->elementSize)
+    {
+        handleFileFormatError(filename, "the file is smaller than its shape");
+    }
+
+    unsigned char* payload = (unsigned char*)view + layout->dataOffset;
+    bool swapBytes = layout->bigEndian == isLittleEndianHost();
+
+    DataPoints dataPoints;
+    dataPoints.size = layout->rows;
+    dataPoints.points = trackedMalloc(layout->rows * sizeof(DataPoint));
+    handleMemoryError(dataPoints.points);
+
+    if (layout->elementSize == sizeof(double) && !swapBytes && !layout->fortranOrder && (uintptr_t)payload % sizeof(double) == 0)
+    {
+        dataPoints.matrix = (double*)payload;
+        dataPoints.mappedView = view;
+        dataPoints.mappedSize = fileSize;
+    }
+    else
+    {
+        dataPoints.matrix = trackedMalloc(numElements * sizeof(double));
+        handleMemoryError(dataPoints.matrix);
+        dataPoints.mappedView = NULL;
+        dataPoints.mappedSize = 0;
+
+        for (size_t row = 0; row < layout->rows; ++row)
+        {
+            for (size_t column = 0; column < layout->columns; ++column)
+            {
+                size_t index = layout->fortranOrder ? column * layout->rows + row : row * layout->columns + column;
+                dataPoints.matrix[row * layout->columns + column] = readMatrixElement(&payload[index * layout->elementSize], layout->elementSize, swapBytes);
+            }
+        }
+
+        unmapFile(view, fileSize);
+    }
+
+    for (size_t i = 0; i < dataPoints.size; ++i)
+    {
+        dataPoints.points[i].attributes = &dataPoints.matrix[i * layout->columns];
+        dataPoints.points[i].dimensions = layout->columns;
+        dataPoints.points[i].partition = SIZE_MAX;
+        dataPoints.points[i].weight = 1.0;
+    }
+
+    return dataPoints;
+}
+
+/**
+ * @brief Reads data points from a .npy file.
+ *
+ * @param filename The name of the file to read.
+ * @return A DataPoints structure containing the data points read from the file.
+ */
+DataPoints readNpyDataPoints(const char* filename)
+{
+    size_t fileSize;
+    void* view = mapFile(filename, &fileSize);
+    MatrixFileLayout layout = parseNpyHeader(view, fileSize, filename);
+
+    return createMatrixDataPoints(view, fileSize, &layout, filename);
+}
+
+/**
+ * @brief Reads data points from a raw binary file.
+ *
+ * The file holds the little-endian elements of a row-major matrix without a header,
+ * so the number of dimensions is given by the caller.
+ *
+ * @param filename The name of the file to read.
+ * @param dimensions The number of dimensions of the data points.
+ * @param elementSize The size of an element in bytes (4 = float32, 8 = float64).
+ * @return A DataPoints structure containing the data points read from the file.
+ */
+DataPoints readRawDataPoints(const char* filename, size_t dimensions, size_t elementSize)
+{
+    size_t fileSize;
+    void* view = mapFile(filename, &fileSize);
+
+    if (dimensions == 0 || fileSize % (dimensions * elementSize) != 0)
+    {
+        handleFileFormatError(filename, "the file size is not a multiple of the row size");
+    }
+
+    MatrixFileLayout layout = { fileSize / (dimensions * elementSize), dimensions, elementSize, false, false, 0 };
+
+    return createMatrixDataPoints(view, fileSize, &layout, filename);
+}
+
+/**
+ * @brief Detects the compression format of a file from its first bytes.
+ *
+ * @param filename The name of the file.
+ * @return The compression format (0 = none, 1 = gzip, 2 = zstd).
+ */
+size_t detectCompression(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        handleFileError(filename);
+    }
+
+    // For disabling the CS6387 warning,
+    // inform the static analyzer that 'file' is not NULL.
+    // Safe to use as we actually check for NULL earlier
+    _Analysis_assume_(file != NULL);
+
+    unsigned char magic[4] = { 0 };
+    size_t length = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+
+    if (length >= 2 && magic[0] == 0x1F && magic[1] == 0x8B) return 1;
+    if (length == 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD) return 2;
+
+    return 0;
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+/**
+ * @brief Initializes a ChunkQueue structure.
+ *
+ * @param queue A pointer to the ChunkQueue structure to be initialized.
+ * @param capacity The number of chunk slots.
+ */
+void initializeChunkQueue(ChunkQueue* queue, size_t capacity)
+{
+    queue->slots = trackedMalloc(capacity * STREAM_CHUNK_SIZE);
+    queue->lengths = trackedMalloc(capacity * sizeof(size_t));
+    handleMemoryError(queue->slots);
+    handleMemoryError(queue->lengths);
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->count = 0;
+    queue->finished = false;
+    queue->cancelled = false;
+    queue->failed = false;
+    queue->outOfMemory = false;
+    queue->errorMessage[0] = '\0';
+
+    if (mtx_init(&queue->lock, mtx_plain) != thrd_success || cnd_init(&queue->notEmpty) != thrd_success || cnd_init(&queue->notFull) != thrd_success)
+    {
+        raiseFatalError("Unable to initialize the chunk queue");
+    }
+}
+
+/**
+ * @brief Frees the memory allocated for a ChunkQueue structure.
+ *
+ * @param queue A pointer to the ChunkQueue structure to be freed. The producer must have stopped.
+ */
+void freeChunkQueue(ChunkQueue* queue)
+{
+    trackedFree(queue->slots);
+    trackedFree(queue->lengths);
+    queue->slots = NULL;
+    queue->lengths = NULL;
+    mtx_destroy(&queue->lock);
+    cnd_destroy(&queue->notEmpty);
+    cnd_destroy(&queue->notFull);
+}
+
+/**
+ * @brief Waits until the producer has a free slot.
+ *
+ * @param queue A pointer to the ChunkQueue structure.
+ * @return The number of free slots, or 0 if the consumer has cancelled the queue.
+ */
+size_t waitForFreeChunks(ChunkQueue* queue)
+{
+    mtx_lock(&queue->lock);
+    while (queue->count == queue->capacity && !queue->cancelled)
+    {
+        cnd_wait(&queue->notFull, &queue->lock);
+    }
+    size_t freeChunks = queue->cancelled ? 0 : queue->capacity - queue->count;
+    mtx_unlock(&queue->lock);
+
+    return freeChunks;
+}
+
+/**
+ * @brief Returns a free slot of the producer.
+ *
+ * @param queue A pointer to the ChunkQueue structure.
+ * @param index The index of the slot among the free slots, less than the count returned by waitForFreeChunks.
+ * @return A pointer to the STREAM_CHUNK_SIZE bytes of the slot.
+ */
+char* getFreeChunk(ChunkQueue* queue, size_t index)
+{
+    return &queue->slots[(queue->tail + index) % queue->capacity * STREAM_CHUNK_SIZE];
+}
+
+/**
+ * @brief Hands the first free slot to the consumer.
+ *
+ * @param queue A pointer to the ChunkQueue structure.
+ * @param length The number of bytes written to the slot.
+ */
+void commitChunk(ChunkQueue* queue, size_t length)
+{
+    mtx_lock(&queue->lock);
+    queue->lengths[queue->tail] = length;
+    queue->tail = (queue->tail + 1) % queue->capacity;
+    queue->count++;
+    cnd_signal(&queue->notEmpty);
+    mtx_unlock(&queue->lock);
+}
+
+/**
+ * @brief Marks the end of the chunks, with the error of the producer if it failed.
+ *
+ * @param queue A pointer to the ChunkQueue structure.
+ * @param errorMessage The message of the producer error, or NULL if the producer succeeded.
+ * @param outOfMemory True if the producer failed to allocate memory.
+ */
+void finishChunkQueue(ChunkQueue* queue, const char* errorMessage, bool outOfMemory)
+{
+    mtx_lock(&queue->lock);
+    if (errorMessage != NULL)
+    {
+        queue->failed = true;
+        queue->outOfMemory = outOfMemory;
+        snprintf(queue->errorMessage, sizeof(queue->errorMessage), "%s", errorMessage);
+    }
+    queue->finished = true;
+    cnd_signal(&queue->notEmpty);
+    mtx_unlock(&queue->lock);
+}
+
+/**
+ * @brief Stops the producer when the consumer will not read the remaining chunks.
+ *
+ * @param queue A pointer to the ChunkQueue structure.
+ */
+void cancelChunkQueue(ChunkQueue* queue)
+{
+    mtx_lock(&queue->lock);
+    queue->cancelled = true;
+    cnd_signal(&queue->notFull);
+    mtx_unlock(&queue->lock);
+}
+
+/**
+ * @brief Waits for the oldest committed chunk.
+ *
+ * The chunk stays in the queue until releaseChunk is called.
+ *
+ * @param queue A pointer to the ChunkQueue structure.
+ * @param length Receives the length of the chunk.
+ * @return The chunk, or NULL when the producer has finished and every chunk has been released.
+ */
+char* peekChunk(ChunkQueue* queue, size_t* length)
+{
+    mtx_lock(&queue->lock);
+    while (queue->count == 0 && !queue->finished)
+    {
+        cnd_wait(&queue->notEmpty, &queue->lock);
+    }
+
+    char* chunk = NULL;
+    if (queue->count > 0)
+    {
+        chunk = &queue->slots[queue->head * STREAM_CHUNK_SIZE];
+        *length = queue->lengths[queue->head];
+    }
+
+    mtx_unlock(&queue->lock);
+    return chunk;
+}
+
+/**
+ * @brief Returns the oldest committed chunk to the producer.
+ *
+ * @param queue A pointer to the ChunkQueue structure.
+ */
+void releaseChunk(ChunkQueue* queue)
+{
+    mtx_lock(&queue->lock);
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    cnd_signal(&queue->notFull);
+    mtx_unlock(&queue->lock);
+}
+#endif
+
+#ifdef HAVE_ZLIB
+/**
+ * @brief Decompresses a gzip file into the chunk queue.
+ *
+ * Concatenated gzip members are decompressed one after another.
+ *
+ * @param filename The name of the gzip file.
+ * @param queue A pointer to the ChunkQueue structure that receives the decompressed chunks.
+ */
+void decompressGzipFile(const char* filename, ChunkQueue* queue)
+{
+    gzFile file = gzopen(filename, "rb");
+    if (file == NULL)
+    {
+        handleFileError(filename);
+    }
+    gzbuffer(file, 256 * 1024);
+
+    while (waitForFreeChunks(queue) > 0)
+    {
+        int length = gzread(file, getFreeChunk(queue, 0), (unsigned int)STREAM_CHUNK_SIZE);
+        if (length < 0)
+        {
+            handleFileFormatError(filename, "corrupt gzip stream");
+        }
+        if (length == 0)
+        {
+            // gzread reports the end of a truncated file like the end of the data
+            int error;
+            gzerror(file, &error);
+            if (error == Z_BUF_ERROR)
+            {
+                handleFileFormatError(filename, "truncated gzip stream");
+            }
+            break;
+        }
+
+        commitChunk(queue, (size_t)length);
+    }
+
+    gzclose(file);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/**
+ * @brief Decompresses the frames of a zstd file in parallel.
+ *
+ * This function is used when the file has several frames and every frame records a decompressed size
+ * of at most STREAM_CHUNK_SIZE bytes. Each free slot of the queue receives one frame, the frames of a batch
+ * are decompressed in parallel and committed in frame order.
+ *
+ * @param filename The name of the zstd file.
+ * @param data A pointer to the mapped file.
+ * @param frameOffsets The offset of each frame.
+ * @param frameLengths The compressed size of each frame.
+ * @param frameSizes The decompressed size of each frame.
+ * @param numFrames The number of frames.
+ * @param queue A pointer to the ChunkQueue structure that receives the decompressed frames.
+ */
+void decompressZstdFramesParallel(const char* filename, const unsigned char* data, const size_t* frameOffsets, const size_t* frameLengths, const size_t* frameSizes, size_t numFrames, ChunkQueue* queue)
+{
+    size_t first = 0;
+    size_t freeChunks;
+    while (first < numFrames && (freeChunks = waitForFreeChunks(queue)) > 0)
+    {
+        size_t last = first + freeChunks < numFrames ? first + freeChunks : numFrames;
+        bool failed = false;
+
+        #pragma omp parallel for schedule(dynamic) reduction(||:failed)
+        for (long long f = (long long)first; f < (long long)last; ++f)
+        {
+            size_t result = ZSTD_decompress(getFreeChunk(queue, (size_t)f - first), frameSizes[f], &data[frameOffsets[f]], frameLengths[f]);
+            if (ZSTD_isError(result) || result != frameSizes[f]) failed = true;
+        }
+
+        if (failed)
+        {
+            handleFileFormatError(filename, "corrupt zstd frame");
+        }
+
+        for (size_t f = first; f < last; ++f)
+        {
+            commitChunk(queue, frameSizes[f]);
+        }
+        first = last;
+    }
+}
+
+/**
+ * @brief Decompresses a zstd file into the chunk queue.
+ *
+ * Files with several frames of known size, none larger than a chunk, are decompressed frame-parallel,
+ * every other file is decompressed as a single stream.
+ *
+ * @param filename The name of the zstd file.
+ * @param queue A pointer to the ChunkQueue structure that receives the decompressed chunks.
+ */
+void decompressZstdFile(const char* filename, ChunkQueue* queue)
+{
+    size_t fileSize;
+    const unsigned char* data = mapFile(filename, &fileSize);
+
+    // Find the frame boundaries and sizes, frames without content (skippable frames) are left out
+    size_t numFrames = 0;
+    size_t allocatedFrames = 16;
+    size_t* frameOffsets = trackedMalloc(allocatedFrames * sizeof(size_t));
+    size_t* frameLengths = trackedMalloc(allocatedFrames * sizeof(size_t));
+    size_t* frameSizes = trackedMalloc(allocatedFrames * sizeof(size_t));
+    handleMemoryError(frameOffsets);
+    handleMemoryError(frameLengths);
+    handleMemoryError(frameSizes);
+
+    bool framesFitChunks = true;
+    size_t offset = 0;
+    while (offset < fileSize && framesFitChunks)
+    {
+        size_t compressedSize = ZSTD_findFrameCompressedSize(&data[offset], fileSize - offset);
+        unsigned long long contentSize = ZSTD_getFrameContentSize(&data[offset], fileSize - offset);
+        if (ZSTD_isError(compressedSize))
+        {
+            handleFileFormatError(filename, "corrupt zstd frame");
+        }
+        if (contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR || contentSize > STREAM_CHUNK_SIZE)
+        {
+            framesFitChunks = false;
+            break;
+        }
+
+        if (contentSize > 0)
+        {
+            if (numFrames == allocatedFrames)
+            {
+                allocatedFrames *= 2;
+                size_t* tempOffsets = trackedRealloc(frameOffsets, allocatedFrames * sizeof(size_t));
+                handleMemoryError(tempOffsets);
+                frameOffsets = tempOffsets;
+                size_t* tempLengths = trackedRealloc(frameLengths, allocatedFrames * sizeof(size_t));
+                handleMemoryError(tempLengths);
+                frameLengths = tempLengths;
+                size_t* tempSizes = trackedRealloc(frameSizes, allocatedFrames * sizeof(size_t));
+                handleMemoryError(tempSizes);
+                frameSizes = tempSizes;
+            }
+            frameOffsets[numFrames] = offset;
+            frameLengths[numFrames] = compressedSize;
+            frameSizes[numFrames] = (size_t)contentSize;
+            numFrames++;
+        }
+        offset += compressedSize;
+    }
+
+    if (framesFitChunks && numFrames > 1)
+    {
+        decompressZstdFramesParallel(filename, data, frameOffsets, frameLengths, frameSizes, numFrames, queue);
+    }
+    else
+    {
+        ZSTD_DCtx* context = ZSTD_createDCtx();
+        handleMemoryError(context);
+
+        ZSTD_inBuffer input = { data, fileSize, 0 };
+        size_t result = 0;
+        bool done = false;
+        while (!done && waitForFreeChunks(queue) > 0)
+        {
+            ZSTD_outBuffer output = { getFreeChunk(queue, 0), STREAM_CHUNK_SIZE, 0 };
+            while (output.pos < output.size)
+            {
+                result = ZSTD_decompressStream(context, &output, &input);
+                if (ZSTD_isError(result))
+                {
+                    handleFileFormatError(filename, "corrupt zstd stream");
+                }
+
+                // With all input consumed and room left in the output, everything has been flushed
+                if (input.pos == input.size && output.pos < output.size)
+                {
+                    done = true;
+                    break;
+                }
+            }
+
+            if (output.pos > 0) commitChunk(queue, output.pos);
+        }
+
+        // A non-zero hint means the last frame is incomplete
+        if (done && result != 0)
+        {
+            handleFileFormatError(filename, "truncated zstd stream");
+        }
+
+        ZSTD_freeDCtx(context);
+    }
+
+    trackedFree(frameOffsets);
+    trackedFree(frameLengths);
+    trackedFree(frameSizes);
+    unmapFile((void*)data, fileSize);
+}
+#endif
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+/**
+ * @brief Runs the decompression of a file on its own thread.
+ *
+ * @param argument A pointer to the DecompressionJob structure.
+ * @return Always 0, errors are passed to the consumer through the queue.
+ */
+int runDecompressionThread(void* argument)
+{
+    DecompressionJob* job = argument;
+
+    // The decompressed chunks belong to the data being loaded
+    setMemorySubsystem(MEMORY_DATA);
+
+    // Errors end the decompression and are raised on the parser thread, where the caller can handle them
+    jmp_buf errorHandler;
+    fatalErrorHandler = &errorHandler;
+    if (setjmp(errorHandler) != 0)
+    {
+        fatalErrorHandler = NULL;
+        finishChunkQueue(job->queue, fatalErrorMessage, fatalErrorOutOfMemory);
+        return 0;
+    }
+
+#ifdef HAVE_ZLIB
+    if (job->compression == 1) decompressGzipFile(job->filename, job->queue);
+#endif
+#ifdef HAVE_ZSTD
+    if (job->compression == 2) decompressZstdFile(job->filename, job->queue);
+#endif
+
+    fatalErrorHandler = NULL;
+    finishChunkQueue(job->queue, NULL, false);
+    return 0;
+}
+#endif
+
+/**
+ * @brief Reads data points from a gzip or zstd compressed text file.
+ *
+ * The file is decompressed on a separate thread into the STREAM_QUEUE_LENGTH chunks of a ChunkQueue, which the text parser
+ * on the calling thread reads in order, so decompression and parsing run at the same time and no temporary file is needed.
+ * The data is completely loaded when the function returns. Decompression errors are raised on the calling thread,
+ * as is the error of a format that was not enabled at compile time (HAVE_ZLIB, HAVE_ZSTD).
+ *
+ * @param filename The name of the file to read.
+ * @param compression The compression format (1 = gzip, 2 = zstd).
+ * @return A DataPoints structure containing the data points read from the file.
+ */
+DataPoints readCompressedDataPoints(const char* filename, size_t compression)
+{
+#ifndef HAVE_ZLIB
+    if (compression == 1) handleFileFormatError(filename, "gzip support was not compiled in (HAVE_ZLIB)");
+#endif
+#ifndef HAVE_ZSTD
+    if (compression == 2) handleFileFormatError(filename, "zstd support was not compiled in (HAVE_ZSTD)");
+#endif
+
+    TextParser parser;
+    initializeTextParser(&parser);
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+    ChunkQueue queue;
+    initializeChunkQueue(&queue, STREAM_QUEUE_LENGTH);
+    DecompressionJob job = { filename, compression, &queue };
+
+    thrd_t thread;
+    if (thrd_create(&thread, runDecompressionThread, &job) != thrd_success)
+    {
+        raiseFatalError("Unable to start the decompression thread");
+    }
+
+    // A parser error must stop the decompression thread before the queue goes away
+    jmp_buf* previousHandler = fatalErrorHandler;
+    jmp_buf errorHandler;
+    fatalErrorHandler = &errorHandler;
+    if (setjmp(errorHandler) != 0)
+    {
+        fatalErrorHandler = previousHandler;
+        cancelChunkQueue(&queue);
+        thrd_join(thread, NULL);
+        freeChunkQueue(&queue);
+        resumeFatalError();
+    }
+
+    char* chunk;
+    size_t length;
+    while ((chunk = peekChunk(&queue, &length)) != NULL)
+    {
+        parseTextChunk(&parser, chunk, length);
+        releaseChunk(&queue);
+    }
+    fatalErrorHandler = previousHandler;
+
+    thrd_join(thread, NULL);
+    if (queue.failed)
+    {
+        // The decompression thread has printed the message
+        snprintf(fatalErrorMessage, sizeof(fatalErrorMessage), "%s", queue.errorMessage);
+        fatalErrorOutOfMemory = queue.outOfMemory;
+        freeChunkQueue(&queue);
+        resumeFatalError();
+    }
+    freeChunkQueue(&queue);
+#endif
+
+    return finishTextParser(&parser);
+}
+
+/**
+ * @brief Checks whether a file name ends with the given extension.
+ *
+ * @param filename The name of the file.
+ * @param extension The extension, including the dot.
+ * @return True if the file name ends with the extension.
+ */
+static bool hasFileExtension(const char* filename, const char* extension)
+{
+    const char* dot = strrchr(filename, '.');
+    return dot != NULL && strcmp(dot, extension) == 0;
+}
+
+/**
+ * @brief Reads data points from a file, selecting the format by the file extension.
+ *
+ * .npy files and raw .f64/.f32 files are memory-mapped, every other file is read as whitespace-separated text,
+ * which is decompressed on the fly if it is gzip or zstd compressed.
+ *
+ * @param filename The name of the file to read.
+ * @param rawDimensions The number of dimensions of raw .f64/.f32 files, which have no header (read from the ground truth file by main).
+ * @return A DataPoints structure containing the data points read from the file.
+ */
+DataPoints loadDataPoints(const char* filename, size_t rawDimensions)
+{
+    double traceStart = traceBegin();
+    size_t previousSubsystem = setMemorySubsystem(MEMORY_DATA);
+    DataPoints dataPoints;
+    size_t compression;
+
+    if (hasFileExtension(filename, ".npy")) dataPoints = readNpyDataPoints(filename);
+    else if (hasFileExtension(filename, ".f64")) dataPoints = readRawDataPoints(filename, rawDimensions, sizeof(double));
+    else if (hasFileExtension(filename, ".f32")) dataPoints = readRawDataPoints(filename, rawDimensions, sizeof(float));
+    else if ((compression = detectCompression(filename)) != 0) dataPoints = readCompressedDataPoints(filename, compression);
+    else dataPoints = readDataPoints(filename);
+
+    setMemorySubsystem(previousSubsystem);
+    traceEnd("load", traceStart);
+
+    return dataPoints;
+}
+
+/**
+ * @brief Writes centroids to a file.
+ *
+ * This function writes the centroids to the specified file. Each centroid's attributes
+ * are written on a new line, with attributes separated by spaces.
+ *
+ * @param filename The name of the file to write the centroids to.
+ * @param centroids A pointer to the Centroids structure containing the centroids to be written.
+ */
+void writeCentroidsToFile(const char* filename, const Centroids* centroids)
+{
+    double traceStart = traceBegin();
+
+    FILE* centroidFile = fopen(filename, "w");
+    if (centroidFile == NULL)
+    {
+        handleFileError(filename);
+        return;
+    }
+
+    for (size_t i = 0; i < centroids->size; ++i) // Loop through each centroid
+    {
+        for (size_t j = 0; j < centroids->points[i].dimensions; ++j) // Loop through each dimension of a centroid
+        {
+            fprintf(centroidFile, "%f ", centroids->points[i].attributes[j]);
+        }
+        fprintf(centroidFile, "\n"); // New line after each centroid's attributes
+    }
+
+    fclose(centroidFile);
+
+    traceEnd("write", traceStart);
+
+    //if (LOGGING >= 3) printf("Centroids written to file: %s\n", filename);
+}
+
+/**
+ * @brief Writes data point partitions to a file.
+ *
+ * This function writes the partition indices of data points to the specified file.
+ * Each partition index is written on a new line.
+ *
+ * @param filename The name of the file to write the partitions to.
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ */
+void writeDataPointPartitionsToFile(const char* filename, const DataPoints* dataPoints)
+{
+    double traceStart = traceBegin();
+
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        handleFileError(filename);
+        return;
+    }
+
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        fprintf(file, "%zu\n", dataPoints->points[i].partition);
+    }
+
+    fclose(file);
+
+    traceEnd("write", traceStart);
+
+    //if (LOGGING >= 3) printf("Data point partitions written to file: %s\n", filename);
+}
+
+/**
+ * @brief Creates a deep copy of a data point.
+ *
+ * This function copies the attributes and dimensions of the source data point
+ * to the destination data point. It allocates memory for the attributes of the
+ * destination data point and copies the attribute values from the source.
+ *
+ * @param destination A pointer to the destination DataPoint structure.
+ * @param source A pointer to the source DataPoint structure.
+ */
+void deepCopyDataPoint(DataPoint* destination, const DataPoint* source)
+{
+    //Debugging
+    /*if (destination == NULL || source == NULL)
+    {
+        raiseFatalError("Null pointer passed to deepCopyDataPoint");
+    }*/
+
+    destination->dimensions = source->dimensions;
+    destination->partition = source->partition;
+    destination->weight = source->weight;
+    
+    if (destination->attributes != NULL)
+    {
+        trackedFree(destination->attributes);
+    }
+
+    destination->attributes = trackedMalloc(source->dimensions * sizeof(double));
+    handleMemoryError(destination->attributes);
+    
+    // Suppress warning C6387 for this line
+	// The static analyzer is not able to detect that 'destination->attributes' is not NULL
+    #pragma warning(suppress : 6387)
+    memcpy(destination->attributes, source->attributes, source->dimensions * sizeof(double));
+}
+
+/**
+ * @brief Creates deep copies of an array of data points.
+ *
+ * This function copies the attributes and dimensions of each source data point
+ * to the corresponding destination data point. It allocates memory for the attributes
+ * of each destination data point and copies the attribute values from the source.
+ *
+ * @param destination A pointer to the array of destination DataPoint structures.
+ * @param source A pointer to the array of source DataPoint structures.
+ * @param size The number of data points in the source and destination arrays.
+ */
+void deepCopyDataPoints(DataPoint* destination, const DataPoint* source, size_t size)
+{
+    if (destination == NULL || source == NULL)
+    {
+        raiseFatalError("Null pointer passed to deepCopyDataPoints");
+    }
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        deepCopyDataPoint(&destination[i], &source[i]);
+    }
+}
+
+/**
+ * @brief Creates a deep copy of a Centroids structure.
+ *
+ * This function copies the centroids from the source Centroids structure
+ * to the destination Centroids structure. It allocates memory for the centroids
+ * in the destination structure and copies the attribute values from the source.
+ *
+ * @param source A pointer to the source Centroids structure.
+ * @param destination A pointer to the destination Centroids structure.
+ * @param numCentroids The number of centroids to copy.
+ */
+void deepCopyCentroids(const Centroids* source, Centroids* destination, size_t numCentroids)
+{
+    destination->size = source->size;
+
+    if (destination->points != NULL)
+    {
+        freeDataPointArray(destination->points, destination->size);
+    }
+
+	destination->points = allocateDataPoints(numCentroids, source->points[0].dimensions).points;
+
+    for (size_t i = 0; i < numCentroids; ++i)
+    {
+        deepCopyDataPoint(&destination->points[i], &source->points[i]);
+    }
+}
+
+/**
+ * @brief Prints all information about the centroids.
+ *
+ * This function prints the number of centroids and the attributes of each centroid.
+ * Each centroid's attributes are printed on a new line, with attributes separated by spaces.
+ *
+ * @param centroids A pointer to the Centroids structure containing the centroids to be printed.
+ */
+void printCentroidsInfo(const Centroids* centroids)
+{
+    printf("Number of centroids: %zu\n", centroids->size);
+
+    for (size_t i = 0; i < centroids->size; ++i)
+    {
+        DataPoint* centroid = &centroids->points[i];
+
+        printf("Centroid %zu (dimensions: %zu) attributes: ", i, centroid->dimensions);
+
+        for (size_t j = 0; j < centroid->dimensions; ++j)
+        {
+            printf("%f ", centroid->attributes[j]);
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Prints partition assignments for data points with partition >= cMax.
+ *
+ * This function prints the partition assignments for data points whose partition index
+ * is greater than or equal to the specified cMax value. It prints the data point index
+ * and its partition index.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param cMax The partition index threshold.
+ */
+void printDataPointsPartitions(const DataPoints* dataPoints, size_t cMax)
+{
+    printf("Data Points Partition Assignments (Partition <= %zu):\n", cMax);
+    printf("Data Points size: %zu\n", dataPoints->size);
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].partition >= cMax)
+        {
+            printf("Data Point %zu: Partition %zu\n", i, dataPoints->points[i].partition);
+        }
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Resets all partitions to 0.
+ *
+ * This function iterates through all data points in the DataPoints structure
+ * and sets their partition index to 0.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ */
+void resetPartitions(DataPoints* dataPoints)
+{    
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        dataPoints->points[i].partition = 0;
+    }
+}
+
+/**
+ * @brief Captures a snapshot of a clustering state.
+ *
+ * The centroids and the cached cluster statistics are copied. The partitions are split into chunks, and a chunk
+ * that is equal to the same chunk of the parent snapshot is shared with it instead of copied.
+ * Capturing also reseeds the random generator with the seed stored in the snapshot (see reseedFromRandomState),
+ * so the capturing run continues exactly like a run restored from the snapshot.
+ *
+ * @param dataPoints A pointer to the DataPoints structure holding the partitions.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param clusterMSEs The SSE of each cluster, or NULL if not cached.
+ * @param mseDrops The tentative SSE drop of each cluster, or NULL if not cached.
+ * @param parent A pointer to a snapshot of a related state over the same data points, or NULL.
+ * @return The ClusteringSnapshot structure, released with releaseClusteringSnapshot.
+ */
+ClusteringSnapshot captureClusteringSnapshot(const DataPoints* dataPoints, const Centroids* centroids, const double* clusterMSEs, const double* mseDrops, const ClusteringSnapshot* parent)
+{
+    ClusteringSnapshot snapshot;
+    snapshot.numPoints = dataPoints->size;
+    snapshot.numChunks = (dataPoints->size + SNAPSHOT_CHUNK_SIZE - 1) / SNAPSHOT_CHUNK_SIZE;
+    snapshot.chunks = trackedMalloc((snapshot.numChunks > 0 ? snapshot.numChunks : 1) * sizeof(PartitionChunk*));
+    handleMemoryError(snapshot.chunks);
+
+    if (parent != NULL && parent->numPoints != dataPoints->size) parent = NULL;
+
+    for (size_t chunk = 0; chunk < snapshot.numChunks; ++chunk)
+    {
+        size_t begin = chunk * SNAPSHOT_CHUNK_SIZE;
+        size_t end = begin + SNAPSHOT_CHUNK_SIZE < dataPoints->size ? begin + SNAPSHOT_CHUNK_SIZE : dataPoints->size;
+
+        if (parent != NULL)
+        {
+            PartitionChunk* parentChunk = parent->chunks[chunk];
+            bool unchanged = true;
+            for (size_t i = begin; i < end && unchanged; ++i)
+            {
+                unchanged = parentChunk->partitions[i - begin] == dataPoints->points[i].partition;
+            }
+
+            if (unchanged)
+            {
+                parentChunk->referenceCount++;
+                snapshot.chunks[chunk] = parentChunk;
+                continue;
+            }
+        }
+
+        PartitionChunk* newChunk = trackedMalloc(sizeof(PartitionChunk));
+        handleMemoryError(newChunk);
+        newChunk->partitions = trackedMalloc((end - begin) * sizeof(size_t));
+        handleMemoryError(newChunk->partitions);
+        for (size_t i = begin; i < end; ++i)
+        {
+            newChunk->partitions[i - begin] = dataPoints->points[i].partition;
+        }
+        newChunk->referenceCount = 1;
+        snapshot.chunks[chunk] = newChunk;
+    }
+
+    snapshot.centroids = allocateCentroids(centroids->size, centroids->points[0].dimensions);
+    deepCopyCentroids(centroids, &snapshot.centroids, centroids->size);
+
+    snapshot.clusterMSEs = NULL;
+    snapshot.mseDrops = NULL;
+    if (clusterMSEs != NULL)
+    {
+        snapshot.clusterMSEs = trackedMalloc(centroids->size * sizeof(double));
+        handleMemoryError(snapshot.clusterMSEs);
+        memcpy(snapshot.clusterMSEs, clusterMSEs, centroids->size * sizeof(double));
+    }
+    if (mseDrops != NULL)
+    {
+        snapshot.mseDrops = trackedMalloc(centroids->size * sizeof(double));
+        handleMemoryError(snapshot.mseDrops);
+        memcpy(snapshot.mseDrops, mseDrops, centroids->size * sizeof(double));
+    }
+
+    snapshot.randomSeed = reseedFromRandomState();
+
+    return snapshot;
+}
+
+/**
+ * @brief Restores a clustering state from a snapshot.
+ *
+ * The partitions are written to the data points, the centroids replace the given centroids,
+ * the cached statistics are copied to the given arrays, and the random generator is reseeded
+ * so that the run continues like the run that captured the snapshot. If the partitions the data points hold
+ * are those of another snapshot, the chunks it shares with the restored one are already in place and are skipped.
+ *
+ * @param snapshot A pointer to the ClusteringSnapshot structure.
+ * @param dataPoints A pointer to the DataPoints structure that receives the partitions.
+ * @param centroids A pointer to the Centroids structure that is replaced by the centroids of the snapshot.
+ * @param clusterMSEs An array that receives the cached SSEs, or NULL.
+ * @param mseDrops An array that receives the cached tentative SSE drops, or NULL.
+ * @param current A pointer to a snapshot of the partitions the data points hold, or NULL.
+ */
+void restoreClusteringSnapshot(const ClusteringSnapshot* snapshot, DataPoints* dataPoints, Centroids* centroids, double* clusterMSEs, double* mseDrops, const ClusteringSnapshot* current)
+{
+    if (current != NULL && current->numChunks != snapshot->numChunks) current = NULL;
+
+    #pragma omp parallel for schedule(static)
+    for (long long chunk = 0; chunk < (long long)snapshot->numChunks; ++chunk)
+    {
+        if (current != NULL && current->chunks[chunk] == snapshot->chunks[chunk]) continue;
+
+        size_t begin = (size_t)chunk * SNAPSHOT_CHUNK_SIZE;
+        size_t end = begin + SNAPSHOT_CHUNK_SIZE < snapshot->numPoints ? begin + SNAPSHOT_CHUNK_SIZE : snapshot->numPoints;
+        const size_t* partitions = snapshot->chunks[chunk]->partitions;
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            dataPoints->points[i].partition = partitions[i - begin];
+        }
+    }
+
+    freeCentroids(centroids);
+    *centroids = allocateCentroids(snapshot->centroids.size, snapshot->centroids.points[0].dimensions);
+    deepCopyCentroids(&snapshot->centroids, centroids, snapshot->centroids.size);
+
+    if (clusterMSEs != NULL && snapshot->clusterMSEs != NULL)
+    {
+        memcpy(clusterMSEs, snapshot->clusterMSEs, snapshot->centroids.size * sizeof(double));
+    }
+    if (mseDrops != NULL && snapshot->mseDrops != NULL)
+    {
+        memcpy(mseDrops, snapshot->mseDrops, snapshot->centroids.size * sizeof(double));
+    }
+
+    srand(snapshot->randomSeed);
+}
+
+/**
+ * @brief Counts the partition chunks two snapshots share.
+ *
+ * @param snapshot1 A pointer to the first ClusteringSnapshot structure.
+ * @param snapshot2 A pointer to the second ClusteringSnapshot structure.
+ * @return The number of chunks shared by the snapshots.
+ */
+size_t countSharedChunks(const ClusteringSnapshot* snapshot1, const ClusteringSnapshot* snapshot2)
+{
+    if (snapshot1->numChunks != snapshot2->numChunks) return 0;
+
+    size_t shared = 0;
+    for (size_t chunk = 0; chunk < snapshot1->numChunks; ++chunk)
+    {
+        if (snapshot1->chunks[chunk] == snapshot2->chunks[chunk]) shared++;
+    }
+
+    return shared;
+}
+
+/**
+ * @brief Releases a clustering snapshot.
+ *
+ * The chunks are freed when no other snapshot uses them.
+ *
+ * @param snapshot A pointer to the ClusteringSnapshot structure to be released.
+ */
+void releaseClusteringSnapshot(ClusteringSnapshot* snapshot)
+{
+    for (size_t chunk = 0; chunk < snapshot->numChunks; ++chunk)
+    {
+        PartitionChunk* partitionChunk = snapshot->chunks[chunk];
+        if (--partitionChunk->referenceCount == 0)
+        {
+            trackedFree(partitionChunk->partitions);
+            trackedFree(partitionChunk);
+        }
+    }
+
+    trackedFree(snapshot->chunks);
+    freeCentroids(&snapshot->centroids);
+    trackedFree(snapshot->clusterMSEs);
+    trackedFree(snapshot->mseDrops);
+    snapshot->chunks = NULL;
+    snapshot->clusterMSEs = NULL;
+    snapshot->mseDrops = NULL;
+    snapshot->numChunks = 0;
+    snapshot->numPoints = 0;
+}
+
+/**
+ * @brief Writes the peak memory and the number of allocations since the last reset.
+ *
+ * The peak of the total comes first, followed by the peak of each subsystem.
+ *
+ * @param file The file to write to (stdout for the console).
+ * @param prefix A string written at the start of the line.
+ */
+void writeMemoryUsage(FILE* file, const char* prefix)
+{
+    const double bytesPerMiB = 1024.0 * 1024.0;
+
+    fprintf(file, "%sPeak memory: %.2f MiB in %zu allocations (", prefix,
+        (double)atomic_load(&activeMemory.total.peak) / bytesPerMiB, (size_t)atomic_load(&activeMemory.total.count));
+    for (size_t s = 0; s < MEMORY_SUBSYSTEMS; ++s)
+    {
+        fprintf(file, "%s%s %.2f", s > 0 ? ", " : "", getMemorySubsystemName(s), (double)atomic_load(&activeMemory.subsystems[s].peak) / bytesPerMiB);
+    }
+    fprintf(file, " MiB)\n");
+}
+
+/**
+ * @brief Writes clustering results to a file.
+ *
+ * This function writes the clustering results, including average CI, MSE, relative CI,
+ * average time taken, peak memory and success rate, to the specified file. The results are appended
+ * to the file if it already exists.
+ *
+ * @param filename The name of the file to write the results to.
+ * @param ciSum The sum of Centroid Index (CI) values.
+ * @param mseSum The sum of Mean Squared Error (MSE) values.
+ * @param timeSum The sum of time taken for each loop.
+ * @param successRate The success rate of the clustering algorithm.
+ * @param numCentroids The number of centroids used in the clustering algorithm.
+ * @param header A header string to be written at the beginning of the results.
+ * @param loopCount The number of loops performed.
+ * @param scaling A scaling factor for the MSE values.
+ * @param outputDirectory The directory where the results file is located.
+ */
+void writeResultsToFile(const char* filename, Statistics stats, size_t numCentroids, const char* header, size_t loopCount, size_t scaling, const char* outputDirectory)
+{
+    double traceStart = traceBegin();
+
+    char outputFilePath[256];
+    snprintf(outputFilePath, sizeof(outputFilePath), "%s/%s", outputDirectory, filename);
+
+    FILE* file = fopen(outputFilePath, "a"); // "a" = appends
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Cannot open file %s for writing\n", filename);
+        return;
+    }
+
+    fprintf(file, "%s\n", header);
+    if (loopCount == 0)
+    {
+        fprintf(file, "No completed trials\n\n");
+        fclose(file);
+        return;
+    }
+    fprintf(file, "Average CI: %.2f and MSE: %.2f\n", (double)stats.ciSum / loopCount, stats.mseSum / loopCount / scaling);
+    fprintf(file, "Relative CI: %.2f\n", (double)stats.ciSum / loopCount / numCentroids);
+    fprintf(file, "Average time taken: %.2f seconds\n", stats.timeSum / loopCount);
+    writeMemoryUsage(file, "");
+    fprintf(file, "Success rate: %.2f%%\n\n", stats.successRate / loopCount * 100);
+
+    fclose(file);
+
+    traceEnd("write", traceStart);
+    
+    //if(LOGGING >= 3) printf("Metrics written to file: %s\n", filename);
+}
+
+/**
+ * @brief Creates a unique directory based on the current date and time.
+ *
+ * This function generates a unique directory name based on the current date and time
+ * and attempts to create the directory. The directory name is stored in the provided
+ * outputDirectory buffer.
+ *
+ * @param outputDirectory A buffer to store the generated directory name.
+ * @param size The size of the outputDirectory buffer.
+ */
+void createUniqueDirectory(char* outputDirectory, size_t size)
+{
+    time_t now = time(NULL);
+    struct tm* t = localtime(&now);
+
+    if (strftime(outputDirectory, size, "outputs/%Y-%m-%d_%H-%M-%S", t) == 0)
+    {
+        fprintf(stderr, "Error: Buffer size is too small in createUniqueDirectory\n");
+        return; //TODO: Exit_failure mieluummin nihin?
+    }
+
+    if (_mkdir(outputDirectory) != 0)
+    {
+        perror("Error: Unable to create directory");
+    }
+}
+
+/**
+ * @brief Gets the name of the split type based on the provided split type index.
+ *
+ * This function returns the name of the split type corresponding to the provided split type index.
+ * If the split type index is invalid, it prints an error message to stderr and returns NULL.
+ *
+ * @param splitType The index of the split type.
+ * @return The name of the split type, or NULL if the split type index is invalid.
+ */
+const char* getSplitTypeName(size_t splitType)
+{
+    switch (splitType)
+    {
+    case 0:
+        return "Intra-cluster";
+    case 1:
+        return "Global";
+    case 2:
+        return "Local repartition";
+    default:
+        fprintf(stderr, "Error: Invalid split type provided\n");
+        return NULL;
+    }
+}
+
+/**
+ * @brief Prints the statistics of a clustering algorithm.
+ *
+ * This function prints the average Centroid Index (CI), Mean Squared Error (MSE),
+ * relative CI, average time taken, peak memory and success rate of a clustering algorithm.
+ *
+ * @param algorithmName The name of the clustering algorithm.
+ * @param stats A Statistics structure containing the results to be printed.
+ * @param loopCount The number of loops performed.
+ * @param numCentroids The number of centroids used in the clustering algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ */
+void printStatistics(const char* algorithmName, Statistics stats, size_t loopCount, size_t numCentroids, size_t scaling)
+{
+    // Stopped by SIGINT before the first trial
+    if (loopCount == 0)
+    {
+        printf("(%s) No completed trials\n\n", algorithmName);
+        return;
+    }
+
+    printf("(%s) Average CI: %.2f and MSE: %.2f\n", algorithmName, (double)stats.ciSum / loopCount, stats.mseSum / loopCount / scaling);
+    printf("(%s) Relative CI: %.2f\n", algorithmName, (double)stats.ciSum / loopCount / numCentroids);
+    printf("(%s) Average time taken: %.2f seconds\n", algorithmName, stats.timeSum / loopCount);
+
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "(%s) ", algorithmName);
+    writeMemoryUsage(stdout, prefix);
+
+    printf("(%s) Success rate: %.2f%%\n\n", algorithmName, stats.successRate / loopCount * 100);
+}
+
+/**
+ * @brief Handles SIGINT and DUMP_SIGNAL by setting the request flags of activeSignals.
+ *
+ * The first SIGINT requests a stop at the next trial boundary and restores the default handler,
+ * so a second SIGINT terminates the process as usual.
+ *
+ * @param signalNumber The number of the signal.
+ */
+static void handleSignal(int signalNumber)
+{
+    if (signalNumber == SIGINT)
+    {
+        activeSignals.stopRequested = 1;
+        signal(SIGINT, SIG_DFL);
+    }
+    else
+    {
+        activeSignals.dumpRequested = 1;
+        signal(signalNumber, handleSignal); // Windows resets the handler before calling it
+    }
+}
+
+/**
+ * @brief Installs the handlers of SIGINT (graceful stop) and DUMP_SIGNAL (state dump).
+ *
+ * DUMP_SIGNAL is SIGUSR1 (kill -USR1 <pid>), on Windows SIGBREAK (Ctrl+Break).
+ *
+ * @param outputDirectory The directory the dumps are written to, kept until the end of the run.
+ */
+void installSignalHandlers(const char* outputDirectory)
+{
+    activeSignals.stopRequested = 0;
+    activeSignals.dumpRequested = 0;
+    activeSignals.outputDirectory = outputDirectory;
+
+    if (signal(SIGINT, handleSignal) == SIG_ERR || signal(DUMP_SIGNAL, handleSignal) == SIG_ERR)
+    {
+        fprintf(stderr, "Error: Unable to install the signal handlers\n");
+    }
+}
+
+/**
+ * @brief Checks whether a graceful stop was requested with SIGINT.
+ *
+ * @return True if the runners should stop at the next trial boundary, false otherwise.
+ */
+bool stopRequested(void)
+{
+    return activeSignals.stopRequested != 0;
+}
+
+/**
+ * @brief Writes the nearest centroid of each data point to a file.
+ *
+ * The partitions of the data points may belong to a rejected swap or a tentative split,
+ * so the dump assigns the data points to the dumped centroids instead.
+ *
+ * @param filename The name of the file to write the partitions to.
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ */
+static void writeNearestPartitionsToFile(const char* filename, const DataPoints* dataPoints, const Centroids* centroids)
+{
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        handleFileError(filename);
+        return;
+    }
+
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        size_t nearest = 0;
+        double minDistance = DBL_MAX;
+        for (size_t c = 0; c < centroids->size; ++c)
+        {
+            double distance = calculateMetricDistance(&dataPoints->points[i], &centroids->points[c]);
+            if (distance < minDistance)
+            {
+                minDistance = distance;
+                nearest = c;
+            }
+        }
+        fprintf(file, "%zu\n", nearest);
+    }
+
+    fclose(file);
+}
+
+/**
+ * @brief Serves a pending DUMP_SIGNAL request at a safe point.
+ *
+ * The centroids (the best solution of the running algorithm) and their partitions are written to
+ * signalDump<N>_centroids.txt and signalDump<N>_partitions.txt in the output directory given to installSignalHandlers,
+ * and the statistics of the completed trials of the current runner are printed. Without a pending request it only tests a flag.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points, or NULL at a trial boundary.
+ * @param centroids A pointer to the Centroids structure containing the best centroids, or NULL at a trial boundary.
+ */
+void serviceSignalRequests(const DataPoints* dataPoints, const Centroids* centroids)
+{
+    if (!activeSignals.dumpRequested) return;
+    activeSignals.dumpRequested = 0;
+
+    size_t dump = ++activeSignals.dumpCount;
+    printf("Signal dump %zu\n", dump);
+
+    if (dataPoints != NULL && centroids != NULL && centroids->size > 0)
+    {
+        const char* directory = activeSignals.outputDirectory != NULL ? activeSignals.outputDirectory : ".";
+        char filename[320];
+        snprintf(filename, sizeof(filename), "%s/signalDump%zu_centroids.txt", directory, dump);
+        writeCentroidsToFile(filename, centroids);
+        snprintf(filename, sizeof(filename), "%s/signalDump%zu_partitions.txt", directory, dump);
+        writeNearestPartitionsToFile(filename, dataPoints, centroids);
+        printf("(Signal dump %zu) %zu centroids and the partitions of %zu data points written to %s/signalDump%zu_*.txt\n", dump, centroids->size, dataPoints->size, directory, dump);
+    }
+
+    if (activeSignals.algorithmName != NULL)
+    {
+        printf("(Signal dump %zu) Statistics of %zu completed trials:\n", dump, activeSignals.completedTrials);
+        printStatistics(activeSignals.algorithmName, activeSignals.stats, activeSignals.completedTrials, activeSignals.numCentroids, activeSignals.scaling);
+    }
+
+    fflush(stdout);
+}
+
+/**
+ * @brief Marks the boundary between two trials of a runner: serves a pending dump and checks for a requested stop.
+ *
+ * The statistics of the completed trials are kept for the dumps of the next trial.
+ * After a stop the runner reports the completed trials, so loopCount is set to their number.
+ *
+ * @param algorithmName The name of the runner, or NULL if it keeps no single statistics.
+ * @param stats A pointer to the Statistics structure of the completed trials, or NULL.
+ * @param completedTrials The number of completed trials.
+ * @param numCentroids The number of clusters.
+ * @param scaling A scaling factor for the MSE values.
+ * @param loopCount A pointer to the number of trials of the runner.
+ * @return True if the runner should stop, false otherwise.
+ */
+bool checkTrialBoundary(const char* algorithmName, const Statistics* stats, size_t completedTrials, size_t numCentroids, size_t scaling, size_t* loopCount)
+{
+    activeSignals.algorithmName = stats != NULL ? algorithmName : NULL;
+    if (stats != NULL) activeSignals.stats = *stats;
+    activeSignals.completedTrials = completedTrials;
+    activeSignals.numCentroids = numCentroids;
+    activeSignals.scaling = scaling;
+
+    serviceSignalRequests(NULL, NULL);
+
+    if (!stopRequested()) return false;
+
+    if (completedTrials > 0)
+    {
+        printf("Stopped by SIGINT after %zu of %zu trials\n", completedTrials, *loopCount);
+    }
+    *loopCount = completedTrials;
+
+    return true;
+}
+
+
+/////////////////
+// Clustering //
+///////////////
+
+/**
+ * @brief Generates random centroids from the data points.
+ *
+ * This function selects random data points to be used as initial centroids for clustering.
+ *
+ * @param numCentroids The number of centroids to generate.
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure to store the generated centroids.
+ */
+void generateRandomCentroids(size_t numCentroids, const DataPoints* dataPoints, Centroids* centroids)
+{    
+    //DEBUGGING
+    /*if (dataPoints->size < numCentroids)
+    {
+        raiseFatalError("There are less data points than the required number of clusters");
+    }*/
+
+    double traceStart = traceBegin();
+
+    size_t* indices = trackedMalloc(sizeof(size_t) * dataPoints->size);
+    handleMemoryError(indices);
+
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        indices[i] = i;
+    }
+
+    for (size_t i = 0; i < numCentroids; ++i)
+    {
+        size_t j = i + rand() % (dataPoints->size - i);
+        size_t temp = indices[i];
+        indices[i] = indices[j];
+        indices[j] = temp;
+    }
+
+    for (size_t i = 0; i < numCentroids; ++i)
+    {
+        size_t selectedIndex = indices[i];
+        deepCopyDataPoint(&centroids->points[i], &dataPoints->points[selectedIndex]);
+    }
+
+    trackedFree(indices);
+
+    traceEnd("seed", traceStart);
+}
+
+/**
+ * @brief Calculates the sum of squared errors (SSE) for the given data points and centroids.
+ *
+ * This function computes the SSE by summing the distances of the active metric (the Euclidean distance by default)
+ * between each data point and its assigned centroid, each multiplied by the weight of the data point.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @return The sum of squared errors (SSE).
+ */
+double calculateSSE(const DataPoints* dataPoints, const Centroids* centroids)
+{
+    // Partial sums per chunk, combined in chunk order below
+    size_t numChunks = getReductionChunkCount(dataPoints->size, 1);
+    size_t chunkSize = (dataPoints->size + numChunks - 1) / numChunks;
+    size_t previousSubsystem = setMemorySubsystem(MEMORY_REDUCTIONS);
+    double* chunkSums = trackedCalloc(numChunks, sizeof(double));
+    handleMemoryError(chunkSums);
+    setMemorySubsystem(previousSubsystem);
+
+    #pragma omp parallel
+    {
+        double traceStart = traceBegin();
+
+        #pragma omp for schedule(static) nowait
+        for (long long chunk = 0; chunk < (long long)numChunks; ++chunk)
+        {
+            size_t begin = (size_t)chunk * chunkSize;
+            size_t end = begin + chunkSize < dataPoints->size ? begin + chunkSize : dataPoints->size;
+            double sum = 0.0;
+            double compensation = 0.0;
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                size_t cIndex = dataPoints->points[i].partition;
+
+                //Debugging
+                /*if (cIndex >= centroids->size)
+                {
+                    raiseFatalError("Invalid partition index %zu for data point %zu", cIndex, i);
+                }*/
+
+                addCompensated(&sum, &compensation, dataPoints->points[i].weight * calculateMetricDistance(&dataPoints->points[i], &centroids->points[cIndex]));
+            }
+
+            chunkSums[chunk] = sum;
+        }
+
+        traceEnd("calculateSSE (thread)", traceStart);
+    }
+
+    double sse = 0.0;
+    double compensation = 0.0;
+    for (size_t chunk = 0; chunk < numChunks; ++chunk)
+    {
+        addCompensated(&sse, &compensation, chunkSums[chunk]);
+    }
+
+    trackedFree(chunkSums);
+
+    return sse;
+}
+
+/**
+ * @brief Calculates the mean squared error (MSE) for the given data points and centroids.
+ *
+ * This function computes the MSE by dividing the sum of squared errors (SSE) by the total number
+ * of data points and dimensions.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @return The mean squared error (MSE).
+ */
+double calculateMSE(const DataPoints* dataPoints, const Centroids* centroids)
+{
+    double sse = calculateSSE(dataPoints, centroids);
+
+    double mse = sse / (dataPoints->size * dataPoints->points[0].dimensions);
+
+    return mse;
+}
+
+/**
+ * @brief Calculates the mean squared error (MSE) for the given data points and centroids.
+ *
+ * This function computes the MSE by dividing the sum of squared errors (SSE) by the total number
+ * of data points and dimensions.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param size The size of the whole data set.
+ * @return The mean squared error (MSE).
+ */
+double calculateMSEWithSize(const DataPoints* dataPoints, const Centroids* centroids, size_t size)
+{
+    double sse = calculateSSE(dataPoints, centroids);
+
+    double mse = sse / (size * dataPoints->points[0].dimensions);
+
+    return mse;
+}
+
+//TODO: ky description lpi, ett vastaa sit mit lasketaan (count vai size)
+/**
+ * @brief Calculates the mean squared error (MSE) for a specific cluster.
+ *
+ * This function computes the MSE for a specific cluster by summing the Euclidean distances
+ * between data points and their assigned centroid, and then dividing by the number of data points
+ * in the cluster and the number of dimensions.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param clusterLabel The label of the cluster for which to calculate the MSE.
+ * @return The mean squared error (MSE) for the specified cluster.
+ */
+double calculateClusterMSE(const DataPoints* dataPoints, const Centroids* centroids, size_t clusterLabel)
+{
+    double sse = 0.0;
+    double compensation = 0.0;
+    size_t count = 0;
+
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].partition == clusterLabel)
+        {
+            addCompensated(&sse, &compensation, dataPoints->points[i].weight * calculateMetricDistance(&dataPoints->points[i], &centroids->points[clusterLabel]));
+            count++;
+        }
+    }
+
+    //Debugger
+    /*if (count == 0)
+    {
+        return 0.0;
+    }*/
+
+	//TODO: count vai dataPoints->size? Eli datapisteiden mr clusterissa vai koko datasetiss?
+    double mse = sse;// (dataPoints->size * dimensions);
+    return mse;
+}
+
+/**
+ * @brief Finds the nearest centroid to a given data point.
+ *
+ * This function calculates the distance of the active metric between the query point and each centroid,
+ * and returns the index of the nearest centroid. The metric is dispatched once per call to a loop
+ * specialized for that metric, like in partitionStep.
+ *
+ * @param queryPoint A pointer to the DataPoint structure representing the query point.
+ * @param targetCentroids A pointer to the Centroids structure containing the centroids.
+ * @return The index of the nearest centroid.
+ */
+size_t findNearestCentroid(const DataPoint* queryPoint, const Centroids* targetCentroids)
+{
+    // Debugging    
+    /*if (targetPoints->size == 0)
+    {
+        raiseFatalError("Cannot find nearest centroid in an empty set of data");
+    }*/
+
+    size_t nearestCentroidId = SIZE_MAX;
+    double minDistance = DBL_MAX;
+	double newDistance = DBL_MAX;
+    const double* attributes = queryPoint->attributes;
+    size_t dimensions = queryPoint->dimensions;
+
+    switch (activeMetric.type)
+    {
+    case 1:
+        for (size_t i = 0; i < targetCentroids->size; ++i)
+        {
+            newDistance = 1.0 - dotProductKernel(attributes, targetCentroids->points[i].attributes, dimensions);
+            if (newDistance < minDistance)
+            {
+                minDistance = newDistance;
+                nearestCentroidId = i;
+            }
+        }
+        break;
+    case 2:
+        for (size_t i = 0; i < targetCentroids->size; ++i)
+        {
+            newDistance = manhattanKernel(attributes, targetCentroids->points[i].attributes, dimensions);
+            if (newDistance < minDistance)
+            {
+                minDistance = newDistance;
+                nearestCentroidId = i;
+            }
+        }
+        break;
+    case 3:
+        for (size_t i = 0; i < targetCentroids->size; ++i)
+        {
+            newDistance = weightedSquaredKernel(attributes, targetCentroids->points[i].attributes, activeMetric.weights, dimensions);
+            if (newDistance < minDistance)
+            {
+                minDistance = newDistance;
+                nearestCentroidId = i;
+            }
+        }
+        break;
+    default:
+        for (size_t i = 0; i < targetCentroids->size; ++i)
+        {
+            newDistance = squaredEuclideanKernel(attributes, targetCentroids->points[i].attributes, dimensions);
+            if (newDistance < minDistance)
+            {
+                minDistance = newDistance;
+                nearestCentroidId = i;
+            }
+        }
+        break;
+    }
+
+    return nearestCentroidId;
+}
+
+/**
+ * @brief Assigns each data point to the nearest centroid by squared Euclidean distance.
+ *
+ * The engine, the number of threads and the block size come from activeAssignment. The blocked engine
+ * copies the centroids to a contiguous matrix and compares a block of data points with one cache-sized
+ * tile of centroids at a time. Both engines visit the centroids in index order and keep the first of equal
+ * distances, so every configuration gives the same partitions.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ */
+static void partitionStepSquaredEuclidean(DataPoints* dataPoints, const Centroids* centroids)
+{
+    size_t dimensions = dataPoints->points[0].dimensions;
+    size_t numCentroids = centroids->size;
+    int numThreads = activeAssignment.threads > 0 ? activeAssignment.threads : getMaxThreads();
+    size_t blockSize = activeAssignment.chunkSize > 0 ? activeAssignment.chunkSize : (dataPoints->size + numThreads - 1) / numThreads;
+    if (blockSize == 0) blockSize = 1;
+    size_t numBlocks = (dataPoints->size + blockSize - 1) / blockSize;
+
+    double* centroidMatrix = NULL;
+    size_t tileSize = numCentroids;
+    if (activeAssignment.engine == 1)
+    {
+        centroidMatrix = trackedMalloc(numCentroids * dimensions * sizeof(double));
+        handleMemoryError(centroidMatrix);
+        for (size_t c = 0; c < numCentroids; ++c)
+        {
+            memcpy(&centroidMatrix[c * dimensions], centroids->points[c].attributes, dimensions * sizeof(double));
+        }
+
+        tileSize = ASSIGNMENT_TILE_BYTES / (dimensions * sizeof(double));
+        if (tileSize == 0) tileSize = 1;
+    }
+
+    // Every point is assigned independently, so the result does not depend on the number of threads
+    #pragma omp parallel num_threads(numThreads)
+    {
+        double traceStart = traceBegin();
+        double* minDistances = NULL;
+        if (centroidMatrix != NULL)
+        {
+            minDistances = trackedMalloc(blockSize * sizeof(double));
+            handleMemoryError(minDistances);
+        }
+
+        #pragma omp for schedule(dynamic) nowait
+        for (long long block = 0; block < (long long)numBlocks; ++block)
+        {
+            size_t begin = (size_t)block * blockSize;
+            size_t end = begin + blockSize < dataPoints->size ? begin + blockSize : dataPoints->size;
+
+            if (centroidMatrix == NULL)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const double* attributes = dataPoints->points[i].attributes;
+                    size_t nearestCentroidId = SIZE_MAX;
+                    double minDistance = DBL_MAX;
+
+                    for (size_t c = 0; c < numCentroids; ++c)
+                    {
+                        double newDistance = squaredEuclideanKernel(attributes, centroids->points[c].attributes, dimensions);
+                        if (newDistance < minDistance)
+                        {
+                            minDistance = newDistance;
+                            nearestCentroidId = c;
+                        }
+                    }
+
+                    dataPoints->points[i].partition = nearestCentroidId;
+                }
+                continue;
+            }
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                minDistances[i - begin] = DBL_MAX;
+                dataPoints->points[i].partition = SIZE_MAX;
+            }
+
+            for (size_t tileBegin = 0; tileBegin < numCentroids; tileBegin += tileSize)
+            {
+                size_t tileEnd = tileBegin + tileSize < numCentroids ? tileBegin + tileSize : numCentroids;
+
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const double* attributes = dataPoints->points[i].attributes;
+                    double minDistance = minDistances[i - begin];
+                    size_t nearestCentroidId = dataPoints->points[i].partition;
+
+                    for (size_t c = tileBegin; c < tileEnd; ++c)
+                    {
+                        double newDistance = squaredEuclideanKernel(attributes, &centroidMatrix[c * dimensions], dimensions);
+                        if (newDistance < minDistance)
+                        {
+                            minDistance = newDistance;
+                            nearestCentroidId = c;
+                        }
+                    }
+
+                    minDistances[i - begin] = minDistance;
+                    dataPoints->points[i].partition = nearestCentroidId;
+                }
+            }
+        }
+
+        trackedFree(minDistances);
+        traceEnd("partitionStep (thread)", traceStart);
+    }
+
+    trackedFree(centroidMatrix);
+}
+
+/**
+ * @brief Assigns each data point to the centroid with the largest cosine similarity.
+ *
+ * Both the data points and the centroids are unit length, so the largest dot product is the nearest centroid.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ */
+static void partitionStepCosine(DataPoints* dataPoints, const Centroids* centroids)
+{
+    size_t dimensions = dataPoints->points[0].dimensions;
+
+    #pragma omp parallel
+    {
+        double traceStart = traceBegin();
+
+        #pragma omp for schedule(static) nowait
+        for (long long i = 0; i < (long long)dataPoints->size; ++i)
+        {
+            const double* attributes = dataPoints->points[i].attributes;
+            size_t nearestCentroidId = SIZE_MAX;
+            double maxSimilarity = -DBL_MAX;
+
+            for (size_t c = 0; c < centroids->size; ++c)
+            {
+                double similarity = dotProductKernel(attributes, centroids->points[c].attributes, dimensions);
+                if (similarity > maxSimilarity)
+                {
+                    maxSimilarity = similarity;
+                    nearestCentroidId = c;
+                }
+            }
+
+            dataPoints->points[i].partition = nearestCentroidId;
+        }
+
+        traceEnd("partitionStep (thread)", traceStart);
+    }
+}
+
+/**
+ * @brief Assigns each data point to the nearest centroid by Manhattan distance.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ */
+static void partitionStepManhattan(DataPoints* dataPoints, const Centroids* centroids)
+{
+    size_t dimensions = dataPoints->points[0].dimensions;
+
+    #pragma omp parallel
+    {
+        double traceStart = traceBegin();
+
+        #pragma omp for schedule(static) nowait
+        for (long long i = 0; i < (long long)dataPoints->size; ++i)
+        {
+            const double* attributes = dataPoints->points[i].attributes;
+            size_t nearestCentroidId = SIZE_MAX;
+            double minDistance = DBL_MAX;
+
+            for (size_t c = 0; c < centroids->size; ++c)
+            {
+                double newDistance = manhattanKernel(attributes, centroids->points[c].attributes, dimensions);
+                if (newDistance < minDistance)
+                {
+                    minDistance = newDistance;
+                    nearestCentroidId = c;
+                }
+            }
+
+            dataPoints->points[i].partition = nearestCentroidId;
+        }
+
+        traceEnd("partitionStep (thread)", traceStart);
+    }
+}
+
+/**
+ * @brief Assigns each data point to the nearest centroid by diagonal Mahalanobis distance.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ */
+static void partitionStepMahalanobis(DataPoints* dataPoints, const Centroids* centroids)
+{
+    size_t dimensions = dataPoints->points[0].dimensions;
+    const double* weights = activeMetric.weights;
+
+    #pragma omp parallel
+    {
+        double traceStart = traceBegin();
+
+        #pragma omp for schedule(static) nowait
+        for (long long i = 0; i < (long long)dataPoints->size; ++i)
+        {
+            const double* attributes = dataPoints->points[i].attributes;
+            size_t nearestCentroidId = SIZE_MAX;
+            double minDistance = DBL_MAX;
+
+            for (size_t c = 0; c < centroids->size; ++c)
+            {
+                double newDistance = weightedSquaredKernel(attributes, centroids->points[c].attributes, weights, dimensions);
+                if (newDistance < minDistance)
+                {
+                    minDistance = newDistance;
+                    nearestCentroidId = c;
+                }
+            }
+
+            dataPoints->points[i].partition = nearestCentroidId;
+        }
+
+        traceEnd("partitionStep (thread)", traceStart);
+    }
+}
+
+/**
+ * @brief Assigns each data point to the nearest centroid.
+ *
+ * This function iterates through all data points and assigns each one to the nearest centroid
+ * based on the active distance metric. The metric is dispatched once per call to a loop specialized
+ * for that metric, so there is no per-distance dispatch.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ */
+void partitionStep(DataPoints* dataPoints, const Centroids* centroids)
+{
+    //DEBUGGING    
+    /*if (dataPoints->size == 0 || centroids->size == 0)
+    {
+        raiseFatalError("Cannot perform optimal partition with empty data or centroids");
+    }*/
+
+    double traceStart = traceBegin();
+
+    switch (activeMetric.type)
+    {
+    case 1:
+        partitionStepCosine(dataPoints, centroids);
+        break;
+    case 2:
+        partitionStepManhattan(dataPoints, centroids);
+        break;
+    case 3:
+        partitionStepMahalanobis(dataPoints, centroids);
+        break;
+    default:
+        partitionStepSquaredEuclidean(dataPoints, centroids);
+        break;
+    }
+
+    traceEnd("partitionStep", traceStart);
+}
+
+/**
+ * @brief Gets the name of an assignment engine.
+ *
+ * @param engine The engine (0 = direct, 1 = blocked).
+ * @return The name of the engine.
+ */
+const char* getAssignmentEngineName(size_t engine)
+{
+    return engine == 1 ? "blocked" : "direct";
+}
+
+/**
+ * @brief Measures the speed of the assignment step with the given configuration.
+ *
+ * The assignment is repeated until AUTOTUNE_MIN_SECONDS have passed, after one untimed warm-up pass.
+ *
+ * @param sample A pointer to the DataPoints structure of the calibration sample.
+ * @param centroids A pointer to the Centroids structure of the calibration centroids.
+ * @param config The configuration to measure.
+ * @return The number of data points assigned per second.
+ */
+static double measureAssignmentSpeed(DataPoints* sample, const Centroids* centroids, AssignmentConfig config)
+{
+    AssignmentConfig previous = activeAssignment;
+    activeAssignment = config;
+
+    partitionStepSquaredEuclidean(sample, centroids);
+
+    size_t passes = 0;
+    double start = getMonotonicSeconds();
+    double elapsed = 0.0;
+    while (elapsed < AUTOTUNE_MIN_SECONDS)
+    {
+        partitionStepSquaredEuclidean(sample, centroids);
+        passes++;
+        elapsed = getMonotonicSeconds() - start;
+    }
+
+    activeAssignment = previous;
+
+    return (double)(passes * sample->size) / elapsed;
+}
+
+/**
+ * @brief Looks up the assignment configuration of a machine and data shape in the profile file.
+ *
+ * @param profileFile The path of the profile file.
+ * @param key The key of the machine and data shape.
+ * @param config A pointer where the configuration is stored if it is found.
+ * @return True if the profile file has a configuration for the key.
+ */
+static bool readAssignmentProfile(const char* profileFile, const char* key, AssignmentConfig* config)
+{
+    FILE* file = fopen(profileFile, "r");
+    if (file == NULL) return false;
+
+    bool found = false;
+    char line[512];
+    while (!found && fgets(line, sizeof(line), file) != NULL)
+    {
+        if (line[0] == '#' || strncmp(line, key, strlen(key)) != 0 || line[strlen(key)] != ' ') continue;
+
+        size_t engine;
+        int threads;
+        size_t chunkSize;
+        if (sscanf(&line[strlen(key)], "%zu %d %zu", &engine, &threads, &chunkSize) == 3 && engine <= 1 && threads >= 0)
+        {
+            config->engine = engine;
+            config->threads = threads;
+            config->chunkSize = chunkSize;
+            found = true;
+        }
+    }
+
+    fclose(file);
+    return found;
+}
+
+/**
+ * @brief Chooses the fastest assignment configuration for the data and the machine.
+ *
+ * The profile file AUTOTUNE_PROFILE_FILE in the output directory is consulted first. Its entries are keyed by the machine name,
+ * the maximum number of threads, the number of data points (rounded down to a power of two),
+ * the dimensions and the number of clusters. Without an entry, every combination of engine, thread count
+ * (powers of two up to the maximum) and block size is timed on an evenly spaced sample of at most
+ * AUTOTUNE_SAMPLE_SIZE data points with centroids at evenly spaced sample points. On a larger data set the
+ * AUTOTUNE_FINALISTS fastest configurations are timed again on all data points, as the block sizes and thread counts
+ * that win on a sample that fits in the cache need not win on the full data. The fastest one is appended to the profile.
+ * The sample is taken without the random number generator, so autotuning does not change the results of the
+ * algorithms, and no configuration changes the partitions. The partitions of the data points are overwritten.
+ * The tuned thread count is set for all parallel loops, not only for the assignment.
+ * Only the Euclidean metric has tunable engines, the other metrics are left as they are.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param numCentroids The number of clusters the algorithms will look for.
+ * @param outputDirectory The directory of the profile file.
+ */
+void autotuneAssignment(DataPoints* dataPoints, size_t numCentroids, const char* outputDirectory)
+{
+    if (activeMetric.type != 0 || dataPoints->size == 0 || numCentroids == 0)
+    {
+        printf("Autotuning: only the Euclidean assignment is tuned\n");
+        return;
+    }
+
+    size_t dimensions = dataPoints->points[0].dimensions;
+    int maxThreads = getMaxThreads();
+
+    size_t sizeClass = 1;
+    while (sizeClass <= dataPoints->size / 2)
+    {
+        sizeClass *= 2;
+    }
+
+    char machine[128];
+    getMachineName(machine, sizeof(machine));
+    char key[256];
+    snprintf(key, sizeof(key), "%s %d %zu %zu %zu", machine, maxThreads, sizeClass, dimensions, numCentroids);
+    char profileFile[300];
+    snprintf(profileFile, sizeof(profileFile), "%s/%s", outputDirectory, AUTOTUNE_PROFILE_FILE);
+
+    AssignmentConfig best = { 0, 0, 0 };
+    if (readAssignmentProfile(profileFile, key, &best))
+    {
+        activeAssignment = best;
+        if (best.threads > 0) setThreadCount(best.threads);
+        printf("Autotuning: %s engine, %d threads, block size %zu (from %s)\n", getAssignmentEngineName(best.engine), best.threads, best.chunkSize, profileFile);
+        return;
+    }
+
+    // Views of evenly spaced data points, they have partitions of their own
+    size_t sampleSize = dataPoints->size < AUTOTUNE_SAMPLE_SIZE ? dataPoints->size : AUTOTUNE_SAMPLE_SIZE;
+    DataPoints sample;
+    sample.size = sampleSize;
+    sample.matrix = NULL;
+    sample.mappedView = NULL;
+    sample.mappedSize = 0;
+    sample.points = trackedMalloc(sampleSize * sizeof(DataPoint));
+    handleMemoryError(sample.points);
+    for (size_t i = 0; i < sampleSize; ++i)
+    {
+        sample.points[i] = dataPoints->points[i * dataPoints->size / sampleSize];
+    }
+
+    Centroids centroids = allocateCentroids(numCentroids, dimensions);
+    for (size_t c = 0; c < numCentroids; ++c)
+    {
+        memcpy(centroids.points[c].attributes, sample.points[c * sampleSize / numCentroids].attributes, dimensions * sizeof(double));
+    }
+
+    const size_t chunkSizes[] = { 0, 256, 1024, 4096 };
+    size_t numChunkSizes = sizeof(chunkSizes) / sizeof(chunkSizes[0]);
+    double bestSpeed = 0.0;
+    size_t numConfigs = 0;
+
+    // The fastest configurations on the sample, fastest first
+    AssignmentConfig finalists[AUTOTUNE_FINALISTS];
+    double finalistSpeeds[AUTOTUNE_FINALISTS];
+    size_t numFinalists = 0;
+
+    for (size_t engine = 0; engine <= 1; ++engine)
+    {
+        for (int threads = 1; ; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads)
+        {
+            for (size_t s = 0; s < numChunkSizes; ++s)
+            {
+                AssignmentConfig config = { engine, threads, chunkSizes[s] };
+                double speed = measureAssignmentSpeed(&sample, &centroids, config);
+                numConfigs++;
+
+                size_t position = numFinalists < AUTOTUNE_FINALISTS ? numFinalists++ : AUTOTUNE_FINALISTS;
+                while (position > 0 && speed > finalistSpeeds[position - 1])
+                {
+                    if (position < AUTOTUNE_FINALISTS)
+                    {
+                        finalists[position] = finalists[position - 1];
+                        finalistSpeeds[position] = finalistSpeeds[position - 1];
+                    }
+                    position--;
+                }
+                if (position < AUTOTUNE_FINALISTS)
+                {
+                    finalists[position] = config;
+                    finalistSpeeds[position] = speed;
+                }
+            }
+            if (threads == maxThreads) break;
+        }
+    }
+
+    freeDataPointViews(&sample);
+
+    best = finalists[0];
+    bestSpeed = finalistSpeeds[0];
+    if (sampleSize < dataPoints->size)
+    {
+        bestSpeed = 0.0;
+        for (size_t f = 0; f < numFinalists; ++f)
+        {
+            double speed = measureAssignmentSpeed(dataPoints, &centroids, finalists[f]);
+            if (speed > bestSpeed)
+            {
+                bestSpeed = speed;
+                best = finalists[f];
+            }
+        }
+    }
+
+    freeCentroids(&centroids);
+
+    activeAssignment = best;
+    setThreadCount(best.threads);
+    printf("Autotuning: %s engine, %d threads, block size %zu (fastest of %zu configurations, %.0f points per second)\n",
+        getAssignmentEngineName(best.engine), best.threads, best.chunkSize, numConfigs, bestSpeed);
+
+    FILE* file = fopen(profileFile, "a");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Cannot open file %s for writing\n", profileFile);
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0)
+    {
+        fprintf(file, "# machine maxThreads sizeClass dimensions clusters engine threads blockSize pointsPerSecond\n");
+    }
+    fprintf(file, "%s %zu %d %zu %.0f\n", key, best.engine, best.threads, best.chunkSize, bestSpeed);
+    fclose(file);
+}
+
+/**
+ * @brief Offers a centroid to the two nearest centroids found so far.
+ *
+ * @param distance The distance of the centroid.
+ * @param id The index of the centroid.
+ * @param firstDistance The smallest distance so far, updated by this function.
+ * @param firstId The index of the nearest centroid so far, updated by this function.
+ * @param secondDistance The second smallest distance so far, updated by this function.
+ * @param secondId The index of the second-nearest centroid so far, updated by this function.
+ */
+static inline void offerToTwoNearest(double distance, size_t id, double* firstDistance, size_t* firstId, double* secondDistance, size_t* secondId)
+{
+    if (distance < *firstDistance)
+    {
+        *secondDistance = *firstDistance;
+        *secondId = *firstId;
+        *firstDistance = distance;
+        *firstId = id;
+    }
+    else if (distance < *secondDistance)
+    {
+        *secondDistance = distance;
+        *secondId = id;
+    }
+}
+
+/**
+ * @brief Finds the nearest and the second-nearest centroid to a given data point.
+ *
+ * This function calculates the assignment distance of the active metric between the query point and each centroid,
+ * in a loop specialized for the metric, and keeps track of the two smallest distances. Ties are resolved in favour
+ * of the lower index, so the nearest centroid is always the same one partitionStep would choose.
+ * The two distances are returned as calculateMetricDistance gives them.
+ *
+ * @param queryPoint A pointer to the DataPoint structure representing the query point.
+ * @param targetCentroids A pointer to the Centroids structure containing the centroids.
+ * @param secondNearestId A pointer where the index of the second-nearest centroid is stored (SIZE_MAX if there is only one centroid).
+ * @param nearestDistance A pointer where the distance to the nearest centroid is stored.
+ * @param secondDistance A pointer where the distance to the second-nearest centroid is stored (DBL_MAX if there is only one centroid).
+ * @return The index of the nearest centroid.
+ */
+size_t findTwoNearestCentroids(const DataPoint* queryPoint, const Centroids* targetCentroids, size_t* secondNearestId, double* nearestDistance, double* secondDistance)
+{
+    size_t firstId = SIZE_MAX;
+    size_t secondId = SIZE_MAX;
+    double firstDistance = DBL_MAX;
+    double secondBest = DBL_MAX;
+    const double* attributes = queryPoint->attributes;
+    size_t dimensions = queryPoint->dimensions;
+
+    switch (activeMetric.type)
+    {
+    case 1:
+        for (size_t i = 0; i < targetCentroids->size; ++i)
+        {
+            offerToTwoNearest(1.0 - dotProductKernel(attributes, targetCentroids->points[i].attributes, dimensions), i, &firstDistance, &firstId, &secondBest, &secondId);
+        }
+        break;
+    case 2:
+        for (size_t i = 0; i < targetCentroids->size; ++i)
+        {
+            offerToTwoNearest(manhattanKernel(attributes, targetCentroids->points[i].attributes, dimensions), i, &firstDistance, &firstId, &secondBest, &secondId);
+        }
+        break;
+    case 3:
+        for (size_t i = 0; i < targetCentroids->size; ++i)
+        {
+            offerToTwoNearest(weightedSquaredKernel(attributes, targetCentroids->points[i].attributes, activeMetric.weights, dimensions), i, &firstDistance, &firstId, &secondBest, &secondId);
+        }
+        break;
+    default:
+        for (size_t i = 0; i < targetCentroids->size; ++i)
+        {
+            offerToTwoNearest(squaredEuclideanKernel(attributes, targetCentroids->points[i].attributes, dimensions), i, &firstDistance, &firstId, &secondBest, &secondId);
+        }
+        break;
+    }
+
+    *secondNearestId = secondId;
+    *nearestDistance = assignmentToMetricDistance(firstDistance);
+    *secondDistance = secondId == SIZE_MAX ? DBL_MAX : assignmentToMetricDistance(secondBest);
+
+    return firstId;
+}
+
+/**
+ * @brief Assigns each data point to the nearest centroid and records the second-nearest centroid.
+ *
+ * This function performs the same assignment as partitionStep, but also fills the cache with the
+ * nearest and second-nearest centroid of every data point and the distances to them,
+ * groups the data points by cluster with a counting sort and records the radius of every cluster.
+ * The cost is the same K distance evaluations per point as in partitionStep.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param cache A pointer to the NearestCentroidCache structure to be filled, allocated for dataPoints->size points.
+ */
+void partitionStepWithSecondNearest(DataPoints* dataPoints, const Centroids* centroids, NearestCentroidCache* cache)
+{
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        size_t nearestCentroidId = findTwoNearestCentroids(&dataPoints->points[i], centroids, &cache->secondNearest[i], &cache->nearestDistance[i], &cache->secondDistance[i]);
+        cache->nearest[i] = nearestCentroidId;
+        dataPoints->points[i].partition = nearestCentroidId;
+    }
+
+    if (cache->numClusters != centroids->size)
+    {
+        trackedFree(cache->memberOffsets);
+        trackedFree(cache->radii);
+        cache->memberOffsets = trackedMalloc((centroids->size + 1) * sizeof(size_t));
+        cache->radii = trackedMalloc(centroids->size * sizeof(double));
+        handleMemoryError(cache->memberOffsets);
+        handleMemoryError(cache->radii);
+        cache->numClusters = centroids->size;
+    }
+
+    for (size_t c = 0; c < cache->numClusters; ++c)
+    {
+        cache->radii[c] = 0.0;
+    }
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (cache->nearestDistance[i] > cache->radii[cache->nearest[i]]) cache->radii[cache->nearest[i]] = cache->nearestDistance[i];
+    }
+
+    // Counting sort: the offsets first hold the counts, then the start of the next free slot of each cluster
+    memset(cache->memberOffsets, 0, (cache->numClusters + 1) * sizeof(size_t));
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        cache->memberOffsets[cache->nearest[i] + 1]++;
+    }
+    for (size_t c = 0; c < cache->numClusters; ++c)
+    {
+        cache->memberOffsets[c + 1] += cache->memberOffsets[c];
+    }
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        cache->members[cache->memberOffsets[cache->nearest[i]]++] = i;
+    }
+    for (size_t c = cache->numClusters; c > 0; --c)
+    {
+        cache->memberOffsets[c] = cache->memberOffsets[c - 1];
+    }
+    cache->memberOffsets[0] = 0;
+}
+
+/**
+ * @brief Calculates the SSE increase caused by removing a centroid.
+ *
+ * This function sums, over the data points whose nearest centroid is the removed one, the difference
+ * between the distance to the second-nearest centroid and the distance to the nearest centroid.
+ * No distances are evaluated, the result comes from the cache and the weights of the data points.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param cache A pointer to the NearestCentroidCache structure matching the current centroids.
+ * @param clusterLabel The label of the centroid to remove.
+ * @return The increase of the SSE if the centroid is removed and its points move to their second-nearest centroid.
+ */
+double calculateRemovalCost(const DataPoints* dataPoints, const NearestCentroidCache* cache, size_t clusterLabel)
+{
+    double cost = 0.0;
+
+    for (size_t m = cache->memberOffsets[clusterLabel]; m < cache->memberOffsets[clusterLabel + 1]; ++m)
+    {
+        size_t i = cache->members[m];
+        cost += dataPoints->points[i].weight * (cache->secondDistance[i] - cache->nearestDistance[i]);
+    }
+
+    return cost;
+}
+
+/**
+ * @brief Calculates the SSE decrease gained by splitting a cluster with an additional centroid.
+ *
+ * This function evaluates, for the data points of the given cluster only, whether the new location is closer
+ * than their current distance, and sums the decrease of the distances. Distances are evaluated
+ * only for the points of the cluster, the other points are read from the cache, in a loop specialized for the active metric.
+ * The current distances are cache->nearestDistance, or cache->secondDistance for the members of a removed centroid.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param cache A pointer to the NearestCentroidCache structure matching the current centroids.
+ * @param clusterLabel The label of the cluster to split.
+ * @param newLocation A pointer to the DataPoint structure representing the location of the additional centroid.
+ * @param currentDistance The current distance of every data point, indexed like the data points.
+ * @return The decrease of the SSE within the cluster if a centroid is added at the new location.
+ */
+double calculateSplitGain(const DataPoints* dataPoints, const NearestCentroidCache* cache, size_t clusterLabel, const DataPoint* newLocation, const double* currentDistance)
+{
+    double gain = 0.0;
+    size_t begin = cache->memberOffsets[clusterLabel];
+    size_t end = cache->memberOffsets[clusterLabel + 1];
+    const double* location = newLocation->attributes;
+    size_t dimensions = newLocation->dimensions;
+
+    switch (activeMetric.type)
+    {
+    case 1:
+        for (size_t m = begin; m < end; ++m)
+        {
+            size_t i = cache->members[m];
+            double newDistance = 1.0 - dotProductKernel(dataPoints->points[i].attributes, location, dimensions);
+            if (newDistance < currentDistance[i]) gain += dataPoints->points[i].weight * (currentDistance[i] - newDistance);
+        }
+        break;
+    case 2:
+        for (size_t m = begin; m < end; ++m)
+        {
+            size_t i = cache->members[m];
+            double newDistance = manhattanKernel(dataPoints->points[i].attributes, location, dimensions);
+            if (newDistance < currentDistance[i]) gain += dataPoints->points[i].weight * (currentDistance[i] - newDistance);
+        }
+        break;
+    case 3:
+        for (size_t m = begin; m < end; ++m)
+        {
+            size_t i = cache->members[m];
+            double newDistance = sqrt(weightedSquaredKernel(dataPoints->points[i].attributes, location, activeMetric.weights, dimensions));
+            if (newDistance < currentDistance[i]) gain += dataPoints->points[i].weight * (currentDistance[i] - newDistance);
+        }
+        break;
+    default:
+        for (size_t m = begin; m < end; ++m)
+        {
+            size_t i = cache->members[m];
+            double newDistance = sqrt(squaredEuclideanKernel(dataPoints->points[i].attributes, location, dimensions));
+            if (newDistance < currentDistance[i]) gain += dataPoints->points[i].weight * (currentDistance[i] - newDistance);
+        }
+        break;
+    }
+
+    return gain;
+}
+
+/**
+ * @brief Calculates the distance of the active metric from data points to a centroid.
+ *
+ * The metric is dispatched once per call to a loop specialized for that metric. Only the data points
+ * of the given cluster are visited, or every data point with its own centroid when clusterLabel is SIZE_MAX.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param clusterLabel The cluster whose data points are visited, or SIZE_MAX for all data points.
+ * @param location A pointer to the DataPoint structure the distances are measured to, or NULL for the centroid of each data point.
+ * @param distances An array of dataPoints->size elements that receives the distances of the visited data points.
+ */
+static void calculateDistancesToCentroid(const DataPoints* dataPoints, const Centroids* centroids, size_t clusterLabel, const DataPoint* location, double* distances)
+{
+    size_t dimensions = dataPoints->points[0].dimensions;
+
+    switch (activeMetric.type)
+    {
+    case 1:
+        for (size_t i = 0; i < dataPoints->size; ++i)
+        {
+            const DataPoint* point = &dataPoints->points[i];
+            if (clusterLabel != SIZE_MAX && point->partition != clusterLabel) continue;
+            const double* target = location != NULL ? location->attributes : centroids->points[point->partition].attributes;
+            distances[i] = 1.0 - dotProductKernel(point->attributes, target, dimensions);
+        }
+        break;
+    case 2:
+        for (size_t i = 0; i < dataPoints->size; ++i)
+        {
+            const DataPoint* point = &dataPoints->points[i];
+            if (clusterLabel != SIZE_MAX && point->partition != clusterLabel) continue;
+            const double* target = location != NULL ? location->attributes : centroids->points[point->partition].attributes;
+            distances[i] = manhattanKernel(point->attributes, target, dimensions);
+        }
+        break;
+    case 3:
+        for (size_t i = 0; i < dataPoints->size; ++i)
+        {
+            const DataPoint* point = &dataPoints->points[i];
+            if (clusterLabel != SIZE_MAX && point->partition != clusterLabel) continue;
+            const double* target = location != NULL ? location->attributes : centroids->points[point->partition].attributes;
+            distances[i] = sqrt(weightedSquaredKernel(point->attributes, target, activeMetric.weights, dimensions));
+        }
+        break;
+    default:
+        for (size_t i = 0; i < dataPoints->size; ++i)
+        {
+            const DataPoint* point = &dataPoints->points[i];
+            if (clusterLabel != SIZE_MAX && point->partition != clusterLabel) continue;
+            const double* target = location != NULL ? location->attributes : centroids->points[point->partition].attributes;
+            distances[i] = sqrt(squaredEuclideanKernel(point->attributes, target, dimensions));
+        }
+        break;
+    }
+}
+
+/**
+ * @brief Moves an empty cluster's centroid to the data point farthest from its own centroid.
+ *
+ * This function searches the data point with the largest distance (active metric) to its centroid,
+ * skipping clusters with a single point so that no other cluster becomes empty,
+ * and moves the empty cluster's centroid there. The data point is assigned to the reseeded cluster.
+ *
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param counts An array containing the number of data points in each cluster, updated by this function.
+ * @param emptyCluster The index of the empty cluster.
+ */
+void reseedEmptyClusterAtFarthestPoint(Centroids* centroids, DataPoints* dataPoints, size_t* counts, size_t emptyCluster)
+{
+    size_t farthestId = SIZE_MAX;
+    double maxDistance = -1.0;
+
+    double* distances = trackedMalloc(dataPoints->size * sizeof(double));
+    handleMemoryError(distances);
+    calculateDistancesToCentroid(dataPoints, centroids, SIZE_MAX, NULL, distances);
+
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        size_t clusterLabel = dataPoints->points[i].partition;
+        if (counts[clusterLabel] < 2) continue;
+
+        if (distances[i] > maxDistance)
+        {
+            maxDistance = distances[i];
+            farthestId = i;
+        }
+    }
+
+    trackedFree(distances);
+
+    // Every cluster has at most one point, nothing to take from
+    if (farthestId == SIZE_MAX) return;
+
+    DataPoint* farthest = &dataPoints->points[farthestId];
+    memcpy(centroids->points[emptyCluster].attributes, farthest->attributes, farthest->dimensions * sizeof(double));
+    counts[farthest->partition]--;
+    farthest->partition = emptyCluster;
+    counts[emptyCluster] = 1;
+}
+
+/**
+ * @brief Uses an empty cluster's centroid to split the cluster with the largest SSE.
+ *
+ * This function finds the cluster with the largest SSE (at least two points), moves the empty cluster's centroid
+ * to the member farthest from that cluster's centroid, divides the members between the two centroids
+ * by distance, and updates both centroids to the weighted means of their new members. The SSE and the distances
+ * use the active metric, and for the cosine metric the means are normalized to unit length; for the Manhattan metric
+ * the next centroid step replaces the means with medians.
+ *
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param counts An array containing the number of data points in each cluster, updated by this function.
+ * @param emptyCluster The index of the empty cluster.
+ */
+void splitLargestClusterIntoEmpty(Centroids* centroids, DataPoints* dataPoints, size_t* counts, size_t emptyCluster)
+{
+    size_t numClusters = centroids->size;
+    size_t dimensions = dataPoints->points[0].dimensions;
+
+    double* clusterSse = trackedCalloc(numClusters, sizeof(double));
+    double* distances = trackedMalloc(dataPoints->size * sizeof(double));
+    handleMemoryError(clusterSse);
+    handleMemoryError(distances);
+    calculateDistancesToCentroid(dataPoints, centroids, SIZE_MAX, NULL, distances);
+
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        clusterSse[dataPoints->points[i].partition] += dataPoints->points[i].weight * distances[i];
+    }
+
+    size_t largest = SIZE_MAX;
+    double maxSse = -1.0;
+    for (size_t clusterLabel = 0; clusterLabel < numClusters; ++clusterLabel)
+    {
+        if (counts[clusterLabel] >= 2 && clusterSse[clusterLabel] > maxSse)
+        {
+            maxSse = clusterSse[clusterLabel];
+            largest = clusterLabel;
+        }
+    }
+
+    trackedFree(clusterSse);
+
+    if (largest == SIZE_MAX)
+    {
+        trackedFree(distances);
+        return;
+    }
+
+    // The farthest member becomes the second centroid
+    size_t farthestId = SIZE_MAX;
+    double maxDistance = -1.0;
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].partition != largest) continue;
+
+        if (distances[i] > maxDistance)
+        {
+            maxDistance = distances[i];
+            farthestId = i;
+        }
+    }
+
+    DataPoint* oldCentroid = &centroids->points[largest];
+    DataPoint* newCentroid = &centroids->points[emptyCluster];
+    memcpy(newCentroid->attributes, dataPoints->points[farthestId].attributes, dimensions * sizeof(double));
+
+    // The distances to the old centroid are kept, those to the new one are calculated for the members only
+    double* newDistances = trackedMalloc(dataPoints->size * sizeof(double));
+    handleMemoryError(newDistances);
+    calculateDistancesToCentroid(dataPoints, centroids, largest, newCentroid, newDistances);
+
+    // Divide the members between the two centroids and calculate their weighted means
+    double* sums = trackedCalloc(2 * dimensions, sizeof(double));
+    handleMemoryError(sums);
+    double sideWeights[2] = { 0.0, 0.0 };
+    counts[largest] = 0;
+    counts[emptyCluster] = 0;
+
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        DataPoint* point = &dataPoints->points[i];
+        if (point->partition != largest) continue;
+
+        size_t side = newDistances[i] < distances[i] ? 1 : 0;
+        point->partition = side == 1 ? emptyCluster : largest;
+        counts[point->partition]++;
+        sideWeights[side] += point->weight;
+
+        for (size_t dim = 0; dim < dimensions; ++dim)
+        {
+            sums[side * dimensions + dim] += point->weight * point->attributes[dim];
+        }
+    }
+
+    DataPoint* sides[2] = { oldCentroid, newCentroid };
+    for (size_t side = 0; side < 2; ++side)
+    {
+        if (sideWeights[side] <= 0.0) continue;
+
+        double* attributes = sides[side]->attributes;
+        for (size_t dim = 0; dim < dimensions; ++dim)
+        {
+            attributes[dim] = sums[side * dimensions + dim] / sideWeights[side];
+        }
+
+        // Spherical k-means: the centroids of the cosine metric are unit length
+        if (activeMetric.type == 1)
+        {
+            double norm = sqrt(dotProductKernel(attributes, attributes, dimensions));
+            if (norm > 0.0)
+            {
+                for (size_t dim = 0; dim < dimensions; ++dim)
+                {
+                    attributes[dim] /= norm;
+                }
+            }
+        }
+    }
+
+    trackedFree(sums);
+    trackedFree(newDistances);
+    trackedFree(distances);
+}
+
+/**
+ * @brief Removes an empty cluster.
+ *
+ * This function moves the last centroid into the slot of the empty cluster, relabels the data points
+ * of the last cluster, and decreases the number of centroids by one. The only remaining cluster is never removed.
+ *
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param counts An array containing the number of data points in each cluster, updated by this function.
+ * @param emptyCluster The index of the empty cluster.
+ */
+void dropEmptyCluster(Centroids* centroids, DataPoints* dataPoints, size_t* counts, size_t emptyCluster)
+{
+    if (centroids->size < 2) return;
+
+    size_t last = centroids->size - 1;
+
+    if (emptyCluster != last)
+    {
+        memcpy(centroids->points[emptyCluster].attributes, centroids->points[last].attributes, centroids->points[last].dimensions * sizeof(double));
+
+        for (size_t i = 0; i < dataPoints->size; ++i)
+        {
+            if (dataPoints->points[i].partition == last)
+            {
+                dataPoints->points[i].partition = emptyCluster;
+            }
+        }
+
+        counts[emptyCluster] = counts[last];
+    }
+
+    freeDataPoint(&centroids->points[last]);
+    centroids->size--;
+}
+
+/**
+ * @brief Selects how the centroid step handles empty clusters.
+ *
+ * @param strategy 0 = keep the centroid, 1 = reseed at the farthest data point, 2 = split the cluster
+ * with the largest SSE, 3 = drop the cluster. Other values select 1.
+ */
+void setEmptyClusterStrategy(size_t strategy)
+{
+    activeEmptyClusterStrategy = strategy <= 3 ? strategy : 1;
+}
+
+/**
+ * @brief Checks that the empty cluster strategy keeps the number of clusters.
+ *
+ * The drop strategy decreases the number of clusters during k-means, which only K-means itself supports.
+ * The other algorithms keep K centroids between their k-means runs (swap backups, repeats, batched models),
+ * build structures for K clusters (grid, groups, graph) or grow the number of clusters to K (splits),
+ * so they refuse to run with it.
+ *
+ * @param algorithmName The name of the algorithm, used in the error message.
+ * @return true if the algorithm can run, false (with an error printed) under the drop strategy.
+ */
+bool requireFixedClusterCount(const char* algorithmName)
+{
+    if (activeEmptyClusterStrategy != 3) return true;
+
+    fprintf(stderr, "Error: %s needs a fixed number of clusters, the drop strategy for empty clusters only works with K-means\n", algorithmName);
+    return false;
+}
+
+/**
+ * @brief Repairs the empty clusters found in the centroid step.
+ *
+ * This function applies the strategy selected with setEmptyClusterStrategy to every cluster with no points.
+ * The clusters are handled from the last to the first, so dropping a cluster only moves clusters already handled.
+ *
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param counts An array containing the number of data points in each cluster, updated by this function.
+ * @return The number of empty clusters found.
+ */
+size_t repairEmptyClusters(Centroids* centroids, DataPoints* dataPoints, size_t* counts)
+{
+    size_t emptyClusters = 0;
+
+    for (size_t clusterLabel = centroids->size; clusterLabel-- > 0; )
+    {
+        if (counts[clusterLabel] > 0) continue;
+
+        emptyClusters++;
+        //if (LOGGING >= 3) printf("Repairing empty cluster %zu\n", clusterLabel);
+
+        switch (activeEmptyClusterStrategy)
+        {
+        case 1:
+            reseedEmptyClusterAtFarthestPoint(centroids, dataPoints, counts, clusterLabel);
+            break;
+        case 2:
+            splitLargestClusterIntoEmpty(centroids, dataPoints, counts, clusterLabel);
+            break;
+        case 3:
+            dropEmptyCluster(centroids, dataPoints, counts, clusterLabel);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return emptyClusters;
+}
+
+/**
+ * @brief Selects the k-th smallest value of an array.
+ *
+ * This function partially reorders the array with quickselect (median-of-three pivots),
+ * so that the k-th smallest value is at index k, smaller values before it and larger values after it.
+ *
+ * @param values The array of values, reordered by this function.
+ * @param count The number of values.
+ * @param k The zero-based rank of the value to select.
+ * @return The k-th smallest value.
+ */
+double selectKthSmallest(double* values, size_t count, size_t k)
+{
+    size_t left = 0;
+    size_t right = count - 1;
+
+    while (left < right)
+    {
+        // Median of three as the pivot
+        size_t middle = left + (right - left) / 2;
+        double a = values[left], b = values[middle], c = values[right];
+        double pivot = (a < b) ? ((b < c) ? b : (a < c ? c : a)) : ((a < c) ? a : (b < c ? c : b));
+
+        size_t i = left;
+        size_t j = right;
+        while (i <= j)
+        {
+            while (values[i] < pivot) i++;
+            while (values[j] > pivot) j--;
+            if (i <= j)
+            {
+                double temp = values[i];
+                values[i] = values[j];
+                values[j] = temp;
+                i++;
+                if (j == 0) break;
+                j--;
+            }
+        }
+
+        if (k <= j) right = j;
+        else if (k >= i) left = i;
+        else break;
+    }
+
+    return values[k];
+}
+
+/**
+ * @brief Represents a coordinate value and the weight of its data point, sorted for the weighted median.
+ */
+typedef struct
+{
+    double value;  /**< Coordinate value. */
+    double weight; /**< Weight of the data point. */
+} WeightedValue;
+
+/**
+ * @brief Compares two WeightedValue structures by value, for qsort.
+ *
+ * @param a A pointer to the first WeightedValue.
+ * @param b A pointer to the second WeightedValue.
+ * @return A negative value, zero or a positive value as the first value is smaller, equal or larger.
+ */
+int compareWeightedValues(const void* a, const void* b)
+{
+    double valueA = ((const WeightedValue*)a)->value;
+    double valueB = ((const WeightedValue*)b)->value;
+
+    return (valueA > valueB) - (valueA < valueB);
+}
+
+/**
+ * @brief Selects the weighted median of the values.
+ *
+ * This function sorts the values and returns the first value where the running weight reaches half
+ * of the total weight. If the running weight is exactly half, the value is averaged with the next one,
+ * so equal weights give the same median as the unweighted one.
+ *
+ * @param values The values and their weights, sorted by this function.
+ * @param count The number of values.
+ * @return The weighted median.
+ */
+double selectWeightedMedian(WeightedValue* values, size_t count)
+{
+    qsort(values, count, sizeof(WeightedValue), compareWeightedValues);
+
+    double totalWeight = 0.0;
+    for (size_t j = 0; j < count; ++j)
+    {
+        totalWeight += values[j].weight;
+    }
+
+    double half = totalWeight / 2.0;
+    double runningWeight = 0.0;
+    size_t j = 0;
+    for (; j + 1 < count; ++j)
+    {
+        runningWeight += values[j].weight;
+        if (runningWeight >= half) break;
+    }
+
+    if (runningWeight == half && j + 1 < count)
+    {
+        return (values[j].value + values[j + 1].value) / 2.0;
+    }
+
+    return values[j].value;
+}
+
+/**
+ * @brief Performs the centroid step for the Manhattan metric.
+ *
+ * This function sets every coordinate of a centroid to the weighted median of that coordinate over the data points
+ * of the cluster, which minimizes the weighted sum of Manhattan distances. For an even number of points with
+ * equal weights the two middle values are averaged, and such clusters use quickselect instead of sorting.
+ * The data points are first grouped by cluster with a counting sort, and
+ * the clusters are processed in parallel, each in its own part of the scratch buffer.
+ *
+ * @param centroids A pointer to the Centroids structure containing the centroids to be updated.
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param counts An array of centroids->size entries, filled with the number of data points in each cluster.
+ */
+void medianCentroidStep(Centroids* centroids, DataPoints* dataPoints, size_t* counts)
+{
+    size_t numClusters = centroids->size;
+    size_t dimensions = dataPoints->points[0].dimensions;
+
+    size_t* offsets = trackedMalloc((numClusters + 1) * sizeof(size_t));
+    size_t* order = trackedMalloc(dataPoints->size * sizeof(size_t));
+    double* values = trackedMalloc(dataPoints->size * sizeof(double));
+    handleMemoryError(offsets);
+    handleMemoryError(order);
+    handleMemoryError(values);
+
+    // The weighted medians need the weights next to the values, only allocated for data with unequal weights
+    WeightedValue* weightedValues = NULL;
+    for (size_t i = 1; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].weight != dataPoints->points[0].weight)
+        {
+            weightedValues = trackedMalloc(dataPoints->size * sizeof(WeightedValue));
+            handleMemoryError(weightedValues);
+            break;
+        }
+    }
+
+    memset(counts, 0, numClusters * sizeof(size_t));
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        counts[dataPoints->points[i].partition]++;
+    }
+
+    offsets[0] = 0;
+    for (size_t clusterLabel = 0; clusterLabel < numClusters; ++clusterLabel)
+    {
+        offsets[clusterLabel + 1] = offsets[clusterLabel] + counts[clusterLabel];
+    }
+
+    // Group the point indices by cluster
+    size_t* cursors = trackedMalloc(numClusters * sizeof(size_t));
+    handleMemoryError(cursors);
+    memcpy(cursors, offsets, numClusters * sizeof(size_t));
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        order[cursors[dataPoints->points[i].partition]++] = i;
+    }
+    trackedFree(cursors);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (long long cluster = 0; cluster < (long long)numClusters; ++cluster)
+    {
+        size_t clusterLabel = (size_t)cluster;
+        size_t count = counts[clusterLabel];
+        if (count == 0) continue;
+
+        double* clusterValues = &values[offsets[clusterLabel]];
+        const size_t* members = &order[offsets[clusterLabel]];
+
+        bool equalWeights = true;
+        for (size_t j = 1; j < count && weightedValues != NULL; ++j)
+        {
+            if (dataPoints->points[members[j]].weight != dataPoints->points[members[0]].weight)
+            {
+                equalWeights = false;
+                break;
+            }
+        }
+
+        if (!equalWeights)
+        {
+            WeightedValue* clusterWeightedValues = &weightedValues[offsets[clusterLabel]];
+
+            for (size_t dim = 0; dim < dimensions; ++dim)
+            {
+                for (size_t j = 0; j < count; ++j)
+                {
+                    clusterWeightedValues[j].value = dataPoints->points[members[j]].attributes[dim];
+                    clusterWeightedValues[j].weight = dataPoints->points[members[j]].weight;
+                }
+
+                centroids->points[clusterLabel].attributes[dim] = selectWeightedMedian(clusterWeightedValues, count);
+            }
+            continue;
+        }
+
+        for (size_t dim = 0; dim < dimensions; ++dim)
+        {
+            for (size_t j = 0; j < count; ++j)
+            {
+                clusterValues[j] = dataPoints->points[members[j]].attributes[dim];
+            }
+
+            double median = selectKthSmallest(clusterValues, count, (count - 1) / 2);
+            if (count % 2 == 0)
+            {
+                // The upper middle value is the smallest value after the lower middle one
+                double upper = clusterValues[count / 2];
+                for (size_t j = count / 2 + 1; j < count; ++j)
+                {
+                    if (clusterValues[j] < upper) upper = clusterValues[j];
+                }
+                median = (median + upper) / 2.0;
+            }
+
+            centroids->points[clusterLabel].attributes[dim] = median;
+        }
+    }
+
+    trackedFree(offsets);
+    trackedFree(order);
+    trackedFree(values);
+    trackedFree(weightedValues);
+}
+
+/**
+ * @brief Adds the weighted deviations, weights and counts of a range of data points to the cluster sums.
+ *
+ * @param centroids A pointer to the Centroids structure, the deviations are taken from these centroids.
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param begin The index of the first data point.
+ * @param end The index after the last data point.
+ * @param sums The sums of the deviations, numClusters * dimensions values.
+ * @param weights The sums of the weights, one per cluster.
+ * @param counts The numbers of data points, one per cluster.
+ */
+static void accumulateCentroidSums(const Centroids* centroids, const DataPoints* dataPoints, size_t begin, size_t end, double* sums, double* weights, size_t* counts)
+{
+    size_t dimensions = dataPoints->points[0].dimensions;
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        const DataPoint* point = &dataPoints->points[i];
+        size_t clusterLabel = point->partition;
+        double* clusterSums = &sums[clusterLabel * dimensions];
+        const double* reference = centroids->points[clusterLabel].attributes;
+
+        // Deviation from the current centroid instead of the raw coordinate
+        for (size_t dim = 0; dim < dimensions; ++dim)
+        {
+            clusterSums[dim] += point->weight * (point->attributes[dim] - reference[dim]);
+        }
+        weights[clusterLabel] += point->weight;
+        counts[clusterLabel]++;
+    }
+}
+
+/**
+ * @brief Performs the centroid step in the k-means algorithm.
+ *
+ * This function updates the centroids by calculating the mean of the data points assigned to each centroid,
+ * weighted by the weights of the data points. The sums are accumulated as deviations from the current centroids,
+ * which keeps them small even for large coordinates and large clusters. With DETERMINISTIC the points are
+ * summed in fixed chunks, in parallel or on one thread one chunk after another, and the chunk sums are combined
+ * with Kahan compensation, so the result does not depend on the number of threads. Otherwise the points
+ * are summed serially. The buffers come from the reduction workspace of the thread.
+ * For the cosine metric the means are normalized to unit length (spherical k-means), and for the Manhattan
+ * metric the coordinate-wise weighted medians are used instead of the means.
+ * Empty clusters are detected from the counts and repaired according to activeEmptyClusterStrategy,
+ * which may reassign data points or, with the drop strategy, decrease the number of centroids.
+ *
+ * @param centroids A pointer to the Centroids structure containing the centroids to be updated.
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ */
+void centroidStep(Centroids* centroids, DataPoints* dataPoints)
+{
+    double traceStart = traceBegin();
+
+    if (activeMetric.type == 2)
+    {
+        size_t* medianCounts = trackedCalloc(centroids->size, sizeof(size_t));
+        handleMemoryError(medianCounts);
+
+        medianCentroidStep(centroids, dataPoints, medianCounts);
+
+        bool hasEmpty = false;
+        for (size_t clusterLabel = 0; clusterLabel < centroids->size; ++clusterLabel)
+        {
+            if (medianCounts[clusterLabel] == 0) hasEmpty = true;
+        }
+        if (hasEmpty && activeEmptyClusterStrategy != 0)
+        {
+            repairEmptyClusters(centroids, dataPoints, medianCounts);
+        }
+
+        trackedFree(medianCounts);
+        traceEnd("centroidStep", traceStart);
+        return;
+    }
+
+    size_t numClusters = centroids->size;
+    size_t dimensions = dataPoints->points[0].dimensions;
+    size_t stateSize = numClusters * dimensions;
+
+    // One slice of sums, weights and counts per chunk in parallel, on one thread a second slice is reused for every chunk
+    size_t numChunks = DETERMINISTIC ? getReductionChunkCount(dataPoints->size, stateSize + 2 * numClusters) : 1;
+    size_t chunkSize = (dataPoints->size + numChunks - 1) / numChunks;
+    bool parallelChunks = numChunks > 1 && getMaxThreads() > 1;
+    size_t numSlices = parallelChunks ? numChunks : (numChunks > 1 ? 2 : 1);
+    size_t numValues = numSlices * (stateSize + numClusters) + stateSize;
+
+    ReductionWorkspace* workspace = reserveReductionWorkspace(numValues, numSlices * numClusters);
+    double* sums = workspace->values;
+    double* weights = &sums[numSlices * stateSize];
+    double* compensation = &weights[numSlices * numClusters];
+    size_t* counts = workspace->counts;
+    memset(sums, 0, numValues * sizeof(double));
+    memset(counts, 0, numSlices * numClusters * sizeof(size_t));
+
+    if (parallelChunks)
+    {
+        // Accumulate weighted sums, weights and counts for each cluster, chunk by chunk
+        #pragma omp parallel
+        {
+            double traceStart = traceBegin();
+
+            #pragma omp for schedule(static) nowait
+            for (long long chunk = 0; chunk < (long long)numChunks; ++chunk)
+            {
+                size_t begin = (size_t)chunk * chunkSize;
+                size_t end = begin + chunkSize < dataPoints->size ? begin + chunkSize : dataPoints->size;
+
+                accumulateCentroidSums(centroids, dataPoints, begin, end, &sums[(size_t)chunk * stateSize],
+                    &weights[(size_t)chunk * numClusters], &counts[(size_t)chunk * numClusters]);
+            }
+
+            traceEnd("centroidStep (thread)", traceStart);
+        }
+    }
+
+    // Combine the chunks in a fixed order, so the sums do not depend on the number of threads
+    for (size_t chunk = 0; chunk < numChunks; ++chunk)
+    {
+        size_t slice = parallelChunks ? chunk : (chunk > 0 ? 1 : 0);
+
+        if (!parallelChunks)
+        {
+            size_t begin = chunk * chunkSize;
+            size_t end = begin + chunkSize < dataPoints->size ? begin + chunkSize : dataPoints->size;
+
+            if (slice > 0)
+            {
+                memset(&sums[stateSize], 0, stateSize * sizeof(double));
+                memset(&weights[numClusters], 0, numClusters * sizeof(double));
+                memset(&counts[numClusters], 0, numClusters * sizeof(size_t));
+            }
+            accumulateCentroidSums(centroids, dataPoints, begin, end, &sums[slice * stateSize], &weights[slice * numClusters], &counts[slice * numClusters]);
+        }
+
+        if (slice == 0) continue;
+
+        for (size_t j = 0; j < stateSize; ++j)
+        {
+            addCompensated(&sums[j], &compensation[j], sums[slice * stateSize + j]);
+        }
+        for (size_t clusterLabel = 0; clusterLabel < numClusters; ++clusterLabel)
+        {
+            weights[clusterLabel] += weights[slice * numClusters + clusterLabel];
+            counts[clusterLabel] += counts[slice * numClusters + clusterLabel];
+        }
+    }
+
+    // Update the centroids
+    bool hasEmptyClusters = false;
+    for (size_t clusterLabel = 0; clusterLabel < numClusters; ++clusterLabel)
+    {
+        if (counts[clusterLabel] > 0)
+        {
+            for (size_t dim = 0; dim < dimensions; ++dim)
+            {
+                centroids->points[clusterLabel].attributes[dim] += sums[clusterLabel * dimensions + dim] / weights[clusterLabel];
+            }
+        }
+        else
+        {
+            //if(LOGGING >= 3) fprintf(stderr, "Warning: Cluster %zu has no points assigned.\n", clusterLabel);
+            hasEmptyClusters = true;
+        }
+    }
+
+    // Spherical k-means: the centroids of the cosine metric are unit length
+    if (activeMetric.type == 1)
+    {
+        for (size_t clusterLabel = 0; clusterLabel < numClusters; ++clusterLabel)
+        {
+            double* attributes = centroids->points[clusterLabel].attributes;
+            double norm = sqrt(dotProductKernel(attributes, attributes, dimensions));
+
+            if (norm > 0.0)
+            {
+                for (size_t dim = 0; dim < dimensions; ++dim)
+                {
+                    attributes[dim] /= norm;
+                }
+            }
+        }
+    }
+
+    if (hasEmptyClusters && activeEmptyClusterStrategy != 0)
+    {
+        repairEmptyClusters(centroids, dataPoints, counts);
+    }
+
+    traceEnd("centroidStep", traceStart);
+}
+
+/**
+ * @brief Counts the number of centroids in centroids2 that do not have any centroids in centroids1 assigned to them.
+ *
+ * This function iterates through all centroids in centroids1 and finds the nearest centroid in centroids2.
+ * It then counts the number of centroids in centroids2 that do not have any centroids in centroids1 assigned to them.
+ *
+ * @param centroids1 A pointer to the first Centroids structure.
+ * @param centroids2 A pointer to the second Centroids structure.
+ * @return The number of centroids in centroids2 that do not have any centroids in centroids1 assigned to them.
+ */
+size_t countOrphans(const Centroids* centroids1, const Centroids* centroids2)
+{
+    size_t countFrom1to2 = 0;
+    size_t* closest = trackedCalloc(centroids2->size, sizeof(size_t));
+    handleMemoryError(closest);
+
+    for (size_t i = 0; i < centroids1->size; ++i)
+    {
+        size_t closestIndex = findNearestCentroid(&centroids1->points[i], centroids2);
+        closest[closestIndex]++;
+    }
+
+    for (size_t i = 0; i < centroids2->size; ++i)
+    {
+        if (closest[i] == 0)
+        {
+            countFrom1to2++;
+        }
+    }
+
+    trackedFree(closest);
+
+    return countFrom1to2;
+}
+
+/**
+ * @brief Calculates the Centroid Index (CI) between two sets of centroids.
+ *
+ * This function calculates the Centroid Index (CI) by counting the number of orphan centroids
+ * between two sets of centroids. It returns the maximum count of orphans from either set.
+ *
+ * @param centroids1 A pointer to the first Centroids structure.
+ * @param centroids2 A pointer to the second Centroids structure.
+ * @return The Centroid Index (CI) between the two sets of centroids.
+ */
+size_t calculateCentroidIndex(const Centroids* centroids1, const Centroids* centroids2)
+{
+    if (LOGGING >= 1)
+    {
+        printf("centroids1: %zu AND 2: %zu\n\n", centroids1->size, centroids2->size);
+        printf("centroids1: %f AND 2: %f\n\n", centroids1->points->attributes[0], centroids2->points->attributes[0]);
+    }
+    
+    size_t countFrom1to2 = countOrphans(centroids1, centroids2);
+    size_t countFrom2to1 = countOrphans(centroids2, centroids1);
+
+    if (LOGGING >= 1)
+    {
+        printf("Count from 1 to 2: %zu AND 2 to 1: %zu\n\n", countFrom1to2, countFrom2to1);
+    }
+
+    return (countFrom1to2 > countFrom2to1) ? countFrom1to2 : countFrom2to1;
+}
+
+/**
+ * @brief Publishes the SSE, the number of clusters and the CI of a solution on the full data.
+ *
+ * Solutions of other data (local k-means) are ignored. The CI takes a pass over all centroid pairs,
+ * so it is counted only for the first solution after each sample and at most once per interval.
+ * The CI is counted without the logging of calculateCentroidIndex.
+ *
+ * @param dataPoints A pointer to the DataPoints structure the solution belongs to.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param sse The SSE of the solution.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids, or NULL.
+ */
+static void publishProgressResult(const DataPoints* dataPoints, const Centroids* centroids, double sse, const Centroids* groundTruth)
+{
+    if (dataPoints != activeProgress.dataPoints) return;
+
+    uint64_t bits;
+    memcpy(&bits, &sse, sizeof(bits));
+    atomic_store_explicit(&activeProgress.sseBits, bits, memory_order_relaxed);
+    atomic_store_explicit(&activeProgress.clusters, centroids->size, memory_order_relaxed);
+
+    size_t sample = atomic_load_explicit(&activeProgress.samplesTaken, memory_order_relaxed);
+    if (groundTruth != NULL && atomic_exchange_explicit(&activeProgress.indexedSample, sample, memory_order_relaxed) != sample)
+    {
+        size_t countFrom1to2 = countOrphans(centroids, groundTruth);
+        size_t countFrom2to1 = countOrphans(groundTruth, centroids);
+        atomic_store_explicit(&activeProgress.centroidIndex, countFrom1to2 > countFrom2to1 ? countFrom1to2 : countFrom2to1, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Publishes the progress of a k-means iteration.
+ *
+ * This function is called once per iteration by runKMeans. Without progress reporting it only loads a flag.
+ * Every iteration counts towards the iterations and the processed data points; the SSE, the number of clusters
+ * and the CI are published only for iterations on the full data, so the local k-means of the split algorithms
+ * do not overwrite them, and not during the k-means of a swap, which publishes its SSE only if the swap is kept.
+ *
+ * @param dataPoints A pointer to the DataPoints structure the iteration ran on.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param sse The SSE of the iteration.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids, or NULL.
+ */
+void publishProgress(const DataPoints* dataPoints, const Centroids* centroids, double sse, const Centroids* groundTruth)
+{
+    if (!atomic_load_explicit(&activeProgress.enabled, memory_order_relaxed)) return;
+
+    atomic_fetch_add_explicit(&activeProgress.iterations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&activeProgress.pointsProcessed, dataPoints->size, memory_order_relaxed);
+
+    if (atomic_load_explicit(&activeProgress.acceptedOnly, memory_order_relaxed)) return;
+
+    publishProgressResult(dataPoints, centroids, sse, groundTruth);
+}
+
+/**
+ * @brief Publishes the SSE of a kept swap, the best SSE of the swap algorithm so far.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the kept centroids.
+ * @param sse The SSE of the kept centroids.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids, or NULL.
+ */
+void publishAcceptedProgress(const DataPoints* dataPoints, const Centroids* centroids, double sse, const Centroids* groundTruth)
+{
+    if (!atomic_load_explicit(&activeProgress.enabled, memory_order_relaxed)) return;
+
+    publishProgressResult(dataPoints, centroids, sse, groundTruth);
+}
+
+/**
+ * @brief Publishes the number of clusters so far, called by the split algorithms after every split.
+ *
+ * @param clusters The number of clusters.
+ */
+void publishProgressClusters(size_t clusters)
+{
+    if (!atomic_load_explicit(&activeProgress.enabled, memory_order_relaxed)) return;
+
+    atomic_store_explicit(&activeProgress.clusters, clusters, memory_order_relaxed);
+}
+
+/**
+ * @brief Reads the progress counters and passes them to the callback as a ProgressSample.
+ *
+ * @param lastTime The elapsed time of the previous sample, updated by this function.
+ * @param lastPoints The processed data points of the previous sample, updated by this function.
+ * @param finished True for the last sample.
+ */
+static void emitProgressSample(double* lastTime, size_t* lastPoints, bool finished)
+{
+    ProgressSample sample;
+    uint64_t bits = atomic_load_explicit(&activeProgress.sseBits, memory_order_relaxed);
+    size_t points = atomic_load_explicit(&activeProgress.pointsProcessed, memory_order_relaxed);
+
+    sample.iteration = atomic_load_explicit(&activeProgress.iterations, memory_order_relaxed);
+    memcpy(&sample.sse, &bits, sizeof(sample.sse));
+    sample.centroidIndex = atomic_load_explicit(&activeProgress.centroidIndex, memory_order_relaxed);
+    sample.clusters = atomic_load_explicit(&activeProgress.clusters, memory_order_relaxed);
+    sample.elapsedSeconds = getMonotonicSeconds() - activeProgress.startTime;
+    sample.pointsPerSecond = sample.elapsedSeconds > *lastTime ? (double)(points - *lastPoints) / (sample.elapsedSeconds - *lastTime) : 0.0;
+    sample.finished = finished;
+
+    *lastTime = sample.elapsedSeconds;
+    *lastPoints = points;
+
+    activeProgress.callback(&sample, activeProgress.userData);
+    atomic_fetch_add_explicit(&activeProgress.samplesTaken, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Thread function of the progress sampler.
+ *
+ * The thread publishes a sample every interval until the reporting stops, and then a last sample.
+ *
+ * @param argument Unused.
+ * @return Always 0.
+ */
+static int runProgressSamplerThread(void* argument)
+{
+    (void)argument;
+
+    double lastTime = 0.0;
+    size_t lastPoints = 0;
+    double nextSample = activeProgress.interval;
+
+    mtx_lock(&activeProgress.lock);
+    while (!activeProgress.stopRequested)
+    {
+        // The wait uses the calendar clock, the samples are still spaced by the monotonic clock
+        double remaining = nextSample - (getMonotonicSeconds() - activeProgress.startTime);
+        if (remaining > 0.0)
+        {
+            struct timespec wakeTime;
+            timespec_get(&wakeTime, TIME_UTC);
+            wakeTime.tv_sec += (time_t)remaining;
+            wakeTime.tv_nsec += (long)((remaining - (double)(time_t)remaining) * 1e9);
+            if (wakeTime.tv_nsec >= 1000000000L)
+            {
+                wakeTime.tv_sec++;
+                wakeTime.tv_nsec -= 1000000000L;
+            }
+
+            cnd_timedwait(&activeProgress.stopSignal, &activeProgress.lock, &wakeTime);
+            continue;
+        }
+
+        mtx_unlock(&activeProgress.lock);
+        emitProgressSample(&lastTime, &lastPoints, false);
+        nextSample += activeProgress.interval;
+        mtx_lock(&activeProgress.lock);
+    }
+    mtx_unlock(&activeProgress.lock);
+
+    emitProgressSample(&lastTime, &lastPoints, true);
+
+    return 0;
+}
+
+/**
+ * @brief Starts the progress reporting.
+ *
+ * The counters are reset and a sampler thread is started that passes a ProgressSample to the callback every interval.
+ * The algorithms themselves never wait for the sampler. Only one reporting can run at a time.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the full data of the run.
+ * @param callback The function that receives the samples, called from the sampler thread.
+ * @param userData Passed to the callback.
+ * @param intervalSeconds Seconds between the samples.
+ */
+void startProgressReporting(const DataPoints* dataPoints, ProgressCallback callback, void* userData, double intervalSeconds)
+{
+    if (atomic_load(&activeProgress.enabled))
+    {
+        fprintf(stderr, "Error: Progress reporting is already running\n");
+        return;
+    }
+
+    atomic_store(&activeProgress.iterations, 0);
+    atomic_store(&activeProgress.pointsProcessed, 0);
+    atomic_store(&activeProgress.clusters, 0);
+    atomic_store(&activeProgress.centroidIndex, SIZE_MAX);
+    atomic_store(&activeProgress.samplesTaken, 0);
+    atomic_store(&activeProgress.indexedSample, SIZE_MAX);
+    atomic_store(&activeProgress.acceptedOnly, false);
+    double noSse = -1.0;
+    uint64_t bits;
+    memcpy(&bits, &noSse, sizeof(bits));
+    atomic_store(&activeProgress.sseBits, bits);
+
+    activeProgress.dataPoints = dataPoints;
+    activeProgress.callback = callback;
+    activeProgress.userData = userData;
+    activeProgress.interval = intervalSeconds;
+    activeProgress.stopRequested = false;
+    activeProgress.startTime = getMonotonicSeconds();
+
+    if (mtx_init(&activeProgress.lock, mtx_plain) != thrd_success || cnd_init(&activeProgress.stopSignal) != thrd_success)
+    {
+        raiseFatalError("Unable to initialize the progress sampler");
+    }
+
+    atomic_store(&activeProgress.enabled, true);
+
+    if (thrd_create(&activeProgress.sampler, runProgressSamplerThread, NULL) != thrd_success)
+    {
+        raiseFatalError("Unable to start the progress sampler thread");
+    }
+}
+
+/**
+ * @brief Stops the progress reporting. The callback receives a last sample before this function returns.
+ */
+void stopProgressReporting(void)
+{
+    if (!atomic_load(&activeProgress.enabled)) return;
+
+    mtx_lock(&activeProgress.lock);
+    activeProgress.stopRequested = true;
+    cnd_signal(&activeProgress.stopSignal);
+    mtx_unlock(&activeProgress.lock);
+
+    thrd_join(activeProgress.sampler, NULL);
+
+    atomic_store(&activeProgress.enabled, false);
+    mtx_destroy(&activeProgress.lock);
+    cnd_destroy(&activeProgress.stopSignal);
+}
+
+/**
+ * @brief A progress callback that rewrites a status file with the latest sample.
+ *
+ * The sample is written to a temporary file that then replaces the status file, so a reader
+ * never sees a partially written status.
+ *
+ * @param sample A pointer to the ProgressSample structure.
+ * @param userData The name of the status file (a string).
+ */
+void writeProgressStatusFile(const ProgressSample* sample, void* userData)
+{
+    const char* filename = (const char*)userData;
+    char temporaryFile[300];
+    snprintf(temporaryFile, sizeof(temporaryFile), "%s.tmp", filename);
+
+    FILE* file = fopen(temporaryFile, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Cannot open file %s for writing\n", temporaryFile);
+        return;
+    }
+
+    fprintf(file, "State: %s\n", sample->finished ? "finished" : "running");
+    fprintf(file, "Elapsed time: %.1f seconds\n", sample->elapsedSeconds);
+    fprintf(file, "K-means iterations: %zu\n", sample->iteration);
+    fprintf(file, "Points per second: %.0f\n", sample->pointsPerSecond);
+    fprintf(file, "Clusters: %zu\n", sample->clusters);
+    if (sample->sse >= 0.0) fprintf(file, "SSE: %.6f\n", sample->sse);
+    else fprintf(file, "SSE: -\n");
+    if (sample->centroidIndex != SIZE_MAX) fprintf(file, "CI: %zu\n", sample->centroidIndex);
+    else fprintf(file, "CI: -\n");
+
+    fclose(file);
+
+#ifdef _WIN32
+    if (!MoveFileExA(temporaryFile, filename, MOVEFILE_REPLACE_EXISTING))
+#else
+    if (rename(temporaryFile, filename) != 0)
+#endif
+    {
+        fprintf(stderr, "Error: Cannot replace the status file %s\n", filename);
+    }
+}
+
+/**
+ * @brief Runs the k-means algorithm on the given data points and centroids.
+ *
+ * This function iterates through partition and centroid steps, calculates the MSE,
+ * and returns the best MSE obtained during the iterations.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param iterations The maximum number of iterations to run the k-means algorithm.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @return The best mean squared error (MSE) obtained during the iterations.
+ */
+double runKMeans(DataPoints* dataPoints, size_t iterations, Centroids* centroids, const Centroids* groundTruth)
+{
+    double traceStart = traceBegin();
+    double bestMse = DBL_MAX;
+    double mse = DBL_MAX;
+
+    for (size_t iteration = 0; iteration < iterations; ++iteration)
+    {
+        atomic_fetch_add_explicit(&activeWork.iterations, 1, memory_order_relaxed);
+
+        partitionStep(dataPoints, centroids);
+
+        centroidStep(centroids, dataPoints);
+        
+        //TODO: mse vai SSE? Tll hetkell SSE vaikka muuttujat ovat mse
+        mse = calculateSSE(dataPoints, centroids);
+        recordAnytimeProgress(dataPoints, centroids, mse);
+        publishProgress(dataPoints, centroids, mse, groundTruth);
+
+        // A dump during a long k-means run, but not of a local k-means or of the k-means of a swap, whose centroids are a trial
+        if (dataPoints == activeSignals.dataPoints && !atomic_load_explicit(&activeProgress.acceptedOnly, memory_order_relaxed))
+        {
+            serviceSignalRequests(dataPoints, centroids);
+        }
+
+        /*if (LOGGING >= 3)
+        {
+			size_t centroidIndex = calculateCentroidIndex(centroids, groundTruth);
+            printf("(runKMeans)After iteration %zu: CI = %zu and MSE = %.5f\n", iteration + 1, centroidIndex, mse / 10000);
+        }*/
+
+        if (mse < bestMse - KMEANS_STOP_TOLERANCE * bestMse)
+        {
+			//if (LOGGING >= 3) printf("Best MSE so far: %.5f\n", mse / 10000);
+            bestMse = mse;
+        }
+        else
+        {
+            // Keep an improvement within the tolerance, but do not iterate further on noise
+            if (mse < bestMse) bestMse = mse;
+            break; // Exit the loop if the MSE does not improve
+        }
+
+        // Out of time, the centroids and partitions of the last iteration are a valid solution
+        if (deadlineReached()) break;
+    }
+
+    traceEnd("k-means", traceStart);
+
+    return bestMse;
+}
+
+/**
+ * @brief Runs k-means from random centroids several times and keeps the best result.
+ *
+ * In an anytime run the repeats stop at the deadline, the first repeat always runs to have a solution.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param bestCentroids A pointer to the Centroids structure that receives the best centroids, its size is the number of clusters.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param maxRepeats The maximum number of repeats for the k-means algorithm.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @return The best mean squared error (MSE) of the repeats.
+ */
+double runRepeatedKMeans(DataPoints* dataPoints, Centroids* bestCentroids, size_t maxIterations, size_t maxRepeats, const Centroids* groundTruth)
+{
+    double bestMse = DBL_MAX;
+    size_t numCentroids = bestCentroids->size;
+
+    for (size_t j = 0; j < maxRepeats; ++j)
+    {
+        if (j > 0 && deadlineReached()) break;
+
+        if (j > 0) serviceSignalRequests(dataPoints, bestCentroids);
+
+        Centroids centroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
+        generateRandomCentroids(numCentroids, dataPoints, &centroids);
+
+        /*if (LOGGING >= 3)
+        {
+            size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+            printf("(Repeated K-means)Initial Centroid Index (CI): %zu\n", centroidIndex);
+        }*/
+
+        double resultMse = runKMeans(dataPoints, maxIterations, &centroids, groundTruth);
+
+        if (resultMse < bestMse)
+        {
+            bestMse = resultMse;
+            deepCopyCentroids(&centroids, bestCentroids, numCentroids);
+        }
+
+        freeCentroids(&centroids);
+    }
+
+    return bestMse;
+}
+
+/**
+ * @brief Calculates the exact SSE change of a centroid swap with a fixed partition.
+ *
+ * This function evaluates moving the removed centroid to the new location without running k-means.
+ * The data points of the removed cluster go to the closer of their second-nearest centroid and the new location:
+ * the removal cost of the cluster less the split gain of the new location over the second-nearest distances.
+ * The other data points move to the new location only if it is closer than their current centroid: the split gain
+ * of their clusters.
+ * The change is that of calculateSSE (the active metric), the SSE that randomSwap accepts or rejects,
+ * and it is exact when the cache matches the current centroids.
+ *
+ * Only the data points that can change are visited: the members of the removed cluster, and the members of
+ * the clusters whose centroid is closer than twice their radius to the new location (by the triangle inequality
+ * no point of a farther cluster is closer to the new location than to its centroid). The cosine distance
+ * is not a metric, so with it every cluster is visited.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure matching the cache.
+ * @param cache A pointer to the NearestCentroidCache structure matching the current centroids.
+ * @param removedCentroid The index of the centroid that is moved.
+ * @param newLocation A pointer to the DataPoint structure representing the new location of the centroid.
+ * @return The change of the SSE caused by the swap (negative values are improvements).
+ */
+double evaluateSwapDelta(const DataPoints* dataPoints, const Centroids* centroids, const NearestCentroidCache* cache, size_t removedCentroid, const DataPoint* newLocation)
+{
+    double delta = 0.0;
+    bool triangleInequality = activeMetric.type != 1;
+
+    for (size_t c = 0; c < cache->numClusters; ++c)
+    {
+        size_t begin = cache->memberOffsets[c];
+        size_t end = cache->memberOffsets[c + 1];
+        if (begin == end) continue;
+
+        if (c == removedCentroid)
+        {
+            // The second-nearest centroid is never the removed one, so it is still available
+            delta += calculateRemovalCost(dataPoints, cache, c) - calculateSplitGain(dataPoints, cache, c, newLocation, cache->secondDistance);
+            continue;
+        }
+
+        if (triangleInequality && calculateMetricDistance(newLocation, &centroids->points[c]) >= 2.0 * cache->radii[c]) continue;
+
+        delta -= calculateSplitGain(dataPoints, cache, c, newLocation, cache->nearestDistance);
+    }
+
+    return delta;
+}
+
+/**
+ * @brief Screens random swap candidates and selects the one with the smallest SSE change.
+ *
+ * This function draws the given number of random (centroid, data point) pairs and evaluates each of them
+ * with evaluateSwapDelta. Only the best candidate needs to be refined with k-means by the caller.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param cache A pointer to the NearestCentroidCache structure matching the current centroids.
+ * @param numCandidates The number of candidate swaps to evaluate.
+ * @param centroidId A pointer where the index of the centroid to move is stored.
+ * @param dataPointId A pointer where the index of the data point to move the centroid to is stored.
+ * @return The SSE change of the selected swap with a fixed partition.
+ */
+double findBestSwapCandidate(const DataPoints* dataPoints, const Centroids* centroids, const NearestCentroidCache* cache, size_t numCandidates, size_t* centroidId, size_t* dataPointId)
+{
+    double bestDelta = DBL_MAX;
+
+    for (size_t i = 0; i < numCandidates; ++i)
+    {
+        size_t candidateCentroidId = rand() % centroids->size;
+        size_t candidateDataPointId = rand() % dataPoints->size;
+
+        double delta = evaluateSwapDelta(dataPoints, centroids, cache, candidateCentroidId, &dataPoints->points[candidateDataPointId]);
+
+        if (delta < bestDelta)
+        {
+            bestDelta = delta;
+            *centroidId = candidateCentroidId;
+            *dataPointId = candidateDataPointId;
+        }
+    }
+
+    return bestDelta;
+}
+
+/**
+ * @brief Swaps a centroid to the location of a data point and keeps the swap if k-means improves the SSE.
+ *
+ * The centroids are backed up before the swap and restored from the backup if the SSE after the
+ * local k-means is not better than the best SSE so far. Only a kept swap publishes its SSE as progress.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param backupAttributes An array of centroids->size * dimensions elements that receives the backup.
+ * @param centroidId The index of the swapped centroid.
+ * @param dataPointId The index of the data point that gives the new location.
+ * @param bestMse The best SSE so far.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @return The SSE after the local k-means, the swap was kept if it is below bestMse.
+ */
+double performSwapStep(DataPoints* dataPoints, Centroids* centroids, double* backupAttributes, size_t centroidId, size_t dataPointId, double bestMse, const Centroids* groundTruth)
+{
+    size_t kMeansIterations = 2;
+    size_t dimensions = centroids->points[0].dimensions;
+
+    //Backup
+    size_t offset = 0;
+    for (size_t j = 0; j < centroids->size; ++j)
+    {
+        memcpy(&backupAttributes[offset], centroids->points[j].attributes, dimensions * sizeof(double));
+        offset += dimensions;
+    }
+
+    //Swap
+    memcpy(centroids->points[centroidId].attributes, dataPoints->points[dataPointId].attributes, dimensions * sizeof(double));
+
+    //K-means, whose SSE is progress only if the swap is kept
+    bool acceptedOnly = atomic_exchange_explicit(&activeProgress.acceptedOnly, true, memory_order_relaxed);
+    double resultMse = runKMeans(dataPoints, kMeansIterations, centroids, groundTruth);
+    atomic_store_explicit(&activeProgress.acceptedOnly, acceptedOnly, memory_order_relaxed);
+
+    //If 1) MSE improves, we keep the change
+    //if not, we reverse the swap
+    if (resultMse < bestMse)
+    {
+        publishAcceptedProgress(dataPoints, centroids, resultMse, groundTruth);
+    }
+    else
+    {
+        offset = 0;
+        for (size_t j = 0; j < centroids->size; ++j)
+        {
+            memcpy(centroids->points[j].attributes, &backupAttributes[offset], dimensions * sizeof(double));
+            offset += dimensions;
+        }
+    }
+
+    return resultMse;
+}
+
+/**
+ * @brief Performs random swaps of centroids and evaluates the resulting clustering using k-means.
+ *
+ * This function performs random swaps of centroids with data points, runs k-means on the modified centroids,
+ * and keeps the changes if the mean squared error (MSE) improves. If the MSE does not improve, it reverses the swap.
+ * The function returns the best mean squared error (MSE) obtained during the swaps.
+ * If swapCandidates is greater than 0, each swap is the best of that many random candidates screened
+ * with evaluateSwapDelta, so k-means is only run on promising swaps.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param maxSwaps The maximum number of attempted swaps.
+ * @param swapCandidates The number of candidate swaps screened per attempted swap (0 = plain random swap).
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @return The best mean squared error (MSE) obtained during the swaps.
+ */
+double randomSwap(DataPoints* dataPoints, Centroids* centroids, size_t maxSwaps, size_t swapCandidates, const Centroids* groundTruth)
+{
+    double bestMse = DBL_MAX;
+    size_t totalAttributes = centroids->size * centroids->points[0].dimensions;
+
+    double* backupAttributes = trackedMalloc(totalAttributes * sizeof(double));
+    handleMemoryError(backupAttributes);
+
+    // The cache stays valid over rejected swaps, as the centroids are restored from the backup
+    NearestCentroidCache cache = { 0 };
+    bool cacheValid = false;
+
+    // Under a memory cap without room for the cache, the swaps are plain random swaps
+    size_t cacheBytes = dataPoints->size * (3 * sizeof(size_t) + 2 * sizeof(double));
+    if (swapCandidates > 0 && cacheBytes > getAvailableMemory())
+    {
+        swapCandidates = 0;
+    }
+    if (swapCandidates > 0)
+    {
+        cache = allocateNearestCentroidCache(dataPoints->size);
+    }
+
+    for (size_t i = 0; i < maxSwaps; ++i)
+    {
+        // Out of time, the centroids hold the best solution so far (the first swap always runs, so there is one)
+        if (i > 0 && deadlineReached()) break;
+
+        serviceSignalRequests(dataPoints, centroids);
+
+        size_t randomCentroidId;
+        size_t randomDataPointId;
+        if (swapCandidates > 0)
+        {
+            if (!cacheValid)
+            {
+                partitionStepWithSecondNearest(dataPoints, centroids, &cache);
+                cacheValid = true;
+            }
+            findBestSwapCandidate(dataPoints, centroids, &cache, swapCandidates, &randomCentroidId, &randomDataPointId);
+        }
+        else
+        {
+            randomCentroidId = rand() % centroids->size;
+            randomDataPointId = rand() % dataPoints->size;
+        }
+
+        double resultMse = performSwapStep(dataPoints, centroids, backupAttributes, randomCentroidId, randomDataPointId, bestMse, groundTruth);
+        if (resultMse < bestMse)
+        {
+            /*if (LOGGING >= 3)
+            {
+				size_t centroidIndex = calculateCentroidIndex(centroids, groundTruth);
+                printf("(RS) Round %zu: Best Centroid Index (CI): %zu and Best Sum-of-Squared Errors (MSE): %.5f\n", i + 1, centroidIndex, resultMse / 10000);
+            }*/
+            
+            bestMse = resultMse;
+            cacheValid = false;
+        }
+    }
+
+    trackedFree(backupAttributes);
+    freeNearestCentroidCache(&cache);
+
+    return bestMse;
+}
+
+/**
+ * @brief Builds the cumulative error of the data points for sampling in proportion to the error.
+ *
+ * The error of a data point is its weighted distance to the centroid of its partition, the same term
+ * calculateSSE sums, so the clusters with a large SSE get most of the samples.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param cumulativeErrors An array of dataPoints->size elements that receives the running sum of the errors.
+ * @return The total error.
+ */
+double buildCumulativeErrors(const DataPoints* dataPoints, const Centroids* centroids, double* cumulativeErrors)
+{
+    double total = 0.0;
+
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        size_t cIndex = dataPoints->points[i].partition;
+        if (cIndex < centroids->size)
+        {
+            total += dataPoints->points[i].weight * calculateMetricDistance(&dataPoints->points[i], &centroids->points[cIndex]);
+        }
+        cumulativeErrors[i] = total;
+    }
+
+    return total;
+}
+
+/**
+ * @brief Draws a random number in [0, 1).
+ *
+ * Two calls of rand() are combined, because RAND_MAX can be as small as 32767 and
+ * a single call would leave most of a large data set out of reach.
+ * Scaled by a positive integer bound and truncated, the result is a random index in [0, bound).
+ *
+ * @return A random number in [0, 1).
+ */
+double randomUnit(void)
+{
+    double range = (double)RAND_MAX + 1.0;
+    double value = ((double)rand() * range + (double)rand()) / (range * range);
+
+    // With a large RAND_MAX the sum has more bits than a double and can round up to 1
+    return value < 1.0 ? value : nextafter(1.0, 0.0);
+}
+
+/**
+ * @brief Draws a data point with a probability proportional to its error.
+ *
+ * @param cumulativeErrors The running sum of the errors from buildCumulativeErrors.
+ * @param size The number of data points.
+ * @param totalError The total error.
+ * @return The index of the drawn data point.
+ */
+size_t sampleByError(const double* cumulativeErrors, size_t size, double totalError)
+{
+    double target = randomUnit() * totalError;
+    size_t low = 0;
+    size_t high = size - 1;
+
+    // The first data point whose running sum exceeds the target
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (cumulativeErrors[middle] > target) high = middle;
+        else low = middle + 1;
+    }
+
+    return low;
+}
+
+/**
+ * @brief Performs random swaps until further swaps are unlikely to improve the clustering.
+ *
+ * This function works like randomSwap, but it tracks the acceptance rate and the relative SSE improvement
+ * of the recent swaps as moving averages over a window of swaps, and the share of swaps that improve the SSE
+ * by at least ADAPTIVE_MIN_GAIN as the estimated probability p of an improvement per swap.
+ * The swaps stop when the probability of at least one improvement within the next window, 1 - (1 - p)^window,
+ * falls below ADAPTIVE_STOP_PROBABILITY. The estimate starts at 1, so at least a window of swaps is made,
+ * and a run with frequent improvements waits longer before it stops than a run with rare ones.
+ * The window grows with the number of clusters, as a single swap then has a smaller chance to hit the right place.
+ * A share of the new centroid locations is drawn in proportion to the error of the data points, so the swaps
+ * favour the clusters with a high SSE; the rest is drawn uniformly to keep every location reachable.
+ * The removed centroid is always drawn uniformly. maxSwaps is an upper limit only.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param maxSwaps The maximum number of attempted swaps.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param report A pointer to the AdaptiveSwapReport structure that receives the number of swaps and the final rates.
+ * @return The best mean squared error (MSE) obtained during the swaps.
+ */
+double adaptiveRandomSwap(DataPoints* dataPoints, Centroids* centroids, size_t maxSwaps, const Centroids* groundTruth, AdaptiveSwapReport* report)
+{
+    double bestMse = DBL_MAX;
+    size_t numCentroids = centroids->size;
+    size_t totalAttributes = numCentroids * centroids->points[0].dimensions;
+
+    double* backupAttributes = trackedMalloc(totalAttributes * sizeof(double));
+    handleMemoryError(backupAttributes);
+
+    // The errors are rebuilt after every accepted swap, when the partitions match the kept centroids
+    double* cumulativeErrors = trackedMalloc(dataPoints->size * sizeof(double));
+    handleMemoryError(cumulativeErrors);
+    double totalError = 0.0;
+
+    size_t window = ADAPTIVE_WINDOW_PER_CLUSTER * numCentroids > ADAPTIVE_SWAP_WINDOW ? ADAPTIVE_WINDOW_PER_CLUSTER * numCentroids : ADAPTIVE_SWAP_WINDOW;
+    double smoothing = 1.0 / (double)window;
+
+    double acceptanceRate = 1.0;
+    double improvementRate = 0.0;
+    double improvementProbability = 1.0;
+    double stopProbability = 1.0;
+    size_t acceptedSwaps = 0;
+    size_t swaps = 0;
+
+    while (swaps < maxSwaps)
+    {
+        // Out of time, the centroids hold the best solution so far (the first swap always runs, so there is one)
+        if (swaps > 0 && deadlineReached()) break;
+
+        serviceSignalRequests(dataPoints, centroids);
+
+        size_t randomCentroidId = rand() % centroids->size;
+        size_t randomDataPointId;
+        if (totalError > 0.0 && randomUnit() < ADAPTIVE_BIASED_PROPOSALS)
+        {
+            randomDataPointId = sampleByError(cumulativeErrors, dataPoints->size, totalError);
+        }
+        else
+        {
+            randomDataPointId = rand() % dataPoints->size;
+        }
+
+        double resultMse = performSwapStep(dataPoints, centroids, backupAttributes, randomCentroidId, randomDataPointId, bestMse, groundTruth);
+        swaps++;
+
+        double relativeGain = 0.0;
+        if (resultMse < bestMse)
+        {
+            relativeGain = bestMse == DBL_MAX ? 1.0 : (bestMse - resultMse) / bestMse;
+            bestMse = resultMse;
+            acceptedSwaps++;
+            totalError = buildCumulativeErrors(dataPoints, centroids, cumulativeErrors);
+        }
+
+        // Moving averages over the window of recent swaps
+        acceptanceRate += smoothing * ((relativeGain > 0.0 ? 1.0 : 0.0) - acceptanceRate);
+        improvementRate += smoothing * (relativeGain - improvementRate);
+        improvementProbability += smoothing * ((relativeGain >= ADAPTIVE_MIN_GAIN ? 1.0 : 0.0) - improvementProbability);
+        stopProbability = 1.0 - pow(1.0 - improvementProbability, (double)window);
+
+        /*if (LOGGING >= 3)
+        {
+            printf("(ARS) Swap %zu: acceptance %.3f, improvement %.6f, probability %.3f\n", swaps, acceptanceRate, improvementRate, stopProbability);
+        }*/
+
+        if (stopProbability < ADAPTIVE_STOP_PROBABILITY) break;
+    }
+
+    trackedFree(backupAttributes);
+    trackedFree(cumulativeErrors);
+
+    report->swaps = swaps;
+    report->acceptedSwaps = acceptedSwaps;
+    report->acceptanceRate = acceptanceRate;
+    report->improvementRate = improvementRate;
+    report->improvementProbability = stopProbability;
+
+    return bestMse;
+}
+
+/**
+*@brief Splits a cluster into two sub - clusters using local k - means.
+*
+*This function splits a cluster into two sub - clusters by selecting two random centroids
+* from the data points in the cluster and running local k - means.It updates the partitions
+* and centroids based on the results of the local k - means.
+*
+*@param dataPoints A pointer to the DataPoints structure containing the data points.
+* @param centroids A pointer to the Centroids structure containing the centroids.
+* @param clusterToSplit The index of the cluster to split.
+* @param localMaxIterations The maximum number of iterations for the local k - means.
+* @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+*/
+void splitClusterIntraCluster(DataPoints* dataPoints, Centroids* centroids, size_t clusterToSplit, size_t localMaxIterations, const Centroids* groundTruth)
+{
+    size_t clusterSize = 0;
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].partition == clusterToSplit)
+        {
+            clusterSize++;
+        }
+    }
+
+    // Random split will break without this
+    if (clusterSize < 2)
+    {
+        return;
+    }
+
+    // Collect indices of points in the cluster
+    size_t* clusterIndices = trackedMalloc(clusterSize * sizeof(size_t));
+    handleMemoryError(clusterIndices);
+
+    size_t index = 0;
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].partition == clusterToSplit)
+        {
+            clusterIndices[index++] = i;
+        }
+    }
+
+    // Random centroids
+    size_t c1 = rand() % clusterSize;
+    size_t c2 = c1;
+    while (c2 == c1)
+    {
+        c2 = rand() % clusterSize;
+    }
+    size_t datapoint1 = clusterIndices[c1];
+    size_t datapoint2 = clusterIndices[c2];
+
+    // Initialize local centroids
+	Centroids localCentroids = allocateCentroids(2, dataPoints->points[0].dimensions);
+
+    deepCopyDataPoint(&localCentroids.points[0], &dataPoints->points[datapoint1]);
+    deepCopyDataPoint(&localCentroids.points[1], &dataPoints->points[datapoint2]);
+
+    // Prepare data points in the cluster
+    DataPoints pointsInCluster;
+    pointsInCluster.size = clusterSize;
+    pointsInCluster.matrix = NULL;
+    pointsInCluster.mappedView = NULL;
+    pointsInCluster.mappedSize = 0;
+    pointsInCluster.points = trackedMalloc(clusterSize * sizeof(DataPoint));
+    handleMemoryError(pointsInCluster.points);
+    for (size_t i = 0; i < clusterSize; ++i)
+    {
+        pointsInCluster.points[i] = dataPoints->points[clusterIndices[i]];
+    }
+
+    // Run local k-means
+    //TODO: poista "resultMse" jos ei tarvita
+    double resultMse = runKMeans(&pointsInCluster, localMaxIterations, &localCentroids, groundTruth);
+
+    // The empty cluster strategy dropped one of the local centroids, the cluster cannot be split
+    if (localCentroids.size < 2)
+    {
+        trackedFree(clusterIndices);
+        trackedFree(pointsInCluster.points);
+        freeCentroids(&localCentroids);
+        return;
+    }
+
+    // Update partitions
+    for (size_t i = 0; i < clusterSize; ++i)
+    {
+        size_t originalIndex = clusterIndices[i];
+        dataPoints->points[originalIndex].partition = (pointsInCluster.points[i].partition == 0) ? clusterToSplit : centroids->size;
+    }
+
+    // Update centroids
+    // TODO: deepcopyjen sijaan suoraan memcpy?
+    //#1
+    deepCopyDataPoint(&centroids->points[clusterToSplit], &localCentroids.points[0]);
+    
+    //#2
+    centroids->size++;
+    centroids->points = trackedRealloc(centroids->points, centroids->size * sizeof(DataPoint));
+    handleMemoryError(centroids->points);
+	centroids->points[centroids->size - 1] = allocateDataPoint(dataPoints->points[0].dimensions);
+    deepCopyDataPoint(&centroids->points[centroids->size - 1], &localCentroids.points[1]);
+    
+
+    // Cleanup
+    trackedFree(clusterIndices);
+    trackedFree(pointsInCluster.points);
+    freeCentroids(&localCentroids);
+}
+
+/**
+ * @brief Splits a cluster into two sub-clusters using global k-means.
+ *
+ * This function splits a cluster into two sub-clusters by selecting two random centroids
+ * from the data points in the cluster and running global k-means. It updates the partitions
+ * and centroids based on the results of the global k-means.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param clusterToSplit The index of the cluster to split.
+ * @param globalMaxIterations The maximum number of iterations for the global k-means.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ */
+void splitClusterGlobal(DataPoints* dataPoints, Centroids* centroids, size_t clusterToSplit, size_t globalMaxIterations, Centroids* groundTruth)
+{
+    size_t clusterSize = 0;
+
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].partition == clusterToSplit)
+        {
+            clusterSize++;
+        }
+    }
+
+    // Random split will break without this
+    if (clusterSize < 2)
+    {
+        return;
+    }
+
+    // Collect the indices of the points in the selected cluster
+    size_t* clusterIndices = trackedMalloc(clusterSize * sizeof(size_t));
+    handleMemoryError(clusterIndices);
+
+    size_t index = 0;
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].partition == clusterToSplit)
+        {
+            clusterIndices[index++] = i;
+        }
+    }
+
+    // Select two random points from the cluster to be the new centroids
+    size_t c1 = rand() % clusterSize;
+    size_t c2 = c1;
+    while (c2 == c1)
+    {
+        c2 = rand() % clusterSize;
+    }
+
+    // Get the indices of the randomly selected data points
+    size_t datapoint1 = clusterIndices[c1];
+    size_t datapoint2 = clusterIndices[c2];
+
+    // Add the first new centroid (overwrite the current centroid at clusterToSplit)
+    deepCopyDataPoint(&centroids->points[clusterToSplit], &dataPoints->points[datapoint1]);
+
+    // Add the second new centroid to the global centroids list
+    centroids->size++;
+    centroids->points = trackedRealloc(centroids->points, centroids->size * sizeof(DataPoint));
+	centroids->points[centroids->size - 1] = allocateDataPoint(dataPoints->points[0].dimensions);
+    deepCopyDataPoint(&centroids->points[centroids->size - 1], &dataPoints->points[datapoint2]);
+
+    // Run global k-means, this time including the new centroids
+    double resultMse = runKMeans(dataPoints, globalMaxIterations, centroids, groundTruth);
+
+    // Cleanup
+    trackedFree(clusterIndices);
+}
+
+// TODO: vain split k-means, haluanko mys random swappiin?
+// TODO: kesken
+/**
+ * @brief Performs local repartitioning of data points to the nearest centroid.
+ *
+ * This function reassigns data points to the nearest centroid if the nearest centroid
+ * is either the new cluster or the cluster to be split. It updates the clustersAffected
+ * array to mark the affected clusters.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param clusterToSplit The index of the cluster to split.
+ * @param clustersAffected A pointer to the array indicating which clusters are affected.
+ */
+void localRepartition(DataPoints* dataPoints, Centroids* centroids, size_t clusterToSplit, bool* clustersAffected)
+{
+    double traceStart = traceBegin();
+    size_t newClusterIndex = centroids->size - 1;
+
+    /* TODO: Kysy/selvit, ett tarvitaanko tt? Oma oletus on, ett ei tarvita
+    // new clusters -> old clusters
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].partition == clusterToSplit || dataPoints->points[i].partition == newClusterIndex)
+        {
+            size_t nearestCentroid = findNearestCentroid(&dataPoints->points[i], centroids);
+
+            if (dataPoints->points[i].partition != nearestCentroid)
+            {
+                clustersAffected[dataPoints->points[i].partition] = true; // Mark the old cluster as affected
+                clustersAffected[nearestCentroid] = true;                 // Mark the new cluster as affected
+                dataPoints->points[i].partition = nearestCentroid;
+            }
+        }
+    }*/
+
+    // old clusters -> new clusters
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        size_t currentCluster = dataPoints->points[i].partition;
+
+        // skip new cluster -> old cluster
+        if (currentCluster == clusterToSplit || currentCluster == newClusterIndex)
+            continue;
+
+        size_t nearestCentroid = findNearestCentroid(&dataPoints->points[i], centroids);
+
+        if (nearestCentroid == newClusterIndex || nearestCentroid == clusterToSplit)
+        {
+            //if (LOGGING >= 3) printf("Local repartition: Success, point %zu is reassigned\n", i);
+
+            clustersAffected[currentCluster] = true;    // Mark the old cluster as affected
+            dataPoints->points[i].partition = nearestCentroid;
+        }
+    }
+
+    traceEnd("repartition", traceStart);
+
+    //if(LOGGING >= 3) printf("Local repartition is over\n\n");
+}
+
+//todo: centroids turha tnne?
+/**
+ * @brief Calculates the MSE drop for a tentative split of a cluster.
+ *
+ * This function calculates the MSE drop by running local k-means on a cluster and comparing
+ * the new MSE with the original MSE. It returns the difference between the original MSE and the new MSE.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param clusterLabel The label of the cluster to split.
+ * @param localMaxIterations The maximum number of iterations for the local k-means.
+ * @param originalClusterMSE The original MSE of the cluster before the split.
+ * @return The MSE drop for the tentative split of the cluster.
+ */
+double tentativeMseDrop(DataPoints* dataPoints, size_t clusterLabel, size_t localMaxIterations, double originalClusterMSE)
+{
+    double traceStart = traceBegin();
+
+    size_t clusterSize = 0;
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].partition == clusterLabel)
+        {
+            clusterSize++;
+        }
+    }
+    
+    // A cluster with less than two points cannot be split
+    if (clusterSize < 2)
+    {
+        return 0.0;
+    }
+
+    size_t previousSubsystem = setMemorySubsystem(MEMORY_TENTATIVE);
+
+    // Views of the data points of the cluster, they share the attributes but have partitions of their own
+    DataPoints pointsInCluster;
+    pointsInCluster.size = clusterSize;
+    pointsInCluster.matrix = NULL;
+    pointsInCluster.mappedView = NULL;
+    pointsInCluster.mappedSize = 0;
+    pointsInCluster.points = trackedMalloc(clusterSize * sizeof(DataPoint));
+    handleMemoryError(pointsInCluster.points);
+
+    size_t index = 0;
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].partition == clusterLabel)
+        {
+            pointsInCluster.points[index] = dataPoints->points[i];
+            index++;
+        }
+    }
+
+    // Random centroids
+    size_t idx1 = rand() % clusterSize;
+    size_t idx2 = idx1;
+    while (idx2 == idx1)
+    {
+        idx2 = rand() % clusterSize;
+    }
+
+    Centroids localCentroids = allocateCentroids(2,dataPoints->points[0].dimensions);
+
+    deepCopyDataPoint(&localCentroids.points[0], &pointsInCluster.points[idx1]);
+    deepCopyDataPoint(&localCentroids.points[1], &pointsInCluster.points[idx2]);
+
+    // k-means
+    double resultMse = runKMeans(&pointsInCluster, localMaxIterations, &localCentroids, NULL);
+
+    // Calculate combined MSE of the two clusters
+	//TODO: WithSize vai ilman? Eli koko datasetin mukaan vai pelkstn clusterin mukaan?
+    //      Jos withSize, niin tthn ei edes tarvita, resultMse on sama?
+    double newClusterMSE = calculateMSEWithSize(&pointsInCluster, &localCentroids, dataPoints->size);
+
+    // No drop if the empty cluster strategy dropped one of the local centroids
+    double mseDrop = localCentroids.size < 2 ? 0.0 : originalClusterMSE - resultMse;
+
+    freeDataPointViews(&pointsInCluster);
+    freeCentroids(&localCentroids);
+    setMemorySubsystem(previousSubsystem);
+
+    traceEnd("tentative split", traceStart);
+
+    return mseDrop;
+}
+
+/**
+ * @brief Calculates the MSE drop for a tentative split of a cluster.
+ *
+ * This function calculates the MSE drop by running local k-means on a cluster and comparing
+ * the new MSE with the original MSE. It returns the difference between the original MSE and the new MSE.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param clusterLabel The label of the cluster to split.
+ * @param localMaxIterations The maximum number of iterations for the local k-means.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @return A ClusteringResult structure containing the new centroids and the MSE drop.
+ */
+ClusteringResult tentativeSplitterForBisecting(DataPoints* dataPoints, size_t clusterLabel, size_t localMaxIterations, const Centroids* groundTruth)
+{
+    double traceStart = traceBegin();
+
+    size_t clusterSize = 0;
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        if (dataPoints->points[i].partition == clusterLabel)
+        {
+            clusterSize++;
+        }
+    }
+
+    // A cluster with less than two points cannot be split, DBL_MAX marks the result as unusable
+    if (clusterSize < 2)
+    {
+        ClusteringResult emptyResult = allocateClusteringResult(0, 0, dataPoints->points[0].dimensions);
+        return emptyResult;
+    }
+
+    size_t previousSubsystem = setMemorySubsystem(MEMORY_TENTATIVE);
+
+    // Views of the data points of the cluster, they share the attributes but have partitions of their own
+    DataPoints pointsInCluster;
+    pointsInCluster.size = clusterSize;
+    pointsInCluster.matrix = NULL;
+    pointsInCluster.mappedView = NULL;
+    pointsInCluster.mappedSize = 0;
+    pointsInCluster.points = trackedMalloc(clusterSize * sizeof(DataPoint));
+    handleMemoryError(pointsInCluster.points);
+
+    size_t index = 0;
+    for (size_t i = 0; i < dataPoints->size; ++i) //todo: tmn loopin voi ehk yhdist ylemmn kanssa? ps. tai ehk ei koska clusterSize?
+    {
+        if (dataPoints->points[i].partition == clusterLabel)
+        {
+            pointsInCluster.points[index] = dataPoints->points[i];
+            index++;
+        }
+    }
+
+    // Random centroids
+    size_t idx1 = rand() % clusterSize;
+    size_t idx2 = idx1;
+    while (idx2 == idx1)
+    {
+        idx2 = rand() % clusterSize;
+    }
+
+    Centroids localCentroids = allocateCentroids(2, dataPoints->points[0].dimensions);
+    deepCopyDataPoint(&localCentroids.points[0], &pointsInCluster.points[idx1]);
+    deepCopyDataPoint(&localCentroids.points[1], &pointsInCluster.points[idx2]);
+
+    // The partition of the result is never read, so it is not allocated
+    ClusteringResult localResult = allocateClusteringResult(0, 2, dataPoints->points[0].dimensions);
+
+    // k-means
+    localResult.mse = runKMeans(&pointsInCluster, localMaxIterations, &localCentroids, groundTruth);
+
+    // The empty cluster strategy dropped one of the local centroids, the result is unusable
+    if (localCentroids.size < 2)
+    {
+        freeClusteringResult(&localResult, 2);
+        freeDataPointViews(&pointsInCluster);
+        freeCentroids(&localCentroids);
+        setMemorySubsystem(previousSubsystem);
+        return allocateClusteringResult(0, 0, dataPoints->points[0].dimensions);
+    }
+
+    // Calculate combined MSE of the two clusters
+    //TODO: WithSize vai ilman? Eli koko datasetin mukaan vai pelkstn clusterin mukaan?
+    //      Jos withSize, niin tthn ei edes tarvita, resultMse on sama?
+    double newClusterMSE = calculateMSEWithSize(&pointsInCluster, &localCentroids, dataPoints->size);
+
+    // Calculate the MSE drop
+    //localResult.mse = newClusterMSE;
+
+	deepCopyDataPoint(&localResult.centroids[0], &localCentroids.points[0]);
+    deepCopyDataPoint(&localResult.centroids[1], &localCentroids.points[1]);
+
+    freeDataPointViews(&pointsInCluster);
+    freeCentroids(&localCentroids);;
+    setMemorySubsystem(previousSubsystem);
+
+    traceEnd("tentative split", traceStart);
+
+    return localResult;
+}
+
+/**
+ * @brief Completes a partial split solution to the given number of centroids when the deadline has passed.
+ *
+ * The missing centroids are placed at random data points and the data points are partitioned,
+ * so the final k-means of the split algorithm starts from a valid solution with all clusters.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param maxCentroids The number of centroids to reach.
+ */
+void completeCentroidsAtDeadline(DataPoints* dataPoints, Centroids* centroids, size_t maxCentroids)
+{
+    if (centroids->size >= maxCentroids) return;
+
+    size_t dimensions = centroids->points[0].dimensions;
+
+    centroids->points = trackedRealloc(centroids->points, maxCentroids * sizeof(DataPoint));
+    handleMemoryError(centroids->points);
+
+    while (centroids->size < maxCentroids)
+    {
+        centroids->points[centroids->size] = allocateDataPoint(dimensions);
+        deepCopyDataPoint(&centroids->points[centroids->size], &dataPoints->points[rand() % dataPoints->size]);
+        centroids->size++;
+    }
+
+    partitionStep(dataPoints, centroids);
+}
+
+/**
+ * @brief Runs the split k-means algorithm with random splitting.
+ *
+ * This function iterates through partition and centroid steps, randomly selects a cluster to split,
+ * and updates the centroids and partitions based on the results of the local k-means.
+ * It returns the best mean squared error (MSE) obtained during the iterations.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param maxCentroids The maximum number of centroids to generate.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @return The best mean squared error (MSE) obtained during the iterations.
+ */
+double runRandomSplit(DataPoints* dataPoints, Centroids* centroids, size_t maxCentroids, size_t maxIterations, const Centroids* groundTruth)
+{
+    size_t localMaxIterations = 2;
+
+    partitionStep(dataPoints, centroids);
+    centroidStep(centroids, dataPoints);
+
+    while(centroids->size < maxCentroids)
+    {
+        if (deadlineReached())
+        {
+            completeCentroidsAtDeadline(dataPoints, centroids, maxCentroids);
+            break;
+        }
+
+        size_t clusterToSplit = rand() % centroids->size;
+
+        splitClusterIntraCluster(dataPoints, centroids, clusterToSplit, localMaxIterations, groundTruth);
+        publishProgressClusters(centroids->size);
+
+        /*if (LOGGING >= 3)
+        {
+            size_t ci = calculateCentroidIndex(centroids, groundTruth);
+            double mse = calculateMSE(dataPoints, centroids);
+            printf("(RandomSplit) Number of centroids: %zu, CI: %zu, and MSE: %.5f \n", centroids->size, ci, mse / 10000);
+        }*/
+    }	
+
+    //TODO: globaali k-means  
+    double finalResultMse = runKMeans(dataPoints, maxIterations, centroids, groundTruth);
+
+    return finalResultMse;
+}
+
+/**
+ * @brief Makes the first split of the MSE split k-means and evaluates the tentative splits of the new clusters.
+ *
+ * This is the common start of every split type. The SSE and the tentative SSE drop of both clusters
+ * are left in the given arrays for continueMseSplit.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the single initial centroid.
+ * @param iterations The maximum number of iterations for the local k-means.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param clusterMSEs An array of at least two elements that receives the SSE of each cluster.
+ * @param MseDrops An array of at least two elements that receives the tentative SSE drop of each cluster.
+ */
+void beginMseSplit(DataPoints* dataPoints, Centroids* centroids, size_t iterations, const Centroids* groundTruth, double* clusterMSEs, double* MseDrops)
+{
+    //Only 1 cluster, so no need for decision making
+    size_t initialClusterToSplit = 0;
+    splitClusterIntraCluster(dataPoints, centroids, initialClusterToSplit, iterations, groundTruth);
+
+    for (size_t i = 0; i < centroids->size; ++i)
+    {
+        clusterMSEs[i] = calculateClusterMSE(dataPoints, centroids, i); //TODO: tarvitaanko omaa rakennetta?
+        MseDrops[i] = tentativeMseDrop(dataPoints, i, iterations, clusterMSEs[i]);
+    }
+}
+
+/**
+ * @brief Continues the MSE split k-means from a state left by beginMseSplit until the number of centroids is reached.
+ *
+ * This function repeatedly splits the cluster with the largest tentative SSE drop with the given split type,
+ * updates the cached SSEs and drops of the affected clusters, and finishes with a global k-means.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param maxCentroids The maximum number of centroids to generate.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param splitType The type of split to perform (0 = intra-cluster, 1 = global, 2 = local repartition).
+ * @param clusterMSEs The SSE of each cluster, maxCentroids elements, updated by this function.
+ * @param MseDrops The tentative SSE drop of each cluster, maxCentroids elements, updated by this function.
+ * @return The best mean squared error (MSE) of the final k-means.
+ */
+double continueMseSplit(DataPoints* dataPoints, Centroids* centroids, size_t maxCentroids, size_t maxIterations, const Centroids* groundTruth, size_t splitType, double* clusterMSEs, double* MseDrops)
+{
+    //TODO: ent jos globaalia ei rajoittaisi, olisiko tullut paremmat tulokset???????
+    //TODO: pohdi tarkemmat arvot, globaaliin 5 nytt toimivan hyvin
+    size_t iterations = splitType == 0 ? maxIterations : splitType == 1 ? maxIterations : maxIterations;
+
+    bool* clustersAffected = trackedCalloc(maxCentroids*2, sizeof(bool));
+    handleMemoryError(clustersAffected);
+
+    while (centroids->size < maxCentroids)
+    {
+        if (deadlineReached())
+        {
+            completeCentroidsAtDeadline(dataPoints, centroids, maxCentroids);
+            break;
+        }
+
+		// Choose the cluster that reduces the MSE the most
+        size_t clusterToSplit = 0;
+        double maxMseDrop = MseDrops[0];
+
+        for (size_t i = 1; i < centroids->size; ++i)
+        {
+            if (MseDrops[i] > maxMseDrop)
+            {
+                maxMseDrop = MseDrops[i];
+                clusterToSplit = i;
+            }
+        }
+
+        /*if (LOGGING >= 3 && splitType == 3)
+        {
+            printDataPointsPartitions(dataPoints, centroids->size);
+        }*/
+
+        // No cluster can be split any more (all have less than two points)
+        if (maxMseDrop == -DBL_MAX) break;
+
+        size_t sizeBeforeSplit = centroids->size;
+
+        if(splitType == 0) splitClusterIntraCluster(dataPoints, centroids, clusterToSplit, iterations, groundTruth);
+		else if (splitType == 1) splitClusterGlobal(dataPoints, centroids, clusterToSplit, iterations, groundTruth);
+		else if (splitType == 2) splitClusterIntraCluster(dataPoints, centroids, clusterToSplit, iterations, groundTruth);
+
+        // The cluster was too small to split, never choose it again
+        if (centroids->size == sizeBeforeSplit)
+        {
+            MseDrops[clusterToSplit] = -DBL_MAX;
+            continue;
+        }
+
+        publishProgressClusters(centroids->size);
+
+		if (splitType == 0) // Intra-cluster
+        {
+            // Recalculate MSE for the affected clusters
+            clusterMSEs[clusterToSplit] = calculateClusterMSE(dataPoints, centroids, clusterToSplit);
+            clusterMSEs[centroids->size - 1] = calculateClusterMSE(dataPoints, centroids, centroids->size - 1);
+
+            // Update MseDrops for the affected clusters
+            MseDrops[clusterToSplit] = tentativeMseDrop(dataPoints, clusterToSplit, iterations, clusterMSEs[clusterToSplit]);
+            MseDrops[centroids->size - 1] = tentativeMseDrop(dataPoints, centroids->size - 1, iterations, clusterMSEs[centroids->size - 1]);
+        }
+		else if (splitType == 1) // Global
+        {            
+            for (size_t i = 0; i < centroids->size; ++i)
+            {
+                clusterMSEs[i] = calculateClusterMSE(dataPoints, centroids, i);
+                MseDrops[i] = tentativeMseDrop(dataPoints, i, iterations, clusterMSEs[i]);
+            }
+        }
+		else if (splitType == 2) // Local repartition
+        {            
+            localRepartition(dataPoints, centroids, clusterToSplit, clustersAffected);
+            
+			clustersAffected[clusterToSplit] = true;
+			clustersAffected[centroids->size - 1] = true;
+
+			// Recalculate MseDrop for affected clusters (old and new)
+            for (size_t i = 0; i < centroids->size; ++i)
+            {
+                if (clustersAffected[i])
+                {
+                    //if (LOGGING >= 3) printf("Affected cluster: %zu\n", i);
+
+                    clusterMSEs[i] = calculateClusterMSE(dataPoints, centroids, i);
+                    MseDrops[i] = tentativeMseDrop(dataPoints, i, iterations, clusterMSEs[i]);
+                }
+            }
+
+            memset(clustersAffected, 0, (maxCentroids * 2) * sizeof(bool));
+        }
+
+        /*if (LOGGING >= 3 && splitType == 2)
+        {
+            size_t ci = calculateCentroidIndex(centroids, groundTruth);
+            double mse = calculateMSE(dataPoints, centroids);
+            printf("(MseSplit) Number of centroids: %zu, CI: %zu, and MSE: %.5f \n", centroids->size, ci, mse / 10000);
+        }*/
+
+
+        //if (LOGGING >= 3 && splitType == 2) printf("Round over\n\n");
+    }
+
+	trackedFree(clustersAffected);
+
+    //TODO: globaali k-means  
+    double finalResultMse = runKMeans(dataPoints, maxIterations, centroids, groundTruth);
+
+    return finalResultMse;
+}
+
+/**
+ * @brief Runs the split k-means algorithm with tentative splitting (choosing to split the one that reduces the MSE the most).
+ *
+ * This function iterates through partition and centroid steps, selects a cluster to split based on the MSE drop,
+ * and updates the centroids and partitions based on the results of the local k-means.
+ * It returns the best mean squared error (MSE) obtained during the iterations.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param maxCentroids The maximum number of centroids to generate.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param splitType The type of split to perform (0 = intra-cluster, 1 = global, 2 = local repartition).
+ * @return The best mean squared error (MSE) obtained during the iterations.
+ */
+double runMseSplit(DataPoints* dataPoints, Centroids* centroids, size_t maxCentroids, size_t maxIterations, const Centroids* groundTruth, size_t splitType)
+{
+    double* clusterMSEs = trackedMalloc(maxCentroids * sizeof(double));
+    handleMemoryError(clusterMSEs);
+
+    double* MseDrops = trackedCalloc(maxCentroids, sizeof(size_t));
+    handleMemoryError(MseDrops);
+
+    beginMseSplit(dataPoints, centroids, maxIterations, groundTruth, clusterMSEs, MseDrops);
+
+    double finalResultMse = continueMseSplit(dataPoints, centroids, maxCentroids, maxIterations, groundTruth, splitType, clusterMSEs, MseDrops);
+
+    trackedFree(clusterMSEs);
+	trackedFree(MseDrops);
+
+    return finalResultMse;
+}
+
+/**
+ * @brief Runs the Bisecting k-means algorithm on the given data points and centroids.
+ *
+ * This function iterates through partition and centroid steps, selects a cluster to split based on the SSE,
+ * and updates the centroids and partitions based on the results of the local k-means.
+ * It returns the best mean squared error (MSE) obtained during the iterations.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param maxCentroids The maximum number of centroids to generate.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @return The best mean squared error (MSE) obtained during the iterations.
+ */
+double runBisectingKMeans(DataPoints* dataPoints, Centroids* centroids, size_t maxCentroids, size_t maxIterations, const Centroids* groundTruth)
+{
+	size_t bisectingIterations = 5;
+    
+    double* SseList = trackedMalloc(maxCentroids * sizeof(size_t));
+    handleMemoryError(SseList);
+    double bestMse = DBL_MAX;
+
+    DataPoint newCentroid1 = allocateDataPoint(dataPoints->points[0].dimensions);
+    DataPoint newCentroid2 = allocateDataPoint(dataPoints->points[0].dimensions);
+
+	//Step 0: Only 1 cluster, so no need for decision making
+    size_t initialClusterToSplit = 0;
+    splitClusterIntraCluster(dataPoints, centroids, initialClusterToSplit, maxIterations, groundTruth);
+
+	SseList[0] = calculateClusterMSE(dataPoints, centroids, 0);
+    SseList[1] = calculateClusterMSE(dataPoints, centroids, 1);
+
+    //Repeat until we have K clusters
+    for (size_t i = 2; centroids->size < maxCentroids; ++i)
+    {
+        //if (LOGGING >= 3) printf("(BKM) Round %zu: Centroids: %zu\n", i-1, centroids->size);
+
+        if (deadlineReached())
+        {
+            completeCentroidsAtDeadline(dataPoints, centroids, maxCentroids);
+            break;
+        }
+
+        // The dumped solution has fewer clusters than the final one
+        serviceSignalRequests(dataPoints, centroids);
+
+        size_t clusterToSplit = 0;
+        double maxSSE = SseList[0];
+
+		//Step 1: Choose the cluster to split (the highest SSE)
+        for (size_t j = 1; j < centroids->size; ++j)
+        {
+            if (SseList[j] > maxSSE)
+            {
+                maxSSE = SseList[j];
+                clusterToSplit = j;
+            }
+        }
+
+        // Every remaining cluster is too small to split
+        if (maxSSE < 0.0) break;
+
+		//Repeat for a set number of iterations (in an anytime run until the deadline, at least once)
+        for (size_t j = 0; j < bisectingIterations; ++j)
+        {
+            if (j > 0 && deadlineReached()) break;
+
+			ClusteringResult curr = tentativeSplitterForBisecting(dataPoints, clusterToSplit, maxIterations, groundTruth);
+
+            //if (LOGGING >= 3) printf("(RKM) Round %d: Latest Centroid Index (CI): %zu and Latest Mean Sum-of-Squared Errors (MSE): %.4f\n", repeat, result1.centroidIndex, result1.mse / 10000);
+
+			// If the result is better than the best result so far, update the best result
+            if (curr.mse < bestMse)
+            {
+                //if (LOGGING >= 3) printf("(from inner) Round %zu\n", j);
+                bestMse = curr.mse;
+                
+                /*if (LOGGING >= 3)
+                {
+                    Centroids tempCentroids;
+                    tempCentroids.size = 2;
+                    tempCentroids.points = curr.centroids;
+                    printCentroidsInfo(&tempCentroids);
+                }*/                
+                
+                // Save the two new centroids
+				deepCopyDataPoint(&newCentroid1, &curr.centroids[0]);
+                deepCopyDataPoint(&newCentroid2, &curr.centroids[1]);
+            }
+
+            freeClusteringResult(&curr, curr.mse == DBL_MAX ? 0 : 2);
+        }
+
+        // The cluster was too small to split, never choose it again
+        if (bestMse == DBL_MAX)
+        {
+            SseList[clusterToSplit] = -1.0;
+            continue;
+        }
+
+		// Replace the old centroid with the new centroid1
+        deepCopyDataPoint(&centroids->points[clusterToSplit], &newCentroid1);
+
+		// Increase the size of the centroids array and add the new centroid2
+        centroids->points = trackedRealloc(centroids->points, (centroids->size + 1) * sizeof(DataPoint));
+        handleMemoryError(centroids->points);
+        centroids->points[centroids->size] = allocateDataPoint(newCentroid2.dimensions);
+        deepCopyDataPoint(&centroids->points[centroids->size], &newCentroid2);
+        centroids->size++;
+        publishProgressClusters(centroids->size);
+
+        if (LOGGING >= 2 && groundTruth != NULL) printf("CI %zu\n", calculateCentroidIndex(centroids, groundTruth));
+
+        //if (LOGGING >= 3) printf("(from outer) Round %zu\n", i);
+        //printCentroidsInfo(centroids);
+
+        partitionStep(dataPoints, centroids);
+
+		//Step 3: Update the SSE list
+        // Recalculate MSE for the affected clusters
+        SseList[clusterToSplit] = calculateClusterMSE(dataPoints, centroids, clusterToSplit);
+        SseList[centroids->size - 1] = calculateClusterMSE(dataPoints, centroids, centroids->size - 1);
+        
+        if (LOGGING >= 2 && centroids->size == maxCentroids - 1) {
+            writeCentroidsToFile("outputs/TESTcentroids.txt", centroids);
+            writeDataPointPartitionsToFile("outputs/TESTpartitions.txt", dataPoints);
+        }
+
+        bestMse = DBL_MAX;
+    }
+
+	//Step 4: Run the final k-means
+    double finalResultMse = runKMeans(dataPoints, maxIterations, centroids, groundTruth);
+    if (LOGGING >= 2) printf("size  %zu\n", centroids->size);
+    // Cleanup
+    trackedFree(SseList);
+	freeDataPoint(&newCentroid1);
+	freeDataPoint(&newCentroid2);
+
+    // The runner writes the results of the first trial, these are for debugging
+    if (LOGGING >= 2)
+    {
+        writeCentroidsToFile("outputs/centroids.txt", centroids);
+        writeDataPointPartitionsToFile("outputs/partitions.txt", dataPoints);
+    }
+
+    return finalResultMse;
+}
+
+/**
+ * @brief Divides the centroids among groups in proportion to the group sizes.
+ *
+ * This function uses the largest remainder method. Every non-empty group gets at least one centroid
+ * and no group gets more centroids than it has data points. The number of groups must not exceed the number of centroids,
+ * otherwise the minimum of one centroid per group cannot be met.
+ *
+ * @param groupSizes The number of data points in each group.
+ * @param numGroups The number of groups.
+ * @param numPoints The total number of data points.
+ * @param numCentroids The number of centroids to divide.
+ * @param allocation Receives the number of centroids of each group.
+ */
+void allocateCentroidsToGroups(const size_t* groupSizes, size_t numGroups, size_t numPoints, size_t numCentroids, size_t* allocation)
+{
+    size_t total = 0;
+    for (size_t g = 0; g < numGroups; ++g)
+    {
+        allocation[g] = (size_t)((double)numCentroids * (double)groupSizes[g] / (double)numPoints);
+        if (allocation[g] > groupSizes[g]) allocation[g] = groupSizes[g];
+        if (allocation[g] == 0 && groupSizes[g] > 0) allocation[g] = 1;
+        total += allocation[g];
+    }
+
+    // The minimum of one centroid per group may overshoot, take from the groups furthest above their share
+    while (total > numCentroids)
+    {
+        size_t best = SIZE_MAX;
+        double bestExcess = -DBL_MAX;
+        for (size_t g = 0; g < numGroups; ++g)
+        {
+            double excess = (double)allocation[g] - (double)numCentroids * (double)groupSizes[g] / (double)numPoints;
+            if (allocation[g] > 1 && excess > bestExcess)
+            {
+                bestExcess = excess;
+                best = g;
+            }
+        }
+
+        // Only possible with more non-empty groups than centroids
+        assert(best != SIZE_MAX);
+        if (best == SIZE_MAX) break;
+        allocation[best]--;
+        total--;
+    }
+
+    // Give the rest to the groups with the largest remainders
+    while (total < numCentroids)
+    {
+        size_t best = SIZE_MAX;
+        double bestRemainder = -DBL_MAX;
+        for (size_t g = 0; g < numGroups; ++g)
+        {
+            double remainder = (double)numCentroids * (double)groupSizes[g] / (double)numPoints - (double)allocation[g];
+            if (allocation[g] < groupSizes[g] && remainder > bestRemainder)
+            {
+                bestRemainder = remainder;
+                best = g;
+            }
+        }
+
+        // Only possible with fewer data points than centroids
+        assert(best != SIZE_MAX);
+        if (best == SIZE_MAX) break;
+        allocation[best]++;
+        total++;
+    }
+}
+
+/**
+ * @brief Groups the leaf centroids of the hierarchy under their nearest group centroid.
+ *
+ * @param centroids A pointer to the Centroids structure containing the leaf centroids.
+ * @param groupCentroids A pointer to the Centroids structure containing the group centroids.
+ * @param leafOffsets Receives the start of each group in leafOrder (groupCentroids->size + 1 entries).
+ * @param leafOrder Receives the leaf indices ordered by group (centroids->size entries).
+ */
+void buildGroupLeafLists(const Centroids* centroids, const Centroids* groupCentroids, size_t* leafOffsets, size_t* leafOrder)
+{
+    size_t numGroups = groupCentroids->size;
+    size_t dimensions = centroids->points[0].dimensions;
+
+    size_t* leafGroups = trackedMalloc(centroids->size * sizeof(size_t));
+    handleMemoryError(leafGroups);
+
+    #pragma omp parallel for schedule(static)
+    for (long long leaf = 0; leaf < (long long)centroids->size; ++leaf)
+    {
+        size_t nearestGroup = 0;
+        double minDistance = DBL_MAX;
+        for (size_t g = 0; g < numGroups; ++g)
+        {
+            double distance = calculateAssignmentDistance(centroids->points[leaf].attributes, groupCentroids->points[g].attributes, dimensions);
+            if (distance < minDistance)
+            {
+                minDistance = distance;
+                nearestGroup = g;
+            }
+        }
+        leafGroups[leaf] = nearestGroup;
+    }
+
+    memset(leafOffsets, 0, (numGroups + 1) * sizeof(size_t));
+    for (size_t leaf = 0; leaf < centroids->size; ++leaf)
+    {
+        leafOffsets[leafGroups[leaf] + 1]++;
+    }
+    for (size_t g = 0; g < numGroups; ++g)
+    {
+        leafOffsets[g + 1] += leafOffsets[g];
+    }
+
+    size_t* cursors = trackedMalloc(numGroups * sizeof(size_t));
+    handleMemoryError(cursors);
+    memcpy(cursors, leafOffsets, numGroups * sizeof(size_t));
+    for (size_t leaf = 0; leaf < centroids->size; ++leaf)
+    {
+        leafOrder[cursors[leafGroups[leaf]]++] = leaf;
+    }
+
+    trackedFree(cursors);
+    trackedFree(leafGroups);
+}
+
+/**
+ * @brief Assigns each data point to the nearest leaf centroid within its neighbouring groups.
+ *
+ * This is the assignment of the two-level tree: a data point only compares the leaf centroids of
+ * the given nearest groups of its own group, which costs about numNeighbours * K / sqrt(K) distances instead of K.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the leaf centroids.
+ * @param pointGroups The group of each data point.
+ * @param neighbourGroups The nearest groups of each group, numNeighbours entries per group.
+ * @param numNeighbours The number of neighbouring groups searched.
+ * @param leafOffsets The start of each group in leafOrder.
+ * @param leafOrder The leaf indices ordered by group.
+ */
+void partitionStepTwoLevel(DataPoints* dataPoints, const Centroids* centroids, const size_t* pointGroups, const size_t* neighbourGroups, size_t numNeighbours, const size_t* leafOffsets, const size_t* leafOrder)
+{
+    size_t dimensions = dataPoints->points[0].dimensions;
+
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < (long long)dataPoints->size; ++i)
+    {
+        const double* attributes = dataPoints->points[i].attributes;
+        const size_t* neighbours = &neighbourGroups[pointGroups[i] * numNeighbours];
+        size_t nearestCentroidId = dataPoints->points[i].partition;
+        double minDistance = DBL_MAX;
+
+        for (size_t n = 0; n < numNeighbours; ++n)
+        {
+            size_t g = neighbours[n];
+            for (size_t j = leafOffsets[g]; j < leafOffsets[g + 1]; ++j)
+            {
+                size_t leaf = leafOrder[j];
+                double distance = calculateAssignmentDistance(attributes, centroids->points[leaf].attributes, dimensions);
+                if (distance < minDistance || (distance == minDistance && leaf < nearestCentroidId))
+                {
+                    minDistance = distance;
+                    nearestCentroidId = leaf;
+                }
+            }
+        }
+
+        dataPoints->points[i].partition = nearestCentroidId;
+    }
+}
+
+/**
+ * @brief Runs two-level hierarchical k-means for a large number of clusters.
+ *
+ * The data points are first clustered into sqrt(K) groups with k-means. The K centroids are divided among
+ * the groups in proportion to their sizes and every group gets a seed drawn serially from rand(). The groups
+ * are then clustered with k-means in parallel, each drawing its initial centroids from its own seed with
+ * nextLocalRandom, so a seeded run gives the same result with any number of threads.
+ * The k-means of a group only touches shared state that is safe to use from several threads: the progress
+ * counters are atomic, the trace buffers belong to the thread, and the SSE, the anytime result and the signal
+ * requests are only published for the full data. The steps inside a group run on the thread of the group.
+ * A failed allocation inside the parallel loop ends the program, as in the other parallel loops.
+ * The optional refinement runs flat k-means iterations where the two-level tree restricts every data point
+ * to the leaf centroids of the HIERARCHICAL_NEIGHBOUR_GROUPS groups nearest to its own.
+ * The tree search uses the distance of the active metric.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure with K allocated centroids, which receives the result.
+ *                  Its size decreases if the empty cluster strategy drops clusters.
+ * @param maxIterations The maximum number of iterations for each k-means run.
+ * @param refinementIterations The number of flat refinement iterations (0 = none).
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @return The SSE of the final partition.
+ */
+double runHierarchicalKMeans(DataPoints* dataPoints, Centroids* centroids, size_t maxIterations, size_t refinementIterations, const Centroids* groundTruth)
+{
+    size_t numCentroids = centroids->size;
+    size_t dimensions = dataPoints->points[0].dimensions;
+    size_t numGroups = (size_t)(sqrt((double)numCentroids) + 0.5);
+    if (numGroups < 1) numGroups = 1;
+    if (numGroups > numCentroids) numGroups = numCentroids;
+
+    //Step 1: Cluster the data points into groups
+    Centroids groupCentroids = allocateCentroids(numGroups, dimensions);
+    generateRandomCentroids(numGroups, dataPoints, &groupCentroids);
+    runKMeans(dataPoints, maxIterations, &groupCentroids, groundTruth);
+    partitionStep(dataPoints, &groupCentroids);
+    numGroups = groupCentroids.size;
+
+    size_t* pointGroups = trackedMalloc(dataPoints->size * sizeof(size_t));
+    size_t* groupOffsets = trackedCalloc(numGroups + 1, sizeof(size_t));
+    size_t* members = trackedMalloc(dataPoints->size * sizeof(size_t));
+    size_t* allocation = trackedMalloc(numGroups * sizeof(size_t));
+    handleMemoryError(pointGroups);
+    handleMemoryError(groupOffsets);
+    handleMemoryError(members);
+    handleMemoryError(allocation);
+
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        pointGroups[i] = dataPoints->points[i].partition;
+        groupOffsets[pointGroups[i] + 1]++;
+    }
+    for (size_t g = 0; g < numGroups; ++g)
+    {
+        groupOffsets[g + 1] += groupOffsets[g];
+    }
+    size_t* cursors = trackedMalloc(numGroups * sizeof(size_t));
+    handleMemoryError(cursors);
+    memcpy(cursors, groupOffsets, numGroups * sizeof(size_t));
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        members[cursors[pointGroups[i]]++] = i;
+    }
+    trackedFree(cursors);
+
+    //Step 2: Divide the centroids among the groups and draw a seed for every group serially
+    size_t* groupSizes = trackedCalloc(numGroups, sizeof(size_t));
+    handleMemoryError(groupSizes);
+    for (size_t g = 0; g < numGroups; ++g)
+    {
+        groupSizes[g] = groupOffsets[g + 1] - groupOffsets[g];
+    }
+    allocateCentroidsToGroups(groupSizes, numGroups, dataPoints->size, numCentroids, allocation);
+    trackedFree(groupSizes);
+
+    Centroids* localCentroids = trackedMalloc(numGroups * sizeof(Centroids));
+    uint64_t* groupSeeds = trackedMalloc(numGroups * sizeof(uint64_t));
+    handleMemoryError(localCentroids);
+    handleMemoryError(groupSeeds);
+    for (size_t g = 0; g < numGroups; ++g)
+    {
+        localCentroids[g].points = NULL;
+        localCentroids[g].size = 0;
+        groupSeeds[g] = (uint64_t)rand() * ((uint64_t)RAND_MAX + 1) + (uint64_t)rand();
+    }
+
+    //Step 3: Cluster the groups in parallel
+    #pragma omp parallel for schedule(dynamic)
+    for (long long group = 0; group < (long long)numGroups; ++group)
+    {
+        size_t g = (size_t)group;
+        if (allocation[g] == 0) continue;
+
+        size_t* groupMembers = &members[groupOffsets[g]];
+        size_t groupSize = groupOffsets[g + 1] - groupOffsets[g];
+        uint64_t randomState = groupSeeds[g];
+
+        localCentroids[g] = allocateCentroids(allocation[g], dimensions);
+        for (size_t c = 0; c < allocation[g]; ++c)
+        {
+            // Partial Fisher-Yates shuffle, the order of the members does not matter
+            size_t j = c + (size_t)(nextLocalRandom(&randomState) % (groupSize - c));
+            size_t temp = groupMembers[c];
+            groupMembers[c] = groupMembers[j];
+            groupMembers[j] = temp;
+            deepCopyDataPoint(&localCentroids[g].points[c], &dataPoints->points[groupMembers[c]]);
+        }
+
+        DataPoints pointsInGroup;
+        pointsInGroup.size = groupSize;
+        pointsInGroup.matrix = NULL;
+        pointsInGroup.mappedView = NULL;
+        pointsInGroup.mappedSize = 0;
+        pointsInGroup.points = trackedMalloc(groupSize * sizeof(DataPoint));
+        handleMemoryError(pointsInGroup.points);
+        for (size_t j = 0; j < groupSize; ++j)
+        {
+            pointsInGroup.points[j] = dataPoints->points[members[groupOffsets[g] + j]];
+        }
+
+        runKMeans(&pointsInGroup, maxIterations, &localCentroids[g], groundTruth);
+        partitionStep(&pointsInGroup, &localCentroids[g]);
+
+        for (size_t j = 0; j < groupSize; ++j)
+        {
+            pointGroups[members[groupOffsets[g] + j]] = pointsInGroup.points[j].partition;
+        }
+
+        freeDataPointViews(&pointsInGroup);
+    }
+
+    //Step 4: Collect the leaf centroids, the local labels become global labels
+    size_t* leafBase = trackedMalloc(numGroups * sizeof(size_t));
+    handleMemoryError(leafBase);
+    size_t numLeaves = 0;
+    for (size_t g = 0; g < numGroups; ++g)
+    {
+        leafBase[g] = numLeaves;
+        for (size_t c = 0; c < localCentroids[g].size; ++c)
+        {
+            deepCopyDataPoint(&centroids->points[numLeaves++], &localCentroids[g].points[c]);
+        }
+        freeCentroids(&localCentroids[g]);
+    }
+    for (size_t c = numLeaves; c < centroids->size; ++c)
+    {
+        freeDataPoint(&centroids->points[c]);
+    }
+    centroids->size = numLeaves;
+
+    for (size_t g = 0; g < numGroups; ++g)
+    {
+        for (size_t j = groupOffsets[g]; j < groupOffsets[g + 1]; ++j)
+        {
+            size_t i = members[j];
+            dataPoints->points[i].partition = leafBase[g] + pointGroups[i];
+            pointGroups[i] = g;
+        }
+    }
+
+    //Step 5: Flat refinement restricted to the neighbouring groups
+    if (refinementIterations > 0)
+    {
+        size_t numNeighbours = HIERARCHICAL_NEIGHBOUR_GROUPS < numGroups ? HIERARCHICAL_NEIGHBOUR_GROUPS : numGroups;
+        size_t* neighbourGroups = trackedMalloc(numGroups * numNeighbours * sizeof(size_t));
+        double* neighbourDistances = trackedMalloc(numNeighbours * sizeof(double));
+        size_t* leafOffsets = trackedMalloc((numGroups + 1) * sizeof(size_t));
+        size_t* leafOrder = trackedMalloc(numCentroids * sizeof(size_t));
+        handleMemoryError(neighbourGroups);
+        handleMemoryError(neighbourDistances);
+        handleMemoryError(leafOffsets);
+        handleMemoryError(leafOrder);
+
+        // The nearest groups of every group by insertion into a sorted list, the group itself comes first
+        for (size_t g = 0; g < numGroups; ++g)
+        {
+            size_t* neighbours = &neighbourGroups[g * numNeighbours];
+            size_t found = 0;
+            for (size_t h = 0; h < numGroups; ++h)
+            {
+                double distance = calculateAssignmentDistance(groupCentroids.points[g].attributes, groupCentroids.points[h].attributes, dimensions);
+                if (h == g) distance = -1.0;
+
+                size_t position = found < numNeighbours ? found++ : numNeighbours;
+                while (position > 0 && neighbourDistances[position - 1] > distance)
+                {
+                    if (position < numNeighbours)
+                    {
+                        neighbours[position] = neighbours[position - 1];
+                        neighbourDistances[position] = neighbourDistances[position - 1];
+                    }
+                    position--;
+                }
+                if (position < numNeighbours)
+                {
+                    neighbours[position] = h;
+                    neighbourDistances[position] = distance;
+                }
+            }
+        }
+
+        for (size_t iteration = 0; iteration < refinementIterations; ++iteration)
+        {
+            // The centroid step may move or drop leaves, so they are regrouped every iteration
+            buildGroupLeafLists(centroids, &groupCentroids, leafOffsets, leafOrder);
+            partitionStepTwoLevel(dataPoints, centroids, pointGroups, neighbourGroups, numNeighbours, leafOffsets, leafOrder);
+            centroidStep(centroids, dataPoints);
+        }
+
+        trackedFree(neighbourGroups);
+        trackedFree(neighbourDistances);
+        trackedFree(leafOffsets);
+        trackedFree(leafOrder);
+    }
+
+    double sse = calculateSSE(dataPoints, centroids);
+
+    trackedFree(pointGroups);
+    trackedFree(groupOffsets);
+    trackedFree(members);
+    trackedFree(allocation);
+    trackedFree(localCentroids);
+    trackedFree(groupSeeds);
+    trackedFree(leafBase);
+    freeCentroids(&groupCentroids);
+
+    return sse;
+}
+
+/**
+ * @brief Allocates the working memory of a graph search.
+ *
+ * @param numCentroids The number of centroids in the graph.
+ * @param beamWidth The maximum number of entries in the beam.
+ * @return A GraphSearch structure with allocated memory.
+ */
+GraphSearch allocateGraphSearch(size_t numCentroids, size_t beamWidth)
+{
+    GraphSearch search;
+    search.visited = trackedCalloc(numCentroids, sizeof(unsigned int));
+    search.beam = trackedMalloc((beamWidth + 1) * sizeof(size_t));
+    search.beamDistances = trackedMalloc((beamWidth + 1) * sizeof(double));
+    search.expanded = trackedMalloc((beamWidth + 1) * sizeof(bool));
+    handleMemoryError(search.visited);
+    handleMemoryError(search.beam);
+    handleMemoryError(search.beamDistances);
+    handleMemoryError(search.expanded);
+    search.stamp = 0;
+    search.beamSize = 0;
+    search.evaluations = 0;
+
+    return search;
+}
+
+/**
+ * @brief Frees the memory allocated for a GraphSearch structure.
+ *
+ * @param search A pointer to the GraphSearch structure to be freed.
+ */
+void freeGraphSearch(GraphSearch* search)
+{
+    trackedFree(search->visited);
+    trackedFree(search->beam);
+    trackedFree(search->beamDistances);
+    trackedFree(search->expanded);
+    search->visited = NULL;
+    search->beam = NULL;
+    search->beamDistances = NULL;
+    search->expanded = NULL;
+}
+
+/**
+ * @brief Frees the memory allocated for a CentroidGraph structure.
+ *
+ * @param graph A pointer to the CentroidGraph structure to be freed.
+ */
+void freeCentroidGraph(CentroidGraph* graph)
+{
+    trackedFree(graph->neighbours);
+    trackedFree(graph->degrees);
+    graph->neighbours = NULL;
+    graph->degrees = NULL;
+    graph->size = 0;
+}
+
+/**
+ * @brief Offers a centroid to the beam of a graph search.
+ *
+ * The beam is kept sorted by distance, and when it is full the farthest entry is dropped.
+ *
+ * @param search A pointer to the GraphSearch structure.
+ * @param beamWidth The maximum number of entries in the beam.
+ * @param centroidId The index of the centroid.
+ * @param distance The squared distance from the query to the centroid.
+ */
+static void offerToBeam(GraphSearch* search, size_t beamWidth, size_t centroidId, double distance)
+{
+    if (search->beamSize == beamWidth && distance >= search->beamDistances[beamWidth - 1]) return;
+
+    size_t position = search->beamSize < beamWidth ? search->beamSize++ : beamWidth - 1;
+    while (position > 0 && (search->beamDistances[position - 1] > distance || (search->beamDistances[position - 1] == distance && search->beam[position - 1] > centroidId)))
+    {
+        search->beam[position] = search->beam[position - 1];
+        search->beamDistances[position] = search->beamDistances[position - 1];
+        search->expanded[position] = search->expanded[position - 1];
+        position--;
+    }
+
+    search->beam[position] = centroidId;
+    search->beamDistances[position] = distance;
+    search->expanded[position] = false;
+}
+
+/**
+ * @brief Searches the centroid graph for the centroids nearest to a query.
+ *
+ * This function runs a greedy beam search: starting from the entry centroid, it repeatedly visits the neighbours
+ * of the nearest beam entry that has not been expanded yet, until every entry of the beam has been expanded.
+ * The result is left in the beam of the search, nearest first.
+ *
+ * @param graph A pointer to the CentroidGraph structure.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param query The attributes of the query point.
+ * @param entry The index of the centroid where the search starts.
+ * @param beamWidth The maximum number of entries in the beam.
+ * @param search A pointer to the GraphSearch structure holding the working memory.
+ */
+void searchCentroidGraph(const CentroidGraph* graph, const Centroids* centroids, const double* query, size_t entry, size_t beamWidth, GraphSearch* search)
+{
+    size_t dimensions = centroids->points[0].dimensions;
+
+    if (++search->stamp == 0)
+    {
+        // The stamp wrapped around, old marks could match the new stamps
+        memset(search->visited, 0, centroids->size * sizeof(unsigned int));
+        search->stamp = 1;
+    }
+
+    search->beamSize = 0;
+    search->visited[entry] = search->stamp;
+    offerToBeam(search, beamWidth, entry, calculateAssignmentDistance(query, centroids->points[entry].attributes, dimensions));
+    search->evaluations++;
+
+    while (true)
+    {
+        size_t current = 0;
+        while (current < search->beamSize && search->expanded[current]) current++;
+        if (current == search->beamSize) break;
+
+        search->expanded[current] = true;
+        size_t node = search->beam[current];
+        const size_t* neighbours = &graph->neighbours[node * graph->maxDegree];
+
+        for (size_t n = 0; n < graph->degrees[node]; ++n)
+        {
+            size_t neighbour = neighbours[n];
+            if (search->visited[neighbour] == search->stamp) continue;
+            search->visited[neighbour] = search->stamp;
+
+            double distance = calculateAssignmentDistance(query, centroids->points[neighbour].attributes, dimensions);
+            search->evaluations++;
+            offerToBeam(search, beamWidth, neighbour, distance);
+        }
+    }
+}
+
+/**
+ * @brief Selects a diverse subset of neighbour candidates for a centroid.
+ *
+ * The candidates are visited nearest first, and a candidate is kept only if it is closer to the base centroid
+ * than to every candidate kept before it. This drops candidates that are reachable through a kept one and
+ * preserves the links towards other directions, which keeps separate clusters of centroids connected.
+ * The kept candidates are moved to the front of the arrays in their original order.
+ *
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param candidates The candidate centroids, ordered by distance to the base centroid.
+ * @param candidateDistances The squared distances of the candidates to the base centroid.
+ * @param numCandidates The number of candidates.
+ * @param limit The maximum number of candidates to keep.
+ * @return The number of candidates kept.
+ */
+static size_t selectDiverseNeighbours(const Centroids* centroids, size_t* candidates, double* candidateDistances, size_t numCandidates, size_t limit)
+{
+    size_t dimensions = centroids->points[0].dimensions;
+    size_t numKept = 0;
+
+    for (size_t n = 0; n < numCandidates && numKept < limit; ++n)
+    {
+        const double* candidate = centroids->points[candidates[n]].attributes;
+        bool keep = true;
+        for (size_t k = 0; k < numKept && keep; ++k)
+        {
+            keep = calculateAssignmentDistance(candidate, centroids->points[candidates[k]].attributes, dimensions) > candidateDistances[n];
+        }
+
+        if (keep)
+        {
+            candidates[numKept] = candidates[n];
+            candidateDistances[numKept] = candidateDistances[n];
+            numKept++;
+        }
+    }
+
+    return numKept;
+}
+
+/**
+ * @brief Adds a directed link to the centroid graph.
+ *
+ * If the neighbour list is full, the list and the new link are pruned back to a diverse subset.
+ *
+ * @param graph A pointer to the CentroidGraph structure.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param from The centroid that receives the link.
+ * @param to The linked centroid.
+ * @param candidates Working memory for maxDegree + 1 centroid indices.
+ * @param candidateDistances Working memory for maxDegree + 1 distances.
+ */
+static void linkCentroids(CentroidGraph* graph, const Centroids* centroids, size_t from, size_t to, size_t* candidates, double* candidateDistances)
+{
+    size_t* neighbours = &graph->neighbours[from * graph->maxDegree];
+    if (graph->degrees[from] < graph->maxDegree)
+    {
+        neighbours[graph->degrees[from]++] = to;
+        return;
+    }
+
+    // Sort the current neighbours and the new one by distance with an insertion sort, the list is short
+    size_t dimensions = centroids->points[0].dimensions;
+    const double* origin = centroids->points[from].attributes;
+    for (size_t n = 0; n <= graph->maxDegree; ++n)
+    {
+        size_t candidate = n < graph->maxDegree ? neighbours[n] : to;
+        double distance = calculateAssignmentDistance(origin, centroids->points[candidate].attributes, dimensions);
+
+        size_t position = n;
+        while (position > 0 && candidateDistances[position - 1] > distance)
+        {
+            candidates[position] = candidates[position - 1];
+            candidateDistances[position] = candidateDistances[position - 1];
+            position--;
+        }
+        candidates[position] = candidate;
+        candidateDistances[position] = distance;
+    }
+
+    graph->degrees[from] = selectDiverseNeighbours(centroids, candidates, candidateDistances, graph->maxDegree + 1, graph->maxDegree);
+    memcpy(neighbours, candidates, graph->degrees[from] * sizeof(size_t));
+}
+
+/**
+ * @brief Builds a navigable small-world graph over the centroids.
+ *
+ * The centroids are inserted in index order. A beam search over the graph built so far finds the nearest
+ * centroids of every new centroid, and the new centroid is linked in both directions to a diverse subset of
+ * at most GRAPH_DEGREE of them.
+ *
+ * @param graph A pointer to the CentroidGraph structure, which receives the graph. Its previous lists are freed.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ */
+void buildCentroidGraph(CentroidGraph* graph, const Centroids* centroids)
+{
+    freeCentroidGraph(graph);
+
+    graph->size = centroids->size;
+    graph->maxDegree = 2 * GRAPH_DEGREE;
+    graph->neighbours = trackedMalloc(graph->size * graph->maxDegree * sizeof(size_t));
+    graph->degrees = trackedCalloc(graph->size, sizeof(size_t));
+    handleMemoryError(graph->neighbours);
+    handleMemoryError(graph->degrees);
+
+    // A wider beam than in the assignment, the quality of the links decides the recall of every later search
+    size_t buildWidth = 2 * GRAPH_DEGREE;
+    GraphSearch search = allocateGraphSearch(graph->size, buildWidth);
+    size_t* candidates = trackedMalloc((graph->maxDegree + 1) * sizeof(size_t));
+    double* candidateDistances = trackedMalloc((graph->maxDegree + 1) * sizeof(double));
+    handleMemoryError(candidates);
+    handleMemoryError(candidateDistances);
+
+    for (size_t c = 1; c < graph->size; ++c)
+    {
+        // Only the centroids before c have links yet, so the search stays within them
+        searchCentroidGraph(graph, centroids, centroids->points[c].attributes, 0, buildWidth, &search);
+
+        size_t numLinks = selectDiverseNeighbours(centroids, search.beam, search.beamDistances, search.beamSize, GRAPH_DEGREE);
+        for (size_t n = 0; n < numLinks; ++n)
+        {
+            linkCentroids(graph, centroids, c, search.beam[n], candidates, candidateDistances);
+            linkCentroids(graph, centroids, search.beam[n], c, candidates, candidateDistances);
+        }
+    }
+
+    trackedFree(candidates);
+    trackedFree(candidateDistances);
+    freeGraphSearch(&search);
+}
+
+/**
+ * @brief Assigns each data point to the nearest centroid found by the graph search.
+ *
+ * The search of a data point starts from its current centroid, which after the first iterations is close
+ * to the answer, so only a few centroids are compared. The result is approximate: a data point
+ * can end up at a centroid that is not its nearest one.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param graph A pointer to the CentroidGraph structure over the centroids.
+ * @return The number of distance evaluations made.
+ */
+size_t partitionStepApproximate(DataPoints* dataPoints, const Centroids* centroids, const CentroidGraph* graph)
+{
+    size_t evaluations = 0;
+
+    #pragma omp parallel reduction(+:evaluations)
+    {
+        GraphSearch search = allocateGraphSearch(centroids->size, GRAPH_SEARCH_WIDTH);
+
+        #pragma omp for schedule(static)
+        for (long long i = 0; i < (long long)dataPoints->size; ++i)
+        {
+            size_t entry = dataPoints->points[i].partition < centroids->size ? dataPoints->points[i].partition : 0;
+            searchCentroidGraph(graph, centroids, dataPoints->points[i].attributes, entry, GRAPH_SEARCH_WIDTH, &search);
+            dataPoints->points[i].partition = search.beam[0];
+        }
+
+        evaluations += search.evaluations;
+        freeGraphSearch(&search);
+    }
+
+    return evaluations;
+}
+
+/**
+ * @brief Measures the accuracy of the approximate assignment to the current centroids on a sample of data points.
+ *
+ * Every sampled data point is searched in the graph like partitionStepApproximate would, but the partitions
+ * are left as they are. Its exact nearest centroid is found by brute force, and the error ratio compares
+ * the distances that calculateSSE sums for the two assignments.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the assigned data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param graph A pointer to the CentroidGraph structure over the centroids.
+ * @param report A pointer to the ApproximateSearchReport structure that receives the recall and the error ratio.
+ */
+void measureAssignmentRecall(const DataPoints* dataPoints, const Centroids* centroids, const CentroidGraph* graph, ApproximateSearchReport* report)
+{
+    size_t sampleSize = RECALL_SAMPLE_SIZE < dataPoints->size ? RECALL_SAMPLE_SIZE : dataPoints->size;
+    size_t matches = 0;
+    double approximateError = 0.0;
+    double exactError = 0.0;
+    GraphSearch search = allocateGraphSearch(centroids->size, GRAPH_SEARCH_WIDTH);
+
+    for (size_t s = 0; s < sampleSize; ++s)
+    {
+        // Golden ratio sequence, so the measurement does not use the random generator and does not follow the order of the file
+        double position = (double)s * 0.6180339887498949;
+        const DataPoint* point = &dataPoints->points[(size_t)((position - floor(position)) * dataPoints->size)];
+        size_t entry = point->partition < centroids->size ? point->partition : 0;
+        searchCentroidGraph(graph, centroids, point->attributes, entry, GRAPH_SEARCH_WIDTH, &search);
+        size_t approximateId = search.beam[0];
+        size_t exactId = findNearestCentroid(point, centroids);
+
+        if (exactId == approximateId) matches++;
+        approximateError += calculateMetricDistance(point, &centroids->points[approximateId]);
+        exactError += calculateMetricDistance(point, &centroids->points[exactId]);
+    }
+
+    freeGraphSearch(&search);
+
+    report->recall = sampleSize > 0 ? (double)matches / (double)sampleSize : 1.0;
+    report->sseRatio = exactError > 0.0 ? approximateError / exactError : 1.0;
+}
+
+/**
+ * @brief Runs the k-means algorithm with the approximate graph assignment.
+ *
+ * This function works like runKMeans, but the partition step searches a small-world graph over the centroids
+ * instead of comparing every centroid. The graph is rebuilt every GRAPH_REBUILD_INTERVAL iterations and whenever
+ * the number of centroids changes; in between the searches use the current centroid positions with the old links.
+ * After the last iteration the recall and the error ratio of the assignment are measured on a sample,
+ * the data points keep the labels of the last iteration.
+ * The graph is built and searched with the distance of the active metric (calculateAssignmentDistance).
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param iterations The maximum number of iterations to run the k-means algorithm.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param report A pointer to the ApproximateSearchReport structure that receives the accuracy of the assignment.
+ * @return The best mean squared error (MSE) obtained during the iterations.
+ */
+double runApproximateKMeans(DataPoints* dataPoints, size_t iterations, Centroids* centroids, ApproximateSearchReport* report)
+{
+    double bestMse = DBL_MAX;
+    double mse = DBL_MAX;
+    size_t evaluations = 0;
+
+    CentroidGraph graph = { NULL, NULL, 0, 0 };
+
+    for (size_t iteration = 0; iteration < iterations; ++iteration)
+    {
+        if (iteration % GRAPH_REBUILD_INTERVAL == 0 || graph.size != centroids->size)
+        {
+            buildCentroidGraph(&graph, centroids);
+        }
+
+        evaluations = partitionStepApproximate(dataPoints, centroids, &graph);
+
+        centroidStep(centroids, dataPoints);
+
+        mse = calculateSSE(dataPoints, centroids);
+
+        if (mse < bestMse - KMEANS_STOP_TOLERANCE * bestMse)
+        {
+            bestMse = mse;
+        }
+        else
+        {
+            if (mse < bestMse) bestMse = mse;
+            break;
+        }
+    }
+
+    // The centroid step moved the centroids, measure the assignment they would get now without changing the labels
+    if (graph.size != centroids->size)
+    {
+        buildCentroidGraph(&graph, centroids);
+    }
+    measureAssignmentRecall(dataPoints, centroids, &graph, report);
+    report->evaluationsPerPoint = (double)evaluations / (double)dataPoints->size;
+
+    freeCentroidGraph(&graph);
+
+    return bestMse;
+}
+
+/**
+ * @brief Finds the cell with the given grid coordinates, or adds it if the cell is not occupied yet.
+ *
+ * The cells are kept in an open addressing hash table that stores cell indices, SIZE_MAX marks an empty slot.
+ *
+ * @param table The hash table, its size is a power of two larger than the number of cells.
+ * @param tableMask The size of the hash table minus one.
+ * @param cellKeys The grid coordinates of the cells, dimensions values per cell.
+ * @param numCells A pointer to the number of cells, incremented when a cell is added.
+ * @param key The grid coordinates to look up.
+ * @param dimensions The number of dimensions.
+ * @return The index of the cell.
+ */
+static size_t findOrAddGridCell(size_t* table, size_t tableMask, long long* cellKeys, size_t* numCells, const long long* key, size_t dimensions)
+{
+    // FNV-1a over the coordinates with a final mix, neighbouring cells must not end up in neighbouring slots
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t dim = 0; dim < dimensions; ++dim)
+    {
+        hash ^= (uint64_t)key[dim];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 29;
+
+    size_t slot = (size_t)hash & tableMask;
+    while (table[slot] != SIZE_MAX)
+    {
+        if (memcmp(&cellKeys[table[slot] * dimensions], key, dimensions * sizeof(long long)) == 0)
+        {
+            return table[slot];
+        }
+        slot = (slot + 1) & tableMask;
+    }
+
+    size_t cell = (*numCells)++;
+    memcpy(&cellKeys[cell * dimensions], key, dimensions * sizeof(long long));
+    table[slot] = cell;
+
+    return cell;
+}
+
+/**
+ * @brief Allocates a hash table for at least the given number of grid cells.
+ *
+ * @param numCells The maximum number of cells in the table.
+ * @param tableMask A pointer where the size of the table minus one is stored.
+ * @return The hash table with every slot empty.
+ */
+static size_t* allocateGridTable(size_t numCells, size_t* tableMask)
+{
+    size_t tableSize = 16;
+    while (tableSize < 2 * numCells) tableSize *= 2;
+
+    size_t* table = trackedMalloc(tableSize * sizeof(size_t));
+    handleMemoryError(table);
+    memset(table, 0xFF, tableSize * sizeof(size_t)); // Every slot SIZE_MAX
+
+    *tableMask = tableSize - 1;
+    return table;
+}
+
+/**
+ * @brief Aggregates data points into the occupied cells of a multi-resolution grid.
+ *
+ * The data points are first binned into cells of the given width. As long as there are more than maxCells
+ * occupied cells, the grid is coarsened by merging 2^d neighbouring cells, which only visits the occupied cells
+ * of the previous level. A coarsening that would leave fewer than minCells cells is not made.
+ * With integer coordinates and the cell width 1.0, the first level merges only duplicate data points.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param cellWidth The width of the cells at the finest resolution.
+ * @param maxCells The largest acceptable number of occupied cells (0 = no coarsening).
+ * @param minCells The smallest acceptable number of occupied cells, usually the number of clusters.
+ * @return A GridAggregation structure holding the weighted cell representatives.
+ */
+GridAggregation aggregateToGrid(const DataPoints* dataPoints, double cellWidth, size_t maxCells, size_t minCells)
+{
+    if (!(cellWidth > 0.0))
+    {
+        raiseFatalError("The grid cell width must be positive");
+    }
+
+    size_t numPoints = dataPoints->size;
+    size_t dimensions = dataPoints->points[0].dimensions;
+
+    double* minimums = trackedMalloc(dimensions * sizeof(double));
+    long long* key = trackedMalloc(dimensions * sizeof(long long));
+    handleMemoryError(minimums);
+    handleMemoryError(key);
+
+    double maxRange = 0.0;
+    for (size_t dim = 0; dim < dimensions; ++dim)
+    {
+        double minimum = DBL_MAX;
+        double maximum = -DBL_MAX;
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            double value = dataPoints->points[i].attributes[dim];
+            if (value < minimum) minimum = value;
+            if (value > maximum) maximum = value;
+        }
+        minimums[dim] = minimum;
+        if (maximum - minimum > maxRange) maxRange = maximum - minimum;
+    }
+
+    // The grid coordinates must fit exactly in a double and in a long long
+    while (maxRange / cellWidth > 4503599627370496.0) cellWidth *= 2.0;
+
+    GridAggregation grid;
+    grid.cellWidth = cellWidth;
+    grid.levels = 0;
+    grid.pointCells = trackedMalloc(numPoints * sizeof(size_t));
+    handleMemoryError(grid.pointCells);
+
+    // Level 0: bin the data points, the sums are relative to the minimums to keep them small
+    size_t tableMask;
+    size_t* table = allocateGridTable(numPoints, &tableMask);
+    long long* cellKeys = trackedMalloc(numPoints * dimensions * sizeof(long long));
+    double* cellSums = trackedCalloc(numPoints * dimensions, sizeof(double));
+    double* cellWeights = trackedCalloc(numPoints, sizeof(double));
+    handleMemoryError(cellKeys);
+    handleMemoryError(cellSums);
+    handleMemoryError(cellWeights);
+    size_t numCells = 0;
+
+    for (size_t i = 0; i < numPoints; ++i)
+    {
+        const DataPoint* point = &dataPoints->points[i];
+        for (size_t dim = 0; dim < dimensions; ++dim)
+        {
+            key[dim] = (long long)floor((point->attributes[dim] - minimums[dim]) / cellWidth);
+        }
+
+        size_t cell = findOrAddGridCell(table, tableMask, cellKeys, &numCells, key, dimensions);
+        grid.pointCells[i] = cell;
+        for (size_t dim = 0; dim < dimensions; ++dim)
+        {
+            cellSums[cell * dimensions + dim] += point->weight * (point->attributes[dim] - minimums[dim]);
+        }
+        cellWeights[cell] += point->weight;
+    }
+    trackedFree(table);
+
+    // Coarser levels: halve the resolution until the number of cells is small enough
+    while (maxCells > 0 && numCells > maxCells)
+    {
+        table = allocateGridTable(numCells, &tableMask);
+        long long* coarseKeys = trackedMalloc(numCells * dimensions * sizeof(long long));
+        double* coarseSums = trackedCalloc(numCells * dimensions, sizeof(double));
+        double* coarseWeights = trackedCalloc(numCells, sizeof(double));
+        size_t* cellMap = trackedMalloc(numCells * sizeof(size_t));
+        handleMemoryError(coarseKeys);
+        handleMemoryError(coarseSums);
+        handleMemoryError(coarseWeights);
+        handleMemoryError(cellMap);
+        size_t numCoarseCells = 0;
+
+        for (size_t cell = 0; cell < numCells; ++cell)
+        {
+            // The coordinates are not negative, so the shift is a floor division by two
+            for (size_t dim = 0; dim < dimensions; ++dim)
+            {
+                key[dim] = cellKeys[cell * dimensions + dim] >> 1;
+            }
+
+            size_t coarseCell = findOrAddGridCell(table, tableMask, coarseKeys, &numCoarseCells, key, dimensions);
+            cellMap[cell] = coarseCell;
+            for (size_t dim = 0; dim < dimensions; ++dim)
+            {
+                coarseSums[coarseCell * dimensions + dim] += cellSums[cell * dimensions + dim];
+            }
+            coarseWeights[coarseCell] += cellWeights[cell];
+        }
+        trackedFree(table);
+
+        bool accepted = numCoarseCells >= minCells;
+        if (accepted)
+        {
+            for (size_t i = 0; i < numPoints; ++i)
+            {
+                grid.pointCells[i] = cellMap[grid.pointCells[i]];
+            }
+
+            trackedFree(cellKeys);
+            trackedFree(cellSums);
+            trackedFree(cellWeights);
+            cellKeys = coarseKeys;
+            cellSums = coarseSums;
+            cellWeights = coarseWeights;
+            numCells = numCoarseCells;
+            grid.cellWidth *= 2.0;
+            grid.levels++;
+        }
+        else
+        {
+            trackedFree(coarseKeys);
+            trackedFree(coarseSums);
+            trackedFree(coarseWeights);
+        }
+        trackedFree(cellMap);
+
+        if (!accepted) break;
+    }
+
+    // The representatives are the weighted means of the cells
+    grid.cells = allocateDataPoints(numCells, dimensions);
+    for (size_t cell = 0; cell < numCells; ++cell)
+    {
+        DataPoint* representative = &grid.cells.points[cell];
+        for (size_t dim = 0; dim < dimensions; ++dim)
+        {
+            representative->attributes[dim] = minimums[dim] + cellSums[cell * dimensions + dim] / cellWeights[cell];
+        }
+        representative->weight = cellWeights[cell];
+    }
+
+    trackedFree(cellKeys);
+    trackedFree(cellSums);
+    trackedFree(cellWeights);
+    trackedFree(minimums);
+    trackedFree(key);
+
+    return grid;
+}
+
+/**
+ * @brief Frees the memory allocated for a GridAggregation structure.
+ *
+ * @param grid A pointer to the GridAggregation structure to be freed.
+ */
+void freeGridAggregation(GridAggregation* grid)
+{
+    freeDataPoints(&grid->cells);
+    trackedFree(grid->pointCells);
+    grid->pointCells = NULL;
+}
+
+/**
+ * @brief Copies the partitions of the grid cells to the original data points.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the original data points.
+ * @param grid A pointer to the GridAggregation structure whose cells have been clustered.
+ */
+void expandGridPartitions(DataPoints* dataPoints, const GridAggregation* grid)
+{
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < (long long)dataPoints->size; ++i)
+    {
+        dataPoints->points[i].partition = grid->cells.points[grid->pointCells[i]].partition;
+    }
+}
+
+/**
+ * @brief Returns the name of the algorithm run on the grid cells.
+ *
+ * @param gridAlgorithm The index of the algorithm.
+ * @return The name of the algorithm, or NULL if the index is invalid.
+ */
+const char* getGridAlgorithmName(size_t gridAlgorithm)
+{
+    switch (gridAlgorithm)
+    {
+    case 0:
+        return "Grid k-means";
+    case 1:
+        return "Grid random swap";
+    case 2:
+        return "Grid random split";
+    case 3:
+        return "Grid MSE split";
+    case 4:
+        return "Grid bisecting k-means";
+    default:
+        fprintf(stderr, "Error: Invalid grid algorithm provided\n");
+        return NULL;
+    }
+}
+
+/**
+ * @brief Runs a clustering on nested random samples of growing size, from coarse to fine.
+ *
+ * The first level clusters a small random sample from random initial centroids with k-means or random swap.
+ * Every following level continues with k-means on a larger sample, starting from the centroids of the previous
+ * level, so the long moves of the centroids happen on the cheap samples and only a few iterations remain
+ * for the full data. The samples are nested: every sample contains the previous one.
+ * A level covers max(numCentroids, fraction * N) data points, and a fraction of 1.0 uses the data points themselves.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure with the allocated centroids, which receives the result.
+ * @param levelFractions The sample fractions of the levels, in increasing order.
+ * @param levelIterations The maximum number of k-means iterations on each level.
+ * @param numLevels The number of levels.
+ * @param firstLevelAlgorithm The algorithm of the first level: 0 = k-means, 1 = random swap.
+ * @param maxSwaps The maximum number of swaps for random swap on the first level.
+ * @param swapCandidates The number of candidate swaps screened per k-means run of random swap.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @return The SSE of the final centroids on all data points.
+ */
+double runMultilevelClustering(DataPoints* dataPoints, Centroids* centroids, const double* levelFractions, const size_t* levelIterations, size_t numLevels, size_t firstLevelAlgorithm, size_t maxSwaps, size_t swapCandidates, const Centroids* groundTruth)
+{
+    size_t numPoints = dataPoints->size;
+    size_t numCentroids = centroids->size;
+
+    // Sample sizes, clamped so that no level is smaller than the one before it
+    size_t* levelSizes = trackedMalloc(numLevels * sizeof(size_t));
+    handleMemoryError(levelSizes);
+    size_t maxSampleSize = 0;
+    for (size_t level = 0; level < numLevels; ++level)
+    {
+        double size = ceil(levelFractions[level] * (double)numPoints);
+        levelSizes[level] = size >= (double)numPoints ? numPoints : (size_t)size;
+        if (levelSizes[level] < numCentroids) levelSizes[level] = numCentroids;
+        if (level > 0 && levelSizes[level] < levelSizes[level - 1]) levelSizes[level] = levelSizes[level - 1];
+        if (levelSizes[level] < numPoints && levelSizes[level] > maxSampleSize) maxSampleSize = levelSizes[level];
+    }
+
+    // One random order for all levels: the sample of a level is a prefix of it, the views share the attributes
+    DataPoints sample;
+    sample.size = 0;
+    sample.matrix = NULL;
+    sample.mappedView = NULL;
+    sample.mappedSize = 0;
+    sample.points = NULL;
+    if (maxSampleSize > 0)
+    {
+        size_t* order = trackedMalloc(numPoints * sizeof(size_t));
+        sample.points = trackedMalloc(maxSampleSize * sizeof(DataPoint));
+        handleMemoryError(order);
+        handleMemoryError(sample.points);
+
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            order[i] = i;
+        }
+        for (size_t i = 0; i < maxSampleSize; ++i)
+        {
+            size_t j = i + (size_t)(randomUnit() * (double)(numPoints - i));
+            size_t temp = order[i];
+            order[i] = order[j];
+            order[j] = temp;
+
+            sample.points[i] = dataPoints->points[order[i]];
+        }
+
+        trackedFree(order);
+    }
+
+    for (size_t level = 0; level < numLevels; ++level)
+    {
+        DataPoints* levelData = dataPoints;
+        if (levelSizes[level] < numPoints)
+        {
+            sample.size = levelSizes[level];
+            levelData = &sample;
+        }
+
+        if (level == 0)
+        {
+            generateRandomCentroids(numCentroids, levelData, centroids);
+        }
+
+        if (level == 0 && firstLevelAlgorithm == 1)
+        {
+            randomSwap(levelData, centroids, maxSwaps, swapCandidates, groundTruth);
+        }
+        else
+        {
+            runKMeans(levelData, levelIterations[level], centroids, groundTruth);
+        }
+
+        if (LOGGING >= 2)
+        {
+            printf("(Multilevel) Level %zu: %zu data points, SSE on the sample %.5f\n", level + 1, levelData->size, calculateSSE(levelData, centroids));
+        }
+    }
+
+    // The partitions of the data points are made with the final centroids, so they match the returned SSE
+    partitionStep(dataPoints, centroids);
+    double sse = calculateSSE(dataPoints, centroids);
+
+    trackedFree(sample.points);
+    trackedFree(levelSizes);
+
+    return sse;
+}
+
+/**
+ * @brief Allocates a model of the batched k-means.
+ *
+ * @param numCentroids The number of centroids of the model.
+ * @param dimensions The number of dimensions of the data points.
+ * @param numPoints The number of data points.
+ * @return A BatchedModel structure with allocated memory.
+ */
+BatchedModel allocateBatchedModel(size_t numCentroids, size_t dimensions, size_t numPoints)
+{
+    BatchedModel model;
+    model.centroids = allocateCentroids(numCentroids, dimensions);
+    model.partitions = trackedMalloc(numPoints * sizeof(size_t));
+    handleMemoryError(model.partitions);
+    model.bestSse = DBL_MAX;
+    model.iterations = 0;
+    model.converged = false;
+
+    return model;
+}
+
+/**
+ * @brief Frees the memory allocated for a BatchedModel structure.
+ *
+ * @param model A pointer to the BatchedModel structure to be freed.
+ */
+void freeBatchedModel(BatchedModel* model)
+{
+    freeCentroids(&model->centroids);
+    trackedFree(model->partitions);
+    model->partitions = NULL;
+}
+
+
+/**
+ * @brief Runs several k-means models in lockstep, sharing every pass over the data.
+ *
+ * The models can differ in the number of centroids or in the initial centroids. Each iteration makes one pass
+ * over the data in blocks of BATCH_BLOCK_BYTES: every active model assigns the data points of the block and
+ * accumulates its sums and SSE while the block is in the cache, so the data is read from memory once per
+ * iteration instead of once per model. The same pass sums the SSE of the new partition from the distances
+ * the assignment found, which is the SSE of the centroids of the previous update with their best partition.
+ * A model stops with the stopping rule of runKMeans applied to that SSE: it keeps the centroids and the partition
+ * the SSE belongs to and no longer takes part in the passes. Otherwise its centroids are updated like in centroidStep,
+ * with the chunk sums combined in a fixed order, and empty clusters are repaired with repairEmptyClusters.
+ * A model that reaches the iteration limit ends with the last update, whose SSE is not measured, like the last
+ * iteration of runKMeans ends with the partition of the centroids before it. The chunk buffers of all models
+ * are allocated once per call, with the chunk count of the first pass, and reused by every iteration.
+ * The Manhattan metric needs medians, which cannot be accumulated in a single pass, so with it the models
+ * are run one after another with runKMeans.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param models The models, with their initial centroids set.
+ * @param numModels The number of models.
+ * @param maxIterations The maximum number of iterations of each model.
+ */
+void runBatchedKMeans(DataPoints* dataPoints, BatchedModel* models, size_t numModels, size_t maxIterations)
+{
+    size_t numPoints = dataPoints->size;
+    size_t dimensions = dataPoints->points[0].dimensions;
+
+    if (activeMetric.type == 2)
+    {
+        for (size_t m = 0; m < numModels; ++m)
+        {
+            resetPartitions(dataPoints);
+            models[m].bestSse = runKMeans(dataPoints, maxIterations, &models[m].centroids, NULL);
+            for (size_t i = 0; i < numPoints; ++i)
+            {
+                models[m].partitions[i] = dataPoints->points[i].partition;
+            }
+            models[m].converged = true;
+        }
+        return;
+    }
+
+    size_t blockSize = BATCH_BLOCK_BYTES / (dimensions * sizeof(double));
+    if (blockSize < 64) blockSize = 64;
+
+    size_t* active = trackedMalloc(numModels * sizeof(size_t));
+    double** sums = trackedMalloc(numModels * sizeof(double*));
+    double** weights = trackedMalloc(numModels * sizeof(double*));
+    size_t** counts = trackedMalloc(numModels * sizeof(size_t*));
+    double** sseSums = trackedMalloc(numModels * sizeof(double*));
+    handleMemoryError(active);
+    handleMemoryError(sums);
+    handleMemoryError(weights);
+    handleMemoryError(counts);
+    handleMemoryError(sseSums);
+
+    size_t stateSize = 0;
+    size_t maxModelStateSize = 0;
+    for (size_t m = 0; m < numModels; ++m)
+    {
+        models[m].bestSse = DBL_MAX;
+        models[m].iterations = 0;
+        models[m].converged = false;
+
+        size_t modelStateSize = models[m].centroids.size * dimensions;
+        stateSize += models[m].centroids.size * (dimensions + 2) + 1;
+        if (modelStateSize > maxModelStateSize) maxModelStateSize = modelStateSize;
+    }
+
+    // Storage for sums, weights, counts and SSE of every model, one slice per reduction chunk, reused by every iteration
+    size_t numChunks = getReductionChunkCount(numPoints, stateSize);
+    size_t chunkSize = (numPoints + numChunks - 1) / numChunks;
+    size_t previousSubsystem = setMemorySubsystem(MEMORY_REDUCTIONS);
+    for (size_t m = 0; m < numModels; ++m)
+    {
+        size_t numClusters = models[m].centroids.size;
+        sums[m] = trackedMalloc(numChunks * numClusters * dimensions * sizeof(double));
+        handleMemoryError(sums[m]);
+        weights[m] = trackedMalloc(numChunks * numClusters * sizeof(double));
+        handleMemoryError(weights[m]);
+        counts[m] = trackedMalloc(numChunks * numClusters * sizeof(size_t));
+        handleMemoryError(counts[m]);
+        sseSums[m] = trackedMalloc(numChunks * sizeof(double));
+        handleMemoryError(sseSums[m]);
+    }
+    double* compensation = trackedMalloc((maxModelStateSize > 0 ? maxModelStateSize : 1) * sizeof(double));
+    handleMemoryError(compensation);
+    setMemorySubsystem(previousSubsystem);
+
+    for (size_t iteration = 0; iteration < maxIterations; ++iteration)
+    {
+        size_t numActive = 0;
+        for (size_t m = 0; m < numModels; ++m)
+        {
+            if (models[m].converged) continue;
+            active[numActive++] = m;
+
+            size_t numClusters = models[m].centroids.size;
+            memset(sums[m], 0, numChunks * numClusters * dimensions * sizeof(double));
+            memset(weights[m], 0, numChunks * numClusters * sizeof(double));
+            memset(counts[m], 0, numChunks * numClusters * sizeof(size_t));
+            memset(sseSums[m], 0, numChunks * sizeof(double));
+        }
+        if (numActive == 0) break;
+
+        #pragma omp parallel for schedule(static)
+        for (long long chunk = 0; chunk < (long long)numChunks; ++chunk)
+        {
+            size_t begin = (size_t)chunk * chunkSize;
+            size_t end = begin + chunkSize < numPoints ? begin + chunkSize : numPoints;
+
+            for (size_t blockBegin = begin; blockBegin < end; blockBegin += blockSize)
+            {
+                size_t blockEnd = blockBegin + blockSize < end ? blockBegin + blockSize : end;
+
+                for (size_t a = 0; a < numActive; ++a)
+                {
+                    size_t m = active[a];
+                    BatchedModel* model = &models[m];
+                    size_t numClusters = model->centroids.size;
+                    double* chunkSums = &sums[m][(size_t)chunk * numClusters * dimensions];
+                    double* chunkWeights = &weights[m][(size_t)chunk * numClusters];
+                    size_t* chunkCounts = &counts[m][(size_t)chunk * numClusters];
+                    double sse = 0.0;
+                    double sseCompensation = 0.0;
+
+                    for (size_t i = blockBegin; i < blockEnd; ++i)
+                    {
+                        const DataPoint* point = &dataPoints->points[i];
+                        size_t nearest = 0;
+                        double minDistance = DBL_MAX;
+                        if (activeMetric.type == 0)
+                        {
+                            // The common case without the metric dispatch in the innermost loop
+                            for (size_t c = 0; c < numClusters; ++c)
+                            {
+                                double distance = squaredEuclideanKernel(point->attributes, model->centroids.points[c].attributes, dimensions);
+                                if (distance < minDistance)
+                                {
+                                    minDistance = distance;
+                                    nearest = c;
+                                }
+                            }
+                        }
+                        else
+                        {
+                            for (size_t c = 0; c < numClusters; ++c)
+                            {
+                                double distance = calculateAssignmentDistance(point->attributes, model->centroids.points[c].attributes, dimensions);
+                                if (distance < minDistance)
+                                {
+                                    minDistance = distance;
+                                    nearest = c;
+                                }
+                            }
+                        }
+                        model->partitions[i] = nearest;
+                        addCompensated(&sse, &sseCompensation, point->weight * assignmentToMetricDistance(minDistance));
+
+                        // Deviation from the current centroid, like in centroidStep
+                        const double* reference = model->centroids.points[nearest].attributes;
+                        double* clusterSums = &chunkSums[nearest * dimensions];
+                        for (size_t dim = 0; dim < dimensions; ++dim)
+                        {
+                            clusterSums[dim] += point->weight * (point->attributes[dim] - reference[dim]);
+                        }
+                        chunkWeights[nearest] += point->weight;
+                        chunkCounts[nearest]++;
+                    }
+
+                    sseSums[m][chunk] += sse;
+                }
+            }
+        }
+
+        // Combine the chunks in a fixed order, stop the models whose SSE no longer improves and update the others
+        for (size_t a = 0; a < numActive; ++a)
+        {
+            size_t m = active[a];
+            BatchedModel* model = &models[m];
+            size_t numClusters = model->centroids.size;
+            size_t modelStateSize = numClusters * dimensions;
+
+            double sse = sseSums[m][0];
+            double sseCompensation = 0.0;
+            for (size_t chunk = 1; chunk < numChunks; ++chunk)
+            {
+                addCompensated(&sse, &sseCompensation, sseSums[m][chunk]);
+            }
+
+            model->iterations++;
+            if (sse < model->bestSse - KMEANS_STOP_TOLERANCE * model->bestSse)
+            {
+                model->bestSse = sse;
+            }
+            else
+            {
+                // The centroids stay those of the pass, so they match the partition and the SSE
+                if (sse < model->bestSse) model->bestSse = sse;
+                model->converged = true;
+                continue;
+            }
+
+            memset(compensation, 0, modelStateSize * sizeof(double));
+            for (size_t chunk = 1; chunk < numChunks; ++chunk)
+            {
+                for (size_t j = 0; j < modelStateSize; ++j)
+                {
+                    addCompensated(&sums[m][j], &compensation[j], sums[m][chunk * modelStateSize + j]);
+                }
+                for (size_t clusterLabel = 0; clusterLabel < numClusters; ++clusterLabel)
+                {
+                    weights[m][clusterLabel] += weights[m][chunk * numClusters + clusterLabel];
+                    counts[m][clusterLabel] += counts[m][chunk * numClusters + clusterLabel];
+                }
+            }
+
+            bool hasEmptyClusters = false;
+            for (size_t clusterLabel = 0; clusterLabel < numClusters; ++clusterLabel)
+            {
+                double* attributes = model->centroids.points[clusterLabel].attributes;
+                if (counts[m][clusterLabel] > 0)
+                {
+                    for (size_t dim = 0; dim < dimensions; ++dim)
+                    {
+                        attributes[dim] += sums[m][clusterLabel * dimensions + dim] / weights[m][clusterLabel];
+                    }
+                }
+                else
+                {
+                    hasEmptyClusters = true;
+                }
+
+                // Spherical k-means: the centroids of the cosine metric are unit length, like in centroidStep also the empty ones
+                if (activeMetric.type == 1)
+                {
+                    double norm = sqrt(dotProductKernel(attributes, attributes, dimensions));
+                    if (norm > 0.0)
+                    {
+                        for (size_t dim = 0; dim < dimensions; ++dim)
+                        {
+                            attributes[dim] /= norm;
+                        }
+                    }
+                }
+            }
+
+            // The repair works on the partitions of the data points, which hold the labels of another model meanwhile
+            if (hasEmptyClusters && activeEmptyClusterStrategy != 0)
+            {
+                for (size_t i = 0; i < numPoints; ++i)
+                {
+                    dataPoints->points[i].partition = model->partitions[i];
+                }
+                repairEmptyClusters(&model->centroids, dataPoints, counts[m]);
+                for (size_t i = 0; i < numPoints; ++i)
+                {
+                    model->partitions[i] = dataPoints->points[i].partition;
+                }
+            }
+        }
+    }
+
+    for (size_t m = 0; m < numModels; ++m)
+    {
+        models[m].converged = true;
+        trackedFree(sums[m]);
+        trackedFree(weights[m]);
+        trackedFree(counts[m]);
+        trackedFree(sseSums[m]);
+    }
+
+    trackedFree(compensation);
+    trackedFree(active);
+    trackedFree(sums);
+    trackedFree(weights);
+    trackedFree(counts);
+    trackedFree(sseSums);
+}
+
+/**
+ * @brief Runs the k-means algorithm on the given data points and centroids.
+ *
+ * This function iterates through partition and centroid steps, calculates the MSE,
+ * and returns the best MSE obtained during the iterations.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param numCentroids The number of centroids to generate.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param loopCount The number of loops to run the k-means algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
+ */
+void runKMeansAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
+{
+    Statistics stats;
+    initializeStatistics(&stats);
+
+    clock_t start, end;
+    double duration;
+
+    // With the drop strategy a trial may end with fewer clusters, so its results are kept apart
+    bool dropping = activeEmptyClusterStrategy == 3;
+    const char* algorithmName = dropping ? "K-means (drop empty clusters)" : "K-means";
+    printf("%s\n", algorithmName);
+
+    for (size_t i = 0; i < loopCount; ++i)
+    {
+        if (checkTrialBoundary(algorithmName, &stats, i, numCentroids, scaling, &loopCount)) break;
+
+        seedTrial(i);
+
+        Centroids centroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
+
+        start = clock();
+
+        generateRandomCentroids(numCentroids, dataPoints, &centroids);
+
+        /*if (LOGGING >= 3)
+        {
+            size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+            printf("(K-means)Initial Centroid Index (CI): %zu\n", centroidIndex);
+        }*/
+
+        double resultMse = runKMeans(dataPoints, maxIterations, &centroids, groundTruth);
+        //if(LOGGING >= 3) printf("(K-means)Best Centroid Index (CI): %d and Best Sum-of-Squared Errors (MSE): %.4f\n", result.centroidIndex, result.mse / 10000000);
+
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+
+        //if (LOGGING >= 3) printf("(K-means)Time taken: %.2f seconds\n\n", duration);
+
+        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+
+        stats.mseSum += resultMse;
+        stats.ciSum += centroidIndex;
+        stats.timeSum += duration;
+        if (centroidIndex == 0) stats.successRate++;
+
+        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
+
+        if (i == 0 && !dropping)
+        {
+            writeCentroidsToFile("outputs/kMeans_centroids.txt", &centroids);
+            writeDataPointPartitionsToFile("outputs/kMeans_partitions.txt", dataPoints);
+        }
+
+        freeCentroids(&centroids);
+    }
+
+    printStatistics(algorithmName, stats, loopCount, numCentroids, scaling);
+
+    writeResultsToFile(fileName, stats, numCentroids, algorithmName, loopCount, scaling, outputDirectory);
+}
+
+/**
+ * @brief Runs the repeated k-means algorithm on the given data points and centroids.
+ *
+ * This function iterates through partition and centroid steps, calculates the MSE,
+ * and returns the best MSE obtained during the iterations.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param numCentroids The number of centroids to generate.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param maxRepeats The maximum number of repeats for the k-means algorithm.
+ * @param loopCount The number of loops to run the k-means algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
+ */
+void runRepeatedKMeansAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t maxRepeats, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
+{
+    if (!requireFixedClusterCount("Repeated K-means")) return;
+
+    Statistics stats;
+    initializeStatistics(&stats);
+
+    clock_t start, end;
+    double duration;
+
+    printf("Repeated K-means\n");
+
+    for (size_t i = 0; i < loopCount; ++i)
+    {
+        if (checkTrialBoundary("Repeated K-means", &stats, i, numCentroids, scaling, &loopCount)) break;
+
+        seedTrial(i);
+
+        Centroids bestCentroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
+
+        start = clock();
+
+        double bestMse = runRepeatedKMeans(dataPoints, &bestCentroids, maxIterations, maxRepeats, groundTruth);
+
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+
+        //if (LOGGING >= 3) printf("(Repeated K-means)Time taken: %.2f seconds\n\n", duration);
+
+        size_t centroidIndex = calculateCentroidIndex(&bestCentroids, groundTruth);
+
+        stats.mseSum += bestMse;
+        stats.ciSum += centroidIndex;
+        stats.timeSum += duration;
+        if (centroidIndex == 0) stats.successRate++;
+
+        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
+
+        if (i == 0)
+        {
+            writeCentroidsToFile("outputs/repeatedKMeans_centroids.txt", &bestCentroids);
+            writeDataPointPartitionsToFile("outputs/repeatedKMeans_partitions.txt", dataPoints);
+        }
+
+        freeCentroids(&bestCentroids);
+    }
+
+    printStatistics("Repeated K-means", stats, loopCount, numCentroids, scaling);
+
+    writeResultsToFile(fileName, stats, numCentroids, "Repeated K-means", loopCount, scaling, outputDirectory);
+}
+
+/**
+ * @brief Runs the repeated k-means algorithm on the given data points and centroids.
+ *
+ * This function iterates through partition and centroid steps, calculates the MSE,
+ * and returns the best MSE obtained during the iterations.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param numCentroids The number of centroids to generate.
+ * @param maxSwaps The maximum number of attempted swaps.
+ * @param swapCandidates The number of candidate swaps screened per attempted swap (0 = plain random swap).
+ * @param loopCount The number of loops to run the k-means algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
+ */
+void runRandomSwapAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxSwaps, size_t swapCandidates, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
 {
-    size_t countFrom1to2 = 0;
-    size_t* closest = calloc(centroids2->size, sizeof(size_t));
-    handleMemoryError(closest);
+    if (!requireFixedClusterCount("Random swap")) return;
 
-    for (size_t i = 0; i < centroids1->size; ++i)
-    {
-        size_t closestIndex = findNearestCentroid(&centroids1->points[i], centroids2);
-        closest[closestIndex]++;
-    }
+    Statistics stats;
+    initializeStatistics(&stats);
 
-    for (size_t i = 0; i < centroids2->size; ++i)
+    clock_t start, end;
+    double duration;
+
+    printf("Random swap\n");
+
+    for (size_t i = 0; i < loopCount; ++i)
     {
-        if (closest[i] == 0)
+        if (checkTrialBoundary("Random Swap", &stats, i, numCentroids, scaling, &loopCount)) break;
+
+        seedTrial(i);
+
+        Centroids centroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
+
+        start = clock();
+
+        generateRandomCentroids(numCentroids, dataPoints, &centroids);
+
+        // Random Swap
+        double resultMse = randomSwap(dataPoints, &centroids, maxSwaps, swapCandidates, groundTruth);
+
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+
+        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+
+        //if (LOGGING >= 3) printf("(Random Swap)Time taken: %.2f seconds\n\n", duration);
+
+        stats.mseSum += resultMse;
+        stats.ciSum += centroidIndex;
+        stats.timeSum += duration;
+        if (centroidIndex == 0) stats.successRate++;
+
+        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
+
+        if (i == 0)
         {
-            countFrom1to2++;
+            writeCentroidsToFile("outputs/randomSwap_centroids.txt", &centroids);
+            writeDataPointPartitionsToFile("outputs/randomSwap_partitions.txt", dataPoints);
         }
+
+        freeCentroids(&centroids);
     }
 
-    free(closest);
+    printStatistics("Random Swap", stats, loopCount, numCentroids, scaling);
 
-    return countFrom1to2;
+    writeResultsToFile(fileName, stats, numCentroids, "Random swap", loopCount, scaling, outputDirectory);
 }
 
 /**
- * @brief Calculates the Centroid Index (CI) between two sets of centroids.
+ * @brief Runs the adaptive random swap algorithm on the given data points.
  *
- * This function calculates the Centroid Index (CI) by counting the number of orphan centroids
- * between two sets of centroids. It returns the maximum count of orphans from either set.
+ * This function runs adaptiveRandomSwap from random centroids and reports, besides the usual statistics,
+ * the average number of attempted and accepted swaps, so the swaps saved compared to a fixed maxSwaps can be seen.
  *
- * @param centroids1 A pointer to the first Centroids structure.
- * @param centroids2 A pointer to the second Centroids structure.
- * @return The Centroid Index (CI) between the two sets of centroids.
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param numCentroids The number of centroids to generate.
+ * @param maxSwaps The maximum number of attempted swaps.
+ * @param loopCount The number of loops to run the algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
  */
-size_t calculateCentroidIndex(const Centroids* centroids1, const Centroids* centroids2)
+void runAdaptiveRandomSwapAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxSwaps, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
 {
-    if (LOGGING >= 1)
-    {
-        printf("centroids1: %zu AND 2: %zu\n\n", centroids1->size, centroids2->size);
-        printf("centroids1: %f AND 2: %f\n\n", centroids1->points->attributes[0], centroids2->points->attributes[0]);
-    }
-    
-    size_t countFrom1to2 = countOrphans(centroids1, centroids2);
-    size_t countFrom2to1 = countOrphans(centroids2, centroids1);
+    if (!requireFixedClusterCount("Adaptive random swap")) return;
 
-    if (LOGGING >= 1)
+    Statistics stats;
+    initializeStatistics(&stats);
+
+    clock_t start, end;
+    double duration;
+    size_t swapSum = 0;
+    size_t acceptedSum = 0;
+
+    printf("Adaptive random swap\n");
+
+    for (size_t i = 0; i < loopCount; ++i)
     {
-        printf("Count from 1 to 2: %zu AND 2 to 1: %zu\n\n", countFrom1to2, countFrom2to1);
+        if (checkTrialBoundary("Adaptive random swap", &stats, i, numCentroids, scaling, &loopCount)) break;
+
+        seedTrial(i);
+
+        Centroids centroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
+
+        start = clock();
+
+        generateRandomCentroids(numCentroids, dataPoints, &centroids);
+
+        AdaptiveSwapReport report;
+        double resultMse = adaptiveRandomSwap(dataPoints, &centroids, maxSwaps, groundTruth, &report);
+
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+
+        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+
+        if (LOGGING >= 2)
+        {
+            printf("(Adaptive random swap) Round %zu: %zu swaps, %zu accepted, acceptance rate %.3f, improvement rate %.6f, improvement probability %.3f\n",
+                i + 1, report.swaps, report.acceptedSwaps, report.acceptanceRate, report.improvementRate, report.improvementProbability);
+        }
+
+        stats.mseSum += resultMse;
+        stats.ciSum += centroidIndex;
+        stats.timeSum += duration;
+        if (centroidIndex == 0) stats.successRate++;
+        swapSum += report.swaps;
+        acceptedSum += report.acceptedSwaps;
+
+        if (i == 0)
+        {
+            writeCentroidsToFile("outputs/adaptiveRandomSwap_centroids.txt", &centroids);
+            writeDataPointPartitionsToFile("outputs/adaptiveRandomSwap_partitions.txt", dataPoints);
+        }
+
+        freeCentroids(&centroids);
     }
 
-    return (countFrom1to2 > countFrom2to1) ? countFrom1to2 : countFrom2to1;
+    printf("(Adaptive random swap) Average swaps: %.1f (maximum %zu), average accepted swaps: %.1f\n", (double)swapSum / loopCount, maxSwaps, (double)acceptedSum / loopCount);
+
+    printStatistics("Adaptive random swap", stats, loopCount, numCentroids, scaling);
+
+    writeResultsToFile(fileName, stats, numCentroids, "Adaptive random swap", loopCount, scaling, outputDirectory);
 }
 
 /**
- * @brief Runs the k-means algorithm on the given data points and centroids.
+ * @brief Runs the split k-means algorithm with random splitting.
  *
- * This function iterates through partition and centroid steps, calculates the MSE,
- * and returns the best MSE obtained during the iterations.
+ * This function iterates through partition and centroid steps, randomly selects a cluster to split,
+ * and updates the centroids and partitions based on the results of the local k-means.
+ * It returns the best mean squared error (MSE) obtained during the iterations.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param iterations The maximum number of iterations to run the k-means algorithm.
- * @param centroids A pointer to the Centroids structure containing the centroids.
  * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
- * @return The best mean squared error (MSE) obtained during the iterations.
+ * @param numCentroids The number of centroids to generate.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param loopCount The number of loops to run the k-means algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
  */
-double runKMeans(DataPoints* dataPoints, size_t iterations, Centroids* centroids, const Centroids* groundTruth)
+void runRandomSplitAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
 {
-    double bestMse = DBL_MAX;
-    double mse = DBL_MAX;
+    if (!requireFixedClusterCount("Random Split k-means")) return;
 
-    for (size_t iteration = 0; iteration < iterations; ++iteration)
+    Statistics stats;
+    initializeStatistics(&stats);
+
+    clock_t start, end;
+    double duration;
+
+    printf("Random Split k-means\n");
+
+    for (size_t i = 0; i < loopCount; ++i)
     {
-        partitionStep(dataPoints, centroids);
+        if (checkTrialBoundary("Random Split", &stats, i, numCentroids, scaling, &loopCount)) break;
 
-        centroidStep(centroids, dataPoints);
-        
-        //TODO: mse vai SSE? Tll hetkell SSE vaikka muuttujat ovat mse
-        mse = calculateSSE(dataPoints, centroids);
+        seedTrial(i);
 
-        /*if (LOGGING >= 3)
-        {
-			size_t centroidIndex = calculateCentroidIndex(centroids, groundTruth);
-            printf("(runKMeans)After iteration %zu: CI = %zu and MSE = %.5f\n", iteration + 1, centroidIndex, mse / 10000);
-        }*/
+        Centroids centroids = allocateCentroids(1, dataPoints->points[0].dimensions);
 
-        if (mse < bestMse)
+        start = clock();
+
+        generateRandomCentroids(centroids.size, dataPoints, &centroids);
+
+        double resultMse = runRandomSplit(dataPoints, &centroids, numCentroids, maxIterations, groundTruth);
+
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+        //if (LOGGING >= 3) printf("(Split1)Time taken: %.2f seconds\n\n", duration);
+
+        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+
+        stats.mseSum += resultMse;
+        stats.ciSum += centroidIndex;
+        stats.timeSum += duration;
+        if (centroidIndex == 0) stats.successRate++;
+
+        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
+
+		//TODO: kaikki tlliset pois lopullisesta versiosta
+        if (i == 0)
         {
-			//if (LOGGING >= 3) printf("Best MSE so far: %.5f\n", mse / 10000);
-            bestMse = mse;
+            writeCentroidsToFile("outputs/randomSplit_centroids.txt", &centroids);
+            writeDataPointPartitionsToFile("outputs/randomSplit_partitions.txt", dataPoints);
         }
-        else
+
+        freeCentroids(&centroids);
+    }
+
+    printStatistics("Random Split", stats, loopCount, numCentroids, scaling);
+
+    writeResultsToFile(fileName, stats, numCentroids, "Random Split", loopCount, scaling, outputDirectory);
+}
+
+/**
+ * @brief Runs the split k-means algorithm with tentative splitting (choosing to split the one that reduces the MSE the most).
+ *
+ * This function iterates through partition and centroid steps, selects a cluster to split based on the MSE drop,
+ * and updates the centroids and partitions based on the results of the local k-means.
+ * It returns the best mean squared error (MSE) obtained during the iterations.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param numCentroids The number of centroids to generate.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param loopCount The number of loops to run the k-means algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
+ * @param splitType The type of split to perform (0 = intra-cluster, 1 = global, 2 = local repartition).
+ */
+void runMseSplitAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory, int splitType)
+{
+    if (!requireFixedClusterCount("MSE Split")) return;
+
+    Statistics stats;
+    initializeStatistics(&stats);
+
+    clock_t start, end;
+    double duration;
+
+    const char* splitTypeName = getSplitTypeName(splitType);
+
+    printf("%s\n", splitTypeName);
+
+    for (size_t i = 0; i < loopCount; ++i)
+    {
+        if (checkTrialBoundary(splitTypeName, &stats, i, numCentroids, scaling, &loopCount)) break;
+
+        seedTrial(i);
+
+        resetPartitions(dataPoints);
+
+        Centroids centroids = allocateCentroids(1, dataPoints->points[0].dimensions);
+
+        start = clock();
+
+        generateRandomCentroids(centroids.size, dataPoints, &centroids);
+
+        double resultMse = runMseSplit(dataPoints, &centroids, numCentroids, maxIterations, groundTruth, splitType);
+
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+        //if (LOGGING >= 3) printf("(Split%d)Time taken: %.2f seconds\n\n", splitType + 1, duration);
+
+        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+
+        stats.mseSum += resultMse;
+        stats.ciSum += centroidIndex;
+        stats.timeSum += duration;
+        if (centroidIndex == 0) stats.successRate++;
+
+        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
+
+        if (i == 0)
         {
-            break; // Exit the loop if the MSE does not improve
+            char centroidsFile[256];
+            char partitionsFile[256];
+            snprintf(centroidsFile, sizeof(centroidsFile), "outputs/%s_centroids.txt", splitTypeName);
+            snprintf(partitionsFile, sizeof(partitionsFile), "outputs/%s_partitions.txt", splitTypeName);
+            writeCentroidsToFile(centroidsFile, &centroids);
+            writeDataPointPartitionsToFile(partitionsFile, dataPoints);
         }
+
+        freeCentroids(&centroids);
     }
 
-    return bestMse;
+    printStatistics(splitTypeName, stats, loopCount, numCentroids, scaling);
+
+    writeResultsToFile(fileName, stats, numCentroids, splitTypeName, loopCount, scaling, outputDirectory);
 }
 
 /**
- * @brief Performs random swaps of centroids and evaluates the resulting clustering using k-means.
+ * @brief Runs all three split types of the MSE split k-means from a shared first split and collects statistics.
  *
- * This function performs random swaps of centroids with data points, runs k-means on the modified centroids,
- * and keeps the changes if the mean squared error (MSE) improves. If the MSE does not improve, it reverses the swap.
- * The function returns the best mean squared error (MSE) obtained during the swaps.
+ * Every split type starts with the same first split and the same tentative splits of the two new clusters,
+ * so in each loop this prefix is computed once, captured in a snapshot, and every split type is restored
+ * from the snapshot and continued with continueMseSplit. The snapshot reseeds the random generator from its own
+ * sequence, so the split types continue with the same random numbers as each other, but not with those of a separate
+ * runMseSplitAlgorithm run. The result of every split type is kept in a snapshot forked from the prefix, which shares
+ * the partition chunks the split type did not change, and the next split type restores only the chunks that differ.
+ * The time of the prefix is added to the time of every split type, and the peak memory of every split type
+ * is measured separately, starting from the memory in use after the prefix (including the snapshot).
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure containing the centroids.
  * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
- * @param maxSwaps The maximum number of attempted swaps.
- * @return The best mean squared error (MSE) obtained during the swaps.
+ * @param numCentroids The number of centroids.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param loopCount The number of loops to run the algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
  */
-double randomSwap(DataPoints* dataPoints, Centroids* centroids, size_t maxSwaps, const Centroids* groundTruth)
+void runMseSplitVariantsAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
 {
-    double bestMse = DBL_MAX;
-    size_t kMeansIterations = 2;
-    size_t numCentroids = centroids->size;
-    size_t dimensions = centroids->points[0].dimensions;
+    if (!requireFixedClusterCount("MSE Split")) return;
 
-    size_t totalAttributes = numCentroids * dimensions;
-
-    double* backupAttributes = malloc(totalAttributes * sizeof(double));
-    handleMemoryError(backupAttributes);
+    const size_t numSplitTypes = 3;
 
-    for (size_t i = 0; i < maxSwaps; ++i)
+    Statistics stats[3];
+    for (size_t splitType = 0; splitType < numSplitTypes; ++splitType)
     {
-        //Backup
-        size_t offset = 0;
-        for (size_t j = 0; j < numCentroids; ++j)
-        {
-            memcpy(&backupAttributes[offset], centroids->points[j].attributes, dimensions * sizeof(double));
-            offset += dimensions;
-        }
+        initializeStatistics(&stats[splitType]);
+    }
 
-        //Swap
-        size_t randomCentroidId = rand() % centroids->size;
-        size_t randomDataPointId = rand() % dataPoints->size;
-        memcpy(centroids->points[randomCentroidId].attributes, dataPoints->points[randomDataPointId].attributes, dimensions * sizeof(double));
-        
-        //K-means
-        double resultMse = runKMeans(dataPoints, kMeansIterations, centroids, groundTruth);
+    clock_t start, end;
+    double prefixTimeSum = 0.0;
 
-        //If 1) MSE improves, we keep the change
-        //if not, we reverse the swap
-        if (resultMse < bestMse)
-        {
-            /*if (LOGGING >= 3)
-            {
-				size_t centroidIndex = calculateCentroidIndex(centroids, groundTruth);
-                printf("(RS) Round %zu: Best Centroid Index (CI): %zu and Best Sum-of-Squared Errors (MSE): %.5f\n", i + 1, centroidIndex, resultMse / 10000);
-            }*/
-            
-            bestMse = resultMse;
-        }
-        else
-        {
-            offset = 0;
-            for (size_t j = 0; j < numCentroids; ++j)
-            {
-                memcpy(centroids->points[j].attributes, &backupAttributes[offset], dimensions * sizeof(double));
-                offset += dimensions;
-            }
-        }
-    }
+    MemoryAccounting memoryUsage[3];
+    memset(memoryUsage, 0, sizeof(memoryUsage));
 
-    free(backupAttributes);
+    printf("MSE split variants\n");
 
-    return bestMse;
-}
+    double* clusterMSEs = trackedMalloc(numCentroids * sizeof(double));
+    double* MseDrops = trackedCalloc(numCentroids, sizeof(double));
+    handleMemoryError(clusterMSEs);
+    handleMemoryError(MseDrops);
 
-/**
-*@brief Splits a cluster into two sub - clusters using local k - means.
-*
-*This function splits a cluster into two sub - clusters by selecting two random centroids
-* from the data points in the cluster and running local k - means.It updates the partitions
-* and centroids based on the results of the local k - means.
-*
-*@param dataPoints A pointer to the DataPoints structure containing the data points.
-* @param centroids A pointer to the Centroids structure containing the centroids.
-* @param clusterToSplit The index of the cluster to split.
-* @param localMaxIterations The maximum number of iterations for the local k - means.
-* @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
-*/
-void splitClusterIntraCluster(DataPoints* dataPoints, Centroids* centroids, size_t clusterToSplit, size_t localMaxIterations, const Centroids* groundTruth)
-{
-    size_t clusterSize = 0;
-    for (size_t i = 0; i < dataPoints->size; ++i)
+    for (size_t i = 0; i < loopCount; ++i)
     {
-        if (dataPoints->points[i].partition == clusterToSplit)
-        {
-            clusterSize++;
-        }
-    }
+        if (checkTrialBoundary(NULL, NULL, i, numCentroids, scaling, &loopCount)) break;
 
-    // Random split will break without this
-    if (clusterSize < 2)
-    {
-        return;
-    }
+        seedTrial(i);
 
-    // Collect indices of points in the cluster
-    size_t* clusterIndices = malloc(clusterSize * sizeof(size_t));
-    handleMemoryError(clusterIndices);
+        resetPartitions(dataPoints);
 
-    size_t index = 0;
-    for (size_t i = 0; i < dataPoints->size; ++i)
-    {
-        if (dataPoints->points[i].partition == clusterToSplit)
+        Centroids centroids = allocateCentroids(1, dataPoints->points[0].dimensions);
+
+        start = clock();
+
+        generateRandomCentroids(centroids.size, dataPoints, &centroids);
+
+        beginMseSplit(dataPoints, &centroids, maxIterations, groundTruth, clusterMSEs, MseDrops);
+        ClusteringSnapshot prefix = captureClusteringSnapshot(dataPoints, &centroids, clusterMSEs, MseDrops, NULL);
+        ClusteringSnapshot results[3];
+
+        end = clock();
+        double prefixTime = ((double)(end - start)) / CLOCKS_PER_SEC;
+        prefixTimeSum += prefixTime;
+
+        for (size_t splitType = 0; splitType < numSplitTypes; ++splitType)
         {
-            clusterIndices[index++] = i;
-        }
-    }
+            resetMemoryPeaks();
+            start = clock();
 
-    // Random centroids
-    size_t c1 = rand() % clusterSize;
-    size_t c2 = c1;
-    while (c2 == c1)
-    {
-        c2 = rand() % clusterSize;
-    }
-    size_t datapoint1 = clusterIndices[c1];
-    size_t datapoint2 = clusterIndices[c2];
+            restoreClusteringSnapshot(&prefix, dataPoints, &centroids, clusterMSEs, MseDrops, splitType > 0 ? &results[splitType - 1] : NULL);
+            double resultMse = continueMseSplit(dataPoints, &centroids, numCentroids, maxIterations, groundTruth, splitType, clusterMSEs, MseDrops);
+            results[splitType] = captureClusteringSnapshot(dataPoints, &centroids, NULL, NULL, &prefix);
 
-    // Initialize local centroids
-	Centroids localCentroids = allocateCentroids(2, dataPoints->points[0].dimensions);
+            end = clock();
+            double duration = ((double)(end - start)) / CLOCKS_PER_SEC + prefixTime;
+            saveMemoryPeaks(&memoryUsage[splitType]);
 
-    deepCopyDataPoint(&localCentroids.points[0], &dataPoints->points[datapoint1]);
-    deepCopyDataPoint(&localCentroids.points[1], &dataPoints->points[datapoint2]);
+            size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
 
-    // Prepare data points in the cluster
-    DataPoints pointsInCluster;
-    pointsInCluster.size = clusterSize;
-    pointsInCluster.points = malloc(clusterSize * sizeof(DataPoint));
-    handleMemoryError(pointsInCluster.points);
-    for (size_t i = 0; i < clusterSize; ++i)
-    {
-        pointsInCluster.points[i] = dataPoints->points[clusterIndices[i]];
+            stats[splitType].mseSum += resultMse;
+            stats[splitType].ciSum += centroidIndex;
+            stats[splitType].timeSum += duration;
+            if (centroidIndex == 0) stats[splitType].successRate++;
+
+            if (i == 0)
+            {
+                const char* splitTypeName = getSplitTypeName(splitType);
+                char centroidsFile[256];
+                char partitionsFile[256];
+                snprintf(centroidsFile, sizeof(centroidsFile), "outputs/%s_centroids.txt", splitTypeName);
+                snprintf(partitionsFile, sizeof(partitionsFile), "outputs/%s_partitions.txt", splitTypeName);
+                writeCentroidsToFile(centroidsFile, &centroids);
+                writeDataPointPartitionsToFile(partitionsFile, dataPoints);
+            }
+        }
+
+        if (LOGGING >= 2)
+        {
+            printf("(MSE split variants) Partition chunks shared with the first split:");
+            for (size_t splitType = 0; splitType < numSplitTypes; ++splitType)
+            {
+                printf(" %s %zu/%zu", getSplitTypeName(splitType), countSharedChunks(&prefix, &results[splitType]), prefix.numChunks);
+            }
+            printf("\n");
+        }
+
+        for (size_t splitType = 0; splitType < numSplitTypes; ++splitType)
+        {
+            releaseClusteringSnapshot(&results[splitType]);
+        }
+        releaseClusteringSnapshot(&prefix);
+        freeCentroids(&centroids);
     }
 
-    // Run local k-means
-    //TODO: poista "resultMse" jos ei tarvita
-    double resultMse = runKMeans(&pointsInCluster, localMaxIterations, &localCentroids, groundTruth);
+    if (loopCount > 0) printf("(MSE split variants) Average time of the shared first split: %.2f seconds\n", prefixTimeSum / loopCount);
 
-    // Update partitions
-    for (size_t i = 0; i < clusterSize; ++i)
+    for (size_t splitType = 0; splitType < numSplitTypes; ++splitType)
     {
-        size_t originalIndex = clusterIndices[i];
-        dataPoints->points[originalIndex].partition = (pointsInCluster.points[i].partition == 0) ? clusterToSplit : centroids->size;
+        const char* splitTypeName = getSplitTypeName(splitType);
+        loadMemoryPeaks(&memoryUsage[splitType]);
+        printStatistics(splitTypeName, stats[splitType], loopCount, numCentroids, scaling);
+        writeResultsToFile(fileName, stats[splitType], numCentroids, splitTypeName, loopCount, scaling, outputDirectory);
     }
 
-    // Update centroids
-    // TODO: deepcopyjen sijaan suoraan memcpy?
-    //#1
-    deepCopyDataPoint(&centroids->points[clusterToSplit], &localCentroids.points[0]);
-    
-    //#2
-    centroids->size++;
-    centroids->points = realloc(centroids->points, centroids->size * sizeof(DataPoint));
-    handleMemoryError(centroids->points);
-	centroids->points[centroids->size - 1] = allocateDataPoint(dataPoints->points[0].dimensions);
-    deepCopyDataPoint(&centroids->points[centroids->size - 1], &localCentroids.points[1]);
-    
-
-    // Cleanup
-    free(clusterIndices);
-    free(pointsInCluster.points);
-    free(localCentroids.points);
+    trackedFree(clusterMSEs);
+    trackedFree(MseDrops);
 }
 
 /**
- * @brief Splits a cluster into two sub-clusters using global k-means.
+ * @brief Runs the Bisecting k-means algorithm on the given data points and centroids.
  *
- * This function splits a cluster into two sub-clusters by selecting two random centroids
- * from the data points in the cluster and running global k-means. It updates the partitions
- * and centroids based on the results of the global k-means.
+ * This function iterates through partition and centroid steps, selects a cluster to split based on the SSE,
+ * and updates the centroids and partitions based on the results of the local k-means.
+ * It returns the best mean squared error (MSE) obtained during the iterations.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure containing the centroids.
- * @param clusterToSplit The index of the cluster to split.
- * @param globalMaxIterations The maximum number of iterations for the global k-means.
  * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param numCentroids The number of centroids to generate.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param loopCount The number of loops to run the k-means algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
  */
-void splitClusterGlobal(DataPoints* dataPoints, Centroids* centroids, size_t clusterToSplit, size_t globalMaxIterations, Centroids* groundTruth)
+void runBisectingKMeansAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
 {
-    size_t clusterSize = 0;
+    if (!requireFixedClusterCount("Bisecting k-means")) return;
 
-    for (size_t i = 0; i < dataPoints->size; ++i)
-    {
-        if (dataPoints->points[i].partition == clusterToSplit)
-        {
-            clusterSize++;
-        }
-    }
+    Statistics stats;
+    initializeStatistics(&stats);
 
-    //Debugging
-    /*if (clusterSize < 2)
-    {
-        return;
-    }*/
+    clock_t start, end;
+    double duration;
 
-    // Collect the indices of the points in the selected cluster
-    size_t* clusterIndices = malloc(clusterSize * sizeof(size_t));
-    handleMemoryError(clusterIndices);
+    printf("Bisecting k-means\n");
 
-    size_t index = 0;
-    for (size_t i = 0; i < dataPoints->size; ++i)
+    for (size_t i = 0; i < loopCount; ++i)
     {
-        if (dataPoints->points[i].partition == clusterToSplit)
-        {
-            clusterIndices[index++] = i;
-        }
-    }
+        if (checkTrialBoundary("Bisecting", &stats, i, numCentroids, scaling, &loopCount)) break;
 
-    // Select two random points from the cluster to be the new centroids
-    size_t c1 = rand() % clusterSize;
-    size_t c2 = c1;
-    while (c2 == c1)
-    {
-        c2 = rand() % clusterSize;
-    }
+        seedTrial(i);
 
-    // Get the indices of the randomly selected data points
-    size_t datapoint1 = clusterIndices[c1];
-    size_t datapoint2 = clusterIndices[c2];
+        resetPartitions(dataPoints);
 
-    // Add the first new centroid (overwrite the current centroid at clusterToSplit)
-    deepCopyDataPoint(&centroids->points[clusterToSplit], &dataPoints->points[datapoint1]);
+        Centroids centroids = allocateCentroids(1, dataPoints->points[0].dimensions);
 
-    // Add the second new centroid to the global centroids list
-    centroids->size++;
-    centroids->points = realloc(centroids->points, centroids->size * sizeof(DataPoint));
-	centroids->points[centroids->size - 1] = allocateDataPoint(dataPoints->points[0].dimensions);
-    deepCopyDataPoint(&centroids->points[centroids->size - 1], &dataPoints->points[datapoint2]);
+        start = clock();
 
-    // Run global k-means, this time including the new centroids
-    double resultMse = runKMeans(dataPoints, globalMaxIterations, centroids, groundTruth);
+        generateRandomCentroids(centroids.size, dataPoints, &centroids);
 
-    // Cleanup
-    free(clusterIndices);
+        //if (LOGGING >= 3) printDataPointsPartitions(dataPoints, centroids.size);
+
+        double resultMse = runBisectingKMeans(dataPoints, &centroids, numCentroids, maxIterations, groundTruth);
+
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+        //if (LOGGING >= 3) printf("(Bisecting)Time taken: %.2f seconds\n\n", duration);
+        printf("Sizeeeee %zu\n", centroids.size);
+        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+
+        stats.mseSum += resultMse;
+        stats.ciSum += centroidIndex;
+        stats.timeSum += duration;
+        if (centroidIndex == 0) stats.successRate++;
+        printf("CI %zu\n", centroidIndex);
+        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
+
+        if (i == 0)
+        {
+            writeCentroidsToFile("outputs/bisectingKMeans_centroids.txt", &centroids);
+            writeDataPointPartitionsToFile("outputs/bisectingKMeans_partitions.txt", dataPoints);
+        }
+
+        freeCentroids(&centroids);
+    }
+
+    printStatistics("Bisecting", stats, loopCount, numCentroids, scaling);
+
+    writeResultsToFile(fileName, stats, numCentroids, "Bisecting k-means", loopCount, scaling, outputDirectory);
 }
 
-// TODO: vain split k-means, haluanko mys random swappiin?
-// TODO: kesken
 /**
- * @brief Performs local repartitioning of data points to the nearest centroid.
+ * @brief Runs the hierarchical k-means algorithm and collects statistics.
  *
- * This function reassigns data points to the nearest centroid if the nearest centroid
- * is either the new cluster or the cluster to be split. It updates the clustersAffected
- * array to mark the affected clusters.
+ * This function runs two-level hierarchical k-means for a specified number of loops, calculates the Centroid Index (CI),
+ * and writes the statistics to a file.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure containing the centroids.
- * @param clusterToSplit The index of the cluster to split.
- * @param clustersAffected A pointer to the array indicating which clusters are affected.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param numCentroids The number of centroids.
+ * @param maxIterations The maximum number of iterations for each k-means run.
+ * @param refinementIterations The number of flat refinement iterations restricted to neighbouring groups.
+ * @param loopCount The number of loops to run the algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
  */
-void localRepartition(DataPoints* dataPoints, Centroids* centroids, size_t clusterToSplit, bool* clustersAffected)
+void runHierarchicalKMeansAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t refinementIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
 {
-    size_t newClusterIndex = centroids->size - 1;
+    if (!requireFixedClusterCount("Hierarchical k-means")) return;
 
-    /* TODO: Kysy/selvit, ett tarvitaanko tt? Oma oletus on, ett ei tarvita
-    // new clusters -> old clusters
-    for (size_t i = 0; i < dataPoints->size; ++i)
-    {
-        if (dataPoints->points[i].partition == clusterToSplit || dataPoints->points[i].partition == newClusterIndex)
-        {
-            size_t nearestCentroid = findNearestCentroid(&dataPoints->points[i], centroids);
+    Statistics stats;
+    initializeStatistics(&stats);
 
-            if (dataPoints->points[i].partition != nearestCentroid)
-            {
-                clustersAffected[dataPoints->points[i].partition] = true; // Mark the old cluster as affected
-                clustersAffected[nearestCentroid] = true;                 // Mark the new cluster as affected
-                dataPoints->points[i].partition = nearestCentroid;
-            }
-        }
-    }*/
+    clock_t start, end;
+    double duration;
 
-    // old clusters -> new clusters
-    for (size_t i = 0; i < dataPoints->size; ++i)
+    printf("Hierarchical k-means\n");
+
+    for (size_t i = 0; i < loopCount; ++i)
     {
-        size_t currentCluster = dataPoints->points[i].partition;
+        if (checkTrialBoundary("Hierarchical K-means", &stats, i, numCentroids, scaling, &loopCount)) break;
 
-        // skip new cluster -> old cluster
-        if (currentCluster == clusterToSplit || currentCluster == newClusterIndex)
-            continue;
+        seedTrial(i);
 
-        size_t nearestCentroid = findNearestCentroid(&dataPoints->points[i], centroids);
+        Centroids centroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
 
-        if (nearestCentroid == newClusterIndex || nearestCentroid == clusterToSplit)
-        {
-            //if (LOGGING >= 3) printf("Local repartition: Success, point %zu is reassigned\n", i);
+        start = clock();
 
-            clustersAffected[currentCluster] = true;    // Mark the old cluster as affected
-            dataPoints->points[i].partition = nearestCentroid;
+        double resultMse = runHierarchicalKMeans(dataPoints, &centroids, maxIterations, refinementIterations, groundTruth);
+
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+
+        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+
+        stats.mseSum += resultMse;
+        stats.ciSum += centroidIndex;
+        stats.timeSum += duration;
+        if (centroidIndex == 0) stats.successRate++;
+
+        if (i == 0)
+        {
+            writeCentroidsToFile("outputs/hierarchicalKMeans_centroids.txt", &centroids);
+            writeDataPointPartitionsToFile("outputs/hierarchicalKMeans_partitions.txt", dataPoints);
         }
+
+        freeCentroids(&centroids);
     }
 
-    //if(LOGGING >= 3) printf("Local repartition is over\n\n");
+    printStatistics("Hierarchical K-means", stats, loopCount, numCentroids, scaling);
+
+    writeResultsToFile(fileName, stats, numCentroids, "Hierarchical k-means", loopCount, scaling, outputDirectory);
 }
 
-//todo: centroids turha tnne?
 /**
- * @brief Calculates the MSE drop for a tentative split of a cluster.
+ * @brief Runs the k-means algorithm with the approximate graph assignment and collects statistics.
  *
- * This function calculates the MSE drop by running local k-means on a cluster and comparing
- * the new MSE with the original MSE. It returns the difference between the original MSE and the new MSE.
+ * This function runs the approximate k-means for a specified number of loops, calculates the Centroid Index (CI),
+ * reports the average recall, error ratio and distance evaluations of the assignment, and writes the statistics to a file.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param clusterLabel The label of the cluster to split.
- * @param localMaxIterations The maximum number of iterations for the local k-means.
- * @param originalClusterMSE The original MSE of the cluster before the split.
- * @return The MSE drop for the tentative split of the cluster.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param numCentroids The number of centroids.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param loopCount The number of loops to run the algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
  */
-double tentativeMseDrop(DataPoints* dataPoints, size_t clusterLabel, size_t localMaxIterations, double originalClusterMSE)
+void runApproximateKMeansAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
 {
-    size_t clusterSize = 0;
-    for (size_t i = 0; i < dataPoints->size; ++i)
-    {
-        if (dataPoints->points[i].partition == clusterLabel)
-        {
-            clusterSize++;
-        }
-    }
-    
-    //DEBUGGING
-    /*if (clusterSize < 2)
-    {
-        return 0.0;
-    }*/
+    if (!requireFixedClusterCount("Approximate k-means")) return;
 
-    DataPoints pointsInCluster = allocateDataPoints(clusterSize, dataPoints->points[0].dimensions);
+    Statistics stats;
+    initializeStatistics(&stats);
 
-    size_t index = 0;
-    for (size_t i = 0; i < dataPoints->size; ++i)
-    {
-        if (dataPoints->points[i].partition == clusterLabel)
-        {
-            deepCopyDataPoint(&pointsInCluster.points[index], &dataPoints->points[i]);
-            index++;
-        }
-    }
+    clock_t start, end;
+    double duration;
+    double recallSum = 0.0;
+    double sseRatioSum = 0.0;
+    double evaluationSum = 0.0;
 
-    // Random centroids
-    size_t idx1 = rand() % clusterSize;
-    size_t idx2 = idx1;
-    while (idx2 == idx1)
+    printf("Approximate k-means\n");
+
+    for (size_t i = 0; i < loopCount; ++i)
     {
-        idx2 = rand() % clusterSize;
-    }
+        if (checkTrialBoundary("Approximate K-means", &stats, i, numCentroids, scaling, &loopCount)) break;
 
-    Centroids localCentroids = allocateCentroids(2,dataPoints->points[0].dimensions);
+        seedTrial(i);
 
-    deepCopyDataPoint(&localCentroids.points[0], &pointsInCluster.points[idx1]);
-    deepCopyDataPoint(&localCentroids.points[1], &pointsInCluster.points[idx2]);
+        Centroids centroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
 
-    // k-means
-    double resultMse = runKMeans(&pointsInCluster, localMaxIterations, &localCentroids, NULL);
+        start = clock();
 
-    // Calculate combined MSE of the two clusters
-	//TODO: WithSize vai ilman? Eli koko datasetin mukaan vai pelkstn clusterin mukaan?
-    //      Jos withSize, niin tthn ei edes tarvita, resultMse on sama?
-    double newClusterMSE = calculateMSEWithSize(&pointsInCluster, &localCentroids, dataPoints->size);
+        generateRandomCentroids(numCentroids, dataPoints, &centroids);
+        resetPartitions(dataPoints);
 
-    double mseDrop = originalClusterMSE - resultMse;
+        ApproximateSearchReport report;
+        double resultMse = runApproximateKMeans(dataPoints, maxIterations, &centroids, &report);
 
-    freeDataPoints(&pointsInCluster);
-    freeCentroids(&localCentroids);
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
 
-    return mseDrop;
+        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+
+        stats.mseSum += resultMse;
+        stats.ciSum += centroidIndex;
+        stats.timeSum += duration;
+        if (centroidIndex == 0) stats.successRate++;
+        recallSum += report.recall;
+        sseRatioSum += report.sseRatio;
+        evaluationSum += report.evaluationsPerPoint;
+
+        if (i == 0)
+        {
+            writeCentroidsToFile("outputs/approximateKMeans_centroids.txt", &centroids);
+            writeDataPointPartitionsToFile("outputs/approximateKMeans_partitions.txt", dataPoints);
+        }
+
+        freeCentroids(&centroids);
+    }
+
+    printStatistics("Approximate K-means", stats, loopCount, numCentroids, scaling);
+    printf("(Approximate K-means) Average recall: %.4f, SSE ratio: %.6f, distance evaluations per point: %.1f\n\n", recallSum / loopCount, sseRatioSum / loopCount, evaluationSum / loopCount);
+
+    writeResultsToFile(fileName, stats, numCentroids, "Approximate k-means", loopCount, scaling, outputDirectory);
 }
 
 /**
- * @brief Calculates the MSE drop for a tentative split of a cluster.
+ * @brief Runs a clustering algorithm on grid-aggregated data points and collects statistics.
  *
- * This function calculates the MSE drop by running local k-means on a cluster and comparing
- * the new MSE with the original MSE. It returns the difference between the original MSE and the new MSE.
+ * The data points are aggregated once into at most maxCells weighted cells, and the selected algorithm
+ * clusters the cell representatives, so its iterations cost time proportional to the number of cells.
+ * The cell partitions are then copied to the data points, and optionally a few k-means iterations
+ * on the data points correct the assignments near the cluster borders. The aggregation time
+ * is included in the time of every loop, and the reported MSE is measured on the data points.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param clusterLabel The label of the cluster to split.
- * @param localMaxIterations The maximum number of iterations for the local k-means.
  * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
- * @return A ClusteringResult structure containing the new centroids and the MSE drop.
+ * @param numCentroids The number of centroids.
+ * @param gridAlgorithm The algorithm run on the cells: 0 = k-means, 1 = random swap, 2 = random split, 3 = MSE split (intra-cluster), 4 = bisecting k-means.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param maxSwaps The maximum number of swaps for the random swap algorithm.
+ * @param swapCandidates The number of candidate swaps screened per k-means run of the random swap algorithm.
+ * @param refinementIterations The maximum number of k-means iterations on the data points after the expansion (0 = none).
+ * @param cellWidth The width of the cells at the finest resolution.
+ * @param maxCells The largest acceptable number of occupied cells.
+ * @param loopCount The number of loops to run the algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
  */
-ClusteringResult tentativeSplitterForBisecting(DataPoints* dataPoints, size_t clusterLabel, size_t localMaxIterations, const Centroids* groundTruth)
+void runGridAggregatedAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t gridAlgorithm, size_t maxIterations, size_t maxSwaps, size_t swapCandidates, size_t refinementIterations, double cellWidth, size_t maxCells, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
 {
-    size_t clusterSize = 0;
-    for (size_t i = 0; i < dataPoints->size; ++i)
-    {
-        if (dataPoints->points[i].partition == clusterLabel)
-        {
-            clusterSize++;
-        }
-    }
+    if (!requireFixedClusterCount("Grid-aggregated clustering")) return;
 
-	//DEBUGGING
-    /*if (clusterSize < 2)
-    {
-        printf("Not enough points to split the cluster\n");
-        exit(EXIT_FAILURE);
-    }*/
+    const char* algorithmName = getGridAlgorithmName(gridAlgorithm);
+    if (algorithmName == NULL) return;
 
+    Statistics stats;
+    initializeStatistics(&stats);
 
-    DataPoints pointsInCluster = allocateDataPoints(clusterSize, dataPoints->points[0].dimensions);
+    clock_t start, end;
+    double duration;
 
-    size_t index = 0;
-    for (size_t i = 0; i < dataPoints->size; ++i) //todo: tmn loopin voi ehk yhdist ylemmn kanssa? ps. tai ehk ei koska clusterSize?
-    {
-        if (dataPoints->points[i].partition == clusterLabel)
-        {
-            deepCopyDataPoint(&pointsInCluster.points[index], &dataPoints->points[i]);
-            index++;
-        }
-    }
+    printf("%s\n", algorithmName);
 
-    // Random centroids
-    size_t idx1 = rand() % clusterSize;
-    size_t idx2 = idx1;
-    while (idx2 == idx1)
+    start = clock();
+    GridAggregation grid = aggregateToGrid(dataPoints, cellWidth, maxCells, numCentroids);
+    end = clock();
+    double aggregationTime = ((double)(end - start)) / CLOCKS_PER_SEC;
+
+    printf("(%s) Grid cells: %zu, cell width: %g, coarsening levels: %zu, aggregation time: %.2f seconds\n", algorithmName, grid.cells.size, grid.cellWidth, grid.levels, aggregationTime);
+
+    if (grid.cells.size < numCentroids)
     {
-        idx2 = rand() % clusterSize;
+        raiseFatalError("The grid has fewer cells (%zu) than clusters (%zu)", grid.cells.size, numCentroids);
     }
 
-    Centroids localCentroids = allocateCentroids(2, dataPoints->points[0].dimensions);
-    deepCopyDataPoint(&localCentroids.points[0], &pointsInCluster.points[idx1]);
-    deepCopyDataPoint(&localCentroids.points[1], &pointsInCluster.points[idx2]);
-
-    ClusteringResult localResult = allocateClusteringResult(dataPoints->size, 2, dataPoints->points[0].dimensions);
+    for (size_t i = 0; i < loopCount; ++i)
+    {
+        if (checkTrialBoundary(algorithmName, &stats, i, numCentroids, scaling, &loopCount)) break;
 
-    // k-means
-    localResult.mse = runKMeans(&pointsInCluster, localMaxIterations, &localCentroids, groundTruth);
+        seedTrial(i);
 
-    // Calculate combined MSE of the two clusters
-    //TODO: WithSize vai ilman? Eli koko datasetin mukaan vai pelkstn clusterin mukaan?
-    //      Jos withSize, niin tthn ei edes tarvita, resultMse on sama?
-    double newClusterMSE = calculateMSEWithSize(&pointsInCluster, &localCentroids, dataPoints->size);
+        resetPartitions(&grid.cells);
 
-    // Calculate the MSE drop
-    //localResult.mse = newClusterMSE;
+        // The split algorithms grow the centroids from a single one
+        size_t initialCentroids = gridAlgorithm <= 1 ? numCentroids : 1;
+        Centroids centroids = allocateCentroids(initialCentroids, dataPoints->points[0].dimensions);
 
-	deepCopyDataPoint(&localResult.centroids[0], &localCentroids.points[0]);
-    deepCopyDataPoint(&localResult.centroids[1], &localCentroids.points[1]);
+        start = clock();
 
-    freeDataPoints(&pointsInCluster);
-    freeCentroids(&localCentroids);;
+        generateRandomCentroids(initialCentroids, &grid.cells, &centroids);
 
-    return localResult;
-}
+        switch (gridAlgorithm)
+        {
+        case 1:
+            randomSwap(&grid.cells, &centroids, maxSwaps, swapCandidates, groundTruth);
+            break;
+        case 2:
+            runRandomSplit(&grid.cells, &centroids, numCentroids, maxIterations, groundTruth);
+            break;
+        case 3:
+            runMseSplit(&grid.cells, &centroids, numCentroids, maxIterations, groundTruth, 0);
+            break;
+        case 4:
+            runBisectingKMeans(&grid.cells, &centroids, numCentroids, maxIterations, groundTruth);
+            break;
+        default:
+            runKMeans(&grid.cells, maxIterations, &centroids, groundTruth);
+            break;
+        }
 
+        expandGridPartitions(dataPoints, &grid);
 
-/**
- * @brief Runs the split k-means algorithm with random splitting.
- *
- * This function iterates through partition and centroid steps, randomly selects a cluster to split,
- * and updates the centroids and partitions based on the results of the local k-means.
- * It returns the best mean squared error (MSE) obtained during the iterations.
- *
- * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure containing the centroids.
- * @param maxCentroids The maximum number of centroids to generate.
- * @param maxIterations The maximum number of iterations for the k-means algorithm.
- * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
- * @return The best mean squared error (MSE) obtained during the iterations.
- */
-double runRandomSplit(DataPoints* dataPoints, Centroids* centroids, size_t maxCentroids, size_t maxIterations, const Centroids* groundTruth)
-{
-    size_t localMaxIterations = 2;
+        double resultMse;
+        if (refinementIterations > 0)
+        {
+            resultMse = runKMeans(dataPoints, refinementIterations, &centroids, groundTruth);
+        }
+        else
+        {
+            resultMse = calculateSSE(dataPoints, &centroids);
+        }
 
-    partitionStep(dataPoints, centroids);
-    centroidStep(centroids, dataPoints);
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC + aggregationTime;
 
-    while(centroids->size < maxCentroids)
-    {
-        size_t clusterToSplit = rand() % centroids->size;
+        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
 
-        splitClusterIntraCluster(dataPoints, centroids, clusterToSplit, localMaxIterations, groundTruth);
+        stats.mseSum += resultMse;
+        stats.ciSum += centroidIndex;
+        stats.timeSum += duration;
+        if (centroidIndex == 0) stats.successRate++;
 
-        /*if (LOGGING >= 3)
+        if (i == 0)
         {
-            size_t ci = calculateCentroidIndex(centroids, groundTruth);
-            double mse = calculateMSE(dataPoints, centroids);
-            printf("(RandomSplit) Number of centroids: %zu, CI: %zu, and MSE: %.5f \n", centroids->size, ci, mse / 10000);
-        }*/
-    }	
+            writeCentroidsToFile("outputs/gridAggregated_centroids.txt", &centroids);
+            writeDataPointPartitionsToFile("outputs/gridAggregated_partitions.txt", dataPoints);
+        }
+
+        freeCentroids(&centroids);
+    }
 
-    //TODO: globaali k-means  
-    double finalResultMse = runKMeans(dataPoints, maxIterations, centroids, groundTruth);
+    printStatistics(algorithmName, stats, loopCount, numCentroids, scaling);
 
-    return finalResultMse;
+    writeResultsToFile(fileName, stats, numCentroids, algorithmName, loopCount, scaling, outputDirectory);
+
+    freeGridAggregation(&grid);
 }
 
 /**
- * @brief Runs the split k-means algorithm with tentative splitting (choosing to split the one that reduces the MSE the most).
+ * @brief Runs the multilevel coarse-to-fine clustering and collects statistics.
  *
- * This function iterates through partition and centroid steps, selects a cluster to split based on the MSE drop,
- * and updates the centroids and partitions based on the results of the local k-means.
- * It returns the best mean squared error (MSE) obtained during the iterations.
+ * This function runs the multilevel clustering for a specified number of loops, calculates the Centroid Index (CI),
+ * and writes the statistics to a file.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure containing the centroids.
- * @param maxCentroids The maximum number of centroids to generate.
- * @param maxIterations The maximum number of iterations for the k-means algorithm.
  * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
- * @param splitType The type of split to perform (0 = intra-cluster, 1 = global, 2 = local repartition).
- * @return The best mean squared error (MSE) obtained during the iterations.
+ * @param numCentroids The number of centroids.
+ * @param levelFractions The sample fractions of the levels, in increasing order.
+ * @param levelIterations The maximum number of k-means iterations on each level.
+ * @param numLevels The number of levels.
+ * @param firstLevelAlgorithm The algorithm of the first level: 0 = k-means, 1 = random swap.
+ * @param maxSwaps The maximum number of swaps for random swap on the first level.
+ * @param swapCandidates The number of candidate swaps screened per k-means run of random swap.
+ * @param loopCount The number of loops to run the algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
  */
-double runMseSplit(DataPoints* dataPoints, Centroids* centroids, size_t maxCentroids, size_t maxIterations, const Centroids* groundTruth, size_t splitType)
+void runMultilevelAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, const double* levelFractions, const size_t* levelIterations, size_t numLevels, size_t firstLevelAlgorithm, size_t maxSwaps, size_t swapCandidates, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
 {
-    //TODO: ent jos globaalia ei rajoittaisi, olisiko tullut paremmat tulokset???????
-    //TODO: pohdi tarkemmat arvot, globaaliin 5 nytt toimivan hyvin
-    size_t iterations = splitType == 0 ? maxIterations : splitType == 1 ? maxIterations : maxIterations;
-
-    double* clusterMSEs = malloc(maxCentroids * sizeof(double));
-    handleMemoryError(clusterMSEs);
-
-    double* MseDrops = calloc(maxCentroids, sizeof(size_t));
-    handleMemoryError(MseDrops);
+    if (!requireFixedClusterCount("Multilevel clustering")) return;
 
-    bool* clustersAffected = calloc(maxCentroids*2, sizeof(bool));
-    handleMemoryError(clustersAffected);
+    Statistics stats;
+    initializeStatistics(&stats);
 
-    //Only 1 cluster, so no need for decision making
-    size_t initialClusterToSplit = 0;
-    splitClusterIntraCluster(dataPoints, centroids, initialClusterToSplit, iterations, groundTruth);
+    clock_t start, end;
+    double duration;
 
-    for (size_t i = 0; i < centroids->size; ++i)
-    {
-        clusterMSEs[i] = calculateClusterMSE(dataPoints, centroids, i); //TODO: tarvitaanko omaa rakennetta?
-        MseDrops[i] = tentativeMseDrop(dataPoints, i, iterations, clusterMSEs[i]);
-    }
+    printf("Multilevel %s\n", firstLevelAlgorithm == 1 ? "random swap" : "k-means");
 
-    while (centroids->size < maxCentroids)
+    for (size_t i = 0; i < loopCount; ++i)
     {
-		// Choose the cluster that reduces the MSE the most
-        size_t clusterToSplit = 0;
-        double maxMseDrop = MseDrops[0];
-
-        for (size_t i = 1; i < centroids->size; ++i)
-        {
-            if (MseDrops[i] > maxMseDrop)
-            {
-                maxMseDrop = MseDrops[i];
-                clusterToSplit = i;
-            }
-        }
+        if (checkTrialBoundary("Multilevel", &stats, i, numCentroids, scaling, &loopCount)) break;
 
-        /*if (LOGGING >= 3 && splitType == 3)
-        {
-            printDataPointsPartitions(dataPoints, centroids->size);
-        }*/
+        seedTrial(i);
 
-        if(splitType == 0) splitClusterIntraCluster(dataPoints, centroids, clusterToSplit, iterations, groundTruth);
-		else if (splitType == 1) splitClusterGlobal(dataPoints, centroids, clusterToSplit, iterations, groundTruth);
-		else if (splitType == 2) splitClusterIntraCluster(dataPoints, centroids, clusterToSplit, iterations, groundTruth);
+        Centroids centroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
 
-		if (splitType == 0) // Intra-cluster
-        {
-            // Recalculate MSE for the affected clusters
-            clusterMSEs[clusterToSplit] = calculateClusterMSE(dataPoints, centroids, clusterToSplit);
-            clusterMSEs[centroids->size - 1] = calculateClusterMSE(dataPoints, centroids, centroids->size - 1);
+        start = clock();
 
-            // Update MseDrops for the affected clusters
-            MseDrops[clusterToSplit] = tentativeMseDrop(dataPoints, clusterToSplit, iterations, clusterMSEs[clusterToSplit]);
-            MseDrops[centroids->size - 1] = tentativeMseDrop(dataPoints, centroids->size - 1, iterations, clusterMSEs[centroids->size - 1]);
-        }
-		else if (splitType == 1) // Global
-        {            
-            for (size_t i = 0; i < centroids->size; ++i)
-            {
-                clusterMSEs[i] = calculateClusterMSE(dataPoints, centroids, i);
-                MseDrops[i] = tentativeMseDrop(dataPoints, i, iterations, clusterMSEs[i]);
-            }
-        }
-		else if (splitType == 2) // Local repartition
-        {            
-            localRepartition(dataPoints, centroids, clusterToSplit, clustersAffected);
-            
-			clustersAffected[clusterToSplit] = true;
-			clustersAffected[centroids->size - 1] = true;
+        double resultMse = runMultilevelClustering(dataPoints, &centroids, levelFractions, levelIterations, numLevels, firstLevelAlgorithm, maxSwaps, swapCandidates, groundTruth);
 
-			// Recalculate MseDrop for affected clusters (old and new)
-            for (size_t i = 0; i < centroids->size; ++i)
-            {
-                if (clustersAffected[i])
-                {
-                    //if (LOGGING >= 3) printf("Affected cluster: %zu\n", i);
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
 
-                    clusterMSEs[i] = calculateClusterMSE(dataPoints, centroids, i);
-                    MseDrops[i] = tentativeMseDrop(dataPoints, i, iterations, clusterMSEs[i]);
-                }
-            }
+        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
 
-            memset(clustersAffected, 0, (maxCentroids * 2) * sizeof(bool));
-        }
+        stats.mseSum += resultMse;
+        stats.ciSum += centroidIndex;
+        stats.timeSum += duration;
+        if (centroidIndex == 0) stats.successRate++;
 
-        /*if (LOGGING >= 3 && splitType == 2)
+        if (i == 0)
         {
-            size_t ci = calculateCentroidIndex(centroids, groundTruth);
-            double mse = calculateMSE(dataPoints, centroids);
-            printf("(MseSplit) Number of centroids: %zu, CI: %zu, and MSE: %.5f \n", centroids->size, ci, mse / 10000);
-        }*/
-
+            writeCentroidsToFile("outputs/multilevel_centroids.txt", &centroids);
+            writeDataPointPartitionsToFile("outputs/multilevel_partitions.txt", dataPoints);
+        }
 
-        //if (LOGGING >= 3 && splitType == 2) printf("Round over\n\n");
+        freeCentroids(&centroids);
     }
 
-    free(clusterMSEs);
-	free(MseDrops);
-	free(clustersAffected);
-
-    //TODO: globaali k-means  
-    double finalResultMse = runKMeans(dataPoints, maxIterations, centroids, groundTruth);
+    printStatistics("Multilevel", stats, loopCount, numCentroids, scaling);
 
-    return finalResultMse;
+    writeResultsToFile(fileName, stats, numCentroids, "Multilevel", loopCount, scaling, outputDirectory);
 }
 
 /**
- * @brief Runs the Bisecting k-means algorithm on the given data points and centroids.
+ * @brief Runs the batched k-means for a sweep of cluster counts and collects statistics for each of them.
  *
- * This function iterates through partition and centroid steps, selects a cluster to split based on the SSE,
- * and updates the centroids and partitions based on the results of the local k-means.
- * It returns the best mean squared error (MSE) obtained during the iterations.
+ * In every loop one model per number of clusters is initialized with random centroids, and all models run
+ * together with runBatchedKMeans. The time of a loop is the time of the whole batch, and it is reported
+ * for every number of clusters. The Centroid Index compares each model with the ground truth as it is,
+ * so it is meaningful only for the number of clusters of the ground truth.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param centroids A pointer to the Centroids structure containing the centroids.
- * @param maxCentroids The maximum number of centroids to generate.
- * @param maxIterations The maximum number of iterations for the k-means algorithm.
  * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
- * @return The best mean squared error (MSE) obtained during the iterations.
+ * @param kValues The numbers of clusters of the models.
+ * @param numModels The number of models.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param loopCount The number of loops to run the algorithm.
+ * @param scaling A scaling factor for the MSE values.
+ * @param fileName The name of the file to write the results to.
+ * @param outputDirectory The directory where the results file is located.
  */
-double runBisectingKMeans(DataPoints* dataPoints, Centroids* centroids, size_t maxCentroids, size_t maxIterations, const Centroids* groundTruth)
+void runBatchedKMeansAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, const size_t* kValues, size_t numModels, size_t maxIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
 {
-	size_t bisectingIterations = 5;
-    
-    double* SseList = malloc(maxCentroids * sizeof(size_t));
-    handleMemoryError(SseList);
-    double bestMse = DBL_MAX;
+    if (!requireFixedClusterCount("Batched k-means")) return;
 
-    DataPoint newCentroid1 = allocateDataPoint(dataPoints->points[0].dimensions);
-    DataPoint newCentroid2 = allocateDataPoint(dataPoints->points[0].dimensions);
+    Statistics* stats = trackedMalloc(numModels * sizeof(Statistics));
+    BatchedModel* models = trackedMalloc(numModels * sizeof(BatchedModel));
+    handleMemoryError(stats);
+    handleMemoryError(models);
+    for (size_t m = 0; m < numModels; ++m)
+    {
+        initializeStatistics(&stats[m]);
+    }
 
-	//Step 0: Only 1 cluster, so no need for decision making
-    size_t initialClusterToSplit = 0;
-    splitClusterIntraCluster(dataPoints, centroids, initialClusterToSplit, maxIterations, groundTruth);
+    clock_t start, end;
+    double duration;
 
-	SseList[0] = calculateClusterMSE(dataPoints, centroids, 0);
-    SseList[1] = calculateClusterMSE(dataPoints, centroids, 1);
+    printf("Batched k-means (%zu models)\n", numModels);
 
-    //Repeat until we have K clusters
-    for (size_t i = 2; centroids->size < maxCentroids; ++i)
+    for (size_t i = 0; i < loopCount; ++i)
     {
-        //if (LOGGING >= 3) printf("(BKM) Round %zu: Centroids: %zu\n", i-1, centroids->size);
+        if (checkTrialBoundary(NULL, NULL, i, 0, scaling, &loopCount)) break;
 
-        size_t clusterToSplit = 0;
-        double maxSSE = SseList[0];
+        seedTrial(i);
 
-		//Step 1: Choose the cluster to split (the highest SSE)
-        for (size_t j = 1; j < centroids->size; ++j)
+        for (size_t m = 0; m < numModels; ++m)
         {
-            if (SseList[j] > maxSSE)
-            {
-                maxSSE = SseList[j];
-                clusterToSplit = j;
-            }
+            models[m] = allocateBatchedModel(kValues[m], dataPoints->points[0].dimensions, dataPoints->size);
         }
 
-		//Repeat for a set number of iterations
-        for (size_t j = 0; j < bisectingIterations; ++j)
+        start = clock();
+
+        for (size_t m = 0; m < numModels; ++m)
         {
-			ClusteringResult curr = tentativeSplitterForBisecting(dataPoints, clusterToSplit, maxIterations, groundTruth);
+            generateRandomCentroids(kValues[m], dataPoints, &models[m].centroids);
+        }
 
-            //if (LOGGING >= 3) printf("(RKM) Round %d: Latest Centroid Index (CI): %zu and Latest Mean Sum-of-Squared Errors (MSE): %.4f\n", repeat, result1.centroidIndex, result1.mse / 10000);
+        runBatchedKMeans(dataPoints, models, numModels, maxIterations);
 
-			// If the result is better than the best result so far, update the best result
-            if (curr.mse < bestMse)
+        end = clock();
+        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+
+        for (size_t m = 0; m < numModels; ++m)
+        {
+            size_t centroidIndex = calculateCentroidIndex(&models[m].centroids, groundTruth);
+
+            stats[m].mseSum += models[m].bestSse;
+            stats[m].ciSum += centroidIndex;
+            stats[m].timeSum += duration;
+            if (centroidIndex == 0) stats[m].successRate++;
+
+            if (i == 0)
             {
-                //if (LOGGING >= 3) printf("(from inner) Round %zu\n", j);
-                bestMse = curr.mse;
-                
-                /*if (LOGGING >= 3)
+                for (size_t p = 0; p < dataPoints->size; ++p)
                 {
-                    Centroids tempCentroids;
-                    tempCentroids.size = 2;
-                    tempCentroids.points = curr.centroids;
-                    printCentroidsInfo(&tempCentroids);
-                }*/                
-                
-                // Save the two new centroids
-				deepCopyDataPoint(&newCentroid1, &curr.centroids[0]);
-                deepCopyDataPoint(&newCentroid2, &curr.centroids[1]);
+                    dataPoints->points[p].partition = models[m].partitions[p];
+                }
 
-				freeClusteringResult(&curr, 2);
+                char centroidsFile[256];
+                char partitionsFile[256];
+                snprintf(centroidsFile, sizeof(centroidsFile), "outputs/batchedKMeans_k%zu_centroids.txt", kValues[m]);
+                snprintf(partitionsFile, sizeof(partitionsFile), "outputs/batchedKMeans_k%zu_partitions.txt", kValues[m]);
+                writeCentroidsToFile(centroidsFile, &models[m].centroids);
+                writeDataPointPartitionsToFile(partitionsFile, dataPoints);
             }
+
+            freeBatchedModel(&models[m]);
         }
+    }
 
-		// Replace the old centroid with the new centroid1
-        deepCopyDataPoint(&centroids->points[clusterToSplit], &newCentroid1);
+    for (size_t m = 0; m < numModels; ++m)
+    {
+        char header[64];
+        snprintf(header, sizeof(header), "Batched k-means (K=%zu)", kValues[m]);
+        printStatistics(header, stats[m], loopCount, kValues[m], scaling);
+        writeResultsToFile(fileName, stats[m], kValues[m], header, loopCount, scaling, outputDirectory);
+    }
 
-		// Increase the size of the centroids array and add the new centroid2
-        centroids->points = realloc(centroids->points, (centroids->size + 1) * sizeof(DataPoint));
-        handleMemoryError(centroids->points);
-        centroids->points[centroids->size] = allocateDataPoint(newCentroid2.dimensions);
-        deepCopyDataPoint(&centroids->points[centroids->size], &newCentroid2);
-        centroids->size++;
+    trackedFree(stats);
+    trackedFree(models);
+}
 
-        printf("CI %zu\n", calculateCentroidIndex(centroids, groundTruth));
+/**
+ * @brief Returns the name of an anytime algorithm.
+ *
+ * @param anytimeAlgorithm The index of the algorithm.
+ * @return The name of the algorithm, or NULL if the index is invalid.
+ */
+const char* getAnytimeAlgorithmName(size_t anytimeAlgorithm)
+{
+    switch (anytimeAlgorithm)
+    {
+    case 0:
+        return "Anytime k-means";
+    case 1:
+        return "Anytime repeated k-means";
+    case 2:
+        return "Anytime random swap";
+    case 3:
+        return "Anytime random split";
+    case 4:
+        return "Anytime MSE split";
+    case 5:
+        return "Anytime bisecting k-means";
+    default:
+        fprintf(stderr, "Error: Invalid anytime algorithm provided\n");
+        return NULL;
+    }
+}
 
-        //if (LOGGING >= 3) printf("(from outer) Round %zu\n", i);
-        //printCentroidsInfo(centroids);
+/**
+ * @brief Runs an algorithm selected by its index from random initial centroids.
+ *
+ * The split algorithms grow the centroids from a single random one, the others start from numCentroids random centroids.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
+ * @param numCentroids The number of centroids to find.
+ * @param algorithm The algorithm (0 = k-means, 1 = repeated k-means, 2 = random swap, 3 = random split, 4 = MSE split, 5 = bisecting k-means).
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param maxRepeats The maximum number of repeats for the repeated k-means algorithm.
+ * @param maxSwaps The maximum number of attempted swaps.
+ * @param swapCandidates The number of candidate swaps screened per attempted swap (0 = plain random swap).
+ * @return The centroids found by the algorithm, freed by the caller.
+ */
+Centroids runAlgorithmByIndex(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t algorithm, size_t maxIterations, size_t maxRepeats, size_t maxSwaps, size_t swapCandidates)
+{
+    size_t initialCentroids = algorithm <= 2 ? numCentroids : 1;
+    Centroids centroids = allocateCentroids(initialCentroids, dataPoints->points[0].dimensions);
 
-        partitionStep(dataPoints, centroids);
+    switch (algorithm)
+    {
+    case 1:
+        runRepeatedKMeans(dataPoints, &centroids, maxIterations, maxRepeats, groundTruth);
+        break;
+    case 2:
+        generateRandomCentroids(numCentroids, dataPoints, &centroids);
+        randomSwap(dataPoints, &centroids, maxSwaps, swapCandidates, groundTruth);
+        break;
+    case 3:
+        generateRandomCentroids(initialCentroids, dataPoints, &centroids);
+        runRandomSplit(dataPoints, &centroids, numCentroids, maxIterations, groundTruth);
+        break;
+    case 4:
+        generateRandomCentroids(initialCentroids, dataPoints, &centroids);
+        runMseSplit(dataPoints, &centroids, numCentroids, maxIterations, groundTruth, 0);
+        break;
+    case 5:
+        generateRandomCentroids(initialCentroids, dataPoints, &centroids);
+        runBisectingKMeans(dataPoints, &centroids, numCentroids, maxIterations, groundTruth);
+        break;
+    default:
+        generateRandomCentroids(numCentroids, dataPoints, &centroids);
+        runKMeans(dataPoints, maxIterations, &centroids, groundTruth);
+        break;
+    }
 
-		//Step 3: Update the SSE list
-        // Recalculate MSE for the affected clusters
-        SseList[clusterToSplit] = calculateClusterMSE(dataPoints, centroids, clusterToSplit);
-        SseList[centroids->size - 1] = calculateClusterMSE(dataPoints, centroids, centroids->size - 1);
-        
-        if (centroids->size == maxCentroids - 1) {
-            writeCentroidsToFile("outputs/TESTcentroids.txt", centroids);
-            writeDataPointPartitionsToFile("outputs/TESTpartitions.txt", dataPoints);
-        }
+    return centroids;
+}
 
-        bestMse = DBL_MAX;
+/**
+ * @brief Writes the quality versus time trace of the last anytime run to a file.
+ *
+ * Each line holds the elapsed time in seconds and the best SSE found by then.
+ *
+ * @param filename The name of the file.
+ * @param scaling A scaling factor for the SSE values.
+ */
+void writeAnytimeTraceToFile(const char* filename, size_t scaling)
+{
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Unable to open file '%s'\n", filename);
+        return;
     }
 
-	//Step 4: Run the final k-means
-    double finalResultMse = runKMeans(dataPoints, maxIterations, centroids, groundTruth);
-    printf("size  %zu\n", centroids->size);
-    // Cleanup
-    free(SseList);
-	freeDataPoint(&newCentroid1);
-	freeDataPoint(&newCentroid2);
-
-    //TODO: Kommentoi/poista/tee jotain, ei tartte joka kierroksella kirjoittaa tiedostoon
-    writeCentroidsToFile("outputs/centroids.txt", centroids);
-    writeDataPointPartitionsToFile("outputs/partitions.txt", dataPoints);
+    for (size_t i = 0; i < activeBudget.traceLength; ++i)
+    {
+        fprintf(file, "%.6f %.6f\n", activeBudget.traceTimes[i], activeBudget.traceSses[i] / scaling);
+    }
 
-    return finalResultMse;
+    fclose(file);
 }
 
 /**
- * @brief Runs the k-means algorithm on the given data points and centroids.
+ * @brief Runs an algorithm with a wall-clock budget and reports the quality it reaches in that time.
  *
- * This function iterates through partition and centroid steps, calculates the MSE,
- * and returns the best MSE obtained during the iterations.
+ * Every trial gets the same budget. The algorithms check the deadline after each k-means iteration,
+ * swap, repeat or split and stop with the best solution so far; a split algorithm that runs out of time
+ * places its missing centroids at random data points before its final k-means. The iteration, repeat
+ * and swap limits still apply, so large limits let the budget decide. The deadline is only checked
+ * between steps, so a run overruns its budget by at most one step plus the final partitioning;
+ * the average and largest overruns are reported. Times are wall-clock times. The result of a trial is the best
+ * complete solution recorded during it, not necessarily the final centroids of the algorithm.
+ * The quality versus time trace of the first trial is written to outputs/anytime_trace.txt.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
  * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
  * @param numCentroids The number of centroids to generate.
+ * @param anytimeAlgorithm The algorithm (0 = k-means, 1 = repeated k-means, 2 = random swap, 3 = random split, 4 = MSE split, 5 = bisecting k-means).
+ * @param budgetMilliseconds The wall-clock budget of each trial in milliseconds.
  * @param maxIterations The maximum number of iterations for the k-means algorithm.
- * @param loopCount The number of loops to run the k-means algorithm.
+ * @param maxRepeats The maximum number of repeats for the repeated k-means algorithm.
+ * @param maxSwaps The maximum number of attempted swaps.
+ * @param swapCandidates The number of candidate swaps screened per attempted swap (0 = plain random swap).
+ * @param loopCount The number of loops to run the algorithm.
  * @param scaling A scaling factor for the MSE values.
  * @param fileName The name of the file to write the results to.
  * @param outputDirectory The directory where the results file is located.
  */
-void runKMeansAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
+void runAnytimeAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t anytimeAlgorithm, size_t budgetMilliseconds, size_t maxIterations, size_t maxRepeats, size_t maxSwaps, size_t swapCandidates, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
 {
+    if (!requireFixedClusterCount("The anytime run")) return;
+
+    const char* algorithmName = getAnytimeAlgorithmName(anytimeAlgorithm);
+    if (algorithmName == NULL) return;
+
     Statistics stats;
     initializeStatistics(&stats);
 
-    clock_t start, end;
-    double duration;
+    double budgetSeconds = budgetMilliseconds / 1000.0;
+    double overrunSum = 0.0;
+    double maxOverrun = 0.0;
 
-    printf("K-means\n");
+    printf("%s (budget %zu ms)\n", algorithmName, budgetMilliseconds);
 
     for (size_t i = 0; i < loopCount; ++i)
     {
-        Centroids centroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
+        if (checkTrialBoundary(algorithmName, &stats, i, numCentroids, scaling, &loopCount)) break;
 
-        start = clock();
+        seedTrial(i);
 
-        generateRandomCentroids(numCentroids, dataPoints, &centroids);
+        resetPartitions(dataPoints);
 
-        /*if (LOGGING >= 3)
-        {
-            size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
-            printf("(K-means)Initial Centroid Index (CI): %zu\n", centroidIndex);
-        }*/
+        startAnytimeBudget(dataPoints, numCentroids, budgetSeconds);
 
-        double resultMse = runKMeans(dataPoints, maxIterations, &centroids, groundTruth);
-        //if(LOGGING >= 3) printf("(K-means)Best Centroid Index (CI): %d and Best Sum-of-Squared Errors (MSE): %.4f\n", result.centroidIndex, result.mse / 10000000);
+        Centroids centroids = runAlgorithmByIndex(dataPoints, groundTruth, numCentroids, anytimeAlgorithm, maxIterations, maxRepeats, maxSwaps, swapCandidates);
 
-        end = clock();
-        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+        // The returned SSE may belong to an earlier iteration or a rejected swap,
+        // so the final centroids are measured with matching partitions
+        partitionStep(dataPoints, &centroids);
+        double resultMse = calculateSSE(dataPoints, &centroids);
+        recordAnytimeProgress(dataPoints, &centroids, resultMse);
 
-        //if (LOGGING >= 3) printf("(K-means)Time taken: %.2f seconds\n\n", duration);
+        // An earlier solution of the run may be better than the final one (e.g. a k-means run cut off by the deadline
+        // after a worse repeat), the result is the best solution seen
+        if (activeBudget.bestSse < resultMse && centroids.size == numCentroids)
+        {
+            for (size_t c = 0; c < numCentroids; ++c)
+            {
+                deepCopyDataPoint(&centroids.points[c], &activeBudget.bestCentroids.points[c]);
+            }
+            partitionStep(dataPoints, &centroids);
+            resultMse = calculateSSE(dataPoints, &centroids);
+        }
+
+        double duration = stopAnytimeBudget();
+        double overrun = duration > budgetSeconds ? duration - budgetSeconds : 0.0;
+        overrunSum += overrun;
+        if (overrun > maxOverrun) maxOverrun = overrun;
 
         size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
 
@@ -2165,375 +11136,912 @@ void runKMeansAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, si
         stats.timeSum += duration;
         if (centroidIndex == 0) stats.successRate++;
 
-        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
-
         if (i == 0)
         {
-            writeCentroidsToFile("outputs/kMeans_centroids.txt", &centroids);
-            writeDataPointPartitionsToFile("outputs/kMeans_partitions.txt", dataPoints);
+            writeCentroidsToFile("outputs/anytime_centroids.txt", &centroids);
+            writeDataPointPartitionsToFile("outputs/anytime_partitions.txt", dataPoints);
+            writeAnytimeTraceToFile("outputs/anytime_trace.txt", scaling);
+        }
+
+        if (LOGGING >= 2 && activeBudget.traceLength > 0)
+        {
+            printf("(%s) Round %zu: %zu improvements, first SSE %.5f at %.1f ms, final SSE %.5f at %.1f ms\n", algorithmName, i + 1, activeBudget.traceLength,
+                activeBudget.traceSses[0] / scaling, activeBudget.traceTimes[0] * 1000.0,
+                activeBudget.traceSses[activeBudget.traceLength - 1] / scaling, activeBudget.traceTimes[activeBudget.traceLength - 1] * 1000.0);
         }
 
         freeCentroids(&centroids);
     }
 
-    printStatistics("K-means", stats, loopCount, numCentroids, scaling);
+    freeAnytimeTrace();
+
+    printf("(%s) Budget: %zu ms, average overrun: %.2f ms, largest overrun: %.2f ms\n", algorithmName, budgetMilliseconds, overrunSum / loopCount * 1000.0, maxOverrun * 1000.0);
 
-    writeResultsToFile(fileName, stats, numCentroids, "K-means", loopCount, scaling, outputDirectory);
+    printStatistics(algorithmName, stats, loopCount, numCentroids, scaling);
+
+    char header[64];
+    snprintf(header, sizeof(header), "%s (%zu ms)", algorithmName, budgetMilliseconds);
+    writeResultsToFile(fileName, stats, numCentroids, header, loopCount, scaling, outputDirectory);
 }
 
 /**
- * @brief Runs the repeated k-means algorithm on the given data points and centroids.
+ * @brief Writes a string to a JSON file as a quoted and escaped JSON string.
  *
- * This function iterates through partition and centroid steps, calculates the MSE,
- * and returns the best MSE obtained during the iterations.
+ * @param file The file to write to.
+ * @param text The string.
+ */
+static void writeJsonString(FILE* file, const char* text)
+{
+    fputc('"', file);
+    for (const char* c = text; *c != '\0'; ++c)
+    {
+        if (*c == '"' || *c == '\\') fputc('\\', file);
+        if ((unsigned char)*c >= 0x20) fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+/**
+ * @brief Runs the benchmark of the algorithms and writes the samples to a JSON file.
+ *
+ * Every algorithm (k-means, repeated k-means, random swap, random split, MSE split, bisecting k-means) runs
+ * the given number of samples. Sample r is seeded from RANDOM_SEED and r even outside the deterministic mode,
+ * and the reductions are always done in a fixed order, so the SSE and CI of a sample depend only on the code,
+ * the data and the settings. Each sample records its wall-clock time, the k-means iterations (including the local
+ * ones of the split algorithms), the time per iteration, the SSE and the CI (null without ground truth).
+ *
+ * The JSON file is compared with a stored baseline of the same machine by python/regression_gate.py,
+ * which flags slower iterations and any change in the SSE or CI.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
- * @param numCentroids The number of centroids to generate.
+ * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids, or NULL.
+ * @param numCentroids The number of centroids to find.
  * @param maxIterations The maximum number of iterations for the k-means algorithm.
- * @param maxRepeats The maximum number of repeats for the k-means algorithm.
- * @param loopCount The number of loops to run the k-means algorithm.
- * @param scaling A scaling factor for the MSE values.
- * @param fileName The name of the file to write the results to.
- * @param outputDirectory The directory where the results file is located.
+ * @param maxRepeats The maximum number of repeats for the repeated k-means algorithm.
+ * @param maxSwaps The maximum number of attempted swaps.
+ * @param swapCandidates The number of candidate swaps screened per attempted swap (0 = plain random swap).
+ * @param numSamples The number of samples of each algorithm.
+ * @param fileName The name of the dataset, stored in the JSON file.
+ * @param outputFile The path of the JSON file.
  */
-void runRepeatedKMeansAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t maxRepeats, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
+void runBenchmark(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t maxRepeats, size_t maxSwaps, size_t swapCandidates, size_t numSamples, const char* fileName, const char* outputFile)
 {
-    Statistics stats;
-    initializeStatistics(&stats);
+    if (!requireFixedClusterCount("The benchmark")) return;
 
-    clock_t start, end;
-    double duration;
+    const char* algorithmNames[] = { "K-means", "Repeated k-means", "Random swap", "Random split", "MSE split", "Bisecting k-means" };
+    size_t numAlgorithms = sizeof(algorithmNames) / sizeof(algorithmNames[0]);
 
-    printf("Repeated K-means\n");
+    FILE* file = fopen(outputFile, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Cannot open file %s for writing\n", outputFile);
+        return;
+    }
 
-    for (size_t i = 0; i < loopCount; ++i)
+    char machine[128];
+    getMachineName(machine, sizeof(machine));
+
+    fprintf(file, "{\n  \"machine\": ");
+    writeJsonString(file, machine);
+    fprintf(file, ",\n  \"threads\": %d,\n  \"dataset\": ", getMaxThreads());
+    writeJsonString(file, fileName);
+    fprintf(file, ",\n  \"size\": %zu,\n  \"dimensions\": %zu,\n  \"clusters\": %zu,\n", dataPoints->size, dataPoints->points[0].dimensions, numCentroids);
+    fprintf(file, "  \"settings\": { \"metric\": %zu, \"maxIterations\": %zu, \"maxRepeats\": %zu, \"maxSwaps\": %zu, \"swapCandidates\": %zu, \"emptyClusterStrategy\": %zu },\n",
+        activeMetric.type, maxIterations, maxRepeats, maxSwaps, swapCandidates, activeEmptyClusterStrategy);
+    fprintf(file, "  \"algorithms\": [\n");
+
+    printf("Benchmark (%zu samples per algorithm)\n", numSamples);
+
+    for (size_t a = 0; a < numAlgorithms; ++a)
     {
-		double bestMse = DBL_MAX;
+        // Stopped by SIGINT, the samples so far are kept
+        if (stopRequested()) break;
 
-        Centroids bestCentroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
+        fprintf(file, "%s    { \"name\": ", a > 0 ? ",\n" : "");
+        writeJsonString(file, algorithmNames[a]);
+        fprintf(file, ", \"samples\": [\n");
 
-        start = clock();
+        // One untimed run first, so the first sample does not pay for cold caches
+        srand(RANDOM_SEED);
+        resetPartitions(dataPoints);
+        Centroids warmUp = runAlgorithmByIndex(dataPoints, groundTruth, numCentroids, a, maxIterations, maxRepeats, maxSwaps, swapCandidates);
+        freeCentroids(&warmUp);
 
-        for (size_t j = 0; j < maxRepeats; ++j)
+        double timeSum = 0.0;
+        size_t completedSamples = 0;
+        for (size_t r = 0; r < numSamples; ++r)
         {
-            Centroids centroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
-            generateRandomCentroids(numCentroids, dataPoints, &centroids);
+            if (r > 0 && stopRequested()) break;
 
-            /*if (LOGGING >= 3)
-            {
-                size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
-                printf("(Repeated K-means)Initial Centroid Index (CI): %zu\n", centroidIndex);
-            }*/
+            srand(RANDOM_SEED ^ (unsigned int)(r * 2654435761u));
+            resetPartitions(dataPoints);
+            atomic_store(&activeWork.iterations, 0);
+
+            double start = getMonotonicSeconds();
+            Centroids centroids = runAlgorithmByIndex(dataPoints, groundTruth, numCentroids, a, maxIterations, maxRepeats, maxSwaps, swapCandidates);
+            double duration = getMonotonicSeconds() - start;
 
-            double resultMse = runKMeans(dataPoints, maxIterations, &centroids, groundTruth);
+            size_t iterations = atomic_load(&activeWork.iterations);
 
-            if (resultMse < bestMse)
+            // The SSE of the final centroids with matching partitions, as in the anytime runs
+            partitionStep(dataPoints, &centroids);
+            double sse = calculateSSE(dataPoints, &centroids);
+
+            fprintf(file, "%s      { \"seed\": %zu, \"seconds\": %.9f, \"iterations\": %zu, \"secondsPerIteration\": %.9g, \"sse\": %.17g, \"ci\": ",
+                r > 0 ? ",\n" : "", r, duration, iterations, iterations > 0 ? duration / iterations : 0.0, sse);
+            if (groundTruth != NULL)
+            {
+                size_t countFrom1to2 = countOrphans(&centroids, groundTruth);
+                size_t countFrom2to1 = countOrphans(groundTruth, &centroids);
+                fprintf(file, "%zu }", countFrom1to2 > countFrom2to1 ? countFrom1to2 : countFrom2to1);
+            }
+            else
             {
-                bestMse = resultMse;
-				deepCopyCentroids(&centroids, &bestCentroids, numCentroids);
+                fprintf(file, "null }");
             }
 
+            timeSum += duration;
+            completedSamples++;
             freeCentroids(&centroids);
         }
 
-        end = clock();
-        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+        fprintf(file, "%s    ] }", completedSamples > 0 ? "\n" : "");
+        printf("(Benchmark) %s: average time %.4f seconds\n", algorithmNames[a], completedSamples > 0 ? timeSum / completedSamples : 0.0);
+    }
 
-        //if (LOGGING >= 3) printf("(Repeated K-means)Time taken: %.2f seconds\n\n", duration);
+    fprintf(file, "\n  ]\n}\n");
+    fclose(file);
 
-        size_t centroidIndex = calculateCentroidIndex(&bestCentroids, groundTruth);
+    printf("Benchmark results written to %s\n\n", outputFile);
+}
 
-        stats.mseSum += bestMse;
-        stats.ciSum += centroidIndex;
-        stats.timeSum += duration;
-        if (centroidIndex == 0) stats.successRate++;
 
-        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
+ //////////////////
+// Diagnostics //
+////////////////
 
-        if (i == 0)
-        {
-            writeCentroidsToFile("outputs/repeatedKMeans_centroids.txt", &bestCentroids);
-            writeDataPointPartitionsToFile("outputs/repeatedKMeans_partitions.txt", dataPoints);
-        }
+/**
+ * @brief Runs a seeded Random Swap and k-means pipeline and stores the result.
+ *
+ * This function is a helper for runDeterminismCheck. It seeds the generator from RANDOM_SEED,
+ * runs a short Random Swap followed by k-means, and copies the centroid attributes and partitions
+ * into the given arrays.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param numCentroids The number of centroids.
+ * @param maxIterations The maximum number of iterations for the k-means algorithm.
+ * @param centroidAttributes An array of numCentroids * dimensions doubles for the resulting centroids.
+ * @param partitions An array of dataPoints->size entries for the resulting partitions.
+ * @return The SSE of the result.
+ */
+double runSeededReferencePipeline(DataPoints* dataPoints, size_t numCentroids, size_t maxIterations, double* centroidAttributes, size_t* partitions)
+{
+    size_t dimensions = dataPoints->points[0].dimensions;
+    size_t checkSwaps = 10;
 
-        freeCentroids(&bestCentroids);
+    srand(RANDOM_SEED);
+
+    Centroids centroids = allocateCentroids(numCentroids, dimensions);
+    generateRandomCentroids(numCentroids, dataPoints, &centroids);
+
+    randomSwap(dataPoints, &centroids, checkSwaps, 0, NULL);
+    double sse = runKMeans(dataPoints, maxIterations, &centroids, NULL);
+
+    for (size_t i = 0; i < numCentroids; ++i)
+    {
+        memcpy(&centroidAttributes[i * dimensions], centroids.points[i].attributes, dimensions * sizeof(double));
+    }
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        partitions[i] = dataPoints->points[i].partition;
     }
 
-    printStatistics("Repeated K-means", stats, loopCount, numCentroids, scaling);
+    freeCentroids(&centroids);
 
-    writeResultsToFile(fileName, stats, numCentroids, "Repeated K-means", loopCount, scaling, outputDirectory);
+    return sse;
 }
 
 /**
- * @brief Runs the repeated k-means algorithm on the given data points and centroids.
+ * @brief Checks that the clustering results are bit-identical across thread counts.
  *
- * This function iterates through partition and centroid steps, calculates the MSE,
- * and returns the best MSE obtained during the iterations.
+ * This function runs the same seeded Random Swap and k-means pipeline with 1, 2 and one thread per processor,
+ * and compares the centroids, partitions and SSE of each run bit by bit against the single-threaded run.
+ * The processor count is used instead of the current thread count, which autotuning may have lowered, and
+ * duplicate thread counts are skipped. With fewer than two distinct thread counts the check is reported as not run.
+ * Any difference is printed. The thread count of the caller is restored afterwards.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
- * @param numCentroids The number of centroids to generate.
+ * @param numCentroids The number of centroids.
  * @param maxIterations The maximum number of iterations for the k-means algorithm.
- * @param maxRepeats The maximum number of repeats for the k-means algorithm.
- * @param loopCount The number of loops to run the k-means algorithm.
- * @param scaling A scaling factor for the MSE values.
- * @param fileName The name of the file to write the results to.
- * @param outputDirectory The directory where the results file is located.
+ * @return true if all runs produced identical results or the check was not run, false otherwise.
  */
-void runRandomSwapAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxSwaps, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
+bool runDeterminismCheck(DataPoints* dataPoints, size_t numCentroids, size_t maxIterations)
 {
-    Statistics stats;
-    initializeStatistics(&stats);
+    size_t dimensions = dataPoints->points[0].dimensions;
+    size_t attributeCount = numCentroids * dimensions;
+    int previousThreads = getMaxThreads();
+    int maxThreads = getProcessorCount();
+    int candidateCounts[3] = { 1, 2, maxThreads };
+    int threadCounts[3];
+    size_t numThreadCounts = 0;
+    bool identical = true;
+
+    for (size_t c = 0; c < 3; ++c)
+    {
+        bool duplicate = false;
+        for (size_t t = 0; t < numThreadCounts; ++t)
+        {
+            if (threadCounts[t] == candidateCounts[c]) duplicate = true;
+        }
+        if (!duplicate) threadCounts[numThreadCounts++] = candidateCounts[c];
+    }
 
-    clock_t start, end;
-    double duration;
+    if (numThreadCounts < 2)
+    {
+        printf("Determinism check not run (only %zu distinct thread count)\n\n", numThreadCounts);
+        return true;
+    }
 
-    printf("Random swap\n");
+    double* referenceAttributes = trackedMalloc(attributeCount * sizeof(double));
+    double* attributes = trackedMalloc(attributeCount * sizeof(double));
+    size_t* referencePartitions = trackedMalloc(dataPoints->size * sizeof(size_t));
+    size_t* partitions = trackedMalloc(dataPoints->size * sizeof(size_t));
+    handleMemoryError(referenceAttributes);
+    handleMemoryError(attributes);
+    handleMemoryError(referencePartitions);
+    handleMemoryError(partitions);
+
+    printf("Determinism check (processors: %d, thread counts:", maxThreads);
+    for (size_t t = 0; t < numThreadCounts; ++t)
+    {
+        printf(" %d", threadCounts[t]);
+    }
+    printf(")\n");
 
-    for (size_t i = 0; i < loopCount; ++i)
+    setThreadCount(threadCounts[0]);
+    double referenceSse = runSeededReferencePipeline(dataPoints, numCentroids, maxIterations, referenceAttributes, referencePartitions);
+
+    for (size_t t = 1; t < numThreadCounts; ++t)
     {
-        Centroids centroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
+        setThreadCount(threadCounts[t]);
+        double sse = runSeededReferencePipeline(dataPoints, numCentroids, maxIterations, attributes, partitions);
 
-        start = clock();
+        bool sameSse = memcmp(&sse, &referenceSse, sizeof(double)) == 0;
+        bool sameCentroids = memcmp(attributes, referenceAttributes, attributeCount * sizeof(double)) == 0;
+        bool samePartitions = memcmp(partitions, referencePartitions, dataPoints->size * sizeof(size_t)) == 0;
 
-        generateRandomCentroids(numCentroids, dataPoints, &centroids);
+        printf("Threads %d vs 1: SSE %s, centroids %s, partitions %s\n", threadCounts[t],
+            sameSse ? "identical" : "DIFFER", sameCentroids ? "identical" : "DIFFER", samePartitions ? "identical" : "DIFFER");
 
-        // Random Swap
-        double resultMse = randomSwap(dataPoints, &centroids, maxSwaps, groundTruth);
+        if (!sameSse)
+        {
+            printf("    SSE %.17g vs %.17g\n", sse, referenceSse);
+        }
 
-        end = clock();
-        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
+        identical = identical && sameSse && sameCentroids && samePartitions;
+    }
 
-        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+    setThreadCount(previousThreads);
 
-        //if (LOGGING >= 3) printf("(Random Swap)Time taken: %.2f seconds\n\n", duration);
+    printf("Determinism check %s\n\n", identical ? "passed" : "FAILED");
 
-        stats.mseSum += resultMse;
-        stats.ciSum += centroidIndex;
-        stats.timeSum += duration;
-        if (centroidIndex == 0) stats.successRate++;
+    trackedFree(referenceAttributes);
+    trackedFree(attributes);
+    trackedFree(referencePartitions);
+    trackedFree(partitions);
 
-        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
+    return identical;
+}
 
-        if (i == 0)
+
+/**
+ * @brief Calculates the assignment distance of the active metric with a plain scalar loop, the reference of the conformance check.
+ *
+ * Like calculateAssignmentDistance, the value is 1 - the dot product for the cosine metric, the sum of the absolute
+ * differences for the Manhattan metric, and the squared Euclidean distance (weighted by the inverse variances
+ * for the diagonal Mahalanobis metric) otherwise.
+ *
+ * @param a The attributes of the first point.
+ * @param b The attributes of the second point.
+ * @param dimensions The number of dimensions.
+ * @return The assignment distance.
+ */
+static double referenceAssignmentDistance(const double* a, const double* b, size_t dimensions)
+{
+    double sum = 0.0;
+    for (size_t dim = 0; dim < dimensions; ++dim)
+    {
+        double diff = a[dim] - b[dim];
+        switch (activeMetric.type)
         {
-            writeCentroidsToFile("outputs/randomSwap_centroids.txt", &centroids);
-            writeDataPointPartitionsToFile("outputs/randomSwap_partitions.txt", dataPoints);
+        case 1:
+            sum += a[dim] * b[dim];
+            break;
+        case 2:
+            sum += fabs(diff);
+            break;
+        case 3:
+            sum += activeMetric.weights[dim] * diff * diff;
+            break;
+        default:
+            sum += diff * diff;
+            break;
         }
-
-        freeCentroids(&centroids);
     }
-
-    printStatistics("Random Swap", stats, loopCount, numCentroids, scaling);
-
-    writeResultsToFile(fileName, stats, numCentroids, "Random swap", loopCount, scaling, outputDirectory);
+    return activeMetric.type == 1 ? 1.0 - sum : sum;
 }
 
 /**
- * @brief Runs the split k-means algorithm with random splitting.
+ * @brief Assigns each data point to its nearest centroid with a plain serial loop, the reference of the conformance check.
  *
- * This function iterates through partition and centroid steps, randomly selects a cluster to split,
- * and updates the centroids and partitions based on the results of the local k-means.
- * It returns the best mean squared error (MSE) obtained during the iterations.
+ * Of equal distances the centroid with the lowest index is chosen.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
- * @param numCentroids The number of centroids to generate.
- * @param maxIterations The maximum number of iterations for the k-means algorithm.
- * @param loopCount The number of loops to run the k-means algorithm.
- * @param scaling A scaling factor for the MSE values.
- * @param fileName The name of the file to write the results to.
- * @param outputDirectory The directory where the results file is located.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param labels An array of dataPoints->size entries for the labels.
  */
-void runRandomSplitAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
+static void referencePartitionStep(const DataPoints* dataPoints, const Centroids* centroids, size_t* labels)
 {
-    Statistics stats;
-    initializeStatistics(&stats);
+    size_t dimensions = dataPoints->points[0].dimensions;
 
-    clock_t start, end;
-    double duration;
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        size_t nearest = 0;
+        double minDistance = DBL_MAX;
+        for (size_t c = 0; c < centroids->size; ++c)
+        {
+            double distance = referenceAssignmentDistance(dataPoints->points[i].attributes, centroids->points[c].attributes, dimensions);
+            if (distance < minDistance)
+            {
+                minDistance = distance;
+                nearest = c;
+            }
+        }
+        labels[i] = nearest;
+    }
+}
 
-    printf("Random Split k-means\n");
+/**
+ * @brief Calculates the weighted median of the values of one cluster, the reference of the Manhattan centroid step.
+ *
+ * With equal weights the median is the middle value, or the mean of the two middle values of an even count.
+ * Otherwise it is the first value where the running weight reaches half of the total weight, averaged with
+ * the next value if the running weight is exactly half.
+ *
+ * @param values The values and their weights, sorted by this function.
+ * @param count The number of values, at least 1.
+ * @return The weighted median.
+ */
+static double referenceWeightedMedian(WeightedValue* values, size_t count)
+{
+    qsort(values, count, sizeof(WeightedValue), compareWeightedValues);
 
-    for (size_t i = 0; i < loopCount; ++i)
+    bool equalWeights = true;
+    long double totalWeight = 0.0;
+    for (size_t j = 0; j < count; ++j)
     {
-        Centroids centroids = allocateCentroids(1, dataPoints->points[0].dimensions);
+        equalWeights = equalWeights && values[j].weight == values[0].weight;
+        totalWeight += values[j].weight;
+    }
 
-        start = clock();
+    if (equalWeights)
+    {
+        return count % 2 == 1 ? values[count / 2].value : (values[count / 2 - 1].value + values[count / 2].value) / 2.0;
+    }
 
-        generateRandomCentroids(centroids.size, dataPoints, &centroids);
+    long double runningWeight = 0.0;
+    for (size_t j = 0; j < count; ++j)
+    {
+        runningWeight += values[j].weight;
+        if (runningWeight * 2.0 == totalWeight && j + 1 < count) return (values[j].value + values[j + 1].value) / 2.0;
+        if (runningWeight * 2.0 >= totalWeight) return values[j].value;
+    }
+    return values[count - 1].value;
+}
 
-        double resultMse = runRandomSplit(dataPoints, &centroids, numCentroids, maxIterations, groundTruth);
+/**
+ * @brief Calculates the centroid of each cluster with a plain serial loop, the reference of the conformance check.
+ *
+ * The centroid is the weighted mean of the cluster, normalized to unit length for the cosine metric,
+ * and the weighted median of every coordinate for the Manhattan metric.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param labels The cluster of each data point.
+ * @param numCentroids The number of clusters.
+ * @param means An array of numCentroids * dimensions doubles for the centroids.
+ * @param counts An array of numCentroids entries for the number of data points of each cluster.
+ */
+static void referenceCentroidStep(const DataPoints* dataPoints, const size_t* labels, size_t numCentroids, double* means, size_t* counts)
+{
+    size_t dimensions = dataPoints->points[0].dimensions;
 
-        end = clock();
-        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
-        //if (LOGGING >= 3) printf("(Split1)Time taken: %.2f seconds\n\n", duration);
+    if (activeMetric.type == 2)
+    {
+        WeightedValue* values = trackedMalloc(dataPoints->size * sizeof(WeightedValue));
+        handleMemoryError(values);
+        memset(counts, 0, numCentroids * sizeof(size_t));
 
-        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+        for (size_t c = 0; c < numCentroids; ++c)
+        {
+            for (size_t dim = 0; dim < dimensions; ++dim)
+            {
+                size_t count = 0;
+                for (size_t i = 0; i < dataPoints->size; ++i)
+                {
+                    if (labels[i] != c) continue;
+                    values[count].value = dataPoints->points[i].attributes[dim];
+                    values[count].weight = dataPoints->points[i].weight;
+                    count++;
+                }
+                counts[c] = count;
+                means[c * dimensions + dim] = count > 0 ? referenceWeightedMedian(values, count) : 0.0;
+            }
+        }
 
-        stats.mseSum += resultMse;
-        stats.ciSum += centroidIndex;
-        stats.timeSum += duration;
-        if (centroidIndex == 0) stats.successRate++;
+        trackedFree(values);
+        return;
+    }
 
-        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
+    long double* sums = trackedCalloc(numCentroids * dimensions, sizeof(long double));
+    long double* weights = trackedCalloc(numCentroids, sizeof(long double));
+    handleMemoryError(sums);
+    handleMemoryError(weights);
+    memset(counts, 0, numCentroids * sizeof(size_t));
+
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        const DataPoint* point = &dataPoints->points[i];
+        for (size_t dim = 0; dim < dimensions; ++dim)
+        {
+            sums[labels[i] * dimensions + dim] += (long double)point->weight * point->attributes[dim];
+        }
+        weights[labels[i]] += point->weight;
+        counts[labels[i]]++;
+    }
 
-		//TODO: kaikki tlliset pois lopullisesta versiosta
-        if (i == 0)
+    for (size_t c = 0; c < numCentroids; ++c)
+    {
+        for (size_t dim = 0; dim < dimensions; ++dim)
         {
-            writeCentroidsToFile("outputs/randomSplit_centroids.txt", &centroids);
-            writeDataPointPartitionsToFile("outputs/randomSplit_partitions.txt", dataPoints);
+            means[c * dimensions + dim] = counts[c] > 0 ? (double)(sums[c * dimensions + dim] / weights[c]) : 0.0;
         }
 
-        freeCentroids(&centroids);
+        if (activeMetric.type == 1)
+        {
+            long double norm = 0.0;
+            for (size_t dim = 0; dim < dimensions; ++dim)
+            {
+                norm += (long double)means[c * dimensions + dim] * means[c * dimensions + dim];
+            }
+            for (size_t dim = 0; dim < dimensions && norm > 0.0; ++dim)
+            {
+                means[c * dimensions + dim] = (double)(means[c * dimensions + dim] / sqrtl(norm));
+            }
+        }
     }
 
-    printStatistics("Random Split", stats, loopCount, numCentroids, scaling);
+    trackedFree(sums);
+    trackedFree(weights);
+}
 
-    writeResultsToFile(fileName, stats, numCentroids, "Random Split", loopCount, scaling, outputDirectory);
+/**
+ * @brief Calculates the SSE of the given labels with a plain serial loop, the reference of the conformance check.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param labels The cluster of each data point.
+ * @return The SSE, with the distance of calculateSSE.
+ */
+static double referenceSse(const DataPoints* dataPoints, const Centroids* centroids, const size_t* labels)
+{
+    size_t dimensions = dataPoints->points[0].dimensions;
+    bool squared = activeMetric.type == 0 || activeMetric.type == 3;
+    long double sse = 0.0;
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        double distance = referenceAssignmentDistance(dataPoints->points[i].attributes, centroids->points[labels[i]].attributes, dimensions);
+        sse += (long double)dataPoints->points[i].weight * (squared ? sqrt(distance) : distance);
+    }
+    return (double)sse;
 }
 
 /**
- * @brief Runs the split k-means algorithm with tentative splitting (choosing to split the one that reduces the MSE the most).
+ * @brief Compares the labels of an engine with the reference labels.
  *
- * This function iterates through partition and centroid steps, selects a cluster to split based on the MSE drop,
- * and updates the centroids and partitions based on the results of the local k-means.
- * It returns the best mean squared error (MSE) obtained during the iterations.
+ * A different label is accepted if its centroid is as near as the reference one within CONFORMANCE_TOLERANCE,
+ * as the distances of a near tie may round differently in the engine; such labels are counted as ties.
  *
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
- * @param numCentroids The number of centroids to generate.
- * @param maxIterations The maximum number of iterations for the k-means algorithm.
- * @param loopCount The number of loops to run the k-means algorithm.
- * @param scaling A scaling factor for the MSE values.
- * @param fileName The name of the file to write the results to.
- * @param outputDirectory The directory where the results file is located.
- * @param splitType The type of split to perform (0 = intra-cluster, 1 = global, 2 = local repartition).
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ * @param referenceLabels The reference labels.
+ * @param labels The labels of the engine.
+ * @param ties A pointer where the number of accepted differences is stored.
+ * @return The number of labels that differ beyond a tie.
  */
-void runMseSplitAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory, int splitType)
+static size_t compareConformanceLabels(const DataPoints* dataPoints, const Centroids* centroids, const size_t* referenceLabels, const size_t* labels, size_t* ties)
 {
-    Statistics stats;
-    initializeStatistics(&stats);
-
-    clock_t start, end;
-    double duration;
-
-    const char* splitTypeName = getSplitTypeName(splitType);
-
-    printf("%s\n", splitTypeName);
+    size_t dimensions = dataPoints->points[0].dimensions;
+    size_t mismatches = 0;
+    *ties = 0;
 
-    for (size_t i = 0; i < loopCount; ++i)
+    for (size_t i = 0; i < dataPoints->size; ++i)
     {
-        resetPartitions(dataPoints);
-
-        Centroids centroids = allocateCentroids(1, dataPoints->points[0].dimensions);
-
-        start = clock();
-
-        generateRandomCentroids(centroids.size, dataPoints, &centroids);
-
-        double resultMse = runMseSplit(dataPoints, &centroids, numCentroids, maxIterations, groundTruth, splitType);
-
-        end = clock();
-        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
-        //if (LOGGING >= 3) printf("(Split%d)Time taken: %.2f seconds\n\n", splitType + 1, duration);
+        if (labels[i] == referenceLabels[i]) continue;
 
-        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+        if (labels[i] < centroids->size)
+        {
+            const double* attributes = dataPoints->points[i].attributes;
+            double referenceDistance = referenceAssignmentDistance(attributes, centroids->points[referenceLabels[i]].attributes, dimensions);
+            double distance = referenceAssignmentDistance(attributes, centroids->points[labels[i]].attributes, dimensions);
+            if (distance <= referenceDistance + CONFORMANCE_TOLERANCE * (referenceDistance + 1.0))
+            {
+                (*ties)++;
+                continue;
+            }
+        }
+        mismatches++;
+    }
 
-        stats.mseSum += resultMse;
-        stats.ciSum += centroidIndex;
-        stats.timeSum += duration;
-        if (centroidIndex == 0) stats.successRate++;
+    return mismatches;
+}
 
-        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
+/**
+ * @brief Compares the centroids of an engine with the reference centroids.
+ *
+ * The centroids of non-empty clusters must match the reference within CONFORMANCE_TOLERANCE. Empty clusters are
+ * compared only if the engine keeps their centroids, then they must be unchanged (within the tolerance for the
+ * cosine metric, which normalizes them again).
+ *
+ * @param centroids A pointer to the Centroids structure of the engine.
+ * @param initial A pointer to the Centroids structure before the centroid step.
+ * @param means The reference centroids.
+ * @param counts The number of data points of each cluster.
+ * @param emptyKeepsCentroid True if the engine leaves the centroids of empty clusters where they were.
+ * @return The number of centroids that differ.
+ */
+static size_t compareConformanceCentroids(const Centroids* centroids, const Centroids* initial, const double* means, const size_t* counts, bool emptyKeepsCentroid)
+{
+    size_t dimensions = initial->points[0].dimensions;
+    size_t mismatches = 0;
 
-        if (i == 0)
+    for (size_t c = 0; c < initial->size; ++c)
+    {
+        const double* attributes = centroids->points[c].attributes;
+        bool differs = false;
+        for (size_t dim = 0; dim < dimensions; ++dim)
         {
-            char centroidsFile[256];
-            char partitionsFile[256];
-            snprintf(centroidsFile, sizeof(centroidsFile), "outputs/%s_centroids.txt", splitTypeName);
-            snprintf(partitionsFile, sizeof(partitionsFile), "outputs/%s_partitions.txt", splitTypeName);
-            writeCentroidsToFile(centroidsFile, &centroids);
-            writeDataPointPartitionsToFile(partitionsFile, dataPoints);
+            if (counts[c] > 0)
+            {
+                double mean = means[c * dimensions + dim];
+                differs = differs || fabs(attributes[dim] - mean) > CONFORMANCE_TOLERANCE * (fabs(mean) + 1.0);
+            }
+            else if (emptyKeepsCentroid)
+            {
+                double kept = initial->points[c].attributes[dim];
+                differs = differs || (activeMetric.type == 1 ? fabs(attributes[dim] - kept) > CONFORMANCE_TOLERANCE * (fabs(kept) + 1.0) : attributes[dim] != kept);
+            }
         }
+        if (differs) mismatches++;
+    }
 
-        freeCentroids(&centroids);
+    return mismatches;
+}
+
+/**
+ * @brief Makes a copy of centroids with their own attributes.
+ *
+ * @param source A pointer to the Centroids structure to copy.
+ * @return The copy, freed with freeCentroids.
+ */
+static Centroids copyConformanceCentroids(const Centroids* source)
+{
+    size_t dimensions = source->points[0].dimensions;
+    Centroids copy = allocateCentroids(source->size, dimensions);
+    for (size_t c = 0; c < source->size; ++c)
+    {
+        memcpy(copy.points[c].attributes, source->points[c].attributes, dimensions * sizeof(double));
     }
+    return copy;
+}
 
-    printStatistics(splitTypeName, stats, loopCount, numCentroids, scaling);
+/**
+ * @brief Prints the result of one engine in the conformance check.
+ *
+ * @param engine The name of the engine.
+ * @param labelMismatches Labels that differ beyond a tie, SIZE_MAX if the labels were not compared.
+ * @param ties Labels that differ within a tie.
+ * @param centroidMismatches Centroids that differ, SIZE_MAX if the centroids were not compared.
+ * @param sse The SSE of the engine, or a negative value if it was not compared.
+ * @param referenceSseValue The SSE of the reference.
+ * @return True if the engine matched the reference.
+ */
+static bool reportConformance(const char* engine, size_t labelMismatches, size_t ties, size_t centroidMismatches, double sse, double referenceSseValue)
+{
+    bool sseDiffers = sse >= 0.0 && fabs(sse - referenceSseValue) > CONFORMANCE_TOLERANCE * (referenceSseValue + 1.0);
+    bool passed = (labelMismatches == 0 || labelMismatches == SIZE_MAX) && (centroidMismatches == 0 || centroidMismatches == SIZE_MAX) && !sseDiffers;
 
-    writeResultsToFile(fileName, stats, numCentroids, splitTypeName, loopCount, scaling, outputDirectory);
+    printf("    %-34s", engine);
+    if (labelMismatches != SIZE_MAX)
+    {
+        if (labelMismatches == 0) printf(" labels ok");
+        else printf(" labels DIFFER (%zu)", labelMismatches);
+        if (ties > 0) printf(" (%zu ties resolved differently)", ties);
+    }
+    if (centroidMismatches != SIZE_MAX)
+    {
+        if (centroidMismatches == 0) printf(" centroids ok");
+        else printf(" centroids DIFFER (%zu)", centroidMismatches);
+    }
+    if (sse >= 0.0)
+    {
+        if (!sseDiffers) printf(" SSE ok");
+        else printf(" SSE DIFFERS (%.17g vs %.17g)", sse, referenceSseValue);
+    }
+    printf("\n");
+
+    return passed;
 }
 
 /**
- * @brief Runs the Bisecting k-means algorithm on the given data points and centroids.
+ * @brief Runs every assignment, centroid and SSE engine on one data set and compares them with the reference.
  *
- * This function iterates through partition and centroid steps, selects a cluster to split based on the SSE,
- * and updates the centroids and partitions based on the results of the local k-means.
- * It returns the best mean squared error (MSE) obtained during the iterations.
+ * The engines are partitionStep with the assignment configurations (direct and blocked engines, thread counts, block sizes)
+ * for the Euclidean metric and with one and all threads for the other metrics, partitionStepWithSecondNearest,
+ * centroidStep with one and all threads, calculateSSE and one iteration of the batched k-means, all with the active metric.
+ * All of them start from the given centroids. The thread count of the caller is restored.
  *
+ * @param name The name of the data set.
  * @param dataPoints A pointer to the DataPoints structure containing the data points.
- * @param groundTruth A pointer to the Centroids structure containing the ground truth centroids.
- * @param numCentroids The number of centroids to generate.
- * @param maxIterations The maximum number of iterations for the k-means algorithm.
- * @param loopCount The number of loops to run the k-means algorithm.
- * @param scaling A scaling factor for the MSE values.
- * @param fileName The name of the file to write the results to.
- * @param outputDirectory The directory where the results file is located.
+ * @param initial A pointer to the Centroids structure containing the centroids.
+ * @return True if every engine matched the reference.
  */
-void runBisectingKMeansAlgorithm(DataPoints* dataPoints, const Centroids* groundTruth, size_t numCentroids, size_t maxIterations, size_t loopCount, size_t scaling, const char* fileName, const char* outputDirectory)
+static bool runConformanceCase(const char* name, DataPoints* dataPoints, const Centroids* initial)
 {
-    Statistics stats;
-    initializeStatistics(&stats);
-
-    clock_t start, end;
-    double duration;
+    size_t numPoints = dataPoints->size;
+    size_t numCentroids = initial->size;
+    size_t dimensions = dataPoints->points[0].dimensions;
+    int previousThreads = getMaxThreads();
+    bool passed = true;
+
+    size_t* referenceLabels = trackedMalloc(numPoints * sizeof(size_t));
+    size_t* labels = trackedMalloc(numPoints * sizeof(size_t));
+    double* means = trackedMalloc(numCentroids * dimensions * sizeof(double));
+    size_t* counts = trackedMalloc(numCentroids * sizeof(size_t));
+    handleMemoryError(referenceLabels);
+    handleMemoryError(labels);
+    handleMemoryError(means);
+    handleMemoryError(counts);
 
-    printf("Bisecting k-means\n");
+    referencePartitionStep(dataPoints, initial, referenceLabels);
+    referenceCentroidStep(dataPoints, referenceLabels, numCentroids, means, counts);
+    double referenceSseValue = referenceSse(dataPoints, initial, referenceLabels);
 
-    for (size_t i = 0; i < loopCount; ++i)
+    size_t emptyClusters = 0;
+    for (size_t c = 0; c < numCentroids; ++c)
+    {
+        if (counts[c] == 0) emptyClusters++;
+    }
+    printf("  %s: %zu data points, %zu dimensions, %zu clusters (%zu empty)\n", name, numPoints, dimensions, numCentroids, emptyClusters);
+
+    // Assignment engines, only the Euclidean metric has configurations, the others run with one and all threads
+    AssignmentConfig previousAssignment = activeAssignment;
+    AssignmentConfig configs[] = { { 0, 0, 0 }, { 0, 1, 0 }, { 0, previousThreads, 256 }, { 1, 1, 0 }, { 1, previousThreads, 1024 }, { 1, 0, 64 } };
+    AssignmentConfig metricConfigs[] = { { 0, 1, 0 }, { 0, previousThreads, 0 } };
+    bool euclidean = activeMetric.type == 0;
+    size_t numConfigs = euclidean ? sizeof(configs) / sizeof(configs[0]) : sizeof(metricConfigs) / sizeof(metricConfigs[0]);
+    for (size_t k = 0; k < numConfigs; ++k)
     {
+        AssignmentConfig config = euclidean ? configs[k] : metricConfigs[k];
+        activeAssignment = config;
+        setThreadCount(config.threads > 0 ? config.threads : previousThreads);
         resetPartitions(dataPoints);
+        partitionStep(dataPoints, initial);
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            labels[i] = dataPoints->points[i].partition;
+        }
 
-        Centroids centroids = allocateCentroids(1, dataPoints->points[0].dimensions);
-
-        start = clock();
-
-        generateRandomCentroids(centroids.size, dataPoints, &centroids);
+        size_t ties;
+        size_t mismatches = compareConformanceLabels(dataPoints, initial, referenceLabels, labels, &ties);
+        char engine[96];
+        char block[32] = "default block";
+        if (config.chunkSize > 0) snprintf(block, sizeof(block), "block %zu", config.chunkSize);
+        if (euclidean) snprintf(engine, sizeof(engine), "%s, %d threads, %s", getAssignmentEngineName(config.engine), config.threads > 0 ? config.threads : previousThreads, block);
+        else snprintf(engine, sizeof(engine), "%s, %d threads", getDistanceMetricName(activeMetric.type), config.threads);
+        passed = reportConformance(engine, mismatches, ties, SIZE_MAX, -1.0, referenceSseValue) && passed;
+    }
+    activeAssignment = previousAssignment;
+    setThreadCount(previousThreads);
+
+    NearestCentroidCache cache = allocateNearestCentroidCache(numPoints);
+    partitionStepWithSecondNearest(dataPoints, initial, &cache);
+    size_t cacheTies;
+    size_t cacheMismatches = compareConformanceLabels(dataPoints, initial, referenceLabels, cache.nearest, &cacheTies);
+    passed = reportConformance("second-nearest cache", cacheMismatches, cacheTies, SIZE_MAX, -1.0, referenceSseValue) && passed;
+    freeNearestCentroidCache(&cache);
+
+    // Centroid step and SSE from the reference labels, empty clusters are left to activeEmptyClusterStrategy
+    int threadCounts[2] = { 1, previousThreads };
+    for (size_t t = 0; t < 2; ++t)
+    {
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            dataPoints->points[i].partition = referenceLabels[i];
+        }
 
-        //if (LOGGING >= 3) printDataPointsPartitions(dataPoints, centroids.size);
+        setThreadCount(threadCounts[t]);
+        Centroids centroids = copyConformanceCentroids(initial);
+        double sse = calculateSSE(dataPoints, initial);
+        centroidStep(&centroids, dataPoints);
 
-        double resultMse = runBisectingKMeans(dataPoints, &centroids, numCentroids, maxIterations, groundTruth);
+        char engine[64];
+        snprintf(engine, sizeof(engine), "centroidStep, %d threads", threadCounts[t]);
+        size_t mismatches = centroids.size == numCentroids ? compareConformanceCentroids(&centroids, initial, means, counts, activeEmptyClusterStrategy == 0) : SIZE_MAX;
+        passed = reportConformance(engine, SIZE_MAX, 0, mismatches, sse, referenceSseValue) && passed;
 
-        end = clock();
-        duration = ((double)(end - start)) / CLOCKS_PER_SEC;
-        //if (LOGGING >= 3) printf("(Bisecting)Time taken: %.2f seconds\n\n", duration);
-        printf("Sizeeeee %zu\n", centroids.size);
-        size_t centroidIndex = calculateCentroidIndex(&centroids, groundTruth);
+        freeCentroids(&centroids);
+    }
+    setThreadCount(previousThreads);
+
+    // One iteration of the batched k-means with the centroids of empty clusters kept, so the labels stay comparable.
+    // Its SSE is summed in the assignment pass and belongs to the initial centroids, except with the Manhattan metric,
+    // where the model runs with runKMeans and its SSE belongs to the updated centroids (the reference medians)
+    size_t previousStrategy = activeEmptyClusterStrategy;
+    activeEmptyClusterStrategy = 0;
+    BatchedModel model = allocateBatchedModel(numCentroids, dimensions, numPoints);
+    Centroids updated = copyConformanceCentroids(initial);
+    for (size_t c = 0; c < numCentroids; ++c)
+    {
+        memcpy(model.centroids.points[c].attributes, initial->points[c].attributes, dimensions * sizeof(double));
+        if (counts[c] > 0) memcpy(updated.points[c].attributes, &means[c * dimensions], dimensions * sizeof(double));
+    }
+    runBatchedKMeans(dataPoints, &model, 1, 1);
+    activeEmptyClusterStrategy = previousStrategy;
+    size_t batchedTies;
+    size_t batchedMismatches = compareConformanceLabels(dataPoints, initial, referenceLabels, model.partitions, &batchedTies);
+    size_t batchedCentroidMismatches = compareConformanceCentroids(&model.centroids, initial, means, counts, true);
+    double batchedSse = activeMetric.type == 2 ? referenceSse(dataPoints, &updated, referenceLabels) : referenceSseValue;
+    passed = reportConformance("batched k-means", batchedMismatches, batchedTies, batchedCentroidMismatches, model.bestSse, batchedSse) && passed;
+    freeCentroids(&updated);
+    freeBatchedModel(&model);
+
+    trackedFree(referenceLabels);
+    trackedFree(labels);
+    trackedFree(means);
+    trackedFree(counts);
+
+    return passed;
+}
 
-        stats.mseSum += resultMse;
-        stats.ciSum += centroidIndex;
-        stats.timeSum += duration;
-        if (centroidIndex == 0) stats.successRate++;
-        printf("CI %zu\n", centroidIndex);
-        //if (LOGGING >= 3) printf("Round %zu\n", i + 1);
+/**
+ * @brief Prepares a synthetic data set of the conformance check for the active metric.
+ *
+ * The cosine metric needs unit-length data points and centroids, and the diagonal Mahalanobis metric
+ * takes its weights from the data set.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param centroids A pointer to the Centroids structure containing the centroids.
+ */
+static void prepareConformanceData(DataPoints* dataPoints, Centroids* centroids)
+{
+    if (activeMetric.type == 1)
+    {
+        DataPoints centroidPoints;
+        centroidPoints.points = centroids->points;
+        centroidPoints.size = centroids->size;
+        centroidPoints.matrix = NULL;
+        centroidPoints.mappedView = NULL;
+        centroidPoints.mappedSize = 0;
+
+        normalizeDataPoints(dataPoints);
+        normalizeDataPoints(&centroidPoints);
+    }
+    else if (activeMetric.type == 3)
+    {
+        setDistanceMetric(3, dataPoints);
+    }
+}
 
-        if (i == 0)
+/**
+ * @brief Checks the optimized assignment, centroid and SSE engines against plain reference implementations.
+ *
+ * The engines are run on the loaded data with seeded random centroids and on synthetic adversarial data:
+ * a grid with exact distance ties, duplicated weighted data points with duplicated centroids and a far centroid
+ * (empty clusters), and random data with an odd number of dimensions and more centroids than fit in one tile
+ * of the blocked engine. The labels, centroids and SSE of every engine are compared with the reference, see
+ * CONFORMANCE_TOLERANCE for the allowed differences. The check uses the active metric: the synthetic data is
+ * normalized for the cosine metric, and the diagonal Mahalanobis metric takes its weights from each data set
+ * (the weights of the loaded data are restored at the end). The loaded data must already be normalized for
+ * the cosine metric.
+ *
+ * @param dataPoints A pointer to the DataPoints structure containing the data points.
+ * @param numCentroids The number of centroids.
+ * @return true if every engine matched the reference, false otherwise.
+ */
+bool runConformanceCheck(DataPoints* dataPoints, size_t numCentroids)
+{
+    bool passed = true;
+    printf("Conformance check, %s metric (tolerance %g)\n", getDistanceMetricName(activeMetric.type), CONFORMANCE_TOLERANCE);
+
+    // The loaded data with seeded random centroids
+    srand(RANDOM_SEED);
+    Centroids centroids = allocateCentroids(numCentroids, dataPoints->points[0].dimensions);
+    generateRandomCentroids(numCentroids, dataPoints, &centroids);
+    passed = runConformanceCase("loaded data", dataPoints, &centroids) && passed;
+    freeCentroids(&centroids);
+
+    // Ties: integer grid, the centroids are 10 apart, so the data points halfway between them are exactly as near to both
+    DataPoints grid = allocateDataPoints(31 * 31, 2);
+    for (size_t i = 0; i < grid.size; ++i)
+    {
+        grid.points[i].attributes[0] = (double)(i % 31);
+        grid.points[i].attributes[1] = (double)(i / 31);
+    }
+    Centroids gridCentroids = allocateCentroids(9, 2);
+    for (size_t c = 0; c < 9; ++c)
+    {
+        gridCentroids.points[c].attributes[0] = 5.0 + 10.0 * (double)(c % 3);
+        gridCentroids.points[c].attributes[1] = 5.0 + 10.0 * (double)(c / 3);
+    }
+    prepareConformanceData(&grid, &gridCentroids);
+    passed = runConformanceCase("ties", &grid, &gridCentroids) && passed;
+    freeCentroids(&gridCentroids);
+    freeDataPoints(&grid);
+
+    // Duplicates: five distinct weighted data points repeated, two duplicated centroids and a far one stay empty
+    const double distinct[5][3] = { { 0.0, 0.0, 0.0 }, { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 1.0, 1.0, 1.0 }, { -3.5, 2.25, 0.125 } };
+    DataPoints duplicates = allocateDataPoints(2000, 3);
+    for (size_t i = 0; i < duplicates.size; ++i)
+    {
+        memcpy(duplicates.points[i].attributes, distinct[i % 5], 3 * sizeof(double));
+        duplicates.points[i].weight = (double)(1 + i % 3);
+    }
+    Centroids duplicateCentroids = allocateCentroids(8, 3);
+    const size_t sources[7] = { 0, 1, 2, 3, 4, 0, 1 };
+    for (size_t c = 0; c < 7; ++c)
+    {
+        memcpy(duplicateCentroids.points[c].attributes, distinct[sources[c]], 3 * sizeof(double));
+    }
+    for (size_t dim = 0; dim < 3; ++dim)
+    {
+        duplicateCentroids.points[7].attributes[dim] = 1e6;
+    }
+    prepareConformanceData(&duplicates, &duplicateCentroids);
+    passed = runConformanceCase("duplicates and empty clusters", &duplicates, &duplicateCentroids) && passed;
+    freeCentroids(&duplicateCentroids);
+    freeDataPoints(&duplicates);
+
+    // Odd dimensions (the scalar tail of the SSE2 kernels) and more centroids than fit in one tile of the blocked engine
+    srand(RANDOM_SEED);
+    size_t oddDimensions = 7;
+    size_t manyCentroids = 2 * ASSIGNMENT_TILE_BYTES / (oddDimensions * sizeof(double)) + 3;
+    DataPoints random = allocateDataPoints(4000, oddDimensions);
+    for (size_t i = 0; i < random.size; ++i)
+    {
+        for (size_t dim = 0; dim < oddDimensions; ++dim)
         {
-            writeCentroidsToFile("outputs/bisectingKMeans_centroids.txt", &centroids);
-            writeDataPointPartitionsToFile("outputs/bisectingKMeans_partitions.txt", dataPoints);
+            random.points[i].attributes[dim] = (double)rand() / RAND_MAX * 100.0 - 50.0;
         }
-
-        freeCentroids(&centroids);
     }
+    Centroids randomCentroids = allocateCentroids(manyCentroids, oddDimensions);
+    generateRandomCentroids(manyCentroids, &random, &randomCentroids);
+    prepareConformanceData(&random, &randomCentroids);
+    passed = runConformanceCase("odd dimensions, many clusters", &random, &randomCentroids) && passed;
+    freeCentroids(&randomCentroids);
+    freeDataPoints(&random);
 
-    printStatistics("Bisecting", stats, loopCount, numCentroids, scaling);
+    if (activeMetric.type == 3) setDistanceMetric(3, dataPoints);
+    resetPartitions(dataPoints);
 
-    writeResultsToFile(fileName, stats, numCentroids, "Bisecting k-means", loopCount, scaling, outputDirectory);
+    printf("Conformance check %s\n\n", passed ? "passed" : "FAILED");
+
+    return passed;
 }
 
 
+// The Python module (python/clustering_module.c) includes this file as a library without main
+#ifndef CLUSTERING_NO_MAIN
+
 ///////////
 // Main //
 /////////
@@ -2629,13 +12137,19 @@ int main()
     // List of dataset file names, ground truth file names, and number of clusters
     const char** datasetList = createStringList(datasetCount);
     const char** gtList = createStringList(datasetCount);
-    size_t* kNumList = malloc(datasetCount * sizeof(size_t));
+    size_t* kNumList = trackedMalloc(datasetCount * sizeof(size_t));
     handleMemoryError(kNumList);	
     initializeLists(datasetList, gtList, kNumList, datasetCount);
 
     char outputDirectory[256]; // Buffer size = 256, increase if needed 
     createUniqueDirectory(outputDirectory, sizeof(outputDirectory));
 
+    // SIGINT stops at the next trial boundary, SIGUSR1 (Ctrl+Break on Windows) dumps the best centroids and the statistics so far
+    installSignalHandlers(outputDirectory);
+
+    // Autotuning lowers the thread count of a dataset, the next one starts from all threads again
+    int maxThreads = getMaxThreads();
+
     //TODO: muista laittaa loopin rajat oikein
     for (size_t i = 7; i < 8; ++i)
     {
@@ -2643,10 +12157,47 @@ int main()
 		size_t maxIterations = 1000; // Maximum number of iterations for the k-means algorithm //TODO lopulliseen 1000(?)
 		size_t maxRepeats = 10; // Maximum number of repeats for the repeated k-means algorithm //TODO lopulliseen 100(?)
 		size_t maxSwaps = 1000; // Maximum number of swaps for the random swap algorithm //TODO lopulliseen 1000(?)
+		size_t swapCandidates = 0; // Candidate swaps screened with the delta-SSE evaluator per k-means run (0 = plain random swap)
+		bool runRepeatedKMeans = false; // Run repeated k-means, too slow to keep enabled
+		bool runRandomSwap = false; // Run random swap
+		bool runAdaptiveRandomSwap = false; // Run adaptive random swap, maxSwaps is its upper limit
+		bool runRandomSplit = false; // Run random split
+		bool runMseSplit = false; // Run the three MSE split types one after another
+		bool runMseSplitVariants = false; // Run the three MSE split types from a shared first split
 		size_t loopCount = 100; // Number of loops to run the algorithms
 		size_t scaling = 10000; // Scaling factor for the MSE values
+		bool checkDeterminism = false; // Run the determinism self-check (different thread counts) before the algorithms
+		bool checkConformance = false; // Compare the optimized assignment, centroid and SSE engines with the reference implementations before the algorithms
+		size_t distanceMetric = 0; // 0 = Euclidean, 1 = cosine (data is normalized), 2 = Manhattan, 3 = diagonal Mahalanobis
+		size_t emptyClusterStrategy = 1; // 0 = keep the centroid, 1 = reseed at the farthest point, 2 = split the largest cluster, 3 = drop the cluster (K-means only)
+		bool compareDropStrategy = false; // Also run K-means with empty clusters dropped, written as "K-means (drop empty clusters)"
+		size_t refinementIterations = 2; // Flat refinement iterations of hierarchical k-means, restricted to neighbouring groups (0 = none)
+		bool runHierarchicalKMeans = false; // Run hierarchical k-means
+		bool runApproximateKMeans = false; // Run approximate k-means (graph search assignment)
+		size_t gridAlgorithm = 0; // Algorithm run on the grid cells: 0 = k-means, 1 = random swap, 2 = random split, 3 = MSE split, 4 = bisecting k-means
+		double gridCellWidth = 1.0; // Finest grid cell width (1.0 merges duplicates of integer data)
+		size_t gridMaxCells = 10000; // Largest number of occupied grid cells, the grid is coarsened until it fits
+		size_t gridRefinementIterations = 2; // K-means iterations on the data points after clustering the grid cells (0 = none)
+		bool runGridAggregated = false; // Run the grid algorithm on grid-aggregated data
+		double levelFractions[] = { 0.01, 0.1, 1.0 }; // Sample fractions of the multilevel levels, 1.0 = the whole data
+		size_t levelIterations[] = { 1000, 50, 10 }; // Maximum k-means iterations on each multilevel level
+		size_t numLevels = sizeof(levelFractions) / sizeof(levelFractions[0]);
+		size_t multilevelAlgorithm = 0; // Algorithm on the first multilevel level: 0 = k-means, 1 = random swap
+		bool runMultilevel = false; // Run the multilevel pipeline
+		bool runBatchedKMeans = false; // Run batched k-means with k - 1, k and k + 1 clusters
+		size_t anytimeAlgorithm = 2; // Algorithm of the anytime run: 0 = k-means, 1 = repeated k-means, 2 = random swap, 3 = random split, 4 = MSE split, 5 = bisecting k-means
+		size_t anytimeBudgetMs = 200; // Wall-clock budget of each anytime trial in milliseconds
+		bool runAnytime = false; // Run the anytime algorithm with the budget above
+		double progressInterval = 0.0; // Seconds between rewrites of status.txt in the output directory (0 = no status file)
+		bool tracePhases = false; // Record the phases of every thread to <dataset>.trace.json in the output directory (open in ui.perfetto.dev)
+		size_t memoryCapMiB = 0; // Cap on the memory of the data and the algorithms in MiB, the reductions and the swap candidates fall back to smaller modes near it, other allocations over it end the run with an error (0 = no cap)
+		bool autotune = false; // Time the assignment engines, thread counts and block sizes on a sample, re-check the fastest on all data points and use the best (kept in autotune_profile.txt in the output directory)
+		size_t benchmarkSamples = 10; // Samples of each algorithm in the benchmark, compare the results with python/regression_gate.py
+		bool runBenchmarks = false; // Run the benchmark of every algorithm and write <dataset>.benchmark.json to the output directory
 
         size_t numCentroids = kNumList[i];
+        size_t batchedKValues[] = { numCentroids > 1 ? numCentroids - 1 : 1, numCentroids, numCentroids + 1 }; // Numbers of clusters of the batched k-means sweep
+        size_t numBatchedModels = sizeof(batchedKValues) / sizeof(batchedKValues[0]);
         char* fileName = datasetList[i];
         char dataFile[256]; // Buffer size = 256, increase if needed
         snprintf(dataFile, sizeof(dataFile), "data/%s", fileName);
@@ -2655,59 +12206,159 @@ int main()
         snprintf(gtFile, sizeof(gtFile), "gt/%s", gtName);        
 
         // Seeding the random number generator
-        srand((unsigned int)time(NULL));
+        srand(DETERMINISTIC ? RANDOM_SEED : (unsigned int)time(NULL));
 
         printf("Starting the process\n");
         printf("File name: %s\n", dataFile);
 
-        size_t numDimensions = getNumDimensions(dataFile);
+        if (tracePhases) startTracing();
+        setMemoryCap(memoryCapMiB * 1024 * 1024);
+
+        // Raw .f64/.f32 files have no header, their dimensions are those of the ground truth centroids
+        size_t rawDimensions = hasFileExtension(dataFile, ".f64") || hasFileExtension(dataFile, ".f32") ? getNumDimensions(gtFile) : 0;
+
+        // The dimensions come from the loaded data, as binary and compressed files have no text lines to count
+        DataPoints dataPoints = loadDataPoints(dataFile, rawDimensions);
+        size_t numDimensions = dataPoints.size > 0 ? dataPoints.points[0].dimensions : 0;
 
         if (numDimensions > 0)
         {
             printf("Number of dimensions in the data: %zu\n", numDimensions);
-
-            DataPoints dataPoints = readDataPoints(dataFile);
             printf("Dataset size: %zu\n", dataPoints.size);
 
             printf("Number of clusters in the data: %zu\n", numCentroids);
 
+            // The k-means iterations on this data serve the dump requests
+            activeSignals.dataPoints = &dataPoints;
+
+            if (distanceMetric == 1)
+            {
+                normalizeDataPoints(&dataPoints);
+            }
+            setDistanceMetric(distanceMetric, &dataPoints);
+            printf("Distance metric: %s\n", getDistanceMetricName(distanceMetric));
+            setEmptyClusterStrategy(emptyClusterStrategy);
+
+            // The tuned configuration of the previous dataset does not carry over
+            AssignmentConfig defaultAssignment = { 0, 0, 0 };
+            activeAssignment = defaultAssignment;
+            setThreadCount(maxThreads);
+            if (autotune)
+            {
+                autotuneAssignment(&dataPoints, numCentroids, outputDirectory);
+            }
+
             Centroids groundTruth = readCentroids(gtFile);
 
             printf("Number of loops: %zu\n\n", loopCount);
 
+            if (checkDeterminism)
+            {
+                runDeterminismCheck(&dataPoints, numCentroids, maxIterations);
+            }
+
+            if (checkConformance)
+            {
+                runConformanceCheck(&dataPoints, numCentroids);
+            }
+
+            // Live progress of the runs below (iteration, SSE, CI, clusters, throughput)
+            char statusFile[300];
+            snprintf(statusFile, sizeof(statusFile), "%s/status.txt", outputDirectory);
+            if (progressInterval > 0.0)
+            {
+                startProgressReporting(&dataPoints, writeProgressStatusFile, statusFile, progressInterval);
+            }
+
             // Run K-means
             runKMeansAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory);
 
+            // Run K-means with the empty clusters dropped instead of repaired (a trial may end with fewer clusters)
+            if (compareDropStrategy && emptyClusterStrategy != 3)
+            {
+                setEmptyClusterStrategy(3);
+                runKMeansAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory);
+                setEmptyClusterStrategy(emptyClusterStrategy);
+            }
+
             // Run Repeated K-means
-			// Too slow to keep it enabled
-            //runRepeatedKMeansAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, maxRepeats, loopCount, scaling, fileName, outputDirectory);
+            if (runRepeatedKMeans) runRepeatedKMeansAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, maxRepeats, loopCount, scaling, fileName, outputDirectory);
 
             // Run Random Swap
-            //runRandomSwapAlgorithm(&dataPoints, &groundTruth, numCentroids, maxSwaps, loopCount, scaling, fileName, outputDirectory);
+            if (runRandomSwap) runRandomSwapAlgorithm(&dataPoints, &groundTruth, numCentroids, maxSwaps, swapCandidates, loopCount, scaling, fileName, outputDirectory);
+
+            // Run Adaptive Random Swap (stops when further swaps are unlikely to help, maxSwaps is only an upper limit)
+            if (runAdaptiveRandomSwap) runAdaptiveRandomSwapAlgorithm(&dataPoints, &groundTruth, numCentroids, maxSwaps, loopCount, scaling, fileName, outputDirectory);
             
             // Run Random Split
-            //runRandomSplitAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory);
+            if (runRandomSplit) runRandomSplitAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory);
 
             // Run MSE Split (Intra-cluster)
-            //runMseSplitAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory, 0);
+            if (runMseSplit) runMseSplitAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory, 0);
                         
             // Run MSE Split (Global)
-            //runMseSplitAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory, 1);
+            if (runMseSplit) runMseSplitAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory, 1);
                         
             // Run MSE Split (Local Repartition)
-            //runMseSplitAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory, 2);
+            if (runMseSplit) runMseSplitAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory, 2);
                         
+            // Run all three MSE Split types from a shared first split (in deterministic mode the same results as the three runs above)
+            if (runMseSplitVariants) runMseSplitVariantsAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory);
+
             // Run Bisecting K-means
             runBisectingKMeansAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory);
 
+            // Run Hierarchical K-means
+            // Meant for a very large number of clusters
+            if (runHierarchicalKMeans) runHierarchicalKMeansAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, refinementIterations, loopCount, scaling, fileName, outputDirectory);
+
+            // Run Approximate K-means (graph search assignment)
+            // Meant for a very large number of clusters
+            if (runApproximateKMeans) runApproximateKMeansAlgorithm(&dataPoints, &groundTruth, numCentroids, maxIterations, loopCount, scaling, fileName, outputDirectory);
+
+            // Run an algorithm on grid-aggregated data
+            // Meant for large low-dimensional data with integer coordinates
+            if (runGridAggregated) runGridAggregatedAlgorithm(&dataPoints, &groundTruth, numCentroids, gridAlgorithm, maxIterations, maxSwaps, swapCandidates, gridRefinementIterations, gridCellWidth, gridMaxCells, loopCount, scaling, fileName, outputDirectory);
+
+            // Run the multilevel pipeline (clusters growing samples, warm-started)
+            if (runMultilevel) runMultilevelAlgorithm(&dataPoints, &groundTruth, numCentroids, levelFractions, levelIterations, numLevels, multilevelAlgorithm, maxSwaps, swapCandidates, loopCount, scaling, fileName, outputDirectory);
+
+            // Run Batched K-means (several numbers of clusters over shared data passes)
+            if (runBatchedKMeans) runBatchedKMeansAlgorithm(&dataPoints, &groundTruth, batchedKValues, numBatchedModels, maxIterations, loopCount, scaling, fileName, outputDirectory);
+
+            // Run an algorithm with a wall-clock budget ("the best clustering in 200 ms"), no repeat or swap limit
+            if (runAnytime) runAnytimeAlgorithm(&dataPoints, &groundTruth, numCentroids, anytimeAlgorithm, anytimeBudgetMs, maxIterations, SIZE_MAX, SIZE_MAX, swapCandidates, loopCount, scaling, fileName, outputDirectory);
+
+            // Run the benchmark, fixed seeds for every sample, writes <dataset>.benchmark.json for python/regression_gate.py
+            if (runBenchmarks)
+            {
+                char benchmarkFile[300];
+                snprintf(benchmarkFile, sizeof(benchmarkFile), "%s/%s.benchmark.json", outputDirectory, fileName);
+                runBenchmark(&dataPoints, &groundTruth, numCentroids, maxIterations, maxRepeats, maxSwaps, swapCandidates, benchmarkSamples, fileName, benchmarkFile);
+            }
+
+            stopProgressReporting();
+
             // Clean up
-            freeDataPoints(&dataPoints);
+            activeSignals.dataPoints = NULL;
+            setDistanceMetric(0, &dataPoints);
             freeCentroids(&groundTruth);
         }
+
+        freeReductionWorkspace();
+        freeDataPoints(&dataPoints);
+
+        if (tracePhases)
+        {
+            char traceFile[300];
+            snprintf(traceFile, sizeof(traceFile), "%s/%s.trace.json", outputDirectory, fileName);
+            writeChromeTrace(traceFile);
+        }
     }
 
     freeStringList(datasetList, datasetCount);
     freeStringList(gtList, datasetCount);
 
     return 0;
-}
\ No newline at end of file
+}
+#endif // CLUSTERING_NO_MAIN
@@ -0,0 +1,553 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+// The clustering program is compiled into the module as a library
+#define CLUSTERING_NO_MAIN
+#include "../Clustering_with_.c"
+
+/**
+ * Python extension module "clustering".
+ *
+ * Exposes K-means, Random Swap, MSE Split, Bisecting k-means and hierarchical k-means to Python.
+ * The point matrix is a NumPy array of shape (N, d). A C-contiguous float64 array is used
+ * in place without copying (other arrays are converted once), and the GIL is released while clustering.
+ * Every function returns a tuple (labels, centroids, sse):
+ * - labels: int array of shape (N,), the cluster of each data point
+ * - centroids: float64 array of shape (K, d)
+ * - sse: the error of the final partition, as calculateSSE reports it
+ *
+ * The library keeps global state (the rand() generator and the distance metric),
+ * so the clustering calls are serialized with a module lock.
+ *
+ * The errors the library reports with raiseFatalError raise MemoryError (failed allocations) or RuntimeError
+ * instead of ending the process. Each call runs in an allocation scope of the library, so the allocations of an
+ * interrupted call are freed and do not count against the memory cap of the next calls. An allocation that fails
+ * inside a parallel loop still ends the process. set_memory_cap(mib) caps the memory of the library.
+ *
+ * conformance_check(data, k, metric=0) runs the conformance check of the library with the given metric and returns
+ * whether every engine matched the reference implementations. set_thread_count(n) sets the number of threads
+ * of the parallel loops (0 = one per processor); a seeded call gives the same result with any number of threads.
+ *
+ * The clustering functions also take progress=None and progress_interval=1.0. A callable progress is called
+ * every progress_interval seconds from the library's sampler thread (holding the GIL) with a dict of
+ * iteration, sse (-1.0 before the first full-data iteration), clusters, elapsed, points_per_second and finished.
+ * Exceptions raised by the callable are reported as unraisable and do not stop the clustering.
+ */
+
+ /////////////
+// Module //
+///////////
+
+// Serializes the clustering calls, acquired only while the GIL is released
+static PyThread_type_lock clusteringLock = NULL;
+
+/**
+ * @brief Sets the Python exception of a fatal error reported by the library.
+ *
+ * Called on the thread that caught the error, as the message is thread-local.
+ */
+static void setFatalErrorException(void)
+{
+    PyErr_SetString(fatalErrorOutOfMemory ? PyExc_MemoryError : PyExc_RuntimeError, fatalErrorMessage);
+}
+
+/**
+ * @brief Wraps a NumPy array as a DataPoints structure.
+ *
+ * This function converts the object to a C-contiguous float64 array, which is a no-op
+ * for such arrays, and wraps its rows with wrapDataPointMatrix.
+ *
+ * @param dataObject The Python object holding the (N, d) point matrix.
+ * @param numCentroids The requested number of clusters, checked against N.
+ * @param array Receives a new reference to the array, which must outlive the DataPoints structure.
+ * @param dataPoints Receives the DataPoints structure, freed with freeDataPointViews.
+ * @return 0 on success, -1 with a Python exception set on failure.
+ */
+static int wrapArray(PyObject* dataObject, Py_ssize_t numCentroids, PyArrayObject** array, DataPoints* dataPoints)
+{
+    *array = (PyArrayObject*)PyArray_FROM_OTF(dataObject, NPY_FLOAT64, NPY_ARRAY_IN_ARRAY);
+    if (*array == NULL) return -1;
+
+    if (PyArray_NDIM(*array) != 2 || PyArray_DIM(*array, 0) < 1 || PyArray_DIM(*array, 1) < 1)
+    {
+        PyErr_SetString(PyExc_ValueError, "data must be a non-empty 2-D array of shape (N, d)");
+        Py_DECREF(*array);
+        return -1;
+    }
+
+    if (numCentroids < 1 || numCentroids > PyArray_DIM(*array, 0))
+    {
+        PyErr_SetString(PyExc_ValueError, "k must be between 1 and the number of data points");
+        Py_DECREF(*array);
+        return -1;
+    }
+
+    jmp_buf errorHandler;
+    fatalErrorOutOfMemory = false;
+    fatalErrorHandler = &errorHandler;
+    if (setjmp(errorHandler) != 0)
+    {
+        fatalErrorHandler = NULL;
+        setFatalErrorException();
+        Py_DECREF(*array);
+        return -1;
+    }
+
+    *dataPoints = wrapDataPointMatrix((double*)PyArray_DATA(*array), (size_t)PyArray_DIM(*array, 0), (size_t)PyArray_DIM(*array, 1));
+    fatalErrorHandler = NULL;
+    return 0;
+}
+
+/**
+ * @brief Parses the seed argument.
+ *
+ * @param seedObject The seed given by the caller, or None for a time-based seed.
+ * @param seed Receives the seed.
+ * @return 0 on success, -1 with a Python exception set on failure.
+ */
+static int parseSeed(PyObject* seedObject, unsigned int* seed)
+{
+    if (seedObject == Py_None)
+    {
+        *seed = (unsigned int)time(NULL);
+        return 0;
+    }
+
+    unsigned long value = PyLong_AsUnsignedLong(seedObject);
+    if (value == (unsigned long)-1 && PyErr_Occurred()) return -1;
+
+    *seed = (unsigned int)value;
+    return 0;
+}
+
+/**
+ * @brief Passes a progress sample to the Python callable given as the progress argument.
+ *
+ * This function runs in the sampler thread, so it takes the GIL itself.
+ *
+ * @param sample A pointer to the ProgressSample structure.
+ * @param userData The Python callable (a borrowed reference kept alive by the call in progress).
+ */
+static void callProgressCallable(const ProgressSample* sample, void* userData)
+{
+    PyGILState_STATE state = PyGILState_Ensure();
+
+    PyObject* callable = (PyObject*)userData;
+    PyObject* info = Py_BuildValue("{s:n,s:d,s:n,s:d,s:d,s:O}",
+        "iteration", (Py_ssize_t)sample->iteration,
+        "sse", sample->sse,
+        "clusters", (Py_ssize_t)sample->clusters,
+        "elapsed", sample->elapsedSeconds,
+        "points_per_second", sample->pointsPerSecond,
+        "finished", sample->finished ? Py_True : Py_False);
+    PyObject* result = info != NULL ? PyObject_CallFunctionObjArgs(callable, info, NULL) : NULL;
+
+    // The exception cannot reach the caller from this thread
+    if (result == NULL) PyErr_WriteUnraisable(callable);
+
+    Py_XDECREF(result);
+    Py_XDECREF(info);
+
+    PyGILState_Release(state);
+}
+
+/**
+ * @brief Builds the (labels, centroids, sse) result tuple.
+ *
+ * @param dataPoints A pointer to the DataPoints structure holding the final partition.
+ * @param centroids A pointer to the Centroids structure holding the final centroids.
+ * @param sse The error of the final partition.
+ * @return A new reference to the tuple, or NULL with a Python exception set.
+ */
+static PyObject* buildResult(const DataPoints* dataPoints, const Centroids* centroids, double sse)
+{
+    size_t dimensions = dataPoints->points[0].dimensions;
+    npy_intp labelDims[1] = { (npy_intp)dataPoints->size };
+    npy_intp centroidDims[2] = { (npy_intp)centroids->size, (npy_intp)dimensions };
+
+    PyArrayObject* labels = (PyArrayObject*)PyArray_SimpleNew(1, labelDims, NPY_INTP);
+    PyArrayObject* centroidArray = (PyArrayObject*)PyArray_SimpleNew(2, centroidDims, NPY_FLOAT64);
+    if (labels == NULL || centroidArray == NULL)
+    {
+        Py_XDECREF(labels);
+        Py_XDECREF(centroidArray);
+        return NULL;
+    }
+
+    npy_intp* labelData = (npy_intp*)PyArray_DATA(labels);
+    for (size_t i = 0; i < dataPoints->size; ++i)
+    {
+        labelData[i] = (npy_intp)dataPoints->points[i].partition;
+    }
+
+    double* centroidData = (double*)PyArray_DATA(centroidArray);
+    for (size_t i = 0; i < centroids->size; ++i)
+    {
+        memcpy(&centroidData[i * dimensions], centroids->points[i].attributes, dimensions * sizeof(double));
+    }
+
+    return Py_BuildValue("(NNd)", labels, centroidArray, sse);
+}
+
+/**
+ * @brief Runs one clustering algorithm on a NumPy array and returns the result tuple.
+ *
+ * This function wraps the array and runs the algorithm with the GIL released. The generator is seeded
+ * while the module lock is held, so a seeded call is reproducible even when other threads are clustering.
+ * The labels are taken from a final partition step, so they always match the returned centroids.
+ * A fatal error of the library is caught with setjmp and raised as a Python exception, and the allocations
+ * of the call are freed with its allocation scope.
+ *
+ * @param algorithm The algorithm (0 = K-means, 1 = Random Swap, 2 = MSE Split, 3 = Bisecting, 4 = hierarchical k-means).
+ * @param dataObject The Python object holding the (N, d) point matrix.
+ * @param numCentroids The number of clusters.
+ * @param iterations The maximum number of k-means iterations, or the number of swaps for Random Swap.
+ * @param option The number of swap candidates for Random Swap, the split type for MSE Split,
+ *               or the number of refinement iterations for hierarchical k-means.
+ * @param seedObject The seed, or None.
+ * @param progressObject A callable that receives the progress samples, or None.
+ * @param progressInterval Seconds between the progress samples.
+ * @return A new reference to the result tuple, or NULL with a Python exception set.
+ */
+static PyObject* runAlgorithm(int algorithm, PyObject* dataObject, Py_ssize_t numCentroids, Py_ssize_t iterations, Py_ssize_t option, PyObject* seedObject, PyObject* progressObject, double progressInterval)
+{
+    if (iterations < 0 || option < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "iteration counts must not be negative");
+        return NULL;
+    }
+
+    if (progressObject != Py_None && (!PyCallable_Check(progressObject) || !(progressInterval > 0.0)))
+    {
+        PyErr_SetString(PyExc_ValueError, "progress must be None or a callable, and progress_interval must be positive");
+        return NULL;
+    }
+
+    unsigned int seed;
+    if (parseSeed(seedObject, &seed) < 0) return NULL;
+
+    PyArrayObject* array;
+    DataPoints dataPoints;
+    if (wrapArray(dataObject, numCentroids, &array, &dataPoints) < 0) return NULL;
+
+    size_t dimensions = dataPoints.points[0].dimensions;
+    Centroids centroids;
+    double sse;
+    jmp_buf errorHandler;
+    bool failed = false;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(clusteringLock, WAIT_LOCK);
+
+    srand(seed);
+
+    if (progressObject != Py_None) startProgressReporting(&dataPoints, callProgressCallable, progressObject, progressInterval);
+
+    beginAllocationScope();
+    fatalErrorOutOfMemory = false;
+    fatalErrorHandler = &errorHandler;
+    if (setjmp(errorHandler) != 0)
+    {
+        failed = true;
+    }
+    else if (algorithm == 0 || algorithm == 1)
+    {
+        centroids = allocateCentroids((size_t)numCentroids, dimensions);
+        generateRandomCentroids(centroids.size, &dataPoints, &centroids);
+
+        if (algorithm == 0) runKMeans(&dataPoints, (size_t)iterations, &centroids, NULL);
+        else randomSwap(&dataPoints, &centroids, (size_t)iterations, (size_t)option, NULL);
+    }
+    else if (algorithm == 4)
+    {
+        centroids = allocateCentroids((size_t)numCentroids, dimensions);
+        runHierarchicalKMeans(&dataPoints, &centroids, (size_t)iterations, (size_t)option, NULL);
+    }
+    else
+    {
+        resetPartitions(&dataPoints);
+        centroids = allocateCentroids(1, dimensions);
+        generateRandomCentroids(centroids.size, &dataPoints, &centroids);
+
+        if (algorithm == 2) runMseSplit(&dataPoints, &centroids, (size_t)numCentroids, (size_t)iterations, NULL, (size_t)option);
+        else runBisectingKMeans(&dataPoints, &centroids, (size_t)numCentroids, (size_t)iterations, NULL);
+    }
+
+    if (!failed)
+    {
+        partitionStep(&dataPoints, &centroids);
+        sse = calculateSSE(&dataPoints, &centroids);
+    }
+    fatalErrorHandler = NULL;
+
+    stopProgressReporting();
+    freeReductionWorkspace();
+    endAllocationScope(failed);
+
+    PyThread_release_lock(clusteringLock);
+    Py_END_ALLOW_THREADS
+
+    if (failed)
+    {
+        setFatalErrorException();
+        freeDataPointViews(&dataPoints);
+        Py_DECREF(array);
+        return NULL;
+    }
+
+    PyObject* result = buildResult(&dataPoints, &centroids, sse);
+
+    freeCentroids(&centroids);
+    freeDataPointViews(&dataPoints);
+    Py_DECREF(array);
+
+    return result;
+}
+
+static PyObject* clustering_kmeans(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* keywords[] = { "data", "k", "max_iterations", "seed", "progress", "progress_interval", NULL };
+    PyObject* dataObject;
+    Py_ssize_t numCentroids;
+    Py_ssize_t maxIterations = 1000;
+    PyObject* seedObject = Py_None;
+    PyObject* progressObject = Py_None;
+    double progressInterval = 1.0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "On|nOOd", keywords, &dataObject, &numCentroids, &maxIterations, &seedObject, &progressObject, &progressInterval)) return NULL;
+
+    return runAlgorithm(0, dataObject, numCentroids, maxIterations, 0, seedObject, progressObject, progressInterval);
+}
+
+static PyObject* clustering_random_swap(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* keywords[] = { "data", "k", "max_swaps", "swap_candidates", "seed", "progress", "progress_interval", NULL };
+    PyObject* dataObject;
+    Py_ssize_t numCentroids;
+    Py_ssize_t maxSwaps = 1000;
+    Py_ssize_t swapCandidates = 0;
+    PyObject* seedObject = Py_None;
+    PyObject* progressObject = Py_None;
+    double progressInterval = 1.0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "On|nnOOd", keywords, &dataObject, &numCentroids, &maxSwaps, &swapCandidates, &seedObject, &progressObject, &progressInterval)) return NULL;
+
+    return runAlgorithm(1, dataObject, numCentroids, maxSwaps, swapCandidates, seedObject, progressObject, progressInterval);
+}
+
+static PyObject* clustering_mse_split(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* keywords[] = { "data", "k", "split_type", "max_iterations", "seed", "progress", "progress_interval", NULL };
+    PyObject* dataObject;
+    Py_ssize_t numCentroids;
+    Py_ssize_t splitType = 0;
+    Py_ssize_t maxIterations = 1000;
+    PyObject* seedObject = Py_None;
+    PyObject* progressObject = Py_None;
+    double progressInterval = 1.0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "On|nnOOd", keywords, &dataObject, &numCentroids, &splitType, &maxIterations, &seedObject, &progressObject, &progressInterval)) return NULL;
+
+    if (splitType < 0 || splitType > 2)
+    {
+        PyErr_SetString(PyExc_ValueError, "split_type must be 0 (intra-cluster), 1 (global) or 2 (local repartition)");
+        return NULL;
+    }
+
+    return runAlgorithm(2, dataObject, numCentroids, maxIterations, splitType, seedObject, progressObject, progressInterval);
+}
+
+static PyObject* clustering_bisecting(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* keywords[] = { "data", "k", "max_iterations", "seed", "progress", "progress_interval", NULL };
+    PyObject* dataObject;
+    Py_ssize_t numCentroids;
+    Py_ssize_t maxIterations = 1000;
+    PyObject* seedObject = Py_None;
+    PyObject* progressObject = Py_None;
+    double progressInterval = 1.0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "On|nOOd", keywords, &dataObject, &numCentroids, &maxIterations, &seedObject, &progressObject, &progressInterval)) return NULL;
+
+    return runAlgorithm(3, dataObject, numCentroids, maxIterations, 0, seedObject, progressObject, progressInterval);
+}
+
+static PyObject* clustering_hierarchical(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* keywords[] = { "data", "k", "max_iterations", "refinement_iterations", "seed", "progress", "progress_interval", NULL };
+    PyObject* dataObject;
+    Py_ssize_t numCentroids;
+    Py_ssize_t maxIterations = 1000;
+    Py_ssize_t refinementIterations = 0;
+    PyObject* seedObject = Py_None;
+    PyObject* progressObject = Py_None;
+    double progressInterval = 1.0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "On|nnOOd", keywords, &dataObject, &numCentroids, &maxIterations, &refinementIterations, &seedObject, &progressObject, &progressInterval)) return NULL;
+
+    return runAlgorithm(4, dataObject, numCentroids, maxIterations, refinementIterations, seedObject, progressObject, progressInterval);
+}
+
+static PyObject* clustering_conformance_check(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* keywords[] = { "data", "k", "metric", NULL };
+    PyObject* dataObject;
+    Py_ssize_t numCentroids;
+    Py_ssize_t metric = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "On|n", keywords, &dataObject, &numCentroids, &metric)) return NULL;
+
+    if (metric < 0 || metric > 3)
+    {
+        PyErr_SetString(PyExc_ValueError, "metric must be 0 (Euclidean), 1 (cosine), 2 (Manhattan) or 3 (diagonal Mahalanobis)");
+        return NULL;
+    }
+
+    // The cosine metric normalizes the data, which must not change the caller's array
+    PyObject* copy = NULL;
+    if (metric == 1)
+    {
+        copy = PyArray_FROM_OTF(dataObject, NPY_FLOAT64, NPY_ARRAY_IN_ARRAY | NPY_ARRAY_ENSURECOPY);
+        if (copy == NULL) return NULL;
+        dataObject = copy;
+    }
+
+    PyArrayObject* array;
+    DataPoints dataPoints;
+    int wrapped = wrapArray(dataObject, numCentroids, &array, &dataPoints);
+    Py_XDECREF(copy);
+    if (wrapped < 0) return NULL;
+
+    jmp_buf errorHandler;
+    bool failed = false;
+    bool passed = false;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(clusteringLock, WAIT_LOCK);
+
+    beginAllocationScope();
+    fatalErrorOutOfMemory = false;
+    fatalErrorHandler = &errorHandler;
+    if (setjmp(errorHandler) != 0)
+    {
+        failed = true;
+    }
+    else
+    {
+        if (metric == 1) normalizeDataPoints(&dataPoints);
+        setDistanceMetric((size_t)metric, &dataPoints);
+        passed = runConformanceCheck(&dataPoints, (size_t)numCentroids);
+    }
+    fatalErrorHandler = NULL;
+
+    // The other functions of the module use the Euclidean metric
+    setDistanceMetric(0, &dataPoints);
+    freeReductionWorkspace();
+    endAllocationScope(failed);
+
+    PyThread_release_lock(clusteringLock);
+    Py_END_ALLOW_THREADS
+
+    freeDataPointViews(&dataPoints);
+    Py_DECREF(array);
+
+    if (failed)
+    {
+        setFatalErrorException();
+        return NULL;
+    }
+
+    return PyBool_FromLong(passed);
+}
+
+static PyObject* clustering_set_memory_cap(PyObject* self, PyObject* args)
+{
+    Py_ssize_t capMiB;
+
+    if (!PyArg_ParseTuple(args, "n", &capMiB)) return NULL;
+
+    if (capMiB < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "the memory cap must not be negative");
+        return NULL;
+    }
+
+    // The cap is only changed between the clustering calls
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(clusteringLock, WAIT_LOCK);
+    setMemoryCap((size_t)capMiB * 1024 * 1024);
+    PyThread_release_lock(clusteringLock);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* clustering_set_thread_count(PyObject* self, PyObject* args)
+{
+    Py_ssize_t numThreads;
+
+    if (!PyArg_ParseTuple(args, "n", &numThreads)) return NULL;
+
+    if (numThreads < 0 || numThreads > INT_MAX)
+    {
+        PyErr_SetString(PyExc_ValueError, "the thread count is out of range");
+        return NULL;
+    }
+
+    // The thread count belongs to the calling thread, which also runs the clustering calls
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(clusteringLock, WAIT_LOCK);
+    setThreadCount(numThreads > 0 ? (int)numThreads : getProcessorCount());
+    PyThread_release_lock(clusteringLock);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef clusteringMethods[] =
+{
+    { "kmeans", (PyCFunction)(void(*)(void))clustering_kmeans, METH_VARARGS | METH_KEYWORDS,
+      "kmeans(data, k, max_iterations=1000, seed=None, progress=None, progress_interval=1.0) -> (labels, centroids, sse)\n\nK-means from random initial centroids." },
+    { "random_swap", (PyCFunction)(void(*)(void))clustering_random_swap, METH_VARARGS | METH_KEYWORDS,
+      "random_swap(data, k, max_swaps=1000, swap_candidates=0, seed=None, progress=None, progress_interval=1.0) -> (labels, centroids, sse)\n\nRandom Swap; swap_candidates > 0 screens candidate swaps with the delta-SSE evaluator." },
+    { "mse_split", (PyCFunction)(void(*)(void))clustering_mse_split, METH_VARARGS | METH_KEYWORDS,
+      "mse_split(data, k, split_type=0, max_iterations=1000, seed=None, progress=None, progress_interval=1.0) -> (labels, centroids, sse)\n\nMSE Split; split_type 0 = intra-cluster, 1 = global, 2 = local repartition." },
+    { "bisecting", (PyCFunction)(void(*)(void))clustering_bisecting, METH_VARARGS | METH_KEYWORDS,
+      "bisecting(data, k, max_iterations=1000, seed=None, progress=None, progress_interval=1.0) -> (labels, centroids, sse)\n\nBisecting k-means." },
+    { "hierarchical", (PyCFunction)(void(*)(void))clustering_hierarchical, METH_VARARGS | METH_KEYWORDS,
+      "hierarchical(data, k, max_iterations=1000, refinement_iterations=0, seed=None, progress=None, progress_interval=1.0) -> (labels, centroids, sse)\n\n"
+      "Two-level hierarchical k-means for large k; the groups are clustered in parallel. Fewer than k centroids are returned if the empty cluster strategy drops clusters." },
+    { "conformance_check", (PyCFunction)(void(*)(void))clustering_conformance_check, METH_VARARGS | METH_KEYWORDS,
+      "conformance_check(data, k, metric=0) -> bool\n\nCompares the optimized assignment, centroid and SSE engines with plain reference implementations\n"
+      "on the data with k seeded random centroids and on synthetic edge cases; metric 0 = Euclidean, 1 = cosine, 2 = Manhattan, 3 = diagonal Mahalanobis." },
+    { "set_memory_cap", clustering_set_memory_cap, METH_VARARGS,
+      "set_memory_cap(mib) -> None\n\nCaps the memory of the library in MiB (0 = no cap); a call that needs more raises MemoryError." },
+    { "set_thread_count", clustering_set_thread_count, METH_VARARGS,
+      "set_thread_count(n) -> None\n\nSets the number of threads of the parallel loops (0 = one per processor)." },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef clusteringModule =
+{
+    PyModuleDef_HEAD_INIT,
+    "clustering",
+    "Clustering algorithms (K-means, Random Swap, MSE Split, Bisecting, hierarchical k-means) over NumPy arrays.",
+    -1,
+    clusteringMethods,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+PyMODINIT_FUNC PyInit_clustering(void)
+{
+    import_array();
+
+    clusteringLock = PyThread_allocate_lock();
+    if (clusteringLock == NULL) return PyErr_NoMemory();
+
+    return PyModule_Create(&clusteringModule);
+}
@@ -0,0 +1,142 @@
+"""Compares benchmark results with a stored baseline of the same machine.
+
+The benchmark is written by runBenchmark in Clustering_with_.c (<dataset>.benchmark.json in the output directory).
+
+    python regression_gate.py outputs/<run>/s1.txt.benchmark.json              # compare with the baseline
+    python regression_gate.py outputs/<run>/s1.txt.benchmark.json --update     # store as the new baseline
+    python regression_gate.py outputs/<run>/s1.txt.benchmark.json --update --force  # store it even if it fails
+
+Baselines are kept in baselines/<machine>/<dataset>-k<clusters>-t<threads>.json. For each algorithm the gate checks:
+
+- the SSE and CI of every seed are unchanged (the samples use fixed seeds and fixed-order reductions),
+- the time per k-means iteration did not grow. The samples of the same seed are paired, the median
+  of their ratios (new / baseline) gets a bootstrap confidence interval, and a metric regresses when
+  the whole interval is above 1 + tolerance.
+  Timings of short runs are noisy, use enough samples and a tolerance above the run-to-run noise.
+
+A result that fails the comparison is not stored with --update unless --force is given.
+The exit status is 1 if a result changed or a metric regressed, otherwise 0.
+"""
+import argparse
+import json
+import os
+import random
+import shutil
+import statistics
+import sys
+
+TIMING_METRICS = ["secondsPerIteration"]
+
+
+def baseline_path(result, baseline_dir):
+    name = "%s-k%d-t%d.json" % (result["dataset"], result["clusters"], result["threads"])
+    return os.path.join(baseline_dir, result["machine"], name)
+
+
+def bootstrap_median(values, resamples, confidence, rng):
+    """Returns the median of the values and its bootstrap confidence interval."""
+    medians = sorted(statistics.median(rng.choices(values, k=len(values))) for _ in range(resamples))
+    tail = (1.0 - confidence) / 2.0
+    return statistics.median(values), medians[int(tail * (resamples - 1))], medians[int((1.0 - tail) * (resamples - 1))]
+
+
+def compare(result, baseline, args):
+    """Prints the comparison and returns the number of failures."""
+    failures = 0
+    rng = random.Random(1)
+
+    for key in ["size", "dimensions", "settings"]:
+        if result[key] != baseline[key]:
+            print("FAIL  %s differs from the baseline: %s != %s" % (key, result[key], baseline[key]))
+            failures += 1
+    if failures > 0:
+        return failures
+
+    old_algorithms = {algorithm["name"]: algorithm for algorithm in baseline["algorithms"]}
+    for algorithm in result["algorithms"]:
+        name = algorithm["name"]
+        old = old_algorithms.get(name)
+        if old is None:
+            print("NEW   %s has no baseline" % name)
+            continue
+
+        # Results of the same seeds must not change
+        old_samples = {sample["seed"]: sample for sample in old["samples"]}
+        changed = []
+        for sample in algorithm["samples"]:
+            old_sample = old_samples.get(sample["seed"])
+            if old_sample is None:
+                continue
+            sse_changed = abs(sample["sse"] - old_sample["sse"]) > args.sse_tolerance * abs(old_sample["sse"])
+            if sse_changed or sample["ci"] != old_sample["ci"]:
+                changed.append("seed %d: SSE %.17g -> %.17g, CI %s -> %s" % (
+                    sample["seed"], old_sample["sse"], sample["sse"], old_sample["ci"], sample["ci"]))
+        if changed:
+            print("FAIL  %s results changed for %d seeds" % (name, len(changed)))
+            for line in changed[:5]:
+                print("        " + line)
+            failures += 1
+
+        # Samples of the same seed do the same work, so the ratios are taken seed by seed
+        for metric in TIMING_METRICS:
+            ratios = []
+            for sample in algorithm["samples"]:
+                old_sample = old_samples.get(sample["seed"])
+                if old_sample is not None and old_sample[metric] > 0.0 and sample["iterations"] > 0:
+                    ratios.append(sample[metric] / old_sample[metric])
+            if not ratios:
+                continue
+
+            ratio, low, high = bootstrap_median(ratios, args.resamples, args.confidence, rng)
+            if low > 1.0 + args.tolerance:
+                status = "FAIL"
+                failures += 1
+            elif high < 1.0 - args.tolerance:
+                status = "FAST"
+            else:
+                status = "ok"
+            print("%-5s %s %s: %.3fx baseline (%.0f%% CI %.3f .. %.3f)" % (
+                status, name, metric, ratio, args.confidence * 100.0, low, high))
+
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compares benchmark results with the baseline of the machine.")
+    parser.add_argument("result", help="benchmark JSON file written by runBenchmark")
+    parser.add_argument("--baseline-dir", default="baselines", help="directory of the baselines (default: baselines)")
+    parser.add_argument("--update", action="store_true", help="store the result as the baseline after the comparison")
+    parser.add_argument("--force", action="store_true", help="with --update, store the result even if the comparison fails")
+    parser.add_argument("--tolerance", type=float, default=0.1, help="allowed relative slowdown (default: 0.1)")
+    parser.add_argument("--confidence", type=float, default=0.95, help="confidence of the intervals (default: 0.95)")
+    parser.add_argument("--resamples", type=int, default=2000, help="bootstrap resamples (default: 2000)")
+    parser.add_argument("--sse-tolerance", type=float, default=1e-9, help="allowed relative SSE change (default: 1e-9)")
+    args = parser.parse_args()
+
+    with open(args.result) as file:
+        result = json.load(file)
+
+    path = baseline_path(result, args.baseline_dir)
+    failures = 0
+    if os.path.exists(path):
+        with open(path) as file:
+            baseline = json.load(file)
+        print("Comparing %s with %s" % (args.result, path))
+        failures = compare(result, baseline, args)
+    elif not args.update:
+        print("No baseline at %s, run with --update to store one" % path)
+        return 1
+
+    if args.update and failures > 0 and not args.force:
+        print("Baseline not updated, the result has %d failures (use --force to store it anyway)" % failures)
+    elif args.update:
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        shutil.copyfile(args.result, path)
+        print("Baseline stored at %s" % path)
+
+    print("%d failures" % failures if failures else "No regressions")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
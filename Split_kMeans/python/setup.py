@@ -0,0 +1,93 @@
+"""Builds the "clustering" Python extension module.
+
+    cd Split_kMeans/python
+    python setup.py build_ext --inplace
+    python -m unittest test_clustering
+
+The module builds with MSVC on Windows and with GCC or Clang on Linux (the C library must provide C11 <threads.h>).
+
+The optional libraries are detected by compiling and linking a small probe: zlib (HAVE_ZLIB) and zstd (HAVE_ZSTD)
+for compressed datasets, and liburing (HAVE_LIBURING, Linux only) for the asynchronous reads of large text files. Headers and libraries outside the default paths are given with -I and -L,
+and CLUSTERING_WITHOUT=zstd,... leaves detected libraries out:
+
+    python setup.py build_ext --inplace -I/opt/zstd/include -L/opt/zstd/lib
+
+Usage:
+
+    import numpy as np, clustering
+    labels, centroids, sse = clustering.kmeans(np.loadtxt("data/s1.txt"), 15, seed=1)
+"""
+import os
+import shutil
+import sys
+import tempfile
+
+from setuptools import Extension, setup
+from setuptools.command.build_ext import build_ext
+
+import numpy
+
+if sys.platform == "win32":
+    extra_compile_args = ["/openmp", "/experimental:c11atomics"]
+    extra_link_args = []
+    libraries = []
+else:
+    extra_compile_args = ["-fopenmp"]
+    extra_link_args = ["-fopenmp"]
+    libraries = ["m"]
+
+# Optional libraries: name, define, library (Windows, others; None = not available) and a probe that must compile and link
+OPTIONAL_LIBRARIES = [
+    ("zlib", "HAVE_ZLIB", ("zlib", "z"), "#include <zlib.h>\nint main(void) { return zlibVersion() == 0; }\n"),
+    ("zstd", "HAVE_ZSTD", ("zstd", "zstd"), "#include <zstd.h>\nint main(void) { return ZSTD_versionNumber() == 0; }\n"),
+    ("liburing", "HAVE_LIBURING", (None, "uring"), "#include <liburing.h>\nint main(void) { struct io_uring ring; return io_uring_queue_init(1, &ring, 0) == 1; }\n"),
+]
+
+
+class BuildExtensionWithOptionalLibraries(build_ext):
+    """Enables the optional libraries the compiler can build and link against."""
+
+    def probe(self, library, source):
+        directory = tempfile.mkdtemp()
+        try:
+            path = os.path.join(directory, "probe.c")
+            with open(path, "w") as file:
+                file.write(source)
+            objects = self.compiler.compile([path], output_dir=directory, include_dirs=self.include_dirs)
+            self.compiler.link_executable(objects, "probe", output_dir=directory, libraries=[library], library_dirs=self.library_dirs)
+            return True
+        except Exception:
+            return False
+        finally:
+            shutil.rmtree(directory, ignore_errors=True)
+
+    def build_extensions(self):
+        disabled = [name.strip() for name in os.environ.get("CLUSTERING_WITHOUT", "").split(",")]
+        found = []
+        for name, define, libraries, source in OPTIONAL_LIBRARIES:
+            library = libraries[0] if sys.platform == "win32" else libraries[1]
+            if library is None or name in disabled or not self.probe(library, source):
+                continue
+            found.append(name)
+            for extension in self.extensions:
+                extension.define_macros.append((define, None))
+                extension.libraries.insert(0, library)
+        print("clustering: optional libraries: %s" % (", ".join(found) if found else "none"))
+        build_ext.build_extensions(self)
+
+
+setup(
+    name="clustering",
+    version="1.0.0",
+    ext_modules=[
+        Extension(
+            "clustering",
+            sources=["clustering_module.c"],
+            include_dirs=[numpy.get_include()],
+            libraries=libraries,
+            extra_compile_args=extra_compile_args,
+            extra_link_args=extra_link_args,
+        )
+    ],
+    cmdclass={"build_ext": BuildExtensionWithOptionalLibraries},
+)
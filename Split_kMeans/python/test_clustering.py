@@ -0,0 +1,153 @@
+"""Tests of the "clustering" extension module.
+
+    cd Split_kMeans/python
+    python setup.py build_ext --inplace
+    python -m unittest test_clustering
+"""
+import unittest
+
+import numpy as np
+
+import clustering
+
+CENTERS = np.array([[0.0, 0.0], [100.0, 0.0], [0.0, 100.0], [100.0, 100.0]])
+
+
+def make_blobs(points_per_center=200, seed=0):
+    """Returns well separated blobs around CENTERS and the blob of every point."""
+    rng = np.random.default_rng(seed)
+    truth = np.repeat(np.arange(len(CENTERS)), points_per_center)
+    data = CENTERS[truth] + rng.normal(scale=2.0, size=(len(truth), 2))
+    return data, truth
+
+
+def calculate_sse(data, labels, centroids):
+    """The SSE as calculateSSE defines it: the sum of the Euclidean distances to the assigned centroids."""
+    return float(np.linalg.norm(data - centroids[labels], axis=1).sum())
+
+
+class ClusteringTest(unittest.TestCase):
+    def setUp(self):
+        self.data, self.truth = make_blobs()
+
+    def check_result(self, result, k):
+        labels, centroids, sse = result
+        self.assertEqual(labels.shape, (len(self.data),))
+        self.assertEqual(centroids.shape, (k, 2))
+
+        # The labels are the nearest centroids and the SSE belongs to them
+        distances = np.linalg.norm(self.data[:, None, :] - centroids[None, :, :], axis=2)
+        np.testing.assert_array_equal(labels, distances.argmin(axis=1))
+        self.assertAlmostEqual(sse, calculate_sse(self.data, labels, centroids), delta=1e-9 * sse)
+
+    def check_blobs_found(self, labels):
+        # Every blob is a single cluster of its own
+        for blob in range(len(CENTERS)):
+            self.assertEqual(len(set(labels[self.truth == blob])), 1)
+        self.assertEqual(len(set(labels)), len(CENTERS))
+
+    def test_kmeans(self):
+        self.check_result(clustering.kmeans(self.data, 4, seed=1), 4)
+
+    def test_random_swap_finds_the_blobs(self):
+        result = clustering.random_swap(self.data, 4, max_swaps=200, seed=1)
+        self.check_result(result, 4)
+        self.check_blobs_found(result[0])
+
+    def test_random_swap_with_candidates_finds_the_blobs(self):
+        result = clustering.random_swap(self.data, 4, max_swaps=50, swap_candidates=8, seed=1)
+        self.check_result(result, 4)
+        self.check_blobs_found(result[0])
+
+    def test_mse_split_finds_the_blobs(self):
+        for split_type in range(3):
+            result = clustering.mse_split(self.data, 4, split_type=split_type, seed=1)
+            self.check_result(result, 4)
+            self.check_blobs_found(result[0])
+
+    def test_bisecting(self):
+        self.check_result(clustering.bisecting(self.data, 4, seed=1), 4)
+
+    def test_hierarchical(self):
+        self.check_result(clustering.hierarchical(self.data, 16, refinement_iterations=2, seed=1), 16)
+
+    def test_hierarchical_does_not_depend_on_the_thread_count(self):
+        # The groups are clustered in parallel, every group with a seed of its own
+        data, _ = make_blobs(points_per_center=2000)
+        results = []
+        try:
+            for threads in (1, 2, 4):
+                clustering.set_thread_count(threads)
+                results.append(clustering.hierarchical(data, 64, refinement_iterations=2, seed=3))
+        finally:
+            clustering.set_thread_count(0)
+
+        for result in results[1:]:
+            np.testing.assert_array_equal(result[0], results[0][0])
+            np.testing.assert_array_equal(result[1], results[0][1])
+            self.assertEqual(result[2], results[0][2])
+
+    def test_seeded_calls_are_repeatable(self):
+        first = clustering.random_swap(self.data, 4, max_swaps=20, seed=7)
+        second = clustering.random_swap(self.data, 4, max_swaps=20, seed=7)
+        np.testing.assert_array_equal(first[0], second[0])
+        np.testing.assert_array_equal(first[1], second[1])
+        self.assertEqual(first[2], second[2])
+
+    def test_invalid_arguments(self):
+        with self.assertRaises(ValueError):
+            clustering.kmeans(self.data, 0)
+        with self.assertRaises(ValueError):
+            clustering.kmeans(self.data, len(self.data) + 1)
+        with self.assertRaises(ValueError):
+            clustering.kmeans(self.data[:, 0], 2)
+        with self.assertRaises(ValueError):
+            clustering.mse_split(self.data, 4, split_type=3)
+
+    def test_memory_cap_raises_memory_error(self):
+        # The point structures alone need more than 1 MiB, the error must not end the process
+        data, _ = make_blobs(points_per_center=20000)
+        clustering.set_memory_cap(1)
+        try:
+            with self.assertRaises(MemoryError):
+                clustering.kmeans(data, 4, seed=1)
+        finally:
+            clustering.set_memory_cap(0)
+
+        self.check_result(clustering.kmeans(self.data, 4, seed=1), 4)
+
+    def test_memory_errors_free_their_allocations(self):
+        # The allocations of the failed calls must not count against the cap of the next calls
+        large, _ = make_blobs(points_per_center=20000)
+        clustering.set_memory_cap(4)
+        try:
+            for _ in range(4):
+                with self.assertRaises(MemoryError):
+                    clustering.bisecting(large, 64, seed=1)
+            data, _ = make_blobs(points_per_center=12500)
+            for _ in range(3):
+                labels, centroids, _ = clustering.bisecting(data, 8, seed=1)
+                self.assertEqual(labels.shape, (len(data),))
+                self.assertEqual(centroids.shape, (8, 2))
+        finally:
+            clustering.set_memory_cap(0)
+
+    def test_conformance_check(self):
+        # Every metric: the optimized engines against the scalar references
+        for metric in range(4):
+            self.assertTrue(clustering.conformance_check(self.data, 4, metric=metric), "metric %d" % metric)
+
+        # The cosine metric works on a normalized copy
+        data = self.data.copy()
+        clustering.conformance_check(data, 4, metric=1)
+        np.testing.assert_array_equal(data, self.data)
+
+    def test_progress_callable(self):
+        samples = []
+        clustering.kmeans(self.data, 4, seed=1, progress=samples.append, progress_interval=0.001)
+        self.assertTrue(samples)
+        self.assertTrue(samples[-1]["finished"])
+
+
+if __name__ == "__main__":
+    unittest.main()